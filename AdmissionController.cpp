@@ -0,0 +1,248 @@
+/*
+ * AdmissionController.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "AdmissionController.h"
+#include "Metrics.h"
+
+static bool admission_ticket_older(const AdmissionTicket* pTicket1, const AdmissionTicket* pTicket2)
+{
+	return pTicket1->iDownSinceUs < pTicket2->iDownSinceUs;
+}
+
+//////////////////////////////////
+// AdmissionController definition
+//////////////////////////////////
+
+AdmissionController* AdmissionController::getInstance()
+{
+	// Never destroyed, the streams release their ticket until the very end of the process
+	static AdmissionController* pInstance = new AdmissionController();
+	return pInstance;
+}
+
+AdmissionController::AdmissionController()
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	m_dRate = 0;
+	m_dBurst = 1;
+	m_iMaxHandshakes = 0;
+	m_iMaxHandshakesPerHost = 0;
+	m_bShutdown = false;
+	m_dTokens = 0;
+	m_iLastRefillUs = 0;
+	m_iHandshakes = 0;
+}
+
+AdmissionController::~AdmissionController()
+{
+	pthread_mutex_destroy(&m_mutex);
+}
+
+int64_t AdmissionController::nowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void AdmissionController::setLimits(double dRate, int iBurst, int iMaxHandshakes, int iMaxHandshakesPerHost)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_dRate = (dRate > 0 ? dRate : 0);
+	m_dBurst = (iBurst > 1 ? iBurst : 1);
+	m_iMaxHandshakes = (iMaxHandshakes > 0 ? iMaxHandshakes : 0);
+	m_iMaxHandshakesPerHost = (iMaxHandshakesPerHost > 0 ? iMaxHandshakesPerHost : 0);
+	m_dTokens = m_dBurst;
+	m_iLastRefillUs = nowUs();
+	pthread_mutex_unlock(&m_mutex);
+
+	MetricsRegistry::getInstance()->m_admission.bEnabled.store(isEnabled(), std::memory_order_relaxed);
+}
+
+bool AdmissionController::isEnabled() const
+{
+	return (m_dRate > 0 || m_iMaxHandshakes > 0 || m_iMaxHandshakesPerHost > 0);
+}
+
+void AdmissionController::shutdown()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_bShutdown = true;
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void AdmissionController::initTicket(AdmissionTicket* pTicket, const char* szURL)
+{
+	// The host and port of the URL, without the credentials
+	const char* szHost = strstr(szURL, "://");
+	szHost = (szHost ? szHost + 3 : szURL);
+	const char* szAt = strchr(szHost, '@');
+	const char* szSlash = strchr(szHost, '/');
+	if(szAt && (!szSlash || szAt < szSlash)){
+		szHost = szAt + 1;
+	}
+	size_t iLength = (szSlash && szSlash > szHost ? (size_t)(szSlash - szHost) : strlen(szHost));
+	if(iLength >= ADMISSION_HOST_SIZE){
+		iLength = ADMISSION_HOST_SIZE - 1;
+	}
+	memcpy(pTicket->szHost, szHost, iLength);
+	pTicket->szHost[iLength] = '\0';
+
+	pTicket->iDownSinceUs = 0;
+	pTicket->iQueuedUs = 0;
+	pTicket->iWaitUs = 0;
+	pTicket->pAdmittedCallback = NULL;
+	pTicket->pClientData = NULL;
+	pTicket->state = ADMISSION_TICKET_NONE;
+}
+
+bool AdmissionController::request(AdmissionTicket* pTicket, int64_t iDownSinceUs)
+{
+	std::vector<AdmissionTicket*> listAdmitted;
+
+	pthread_mutex_lock(&m_mutex);
+	if(pTicket->state.load(std::memory_order_relaxed) == ADMISSION_TICKET_NONE){
+		pTicket->iDownSinceUs = iDownSinceUs;
+		pTicket->iQueuedUs = nowUs();
+		pTicket->iWaitUs = 0;
+		pTicket->state.store(ADMISSION_TICKET_WAITING, std::memory_order_relaxed);
+		m_listWaiting.push_back(pTicket);
+	}
+	admitWaitingTickets(listAdmitted);
+	bool bAdmitted = (pTicket->state.load(std::memory_order_relaxed) == ADMISSION_TICKET_ADMITTED);
+	pthread_mutex_unlock(&m_mutex);
+
+	callCallbacks(listAdmitted, pTicket);
+	return bAdmitted;
+}
+
+void AdmissionController::release(AdmissionTicket* pTicket)
+{
+	std::vector<AdmissionTicket*> listAdmitted;
+	AdmissionMetrics& metrics = MetricsRegistry::getInstance()->m_admission;
+
+	pthread_mutex_lock(&m_mutex);
+	int state = pTicket->state.load(std::memory_order_relaxed);
+	if(state == ADMISSION_TICKET_WAITING){
+		m_listWaiting.erase(std::remove(m_listWaiting.begin(), m_listWaiting.end(), pTicket), m_listWaiting.end());
+		metrics.iQueueDepth.store((int)m_listWaiting.size(), std::memory_order_relaxed);
+	}else if(state == ADMISSION_TICKET_ADMITTED){
+		m_iHandshakes--;
+		std::map<std::string, int>::iterator iter = m_mapHostHandshakes.find(pTicket->szHost);
+		if(iter != m_mapHostHandshakes.end() && --iter->second <= 0){
+			m_mapHostHandshakes.erase(iter);
+		}
+		metrics.iHandshakes.store(m_iHandshakes, std::memory_order_relaxed);
+	}
+	pTicket->state.store(ADMISSION_TICKET_NONE, std::memory_order_relaxed);
+
+	// A handshake slot may be free now
+	if(state == ADMISSION_TICKET_ADMITTED){
+		admitWaitingTickets(listAdmitted);
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	callCallbacks(listAdmitted, NULL);
+}
+
+int64_t AdmissionController::dispatch()
+{
+	std::vector<AdmissionTicket*> listAdmitted;
+
+	pthread_mutex_lock(&m_mutex);
+	int64_t iDelayUs = admitWaitingTickets(listAdmitted);
+	pthread_mutex_unlock(&m_mutex);
+
+	callCallbacks(listAdmitted, NULL);
+	return iDelayUs;
+}
+
+void AdmissionController::refill(int64_t iNowUs)
+{
+	if(m_dRate > 0){
+		m_dTokens += (double)(iNowUs - m_iLastRefillUs) * m_dRate / 1000000.0;
+		if(m_dTokens > m_dBurst){
+			m_dTokens = m_dBurst;
+		}
+	}
+	m_iLastRefillUs = iNowUs;
+}
+
+int64_t AdmissionController::admitWaitingTickets(std::vector<AdmissionTicket*>& listAdmitted)
+{
+	AdmissionMetrics& metrics = MetricsRegistry::getInstance()->m_admission;
+	if(m_bShutdown){
+		return -1;
+	}
+	int64_t iNowUs = nowUs();
+	refill(iNowUs);
+
+	// The streams down for the longest time first
+	std::stable_sort(m_listWaiting.begin(), m_listWaiting.end(), admission_ticket_older);
+
+	bool bWaitingForToken = false;
+	std::vector<AdmissionTicket*>::iterator iter = m_listWaiting.begin();
+	while(iter != m_listWaiting.end()){
+		if(m_iMaxHandshakes > 0 && m_iHandshakes >= m_iMaxHandshakes){
+			break;
+		}
+		AdmissionTicket* pTicket = *iter;
+		int& iHostHandshakes = m_mapHostHandshakes[pTicket->szHost];
+		if(m_iMaxHandshakesPerHost > 0 && iHostHandshakes >= m_iMaxHandshakesPerHost){
+			// The next ones may go to other hosts
+			++iter;
+			continue;
+		}
+		if(m_dRate > 0 && m_dTokens < 1){
+			bWaitingForToken = true;
+			break;
+		}
+
+		if(m_dRate > 0){
+			m_dTokens -= 1;
+		}
+		m_iHandshakes++;
+		iHostHandshakes++;
+		pTicket->iWaitUs = iNowUs - pTicket->iQueuedUs;
+		pTicket->state.store(ADMISSION_TICKET_ADMITTED, std::memory_order_release);
+		metrics.waitTime.record((uint64_t)pTicket->iWaitUs);
+		metrics.iAdmitted.fetch_add(1, std::memory_order_relaxed);
+		listAdmitted.push_back(pTicket);
+		iter = m_listWaiting.erase(iter);
+	}
+
+	// Entries of the hosts without handshake are kept by the lookups above
+	for(std::map<std::string, int>::iterator iterHost = m_mapHostHandshakes.begin(); iterHost != m_mapHostHandshakes.end(); ){
+		if(iterHost->second <= 0){
+			m_mapHostHandshakes.erase(iterHost++);
+		}else{
+			++iterHost;
+		}
+	}
+
+	metrics.iQueueDepth.store((int)m_listWaiting.size(), std::memory_order_relaxed);
+	metrics.iHandshakes.store(m_iHandshakes, std::memory_order_relaxed);
+
+	if(!bWaitingForToken){
+		return -1;
+	}
+	return (int64_t)((1 - m_dTokens) * 1000000.0 / m_dRate) + 1;
+}
+
+void AdmissionController::callCallbacks(const std::vector<AdmissionTicket*>& listAdmitted, AdmissionTicket* pExcept)
+{
+	for(size_t i=0; i<listAdmitted.size(); i++){
+		AdmissionTicket* pTicket = listAdmitted[i];
+		if(pTicket != pExcept && pTicket->pAdmittedCallback){
+			pTicket->pAdmittedCallback(pTicket->pClientData);
+		}
+	}
+}
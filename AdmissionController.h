@@ -0,0 +1,101 @@
+/*
+ * AdmissionController.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef ADMISSIONCONTROLLER_H_
+#define ADMISSIONCONTROLLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ADMISSION_HOST_SIZE 256
+
+enum AdmissionTicketState
+{
+	ADMISSION_TICKET_NONE = 0,
+	ADMISSION_TICKET_WAITING,
+	ADMISSION_TICKET_ADMITTED, // Handshake in progress, until released
+};
+
+// Held by a stream for each attempt
+struct AdmissionTicket
+{
+	char szHost[ADMISSION_HOST_SIZE];
+	int64_t iDownSinceUs; // The oldest one is admitted first
+	int64_t iQueuedUs;
+	int64_t iWaitUs; // Set when admitted
+
+	// Called from any thread when admitted later than request()
+	void (*pAdmittedCallback)(void* pClientData);
+	void* pClientData;
+
+	std::atomic<int> state;
+};
+
+//////////////////////////////////
+// AdmissionController declaration
+//////////////////////////////////
+
+// Process-wide admission of the new RTSP sessions, so that the streams that
+// failed together don't reconnect together: a token bucket limits the rate
+// of the handshakes, and their number in progress is limited for the whole
+// process and for each host.
+class AdmissionController
+{
+public:
+	static AdmissionController* getInstance();
+
+	// 0 for no limit. Disabled if there is no limit at all.
+	void setLimits(double dRate, int iBurst, int iMaxHandshakes, int iMaxHandshakesPerHost);
+	bool isEnabled() const;
+	// Nothing is admitted anymore, once the event loops are stopped
+	void shutdown();
+
+	void initTicket(AdmissionTicket* pTicket, const char* szURL);
+
+	// Queues the ticket, returns true if admitted at once (the callback is not called then)
+	bool request(AdmissionTicket* pTicket, int64_t iDownSinceUs);
+	// Leaves the queue, or ends the handshake of an admitted ticket
+	void release(AdmissionTicket* pTicket);
+
+	// Admits the waiting tickets allowed by the budgets. Returns the delay before
+	// the next token, or -1 if nothing waits for a token.
+	int64_t dispatch();
+
+	static int64_t nowUs();
+
+private:
+	AdmissionController();
+	~AdmissionController();
+
+	// Called with the mutex locked, the callbacks are called after unlocking it
+	int64_t admitWaitingTickets(std::vector<AdmissionTicket*>& listAdmitted);
+	void refill(int64_t iNowUs);
+	static void callCallbacks(const std::vector<AdmissionTicket*>& listAdmitted, AdmissionTicket* pExcept);
+
+private:
+	pthread_mutex_t m_mutex;
+
+	double m_dRate; // Tokens per second
+	double m_dBurst;
+	int m_iMaxHandshakes;
+	int m_iMaxHandshakesPerHost;
+	bool m_bShutdown;
+
+	double m_dTokens;
+	int64_t m_iLastRefillUs;
+
+	std::vector<AdmissionTicket*> m_listWaiting;
+	int m_iHandshakes;
+	std::map<std::string, int> m_mapHostHandshakes;
+};
+
+#endif /* ADMISSIONCONTROLLER_H_ */
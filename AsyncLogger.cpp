@@ -0,0 +1,265 @@
+/*
+ * AsyncLogger.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "AsyncLogger.h"
+#include "LoopClock.h"
+
+// Ring of the calling thread, created on its first message
+static __thread void* g_pAsyncLoggerThreadState = NULL;
+
+static bool asyncLogRecordBefore(const AsyncLogRecord& record1, const AsyncLogRecord& record2)
+{
+	return timercmp(&record1.tv, &record2.tv, <);
+}
+
+//////////////////////////////////
+// AsyncLogger definition
+//////////////////////////////////
+
+AsyncLogger* AsyncLogger::getInstance()
+{
+	// Never destroyed, any thread may log until the very end of the process
+	static AsyncLogger* pInstance = new AsyncLogger();
+	return pInstance;
+}
+
+AsyncLogger::AsyncLogger()
+{
+	m_pOutput = stderr;
+	pthread_mutex_init(&m_mutexThreads, NULL);
+	m_bRunning = false;
+	m_bStop = false;
+	m_iDropCount = 0;
+	m_iReportedDropCount = 0;
+	m_iCachedTimeSec = -1;
+	m_bInMessage = false;
+	m_szCachedTime[0] = '\0';
+}
+
+AsyncLogger::~AsyncLogger()
+{
+	stop();
+	for(size_t i=0; i<m_listThreadStates.size(); i++){
+		delete m_listThreadStates[i]->pRing;
+		delete m_listThreadStates[i];
+	}
+	m_listThreadStates.clear();
+	pthread_mutex_destroy(&m_mutexThreads);
+}
+
+void AsyncLogger::setOutput(FILE* pOutput)
+{
+	m_pOutput = pOutput;
+}
+
+bool AsyncLogger::start()
+{
+	if(m_bRunning){
+		return true;
+	}
+	m_bStop = false;
+	if(pthread_create(&m_thread, NULL, writerThread, this) != 0){
+		return false;
+	}
+	m_bRunning = true;
+	return true;
+}
+
+void AsyncLogger::stop()
+{
+	if(!m_bRunning){
+		return;
+	}
+	// New messages are written directly from now on
+	m_bRunning = false;
+	m_bStop = true;
+	pthread_join(m_thread, NULL);
+	drain();
+}
+
+uint64_t AsyncLogger::getDropCount() const
+{
+	return m_iDropCount.load(std::memory_order_relaxed);
+}
+
+AsyncLogger::ThreadState* AsyncLogger::getThreadState()
+{
+	ThreadState* pState = (ThreadState*)g_pAsyncLoggerThreadState;
+	if(!pState){
+		pState = new ThreadState();
+		pState->pRing = new SpscRing<AsyncLogRecord>(ASYNC_LOGGER_RING_SIZE);
+		memset(pState->rateSlots, 0, sizeof(pState->rateSlots));
+		// Kept until the end, the writer may still read the ring after the thread exits
+		pthread_mutex_lock(&m_mutexThreads);
+		m_listThreadStates.push_back(pState);
+		pthread_mutex_unlock(&m_mutexThreads);
+		g_pAsyncLoggerThreadState = pState;
+	}
+	return pState;
+}
+
+bool AsyncLogger::acceptRate(ThreadState* pState, uint32_t iHash, time_t iNow, int* pSuppressed)
+{
+	RateSlot& slot = pState->rateSlots[iHash % ASYNC_LOGGER_RATE_SLOTS];
+	if(slot.iHash != iHash){
+		slot.iHash = iHash;
+		slot.iWindow = iNow;
+		slot.iCount = 0;
+		slot.iSuppressed = 0;
+	}else if(slot.iWindow != iNow){
+		slot.iWindow = iNow;
+		slot.iCount = 0;
+	}
+
+	if(slot.iCount >= ASYNC_LOGGER_RATE_BURST){
+		slot.iSuppressed++;
+		return false;
+	}
+	slot.iCount++;
+	*pSuppressed = slot.iSuppressed;
+	slot.iSuppressed = 0;
+	return true;
+}
+
+void AsyncLogger::vlog(int iStreamId, int iAttempt, const char* szFormat, va_list args)
+{
+	char szMessage[ASYNC_LOGGER_MESSAGE_SIZE];
+	int iLength = vsnprintf(szMessage, sizeof(szMessage), szFormat, args);
+	if(iLength < 0){
+		return;
+	}
+	if(iLength >= (int)sizeof(szMessage)){
+		iLength = sizeof(szMessage) - 1;
+	}
+
+	// A long message takes several records, pushed at once
+	AsyncLogRecord records[(ASYNC_LOGGER_MESSAGE_SIZE + ASYNC_LOGGER_TEXT_SIZE - 1) / ASYNC_LOGGER_TEXT_SIZE];
+	size_t iRecordCount = 0;
+	// The time of the iteration in an event loop, the messages of a handler share it
+	struct timeval tvNow;
+	LoopClock::wallClock(tvNow);
+	int iOffset = 0;
+	do{
+		AsyncLogRecord& record = records[iRecordCount++];
+		record.tv = tvNow;
+		record.iStreamId = iStreamId;
+		record.iAttempt = iAttempt;
+		record.iSuppressed = 0;
+		record.iLength = (unsigned char)std::min(iLength - iOffset, ASYNC_LOGGER_TEXT_SIZE);
+		memcpy(record.szText, szMessage + iOffset, record.iLength);
+		iOffset += record.iLength;
+		record.bContinued = (iOffset < iLength);
+	}while(iOffset < iLength);
+
+	if(!m_bRunning.load(std::memory_order_acquire)){
+		flockfile(m_pOutput);
+		for(size_t i=0; i<iRecordCount; i++){
+			writeRecord(records[i], false);
+		}
+		fflush(m_pOutput);
+		funlockfile(m_pOutput);
+		return;
+	}
+
+	// FNV-1a of the message, a message is repeated when the same text comes again for the same stream
+	uint32_t iHash = 2166136261u ^ (uint32_t)iStreamId;
+	for(int i=0; i<iLength; i++){
+		iHash = (iHash ^ (uint8_t)szMessage[i]) * 16777619u;
+	}
+
+	ThreadState* pState = getThreadState();
+	if(!acceptRate(pState, iHash, tvNow.tv_sec, &records[iRecordCount-1].iSuppressed)){
+		return;
+	}
+	if(!pState->pRing->pushBatch(records, iRecordCount)){
+		m_iDropCount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void AsyncLogger::writeRecord(const AsyncLogRecord& record, bool bWriterThread)
+{
+	// Called with the output locked. Only the first record of a message has the prefix.
+	if(!m_bInMessage){
+		char szLocalTime[sizeof(m_szCachedTime)];
+		char* szTime = (bWriterThread ? m_szCachedTime : szLocalTime);
+		// The writer only renders the date once per second
+		if(!bWriterThread || record.tv.tv_sec != m_iCachedTimeSec){
+			struct tm time_tm;
+			time_t tmpTime = record.tv.tv_sec;
+			localtime_r(&tmpTime, &time_tm);
+			strftime(szTime, sizeof(szLocalTime), "%Y-%m-%d %H:%M:%S", &time_tm);
+			if(bWriterThread){
+				m_iCachedTimeSec = record.tv.tv_sec;
+			}
+		}
+		fprintf(m_pOutput, "[%s,%06ld::%d::%d] ", szTime, (long)record.tv.tv_usec, record.iStreamId, record.iAttempt);
+	}
+
+	fwrite(record.szText, 1, record.iLength, m_pOutput);
+	m_bInMessage = record.bContinued;
+	if(!record.bContinued){
+		if(record.iSuppressed > 0){
+			fprintf(m_pOutput, " (%d identical message(s) suppressed)", record.iSuppressed);
+		}
+		fputc('\n', m_pOutput);
+	}
+}
+
+size_t AsyncLogger::drain()
+{
+	pthread_mutex_lock(&m_mutexThreads);
+	std::vector<ThreadState*> listThreadStates = m_listThreadStates;
+	pthread_mutex_unlock(&m_mutexThreads);
+
+	m_listPending.clear();
+	AsyncLogRecord records[64];
+	for(size_t i=0; i<listThreadStates.size(); i++){
+		size_t iCount;
+		while((iCount = listThreadStates[i]->pRing->popBatch(records, 64)) > 0){
+			m_listPending.insert(m_listPending.end(), records, records + iCount);
+		}
+	}
+
+	// Each ring is in order, merge the threads
+	std::stable_sort(m_listPending.begin(), m_listPending.end(), asyncLogRecordBefore);
+	flockfile(m_pOutput);
+	for(size_t i=0; i<m_listPending.size(); i++){
+		writeRecord(m_listPending[i], true);
+	}
+
+	uint64_t iDropCount = m_iDropCount.load(std::memory_order_relaxed);
+	if(iDropCount != m_iReportedDropCount){
+		fprintf(m_pOutput, "[AsyncLogger] %llu message(s) dropped, the log rings were full\n",
+				(unsigned long long)(iDropCount - m_iReportedDropCount));
+		m_iReportedDropCount = iDropCount;
+	}
+	if(!m_listPending.empty()){
+		fflush(m_pOutput);
+	}
+	funlockfile(m_pOutput);
+	return m_listPending.size();
+}
+
+void* AsyncLogger::writerThread(void* arg)
+{
+	((AsyncLogger*)arg)->runWriter();
+	return NULL;
+}
+
+void AsyncLogger::runWriter()
+{
+	while(!m_bStop.load(std::memory_order_relaxed)){
+		if(drain() == 0){
+			usleep(ASYNC_LOGGER_FLUSH_PERIOD_MS * 1000);
+		}
+	}
+}
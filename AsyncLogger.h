@@ -0,0 +1,112 @@
+/*
+ * AsyncLogger.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef ASYNCLOGGER_H_
+#define ASYNCLOGGER_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "SpscRing.h"
+
+#define ASYNC_LOGGER_TEXT_SIZE 226 // A record fills 256 bytes
+#define ASYNC_LOGGER_MESSAGE_SIZE 4096 // Longer messages are truncated
+#define ASYNC_LOGGER_RING_SIZE 4096 // Records per thread
+#define ASYNC_LOGGER_RATE_BURST 20 // Same messages accepted per second and per thread
+#define ASYNC_LOGGER_RATE_SLOTS 64
+#define ASYNC_LOGGER_FLUSH_PERIOD_MS 20
+
+//////////////////////////////////
+// AsyncLogger declaration
+//////////////////////////////////
+
+struct AsyncLogRecord
+{
+	struct timeval tv;
+	int iStreamId;
+	int iAttempt;
+	int iSuppressed; // Identical messages suppressed just before this one
+	bool bContinued; // The message goes on in the next record
+	unsigned char iLength;
+	char szText[ASYNC_LOGGER_TEXT_SIZE];
+};
+
+// Logger moving the cost of the logs out of the calling thread: the message
+// is formatted with vsnprintf() into a fixed size record pushed into a ring
+// owned by the calling thread, the timestamp rendering and the writing being
+// done by a background thread. A message repeated too often is limited to
+// ASYNC_LOGGER_RATE_BURST per second, the others are counted only.
+// When not started, the messages are written directly.
+class AsyncLogger
+{
+public:
+	static AsyncLogger* getInstance();
+
+	void setOutput(FILE* pOutput);
+
+	bool start();
+	// Writes the messages still queued
+	void stop();
+
+	void vlog(int iStreamId, int iAttempt, const char* szFormat, va_list args);
+
+	uint64_t getDropCount() const;
+
+private:
+	AsyncLogger();
+	~AsyncLogger();
+
+	struct RateSlot
+	{
+		uint32_t iHash;
+		time_t iWindow;
+		int iCount;
+		int iSuppressed;
+	};
+
+	struct ThreadState
+	{
+		SpscRing<AsyncLogRecord>* pRing;
+		RateSlot rateSlots[ASYNC_LOGGER_RATE_SLOTS];
+	};
+
+	ThreadState* getThreadState();
+	bool acceptRate(ThreadState* pState, uint32_t iHash, time_t iNow, int* pSuppressed);
+
+	void writeRecord(const AsyncLogRecord& record, bool bWriterThread);
+	size_t drain();
+
+	static void* writerThread(void* arg);
+	void runWriter();
+
+private:
+	FILE* m_pOutput;
+
+	pthread_mutex_t m_mutexThreads;
+	std::vector<ThreadState*> m_listThreadStates;
+
+	pthread_t m_thread;
+	std::atomic<bool> m_bRunning;
+	std::atomic<bool> m_bStop;
+
+	std::atomic<uint64_t> m_iDropCount;
+	uint64_t m_iReportedDropCount;
+
+	// Used by the writer only
+	std::vector<AsyncLogRecord> m_listPending;
+	time_t m_iCachedTimeSec;
+	char m_szCachedTime[32];
+
+	// Written with the output locked
+	bool m_bInMessage;
+};
+
+#endif /* ASYNCLOGGER_H_ */
@@ -0,0 +1,483 @@
+/*
+ * EpollTaskScheduler.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+
+#include "EpollTaskScheduler.h"
+#include "LoopClock.h"
+
+//////////////////////////////////
+// Datagram batch definition
+//////////////////////////////////
+
+struct EpollDatagramBatch
+{
+	int socketNum;
+	int iCount;
+	int iNext;
+	struct mmsghdr msgs[EPOLL_BATCH_SIZE];
+	struct iovec iovecs[EPOLL_BATCH_SIZE];
+	struct sockaddr_storage addrs[EPOLL_BATCH_SIZE];
+	uint8_t data[EPOLL_BATCH_SIZE][EPOLL_BATCH_DATAGRAM_SIZE];
+};
+
+//////////////////////////////////
+// Epoll TaskScheduler definition
+//////////////////////////////////
+
+EpollTaskScheduler* EpollTaskScheduler::createNew(unsigned maxSchedulerGranularity)
+{
+	int iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(iEpollFd < 0){
+		return NULL;
+	}
+
+	// Used to wake up epoll_wait() when an event is triggered from another thread
+	int iWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(iWakeupFd < 0){
+		close(iEpollFd);
+		return NULL;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = iWakeupFd;
+	if(epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iWakeupFd, &event) != 0){
+		close(iWakeupFd);
+		close(iEpollFd);
+		return NULL;
+	}
+
+	return new EpollTaskScheduler(iEpollFd, iWakeupFd, maxSchedulerGranularity);
+}
+
+EpollTaskScheduler::EpollTaskScheduler(int iEpollFd, int iWakeupFd, unsigned maxSchedulerGranularity)
+{
+	m_iEpollFd = iEpollFd;
+	m_iWakeupFd = iWakeupFd;
+	m_iMaxSchedulerGranularity = maxSchedulerGranularity;
+	m_iSocketCount = 0;
+	m_pBatch = NULL;
+	memset(&m_batchStats, 0, sizeof(m_batchStats));
+	m_bKeepSocketlessHandlers = false;
+
+	m_iTriggersAwaitingHandling = 0;
+	m_iUsedTriggersMask = 0;
+	for(int i=0; i<32; i++){
+		m_triggerHandlers[i] = NULL;
+		m_triggerClientDatas[i] = NULL;
+	}
+}
+
+EpollTaskScheduler::~EpollTaskScheduler()
+{
+	if(m_iWakeupFd >= 0){
+		close(m_iWakeupFd);
+		m_iWakeupFd = -1;
+	}
+	if(m_iEpollFd >= 0){
+		close(m_iEpollFd);
+		m_iEpollFd = -1;
+	}
+	if(m_pBatch){
+		free(m_pBatch);
+		m_pBatch = NULL;
+	}
+}
+
+void EpollTaskScheduler::setEdgeTriggered(int socketNum, bool bEdgeTriggered)
+{
+	if(socketNum < 0){
+		return;
+	}
+	if((size_t)socketNum >= m_listHandlers.size()){
+		m_listHandlers.resize(socketNum+1, EpollHandler());
+	}
+
+	EpollHandler& handler = m_listHandlers[socketNum];
+	if(handler.bEdgeTriggered != bEdgeTriggered){
+		handler.bEdgeTriggered = bEdgeTriggered;
+		if(handler.conditionSet != 0){
+			updateSocket(socketNum, true);
+		}
+	}
+}
+
+void EpollTaskScheduler::setBatchReceive(int socketNum, bool bBatchReceive)
+{
+	if(socketNum < 0){
+		return;
+	}
+	if((size_t)socketNum >= m_listHandlers.size()){
+		m_listHandlers.resize(socketNum+1, EpollHandler());
+	}
+	m_listHandlers[socketNum].bBatchReceive = bBatchReceive;
+
+	if(bBatchReceive && !m_pBatch){
+		m_pBatch = (EpollDatagramBatch*)malloc(sizeof(EpollDatagramBatch));
+		m_pBatch->socketNum = -1;
+		m_pBatch->iCount = 0;
+		m_pBatch->iNext = 0;
+		for(int i=0; i<EPOLL_BATCH_SIZE; i++){
+			m_pBatch->iovecs[i].iov_base = m_pBatch->data[i];
+			m_pBatch->iovecs[i].iov_len = EPOLL_BATCH_DATAGRAM_SIZE;
+		}
+	}
+}
+
+void EpollTaskScheduler::getBatchStats(EpollBatchStats& stats) const
+{
+	stats = m_batchStats;
+}
+
+bool EpollTaskScheduler::readBatchedDatagram(int socketNum, uint8_t* pBuffer, unsigned iMaxSize, unsigned& iBytesRead, struct sockaddr_storage& fromAddress)
+{
+	EpollDatagramBatch* pBatch = m_pBatch;
+	if(!pBatch || socketNum < 0 || pBatch->socketNum != socketNum || pBatch->iNext >= pBatch->iCount){
+		return false;
+	}
+
+	struct mmsghdr& msg = pBatch->msgs[pBatch->iNext++];
+	iBytesRead = std::min((unsigned)msg.msg_len, iMaxSize);
+	memcpy(pBuffer, pBatch->data[&msg - pBatch->msgs], iBytesRead);
+	memset(&fromAddress, 0, sizeof(fromAddress));
+	memcpy(&fromAddress, msg.msg_hdr.msg_name, std::min((size_t)msg.msg_hdr.msg_namelen, sizeof(fromAddress)));
+	return true;
+}
+
+void EpollTaskScheduler::setKeepSocketlessHandlers(bool bKeep)
+{
+	m_bKeepSocketlessHandlers = bKeep;
+	if(!bKeep){
+		m_mapSocketlessHandlers.clear();
+	}
+}
+
+TaskScheduler::BackgroundHandlerProc* EpollTaskScheduler::getSocketlessHandler(void* clientData) const
+{
+	std::map<void*, BackgroundHandlerProc*>::const_iterator iter = m_mapSocketlessHandlers.find(clientData);
+	return (iter != m_mapSocketlessHandlers.end() ? iter->second : NULL);
+}
+
+void EpollTaskScheduler::forgetSocketlessHandler(void* clientData)
+{
+	m_mapSocketlessHandlers.erase(clientData);
+}
+
+bool EpollTaskScheduler::redirectSocket(int socketNum, int iFd)
+{
+	if(socketNum < 0 || iFd < 0){
+		return false;
+	}
+
+	// The watch of epoll is bound to the file, not to its number
+	bool bWatched = ((size_t)socketNum < m_listHandlers.size() && m_listHandlers[socketNum].conditionSet != 0);
+	if(bWatched){
+		epoll_ctl(m_iEpollFd, EPOLL_CTL_DEL, socketNum, NULL);
+	}
+	bool bRes = (dup3(iFd, socketNum, O_CLOEXEC) == socketNum);
+	if(bWatched && !updateSocket(socketNum, false)){
+		EpollHandler& handler = m_listHandlers[socketNum];
+		handler.conditionSet = 0;
+		handler.handlerProc = NULL;
+		handler.clientData = NULL;
+		m_iSocketCount--;
+		bRes = false;
+	}
+	return bRes;
+}
+
+int EpollTaskScheduler::getSocketCount() const
+{
+	return m_iSocketCount;
+}
+
+bool EpollTaskScheduler::updateSocket(int socketNum, bool bAlreadyWatched)
+{
+	EpollHandler& handler = m_listHandlers[socketNum];
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = socketNum;
+	if(handler.conditionSet & SOCKET_READABLE){
+		event.events |= EPOLLIN;
+	}
+	if(handler.conditionSet & SOCKET_WRITABLE){
+		event.events |= EPOLLOUT;
+	}
+	if(handler.conditionSet & SOCKET_EXCEPTION){
+		event.events |= EPOLLPRI;
+	}
+	if(handler.bEdgeTriggered){
+		event.events |= EPOLLET;
+	}
+
+	int iRes = epoll_ctl(m_iEpollFd, (bAlreadyWatched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), socketNum, &event);
+	if(iRes != 0 && errno == ENOENT){
+		// The socket has been closed and its number reused without disabling the handling
+		iRes = epoll_ctl(m_iEpollFd, EPOLL_CTL_ADD, socketNum, &event);
+	}else if(iRes != 0 && errno == EEXIST){
+		iRes = epoll_ctl(m_iEpollFd, EPOLL_CTL_MOD, socketNum, &event);
+	}
+	return (iRes == 0);
+}
+
+void EpollTaskScheduler::setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData)
+{
+	if(socketNum < 0){
+		// Only the handlers being set are known by their client data
+		if(m_bKeepSocketlessHandlers && conditionSet != 0 && handlerProc != NULL && clientData != NULL){
+			m_mapSocketlessHandlers[clientData] = handlerProc;
+		}
+		return;
+	}
+	if((size_t)socketNum >= m_listHandlers.size()){
+		m_listHandlers.resize(socketNum+1, EpollHandler());
+	}
+
+	EpollHandler& handler = m_listHandlers[socketNum];
+	bool bAlreadyWatched = (handler.conditionSet != 0);
+
+	if(conditionSet == 0 || handlerProc == NULL){
+		if(bAlreadyWatched){
+			// May fail if the socket is already closed, the kernel has removed it then
+			epoll_ctl(m_iEpollFd, EPOLL_CTL_DEL, socketNum, NULL);
+			m_iSocketCount--;
+		}
+		handler.conditionSet = 0;
+		handler.handlerProc = NULL;
+		handler.clientData = NULL;
+		handler.bEdgeTriggered = false;
+		handler.bBatchReceive = false;
+		return;
+	}
+
+	handler.conditionSet = conditionSet;
+	handler.handlerProc = handlerProc;
+	handler.clientData = clientData;
+	if(updateSocket(socketNum, bAlreadyWatched)){
+		if(!bAlreadyWatched){
+			m_iSocketCount++;
+		}
+	}else{
+		handler.conditionSet = 0;
+		handler.handlerProc = NULL;
+		handler.clientData = NULL;
+		if(bAlreadyWatched){
+			m_iSocketCount--;
+		}
+	}
+}
+
+void EpollTaskScheduler::moveSocketHandling(int oldSocketNum, int newSocketNum)
+{
+	if(oldSocketNum < 0 || newSocketNum < 0 || (size_t)oldSocketNum >= m_listHandlers.size()){
+		return;
+	}
+
+	EpollHandler handler = m_listHandlers[oldSocketNum];
+	setBackgroundHandling(oldSocketNum, 0, NULL, NULL);
+	setEdgeTriggered(newSocketNum, handler.bEdgeTriggered);
+	setBatchReceive(newSocketNum, handler.bBatchReceive);
+	setBackgroundHandling(newSocketNum, handler.conditionSet, handler.handlerProc, handler.clientData);
+}
+
+EventTriggerId EpollTaskScheduler::createEventTrigger(TaskFunc* eventHandlerProc)
+{
+	for(int i=0; i<32; i++){
+		EventTriggerId mask = ((EventTriggerId)1) << i;
+		if((m_iUsedTriggersMask & mask) == 0){
+			m_iUsedTriggersMask |= mask;
+			m_triggerHandlers[i] = eventHandlerProc;
+			m_triggerClientDatas[i] = NULL;
+			return mask;
+		}
+	}
+	return 0; // No more free trigger
+}
+
+void EpollTaskScheduler::deleteEventTrigger(EventTriggerId eventTriggerId)
+{
+	m_iTriggersAwaitingHandling.fetch_and(~eventTriggerId);
+	m_iUsedTriggersMask &= ~eventTriggerId;
+	for(int i=0; i<32; i++){
+		if(eventTriggerId & (((EventTriggerId)1) << i)){
+			m_triggerHandlers[i] = NULL;
+			m_triggerClientDatas[i] = NULL;
+		}
+	}
+}
+
+void EpollTaskScheduler::triggerEvent(EventTriggerId eventTriggerId, void* clientData)
+{
+	// May be called from any thread
+	for(int i=0; i<32; i++){
+		if(eventTriggerId & (((EventTriggerId)1) << i)){
+			m_triggerClientDatas[i].store(clientData);
+		}
+	}
+
+	uint32_t iPrevious = m_iTriggersAwaitingHandling.fetch_or(eventTriggerId);
+	if(iPrevious == 0){
+		uint64_t iValue = 1;
+		ssize_t iRes = write(m_iWakeupFd, &iValue, sizeof(iValue));
+		(void)iRes; // The counter can only be full if the loop is already awaken
+	}
+}
+
+void EpollTaskScheduler::handleTriggers()
+{
+	uint32_t iTriggers = m_iTriggersAwaitingHandling.exchange(0);
+	for(int i=0; iTriggers != 0 && i<32; i++){
+		EventTriggerId mask = ((EventTriggerId)1) << i;
+		if(iTriggers & mask){
+			iTriggers &= ~mask;
+			if(m_triggerHandlers[i] != NULL){
+				(*m_triggerHandlers[i])(m_triggerClientDatas[i].load());
+			}
+		}
+	}
+}
+
+void EpollTaskScheduler::handleBatch(int socketNum, int resultConditionSet)
+{
+	EpollDatagramBatch* pBatch = m_pBatch;
+	for(int i=0; i<EPOLL_BATCH_SIZE; i++){
+		struct msghdr& hdr = pBatch->msgs[i].msg_hdr;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name = &pBatch->addrs[i];
+		hdr.msg_namelen = sizeof(pBatch->addrs[i]);
+		hdr.msg_iov = &pBatch->iovecs[i];
+		hdr.msg_iovlen = 1;
+	}
+
+	EpollHandler handler = m_listHandlers[socketNum];
+	int iCount = recvmmsg(socketNum, pBatch->msgs, EPOLL_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	if(iCount <= 0){
+		// The handler gets the error from its own read
+		(*handler.handlerProc)(handler.clientData, resultConditionSet);
+		return;
+	}
+
+	pBatch->socketNum = socketNum;
+	pBatch->iCount = iCount;
+	pBatch->iNext = 0;
+	m_batchStats.iBatches++;
+	m_batchStats.iDatagrams += iCount;
+	for(int i=0; i<iCount; i++){
+		if(pBatch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC){
+			m_batchStats.iTruncated++;
+		}
+	}
+
+	while(pBatch->iNext < pBatch->iCount){
+		int iNext = pBatch->iNext;
+		(*handler.handlerProc)(handler.clientData, resultConditionSet);
+
+		// Stop if the handler doesn't read anymore, or has been changed by this datagram
+		const EpollHandler& currentHandler = m_listHandlers[socketNum];
+		if(pBatch->iNext == iNext || currentHandler.handlerProc != handler.handlerProc ||
+				currentHandler.clientData != handler.clientData || !currentHandler.bBatchReceive){
+			break;
+		}
+	}
+
+	m_batchStats.iUnread += pBatch->iCount - pBatch->iNext;
+	pBatch->socketNum = -1;
+	pBatch->iCount = 0;
+	pBatch->iNext = 0;
+}
+
+void EpollTaskScheduler::SingleStep(unsigned maxDelayTime)
+{
+	// Compute how long we can wait for the next delayed task
+	DelayInterval const& timeToDelay = fDelayQueue.timeToNextAlarm();
+	int64_t iTimeoutUs = (int64_t)timeToDelay.seconds()*1000000 + timeToDelay.useconds();
+	if(maxDelayTime > 0 && iTimeoutUs > (int64_t)maxDelayTime){
+		iTimeoutUs = maxDelayTime;
+	}
+	// Wake up regularly in order to check the watch variable of the event loop
+	if(m_iMaxSchedulerGranularity > 0 && iTimeoutUs > (int64_t)m_iMaxSchedulerGranularity){
+		iTimeoutUs = m_iMaxSchedulerGranularity;
+	}
+	if(iTimeoutUs > EPOLL_MAX_WAIT_US){
+		iTimeoutUs = EPOLL_MAX_WAIT_US;
+	}
+	if(m_iTriggersAwaitingHandling.load(std::memory_order_relaxed) != 0){
+		iTimeoutUs = 0;
+	}
+	int iTimeoutMs = (int)((iTimeoutUs + 999) / 1000);
+
+	int iEventCount = epoll_wait(m_iEpollFd, m_events, EPOLL_MAX_EVENTS, iTimeoutMs);
+	if(iEventCount < 0){
+		if(errno != EINTR && errno != EAGAIN){
+			internalError();
+		}
+		iEventCount = 0;
+	}
+
+	// The handlers of this step share the time read after the wait
+	LoopClock::beginIteration();
+
+	for(int i=0; i<iEventCount; i++){
+		int socketNum = m_events[i].data.fd;
+		if(socketNum == m_iWakeupFd){
+			uint64_t iValue;
+			ssize_t iRes = read(m_iWakeupFd, &iValue, sizeof(iValue));
+			(void)iRes;
+			continue;
+		}
+
+		// The handler may have been removed by a previous handler of this step
+		if((size_t)socketNum >= m_listHandlers.size()){
+			continue;
+		}
+		EpollHandler& handler = m_listHandlers[socketNum];
+		if(handler.handlerProc == NULL){
+			continue;
+		}
+
+		uint32_t events = m_events[i].events;
+		int resultConditionSet = 0;
+		if((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (handler.conditionSet & SOCKET_READABLE)){
+			resultConditionSet |= SOCKET_READABLE;
+		}
+		if((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && (handler.conditionSet & SOCKET_WRITABLE)){
+			resultConditionSet |= SOCKET_WRITABLE;
+		}
+		if((events & (EPOLLPRI | EPOLLERR)) && (handler.conditionSet & SOCKET_EXCEPTION)){
+			resultConditionSet |= SOCKET_EXCEPTION;
+		}
+		if(handler.bBatchReceive && (resultConditionSet & SOCKET_READABLE)){
+			handleBatch(socketNum, resultConditionSet);
+		}else if(resultConditionSet != 0){
+			(*handler.handlerProc)(handler.clientData, resultConditionSet);
+		}
+	}
+
+	// Handle the triggered events after the sockets, in case a handler changes the set of sockets
+	handleTriggers();
+
+	// Then the delayed tasks that are due. The DelayQueue only handles one of them per call.
+	for(int i=0; i<EPOLL_MAX_ALARMS_PER_STEP; i++){
+		DelayInterval const& timeToNextAlarm = fDelayQueue.timeToNextAlarm();
+		if(timeToNextAlarm.seconds() != 0 || timeToNextAlarm.useconds() != 0){
+			break;
+		}
+		fDelayQueue.handleAlarm();
+	}
+
+	LoopClock::endIteration();
+}
@@ -0,0 +1,138 @@
+/*
+ * EpollTaskScheduler.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef EPOLLTASKSCHEDULER_H_
+#define EPOLLTASKSCHEDULER_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include <BasicUsageEnvironment.hh>
+
+#define EPOLL_MAX_EVENTS 256
+#define EPOLL_MAX_ALARMS_PER_STEP 64
+#define EPOLL_MAX_WAIT_US 1000000000
+#define EPOLL_BATCH_SIZE 64 // Datagrams received by one recvmmsg()
+#define EPOLL_BATCH_DATAGRAM_SIZE 4096 // Larger than the RTP packets, which fit the MTU
+
+struct EpollBatchStats
+{
+	uint64_t iBatches; // recvmmsg() calls returning datagrams
+	uint64_t iDatagrams;
+	uint64_t iTruncated; // Larger than EPOLL_BATCH_DATAGRAM_SIZE
+	uint64_t iUnread; // Left in a batch by a handler removed or not reading
+};
+
+struct EpollDatagramBatch;
+
+//////////////////////////////////
+// Epoll TaskScheduler declaration
+//////////////////////////////////
+
+// TaskScheduler using epoll() instead of select(): no FD_SETSIZE limit and
+// no scan of every socket at each loop iteration. The delayed tasks are still
+// handled by the DelayQueue of BasicTaskScheduler0.
+//
+// The live555 handlers read a single packet each time they are called, so the
+// sockets are watched level-triggered unless setEdgeTriggered() is used for a
+// handler reading until EAGAIN.
+//
+// With setBatchReceive(), the datagrams of a UDP socket are received by
+// recvmmsg() when it is readable, then its handler is called once per
+// datagram: the socket read by the handler (see ReceiveGroupsock) takes the
+// next one with readBatchedDatagram() instead of doing a system call. The
+// datagrams of all the sockets of the scheduler share one batch, since each
+// one is emptied before the next socket.
+//
+// live555 sets the read handler of a RTP source or a RTCP instance receiving
+// over the RTSP connection on its closed datagram socket (-1). With
+// setKeepSocketlessHandlers(), these handlers are kept by their client data,
+// so that the packets demultiplexed from the connection (see
+// InterleavedDemux) can be given to their source.
+class EpollTaskScheduler : public BasicTaskScheduler0
+{
+public:
+	static EpollTaskScheduler* createNew(unsigned maxSchedulerGranularity = 10000/*microseconds*/);
+	virtual ~EpollTaskScheduler();
+
+	void setEdgeTriggered(int socketNum, bool bEdgeTriggered);
+	// Reset when the handling of the socket is disabled
+	void setBatchReceive(int socketNum, bool bBatchReceive);
+	void getBatchStats(EpollBatchStats& stats) const;
+	// Called by the handler of a socket received by batches. Returns false if
+	// no datagram of the socket is left in the batch.
+	bool readBatchedDatagram(int socketNum, uint8_t* pBuffer, unsigned iMaxSize, unsigned& iBytesRead, struct sockaddr_storage& fromAddress);
+
+	void setKeepSocketlessHandlers(bool bKeep);
+	// NULL if no handler was set for the client data
+	BackgroundHandlerProc* getSocketlessHandler(void* clientData) const;
+	// To be called before the client data is deleted
+	void forgetSocketlessHandler(void* clientData);
+
+	// The socket number refers to the file of iFd from now on, its handler
+	// being kept. Returns false on error.
+	bool redirectSocket(int socketNum, int iFd);
+
+	int getSocketCount() const;
+
+public:
+	// Redefined virtual functions
+	virtual void SingleStep(unsigned maxDelayTime = 0);
+
+	virtual void setBackgroundHandling(int socketNum, int conditionSet, BackgroundHandlerProc* handlerProc, void* clientData);
+	virtual void moveSocketHandling(int oldSocketNum, int newSocketNum);
+
+	virtual EventTriggerId createEventTrigger(TaskFunc* eventHandlerProc);
+	virtual void deleteEventTrigger(EventTriggerId eventTriggerId);
+	virtual void triggerEvent(EventTriggerId eventTriggerId, void* clientData = NULL);
+
+protected:
+	EpollTaskScheduler(int iEpollFd, int iWakeupFd, unsigned maxSchedulerGranularity);
+
+	bool updateSocket(int socketNum, bool bAlreadyWatched);
+	void handleTriggers();
+	void handleBatch(int socketNum, int resultConditionSet);
+
+private:
+	struct EpollHandler
+	{
+		int conditionSet;
+		BackgroundHandlerProc* handlerProc;
+		void* clientData;
+		bool bEdgeTriggered;
+		bool bBatchReceive;
+	};
+
+	int m_iEpollFd;
+	int m_iWakeupFd;
+	unsigned m_iMaxSchedulerGranularity;
+
+	// Indexed by socket number
+	std::vector<EpollHandler> m_listHandlers;
+	int m_iSocketCount;
+
+	struct epoll_event m_events[EPOLL_MAX_EVENTS];
+
+	// Allocated with the first socket received by batches
+	EpollDatagramBatch* m_pBatch;
+	EpollBatchStats m_batchStats;
+
+	bool m_bKeepSocketlessHandlers;
+	std::map<void*, BackgroundHandlerProc*> m_mapSocketlessHandlers; // By client data
+
+	// Triggers may be raised from any thread
+	std::atomic<uint32_t> m_iTriggersAwaitingHandling;
+	uint32_t m_iUsedTriggersMask;
+	TaskFunc* m_triggerHandlers[32];
+	std::atomic<void*> m_triggerClientDatas[32];
+};
+
+#endif /* EPOLLTASKSCHEDULER_H_ */
@@ -0,0 +1,191 @@
+/*
+ * FrameConsumer.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <time.h>
+
+#include "FrameConsumer.h"
+
+//////////////////////////////////
+// FrameConsumerPool definition
+//////////////////////////////////
+
+FrameConsumerPool::FrameConsumerPool(int iThreadCount, size_t iRingSize)
+{
+	if(iThreadCount < 1){
+		iThreadCount = 1;
+	}
+	for(int i=0; i<iThreadCount; i++){
+		Worker* pWorker = new Worker();
+		pWorker->pPool = this;
+		pWorker->bStarted = false;
+		pthread_mutex_init(&pWorker->mutex, NULL);
+		pthread_cond_init(&pWorker->cond, NULL);
+		pWorker->bSleeping = false;
+		m_listWorkers.push_back(pWorker);
+	}
+	m_iRingSize = iRingSize;
+	m_bStop = false;
+	m_iConsumedFrames = 0;
+	m_iBatchCount = 0;
+}
+
+FrameConsumerPool::~FrameConsumerPool()
+{
+	stop();
+	for(size_t i=0; i<m_listWorkers.size(); i++){
+		pthread_mutex_destroy(&m_listWorkers[i]->mutex);
+		pthread_cond_destroy(&m_listWorkers[i]->cond);
+		delete m_listWorkers[i];
+	}
+	m_listWorkers.clear();
+	for(size_t i=0; i<m_listRings.size(); i++){
+		delete m_listRings[i];
+	}
+	m_listRings.clear();
+}
+
+void FrameConsumerPool::addConsumer(FrameConsumerProc* proc, void* clientData)
+{
+	Consumer consumer;
+	consumer.proc = proc;
+	consumer.clientData = clientData;
+	m_listConsumers.push_back(consumer);
+}
+
+FrameConsumerPool::Worker* FrameConsumerPool::getWorker(int iStreamId) const
+{
+	return m_listWorkers[(size_t)iStreamId % m_listWorkers.size()];
+}
+
+FrameRing* FrameConsumerPool::createRing(int iStreamId)
+{
+	FrameRing* pRing = new FrameRing(m_iRingSize);
+	m_listRings.push_back(pRing);
+	getWorker(iStreamId)->listRings.push_back(pRing);
+	return pRing;
+}
+
+void FrameConsumerPool::notify(int iStreamId)
+{
+	Worker* pWorker = getWorker(iStreamId);
+	// Pairs with the check of the rings done by the worker after setting the flag
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(pWorker->bSleeping.load(std::memory_order_relaxed)){
+		pthread_mutex_lock(&pWorker->mutex);
+		pthread_cond_signal(&pWorker->cond);
+		pthread_mutex_unlock(&pWorker->mutex);
+	}
+}
+
+bool FrameConsumerPool::start()
+{
+	bool bRes = true;
+	m_bStop = false;
+	for(size_t i=0; i<m_listWorkers.size(); i++){
+		Worker* pWorker = m_listWorkers[i];
+		if(pthread_create(&pWorker->thread, NULL, workerThread, pWorker) == 0){
+			pWorker->bStarted = true;
+		}else{
+			bRes = false;
+		}
+	}
+	return bRes;
+}
+
+void FrameConsumerPool::stop()
+{
+	m_bStop = true;
+	for(size_t i=0; i<m_listWorkers.size(); i++){
+		Worker* pWorker = m_listWorkers[i];
+		if(pWorker->bStarted){
+			pthread_mutex_lock(&pWorker->mutex);
+			pthread_cond_signal(&pWorker->cond);
+			pthread_mutex_unlock(&pWorker->mutex);
+			pthread_join(pWorker->thread, NULL);
+			pWorker->bStarted = false;
+		}
+	}
+
+	// The producers are stopped and the workers gone, the end of the streams is not lost
+	for(size_t i=0; i<m_listRings.size(); i++){
+		while(drainRing(m_listRings[i]) > 0){
+		}
+	}
+}
+
+void* FrameConsumerPool::workerThread(void* arg)
+{
+	Worker* pWorker = (Worker*)arg;
+	pWorker->pPool->runWorker(pWorker);
+	return NULL;
+}
+
+size_t FrameConsumerPool::drainRing(FrameRing* pRing)
+{
+	FrameDescriptor frames[FRAME_CONSUMER_BATCH_SIZE];
+	size_t iCount = pRing->popBatch(frames, FRAME_CONSUMER_BATCH_SIZE);
+	if(iCount == 0){
+		return 0;
+	}
+
+	for(size_t i=0; i<iCount; i++){
+		for(size_t j=0; j<m_listConsumers.size(); j++){
+			(*m_listConsumers[j].proc)(m_listConsumers[j].clientData, frames[i]);
+		}
+		frames[i].pBuffer->unref();
+	}
+
+	m_iConsumedFrames.fetch_add(iCount, std::memory_order_relaxed);
+	m_iBatchCount.fetch_add(1, std::memory_order_relaxed);
+	return iCount;
+}
+
+void FrameConsumerPool::runWorker(Worker* pWorker)
+{
+	while(!m_bStop.load(std::memory_order_relaxed)){
+		size_t iCount = 0;
+		for(size_t i=0; i<pWorker->listRings.size(); i++){
+			iCount += drainRing(pWorker->listRings[i]);
+		}
+		if(iCount > 0){
+			continue;
+		}
+
+		// Nothing to do: announce the sleep, then check again before waiting. A producer
+		// seeing the flag needs the mutex to signal, so it cannot signal before the wait.
+		pWorker->bSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		pthread_mutex_lock(&pWorker->mutex);
+		bool bEmpty = true;
+		for(size_t i=0; bEmpty && i<pWorker->listRings.size(); i++){
+			bEmpty = (pWorker->listRings[i]->size() == 0);
+		}
+		if(bEmpty && !m_bStop.load(std::memory_order_relaxed)){
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += FRAME_CONSUMER_IDLE_WAIT_MS * 1000000;
+			if(ts.tv_nsec >= 1000000000){
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&pWorker->cond, &pWorker->mutex, &ts);
+		}
+		pthread_mutex_unlock(&pWorker->mutex);
+		pWorker->bSleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+void FrameConsumerPool::getStats(FrameConsumerStats& stats) const
+{
+	stats.iConsumedFrames = m_iConsumedFrames.load(std::memory_order_relaxed);
+	stats.iBatchCount = m_iBatchCount.load(std::memory_order_relaxed);
+	stats.iDroppedFrames = 0;
+	stats.iQueuedFrames = 0;
+	for(size_t i=0; i<m_listRings.size(); i++){
+		stats.iDroppedFrames += m_listRings[i]->getDropCount();
+		stats.iQueuedFrames += m_listRings[i]->size();
+	}
+}
@@ -0,0 +1,113 @@
+/*
+ * FrameConsumer.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef FRAMECONSUMER_H_
+#define FRAMECONSUMER_H_
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "FramePool.h"
+#include "SpscRing.h"
+
+#define FRAME_CONSUMER_BATCH_SIZE 32
+#define FRAME_CONSUMER_IDLE_WAIT_MS 10 // Sleeping workers also check the stop flag this often
+
+//////////////////////////////////
+// FrameDescriptor declaration
+//////////////////////////////////
+
+// A received frame, the reference of the buffer being owned by the descriptor
+struct FrameDescriptor
+{
+	FrameBuffer* pBuffer;
+	struct timeval presentationTime;
+	int iStreamId;
+	int iSubsessionId;
+	bool bRTCPSync;
+	bool bTruncated;
+	void* pClientData; // Of the producer, for its consumer
+};
+
+typedef SpscRing<FrameDescriptor> FrameRing;
+
+// Called by the worker threads for each frame, the buffer is released after
+typedef void (FrameConsumerProc)(void* clientData, const FrameDescriptor& frame);
+
+//////////////////////////////////
+// FrameConsumerPool declaration
+//////////////////////////////////
+
+struct FrameConsumerStats
+{
+	uint64_t iConsumedFrames;
+	uint64_t iBatchCount;
+	uint64_t iDroppedFrames;
+	uint64_t iQueuedFrames; // Currently waiting in the rings
+};
+
+// Worker threads draining the rings filled by the event loops. Each stream has
+// its own ring, so the event loop of the stream is the only producer, and each
+// ring is drained by a single worker.
+class FrameConsumerPool
+{
+public:
+	FrameConsumerPool(int iThreadCount, size_t iRingSize);
+	virtual ~FrameConsumerPool();
+
+	// Must be called before start()
+	void addConsumer(FrameConsumerProc* proc, void* clientData);
+	FrameRing* createRing(int iStreamId);
+
+	// Called by the producer after a push, wakes up the worker if it sleeps
+	void notify(int iStreamId);
+
+	bool start();
+	// Waits for the workers, the frames still queued are consumed by the calling thread
+	void stop();
+
+	void getStats(FrameConsumerStats& stats) const;
+
+private:
+	struct Worker
+	{
+		FrameConsumerPool* pPool;
+		pthread_t thread;
+		bool bStarted;
+		std::vector<FrameRing*> listRings;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		std::atomic<bool> bSleeping;
+	};
+
+	struct Consumer
+	{
+		FrameConsumerProc* proc;
+		void* clientData;
+	};
+
+	static void* workerThread(void* arg);
+	void runWorker(Worker* pWorker);
+	size_t drainRing(FrameRing* pRing);
+
+	Worker* getWorker(int iStreamId) const;
+
+private:
+	std::vector<Worker*> m_listWorkers;
+	std::vector<FrameRing*> m_listRings;
+	std::vector<Consumer> m_listConsumers;
+	size_t m_iRingSize;
+
+	std::atomic<bool> m_bStop;
+
+	std::atomic<uint64_t> m_iConsumedFrames;
+	std::atomic<uint64_t> m_iBatchCount;
+};
+
+#endif /* FRAMECONSUMER_H_ */
@@ -0,0 +1,245 @@
+/*
+ * FramePool.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "FramePool.h"
+
+//////////////////////////////////
+// FrameBuffer definition
+//////////////////////////////////
+
+FrameBuffer::FrameBuffer()
+{
+	m_pPool = NULL;
+	m_iSizeClass = 0;
+	m_pData = NULL;
+	m_iCapacity = 0;
+	m_iSize = 0;
+	m_bResident = false;
+	m_iRefCount = 0;
+	m_pNextFree = NULL;
+}
+
+void FrameBuffer::ref()
+{
+	m_iRefCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameBuffer::unref()
+{
+	// The last owner must see every write of the others before giving it back
+	if(m_iRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1){
+		m_pPool->release(this);
+	}
+}
+
+int FrameBuffer::refCount() const
+{
+	return m_iRefCount.load(std::memory_order_relaxed);
+}
+
+//////////////////////////////////
+// FramePool definition
+//////////////////////////////////
+
+FramePool* FramePool::getInstance()
+{
+	// Never destroyed, the buffers may be released until the very end of the process
+	static FramePool* pInstance = new FramePool();
+	return pInstance;
+}
+
+FramePool::FramePool()
+{
+	for(int i=0; i<FRAME_POOL_CLASS_COUNT; i++){
+		pthread_mutex_init(&m_classes[i].mutex, NULL);
+		m_classes[i].pFreeList = NULL;
+		m_classes[i].iFreeCount = 0;
+	}
+	m_bHugePages = false;
+
+	m_iBytesInUse = 0;
+	m_iBytesInUseHighWater = 0;
+	m_iBytesMapped = 0;
+	m_iBytesMappedHighWater = 0;
+	m_iBuffersInUse = 0;
+	m_iBuffersInUseHighWater = 0;
+	m_iAcquireCount = 0;
+}
+
+FramePool::~FramePool()
+{
+	for(int i=0; i<FRAME_POOL_CLASS_COUNT; i++){
+		pthread_mutex_destroy(&m_classes[i].mutex);
+	}
+}
+
+void FramePool::setHugePages(bool bEnable)
+{
+	m_bHugePages = bEnable;
+}
+
+int FramePool::getSizeClass(size_t iMinCapacity)
+{
+	int iShift = FRAME_POOL_MIN_CLASS_SHIFT;
+	while(iShift < FRAME_POOL_MAX_CLASS_SHIFT && ((size_t)1 << iShift) < iMinCapacity){
+		iShift++;
+	}
+	return iShift - FRAME_POOL_MIN_CLASS_SHIFT;
+}
+
+FrameBuffer* FramePool::keep(FrameBuffer* pBuffer)
+{
+	size_t iSize = pBuffer->size();
+	if(pBuffer->capacity() >= getClassCapacity(iSize) * FRAME_POOL_COMPACT_RATIO){
+		FrameBuffer* pCopy = acquire(iSize);
+		if(pCopy){
+			memcpy(pCopy->data(), pBuffer->data(), iSize);
+			pCopy->setSize(iSize);
+			return pCopy;
+		}
+	}
+	pBuffer->ref();
+	return pBuffer;
+}
+
+size_t FramePool::getClassCapacity(size_t iMinCapacity)
+{
+	return (size_t)1 << (getSizeClass(iMinCapacity) + FRAME_POOL_MIN_CLASS_SHIFT);
+}
+
+void FramePool::updateHighWater(std::atomic<uint64_t>& highWater, uint64_t iValue)
+{
+	uint64_t iHighWater = highWater.load(std::memory_order_relaxed);
+	while(iValue > iHighWater && !highWater.compare_exchange_weak(iHighWater, iValue, std::memory_order_relaxed)){
+	}
+}
+
+void* FramePool::mapMemory(size_t iSize)
+{
+	void* pMemory = MAP_FAILED;
+	if(m_bHugePages && (iSize % FRAME_POOL_SLAB_SIZE) == 0){
+		pMemory = mmap(NULL, iSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	if(pMemory == MAP_FAILED){
+		pMemory = mmap(NULL, iSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(pMemory == MAP_FAILED){
+			return NULL;
+		}
+		if(m_bHugePages){
+			// No huge page reserved, let the transparent huge pages do their best
+			madvise(pMemory, iSize, MADV_HUGEPAGE);
+		}
+	}
+
+	uint64_t iBytesMapped = m_iBytesMapped.fetch_add(iSize, std::memory_order_relaxed) + iSize;
+	updateHighWater(m_iBytesMappedHighWater, iBytesMapped);
+	return pMemory;
+}
+
+bool FramePool::allocateSlab(int iSizeClass)
+{
+	// Called with the mutex of the class locked
+	size_t iCapacity = (size_t)1 << (iSizeClass + FRAME_POOL_MIN_CLASS_SHIFT);
+	size_t iSlabSize = (iCapacity < FRAME_POOL_SLAB_SIZE ? FRAME_POOL_SLAB_SIZE : iCapacity);
+
+	uint8_t* pSlab = (uint8_t*)mapMemory(iSlabSize);
+	if(!pSlab){
+		return false;
+	}
+
+	SizeClass& sizeClass = m_classes[iSizeClass];
+	for(size_t iOffset = 0; iOffset + iCapacity <= iSlabSize; iOffset += iCapacity){
+		FrameBuffer* pBuffer = new FrameBuffer();
+		pBuffer->m_pPool = this;
+		pBuffer->m_iSizeClass = iSizeClass;
+		pBuffer->m_pData = pSlab + iOffset;
+		pBuffer->m_iCapacity = iCapacity;
+		pBuffer->m_pNextFree = sizeClass.pFreeList;
+		sizeClass.pFreeList = pBuffer;
+		sizeClass.iFreeCount++;
+	}
+	return true;
+}
+
+FrameBuffer* FramePool::acquire(size_t iMinCapacity)
+{
+	if(iMinCapacity > FRAME_POOL_MAX_CAPACITY){
+		return NULL;
+	}
+	int iSizeClass = getSizeClass(iMinCapacity);
+	SizeClass& sizeClass = m_classes[iSizeClass];
+
+	pthread_mutex_lock(&sizeClass.mutex);
+	if(!sizeClass.pFreeList && !allocateSlab(iSizeClass)){
+		pthread_mutex_unlock(&sizeClass.mutex);
+		return NULL;
+	}
+	// Last released first, its pages are the most likely to be resident and in cache
+	FrameBuffer* pBuffer = sizeClass.pFreeList;
+	sizeClass.pFreeList = pBuffer->m_pNextFree;
+	sizeClass.iFreeCount--;
+	pthread_mutex_unlock(&sizeClass.mutex);
+
+	pBuffer->m_pNextFree = NULL;
+	pBuffer->m_iSize = 0;
+	pBuffer->m_bResident = true;
+	pBuffer->m_iRefCount.store(1, std::memory_order_relaxed);
+
+	uint64_t iBytesInUse = m_iBytesInUse.fetch_add(pBuffer->m_iCapacity, std::memory_order_relaxed) + pBuffer->m_iCapacity;
+	updateHighWater(m_iBytesInUseHighWater, iBytesInUse);
+	uint64_t iBuffersInUse = m_iBuffersInUse.fetch_add(1, std::memory_order_relaxed) + 1;
+	updateHighWater(m_iBuffersInUseHighWater, iBuffersInUse);
+	m_iAcquireCount.fetch_add(1, std::memory_order_relaxed);
+
+	return pBuffer;
+}
+
+void FramePool::release(FrameBuffer* pBuffer)
+{
+	m_iBytesInUse.fetch_sub(pBuffer->m_iCapacity, std::memory_order_relaxed);
+	m_iBuffersInUse.fetch_sub(1, std::memory_order_relaxed);
+
+	SizeClass& sizeClass = m_classes[pBuffer->m_iSizeClass];
+	pthread_mutex_lock(&sizeClass.mutex);
+	pBuffer->m_pNextFree = sizeClass.pFreeList;
+	sizeClass.pFreeList = pBuffer;
+	sizeClass.iFreeCount++;
+	pthread_mutex_unlock(&sizeClass.mutex);
+}
+
+void FramePool::trim()
+{
+	for(int i=getSizeClass(FRAME_POOL_TRIM_MIN_SIZE); i<FRAME_POOL_CLASS_COUNT; i++){
+		SizeClass& sizeClass = m_classes[i];
+		pthread_mutex_lock(&sizeClass.mutex);
+		// The head of the list is kept resident, it is the next one to be used
+		FrameBuffer* pBuffer = (sizeClass.pFreeList ? sizeClass.pFreeList->m_pNextFree : NULL);
+		while(pBuffer){
+			if(pBuffer->m_bResident){
+				// Fails on a huge page smaller than the page, which then stays resident
+				madvise(pBuffer->m_pData, pBuffer->m_iCapacity, MADV_DONTNEED);
+				pBuffer->m_bResident = false;
+			}
+			pBuffer = pBuffer->m_pNextFree;
+		}
+		pthread_mutex_unlock(&sizeClass.mutex);
+	}
+}
+
+void FramePool::getStats(FramePoolStats& stats) const
+{
+	stats.iBytesInUse = m_iBytesInUse.load(std::memory_order_relaxed);
+	stats.iBytesInUseHighWater = m_iBytesInUseHighWater.load(std::memory_order_relaxed);
+	stats.iBytesMapped = m_iBytesMapped.load(std::memory_order_relaxed);
+	stats.iBytesMappedHighWater = m_iBytesMappedHighWater.load(std::memory_order_relaxed);
+	stats.iBuffersInUse = m_iBuffersInUse.load(std::memory_order_relaxed);
+	stats.iBuffersInUseHighWater = m_iBuffersInUseHighWater.load(std::memory_order_relaxed);
+	stats.iAcquireCount = m_iAcquireCount.load(std::memory_order_relaxed);
+	stats.bHugePages = m_bHugePages;
+}
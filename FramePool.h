@@ -0,0 +1,136 @@
+/*
+ * FramePool.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef FRAMEPOOL_H_
+#define FRAMEPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <vector>
+
+#define FRAME_POOL_MIN_CLASS_SHIFT 8 // 256 bytes
+#define FRAME_POOL_MAX_CLASS_SHIFT 26 // 64 MB
+#define FRAME_POOL_CLASS_COUNT (FRAME_POOL_MAX_CLASS_SHIFT - FRAME_POOL_MIN_CLASS_SHIFT + 1)
+#define FRAME_POOL_MAX_CAPACITY ((size_t)1 << FRAME_POOL_MAX_CLASS_SHIFT) // Of the largest class
+#define FRAME_POOL_SLAB_SIZE (2*1024*1024) // Size of a huge page
+#define FRAME_POOL_TRIM_MIN_SIZE (64*1024) // Smaller free buffers are kept resident
+#define FRAME_POOL_COMPACT_RATIO 4 // A frame using less than this part of its buffer is copied to a smaller one by keep()
+
+class FramePool;
+
+//////////////////////////////////
+// FrameBuffer declaration
+//////////////////////////////////
+
+// Buffer of the pool, shared by reference counting: a frame received in it can
+// be kept by a consumer without copy, the buffer going back to the pool when
+// the last reference is released. Any thread may release a reference.
+class FrameBuffer
+{
+public:
+	uint8_t* data() const { return m_pData; }
+	size_t capacity() const { return m_iCapacity; }
+	size_t size() const { return m_iSize; }
+	void setSize(size_t iSize) { m_iSize = iSize; }
+
+	void ref();
+	void unref();
+	int refCount() const;
+
+private:
+	friend class FramePool;
+	FrameBuffer();
+
+	FramePool* m_pPool;
+	int m_iSizeClass;
+	uint8_t* m_pData;
+	size_t m_iCapacity;
+	size_t m_iSize;
+	bool m_bResident;
+	std::atomic<int> m_iRefCount;
+	FrameBuffer* m_pNextFree;
+};
+
+//////////////////////////////////
+// FramePool declaration
+//////////////////////////////////
+
+struct FramePoolStats
+{
+	uint64_t iBytesInUse; // Capacity of the buffers currently referenced
+	uint64_t iBytesInUseHighWater;
+	uint64_t iBytesMapped; // Memory reserved from the system
+	uint64_t iBytesMappedHighWater;
+	uint64_t iBuffersInUse;
+	uint64_t iBuffersInUseHighWater;
+	uint64_t iAcquireCount;
+	bool bHugePages;
+};
+
+// Process-wide pool of frame buffers with power of two size classes. The
+// small classes are carved from slabs of FRAME_POOL_SLAB_SIZE, optionally
+// backed by huge pages, the bigger ones have a mapping of their own. Memory is
+// mapped on demand, so only the pages really written use resident memory.
+class FramePool
+{
+public:
+	static FramePool* getInstance();
+
+	// Must be called before the first buffer is acquired
+	void setHugePages(bool bEnable);
+
+	// Returns a buffer of at least iMinCapacity bytes, with one reference. NULL
+	// if out of memory or above FRAME_POOL_MAX_CAPACITY.
+	FrameBuffer* acquire(size_t iMinCapacity);
+	// Returns a reference of the buffer, or of a copy in a buffer of the right
+	// size if the frame uses a small part of it: the receive buffers are sized
+	// for the key frames, the other frames are much smaller
+	FrameBuffer* keep(FrameBuffer* pBuffer);
+
+	// Gives back to the system the pages of the big free buffers
+	void trim();
+
+	void getStats(FramePoolStats& stats) const;
+
+	static size_t getClassCapacity(size_t iMinCapacity);
+
+private:
+	FramePool();
+	~FramePool();
+
+	friend class FrameBuffer;
+	void release(FrameBuffer* pBuffer);
+
+	static int getSizeClass(size_t iMinCapacity);
+	bool allocateSlab(int iSizeClass);
+	void* mapMemory(size_t iSize);
+
+	static void updateHighWater(std::atomic<uint64_t>& highWater, uint64_t iValue);
+
+private:
+	struct SizeClass
+	{
+		pthread_mutex_t mutex;
+		FrameBuffer* pFreeList;
+		size_t iFreeCount;
+	};
+
+	SizeClass m_classes[FRAME_POOL_CLASS_COUNT];
+	bool m_bHugePages;
+
+	std::atomic<uint64_t> m_iBytesInUse;
+	std::atomic<uint64_t> m_iBytesInUseHighWater;
+	std::atomic<uint64_t> m_iBytesMapped;
+	std::atomic<uint64_t> m_iBytesMappedHighWater;
+	std::atomic<uint64_t> m_iBuffersInUse;
+	std::atomic<uint64_t> m_iBuffersInUseHighWater;
+	std::atomic<uint64_t> m_iAcquireCount;
+};
+
+#endif /* FRAMEPOOL_H_ */
@@ -0,0 +1,416 @@
+/*
+ * GopCache.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+
+#include "GopCache.h"
+#include "Metrics.h"
+
+static int gop_cache_parameter_set_index(int iClass)
+{
+	switch(iClass){
+	case NAL_UNIT_VPS:
+		return 0;
+	case NAL_UNIT_SPS:
+		return 1;
+	case NAL_UNIT_PPS:
+		return 2;
+	default:
+		break;
+	}
+	return -1;
+}
+
+//////////////////////////////////
+// GopCacheEntry definition
+//////////////////////////////////
+
+GopCacheEntry::GopCacheEntry(GopCache* pCache, int iStreamId, int iSubsessionId)
+{
+	m_pCache = pCache;
+	m_iStreamId = iStreamId;
+	m_iSubsessionId = iSubsessionId;
+	for(int i=0; i<3; i++){
+		m_pParameterSets[i] = NULL;
+	}
+	m_iBytes = 0;
+	m_bCaching = false;
+	pthread_mutex_init(&m_mutexConsumers, NULL);
+	m_pLruPrev = NULL;
+	m_pLruNext = NULL;
+}
+
+GopCacheEntry::~GopCacheEntry()
+{
+	clearFrames();
+	clearPrefix();
+	clearParameterSets();
+	pthread_mutex_destroy(&m_mutexConsumers);
+}
+
+size_t GopCacheEntry::clearFrames()
+{
+	size_t iReleased = 0;
+	for(size_t i=0; i<m_listFrames.size(); i++){
+		iReleased += m_listFrames[i].pBuffer->capacity();
+		m_listFrames[i].pBuffer->unref();
+	}
+	m_listFrames.clear();
+	m_iBytes -= iReleased;
+	m_bCaching = false;
+	return iReleased;
+}
+
+size_t GopCacheEntry::clearPrefix()
+{
+	size_t iReleased = 0;
+	for(size_t i=0; i<m_listPrefix.size(); i++){
+		iReleased += m_listPrefix[i].pBuffer->capacity();
+		m_listPrefix[i].pBuffer->unref();
+	}
+	m_listPrefix.clear();
+	m_iBytes -= iReleased;
+	return iReleased;
+}
+
+size_t GopCacheEntry::clearParameterSets()
+{
+	size_t iReleased = 0;
+	for(int i=0; i<3; i++){
+		if(m_pParameterSets[i]){
+			iReleased += m_pParameterSets[i]->capacity();
+			m_pParameterSets[i]->unref();
+			m_pParameterSets[i] = NULL;
+		}
+	}
+	m_iBytes -= iReleased;
+	return iReleased;
+}
+
+int64_t GopCacheEntry::storeParameterSets(FrameBuffer* pBuffer, const NalFrameInfo& info)
+{
+	int64_t iAdded = 0;
+	for(unsigned i=0; i<info.iUnitCount; i++){
+		const NalUnit& unit = info.units[i];
+		int iIndex = gop_cache_parameter_set_index(unit.iClass);
+		if(iIndex < 0){
+			continue;
+		}
+		FrameBuffer* pCopy = FramePool::getInstance()->acquire(unit.iSize);
+		if(!pCopy){
+			continue;
+		}
+		memcpy(pCopy->data(), pBuffer->data() + unit.iOffset, unit.iSize);
+		pCopy->setSize(unit.iSize);
+		if(m_pParameterSets[iIndex]){
+			iAdded -= (int64_t)m_pParameterSets[iIndex]->capacity();
+			m_pParameterSets[iIndex]->unref();
+		}
+		m_pParameterSets[iIndex] = pCopy;
+		iAdded += (int64_t)pCopy->capacity();
+	}
+	m_iBytes += iAdded;
+	return iAdded;
+}
+
+void GopCacheEntry::attach(GopCacheConsumerProc* proc, void* clientData)
+{
+	std::vector<GopCacheFrame> listFrames;
+
+	// Held until the cached frames are given, so that no live frame comes in between
+	pthread_mutex_lock(&m_mutexConsumers);
+	pthread_mutex_lock(&m_pCache->m_mutex);
+	Consumer consumer;
+	consumer.proc = proc;
+	consumer.clientData = clientData;
+	m_listConsumers.push_back(consumer);
+	m_pCache->touchEntry(this);
+
+	// The references are taken under the mutex, the frames could be evicted by another stream
+	GopCacheFrame frame;
+	timerclear(&frame.presentationTime);
+	if(!m_listFrames.empty()){
+		frame.presentationTime = m_listFrames[0].presentationTime;
+	}
+	frame.iFlags = NAL_FRAME_PARAMETER_SETS;
+	frame.bCached = true;
+	for(int i=0; i<3; i++){
+		if(m_pParameterSets[i]){
+			frame.pBuffer = m_pParameterSets[i];
+			frame.pBuffer->ref();
+			listFrames.push_back(frame);
+		}
+	}
+	for(size_t i=0; i<m_listFrames.size(); i++){
+		m_listFrames[i].pBuffer->ref();
+		listFrames.push_back(m_listFrames[i]);
+	}
+	// Of the next picture, given in the order received
+	for(size_t i=0; i<m_listPrefix.size(); i++){
+		m_listPrefix[i].pBuffer->ref();
+		listFrames.push_back(m_listPrefix[i]);
+	}
+	m_pCache->m_iAttaches++;
+	m_pCache->m_iFramesServed += listFrames.size();
+	m_pCache->updateMetrics();
+	pthread_mutex_unlock(&m_pCache->m_mutex);
+
+	for(size_t i=0; i<listFrames.size(); i++){
+		(*proc)(clientData, listFrames[i]);
+		listFrames[i].pBuffer->unref();
+	}
+	pthread_mutex_unlock(&m_mutexConsumers);
+}
+
+void GopCacheEntry::detach(GopCacheConsumerProc* proc, void* clientData)
+{
+	pthread_mutex_lock(&m_mutexConsumers);
+	pthread_mutex_lock(&m_pCache->m_mutex);
+	for(size_t i=0; i<m_listConsumers.size(); i++){
+		if(m_listConsumers[i].proc == proc && m_listConsumers[i].clientData == clientData){
+			m_listConsumers.erase(m_listConsumers.begin() + i);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m_pCache->m_mutex);
+	pthread_mutex_unlock(&m_mutexConsumers);
+}
+
+void GopCacheEntry::addFrame(FrameBuffer* pBuffer, const struct timeval& presentationTime, const NalFrameInfo& info)
+{
+	bool bSlice = ((info.iFlags & NAL_FRAME_SLICE) != 0);
+	bool bParameterSets = ((info.iFlags & NAL_FRAME_PARAMETER_SETS) && !bSlice);
+	bool bKeyFrame = ((info.iFlags & NAL_FRAME_KEY_FRAME) != 0);
+
+	// Prepared before locking, a stale flag only costs a copy or a reference given back
+	FrameBuffer* pCachedBuffer = NULL;
+	if(!bSlice || bKeyFrame || m_bCaching.load(std::memory_order_relaxed)){
+		pCachedBuffer = FramePool::getInstance()->keep(pBuffer);
+	}
+
+	// A frame is either cached before an attachment, or given live after it
+	pthread_mutex_lock(&m_mutexConsumers);
+	pthread_mutex_lock(&m_pCache->m_mutex);
+	int64_t iAdded = 0;
+	if(bParameterSets){
+		iAdded += storeParameterSets(pBuffer, info);
+	}
+	if(pCachedBuffer){
+		GopCacheFrame frame;
+		frame.pBuffer = pCachedBuffer;
+		frame.presentationTime = presentationTime;
+		frame.iFlags = info.iFlags;
+		frame.bCached = true;
+		if(!bSlice){
+			// Held for the next slice, the oldest ones are dropped
+			if(m_listPrefix.size() >= GOP_CACHE_MAX_PREFIX){
+				m_iBytes -= m_listPrefix[0].pBuffer->capacity();
+				iAdded -= (int64_t)m_listPrefix[0].pBuffer->capacity();
+				m_listPrefix[0].pBuffer->unref();
+				m_listPrefix.erase(m_listPrefix.begin());
+			}
+			m_listPrefix.push_back(frame);
+			m_iBytes += pCachedBuffer->capacity();
+			iAdded += (int64_t)pCachedBuffer->capacity();
+			pCachedBuffer = NULL;
+		}else if(bKeyFrame || !m_listFrames.empty()){
+			if(bKeyFrame){
+				iAdded -= (int64_t)clearFrames();
+			}
+			if(m_listFrames.size() + m_listPrefix.size() < GOP_CACHE_MAX_FRAMES){
+				// The prefix moves to the GOP, its bytes are already counted
+				m_listFrames.insert(m_listFrames.end(), m_listPrefix.begin(), m_listPrefix.end());
+				m_listPrefix.clear();
+				m_listFrames.push_back(frame);
+				m_iBytes += pCachedBuffer->capacity();
+				iAdded += (int64_t)pCachedBuffer->capacity();
+				m_bCaching = true;
+				pCachedBuffer = NULL;
+			}else{
+				// The GOP is too long to be kept, wait for the next key frame
+				iAdded -= (int64_t)clearFrames();
+			}
+		}
+	}
+	if(bSlice && !m_listPrefix.empty()){
+		// Not cached with this slice
+		iAdded -= (int64_t)clearPrefix();
+	}
+	if(!m_listConsumers.empty()){
+		m_pCache->touchEntry(this);
+	}
+	m_pCache->addBytes(iAdded);
+	pthread_mutex_unlock(&m_pCache->m_mutex);
+
+	if(pCachedBuffer){
+		pCachedBuffer->unref();
+	}
+
+	if(!m_listConsumers.empty()){
+		GopCacheFrame frame;
+		frame.pBuffer = pBuffer;
+		frame.presentationTime = presentationTime;
+		frame.iFlags = info.iFlags;
+		frame.bCached = false;
+		for(size_t i=0; i<m_listConsumers.size(); i++){
+			(*m_listConsumers[i].proc)(m_listConsumers[i].clientData, frame);
+		}
+	}
+	pthread_mutex_unlock(&m_mutexConsumers);
+}
+
+void GopCacheEntry::dropFrame()
+{
+	pthread_mutex_lock(&m_pCache->m_mutex);
+	if(!m_listFrames.empty() || !m_listPrefix.empty()){
+		int64_t iReleased = (int64_t)(clearFrames() + clearPrefix());
+		m_pCache->addBytes(-iReleased);
+	}
+	pthread_mutex_unlock(&m_pCache->m_mutex);
+}
+
+//////////////////////////////////
+// GopCache definition
+//////////////////////////////////
+
+GopCache* GopCache::getInstance()
+{
+	// Never destroyed, the sinks release their entry until the very end of the process
+	static GopCache* pInstance = new GopCache();
+	return pInstance;
+}
+
+GopCache::GopCache()
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	m_iBudget = 0;
+	m_iBytes = 0;
+	m_iEntries = 0;
+	m_iEvictions = 0;
+	m_iAttaches = 0;
+	m_iFramesServed = 0;
+	m_pLruHead = NULL;
+	m_pLruTail = NULL;
+}
+
+GopCache::~GopCache()
+{
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void GopCache::setBudget(size_t iBudget)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_iBudget = iBudget;
+	MetricsRegistry::getInstance()->m_gopCache.bEnabled.store(iBudget > 0, std::memory_order_relaxed);
+	updateMetrics();
+	pthread_mutex_unlock(&m_mutex);
+}
+
+GopCacheEntry* GopCache::createEntry(int iStreamId, int iSubsessionId)
+{
+	GopCacheEntry* pEntry = new GopCacheEntry(this, iStreamId, iSubsessionId);
+	pthread_mutex_lock(&m_mutex);
+	linkEntry(pEntry);
+	m_iEntries++;
+	updateMetrics();
+	pthread_mutex_unlock(&m_mutex);
+	return pEntry;
+}
+
+void GopCache::releaseEntry(GopCacheEntry* pEntry)
+{
+	pthread_mutex_lock(&m_mutex);
+	size_t iReleased = pEntry->clearFrames() + pEntry->clearPrefix() + pEntry->clearParameterSets();
+	unlinkEntry(pEntry);
+	m_iEntries--;
+	addBytes(-(int64_t)iReleased);
+	pthread_mutex_unlock(&m_mutex);
+	delete pEntry;
+}
+
+void GopCache::linkEntry(GopCacheEntry* pEntry)
+{
+	pEntry->m_pLruPrev = m_pLruTail;
+	pEntry->m_pLruNext = NULL;
+	if(m_pLruTail){
+		m_pLruTail->m_pLruNext = pEntry;
+	}else{
+		m_pLruHead = pEntry;
+	}
+	m_pLruTail = pEntry;
+}
+
+void GopCache::unlinkEntry(GopCacheEntry* pEntry)
+{
+	if(pEntry->m_pLruPrev){
+		pEntry->m_pLruPrev->m_pLruNext = pEntry->m_pLruNext;
+	}else{
+		m_pLruHead = pEntry->m_pLruNext;
+	}
+	if(pEntry->m_pLruNext){
+		pEntry->m_pLruNext->m_pLruPrev = pEntry->m_pLruPrev;
+	}else{
+		m_pLruTail = pEntry->m_pLruPrev;
+	}
+	pEntry->m_pLruPrev = NULL;
+	pEntry->m_pLruNext = NULL;
+}
+
+void GopCache::touchEntry(GopCacheEntry* pEntry)
+{
+	if(pEntry != m_pLruTail){
+		unlinkEntry(pEntry);
+		linkEntry(pEntry);
+	}
+}
+
+void GopCache::addBytes(int64_t iBytes)
+{
+	m_iBytes += iBytes;
+	if(m_iBytes > m_iBudget){
+		evict();
+	}
+	updateMetrics();
+}
+
+void GopCache::evict()
+{
+	GopCacheEntry* pEntry = m_pLruHead;
+	while(pEntry && m_iBytes > m_iBudget){
+		if(!pEntry->m_listFrames.empty() || !pEntry->m_listPrefix.empty()){
+			// The parameter sets are kept, the frames are cached again from the
+			// next key frame. Not used, the entry stays the first to be evicted.
+			m_iBytes -= pEntry->clearFrames();
+			m_iBytes -= pEntry->clearPrefix();
+			m_iEvictions++;
+		}
+		pEntry = pEntry->m_pLruNext;
+	}
+}
+
+void GopCache::updateMetrics()
+{
+	GopCacheMetrics& metrics = MetricsRegistry::getInstance()->m_gopCache;
+	metrics.iBudget.store(m_iBudget, std::memory_order_relaxed);
+	metrics.iBytes.store(m_iBytes, std::memory_order_relaxed);
+	metrics.iEntries.store(m_iEntries, std::memory_order_relaxed);
+	metrics.iEvictions.store(m_iEvictions, std::memory_order_relaxed);
+	metrics.iAttaches.store(m_iAttaches, std::memory_order_relaxed);
+	metrics.iFramesServed.store(m_iFramesServed, std::memory_order_relaxed);
+}
+
+void GopCache::getStats(GopCacheStats& stats)
+{
+	pthread_mutex_lock(&m_mutex);
+	stats.iBudget = m_iBudget;
+	stats.iBytes = m_iBytes;
+	stats.iEntries = m_iEntries;
+	stats.iEvictions = m_iEvictions;
+	stats.iAttaches = m_iAttaches;
+	stats.iFramesServed = m_iFramesServed;
+	pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,166 @@
+/*
+ * GopCache.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef GOPCACHE_H_
+#define GOPCACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "FramePool.h"
+#include "NalParser.h"
+
+#define GOP_CACHE_MAX_FRAMES 1024 // Frames of a GOP, a longer one is not cached
+#define GOP_CACHE_MAX_PREFIX 32 // Frames without slice kept for the next picture (parameter sets, SEI, AUD)
+
+class GopCache;
+
+// A frame given to a consumer. The buffer is only valid during the call, the
+// consumer takes a reference to keep it.
+struct GopCacheFrame
+{
+	FrameBuffer* pBuffer;
+	struct timeval presentationTime;
+	unsigned iFlags; // NAL_FRAME_xxx
+	bool bCached; // Given from the cache when attaching, before the live frames
+};
+
+typedef void (GopCacheConsumerProc)(void* clientData, const GopCacheFrame& frame);
+
+//////////////////////////////////
+// GopCacheEntry declaration
+//////////////////////////////////
+
+// Cache of a H264/H265 subsession: its last parameter sets, and the frames
+// from its last key frame on, kept by reference. The frames without slice
+// (parameter sets, SEI, AUD) are held until the next slice, so the ones
+// preceding a key frame start its GOP. A consumer attached gets them at once,
+// so it can decode from the key frame without waiting for the next one, then
+// it gets the live frames. Fed by the frame processing of the stream, the
+// eviction of the frames by another stream is done under the mutex of the
+// GopCache. An evicted entry keeps its parameter sets, and caches again from
+// the next key frame.
+class GopCacheEntry
+{
+public:
+	// From any thread. The cached frames are given before returning, then each
+	// new frame from the event loop of the stream. The callbacks are called with
+	// the mutex of the consumers locked: they must not attach nor detach, and
+	// once detached a consumer gets no more frame.
+	void attach(GopCacheConsumerProc* proc, void* clientData);
+	void detach(GopCacheConsumerProc* proc, void* clientData);
+
+	// Called by the sink for each frame, the parameter sets are taken from the frames without slice
+	void addFrame(FrameBuffer* pBuffer, const struct timeval& presentationTime, const NalFrameInfo& info);
+	// Called by the sink for a frame not given to addFrame (truncated), the
+	// frames after it cannot be decoded so nothing is cached until the next key frame
+	void dropFrame();
+
+	int getStreamId() const { return m_iStreamId; }
+	int getSubsessionId() const { return m_iSubsessionId; }
+
+private:
+	friend class GopCache;
+	GopCacheEntry(GopCache* pCache, int iStreamId, int iSubsessionId);
+	~GopCacheEntry();
+
+	// Called with the mutex of the GopCache locked, returns the bytes released
+	size_t clearFrames();
+	size_t clearPrefix();
+	size_t clearParameterSets();
+	int64_t storeParameterSets(FrameBuffer* pBuffer, const NalFrameInfo& info);
+
+	struct Consumer
+	{
+		GopCacheConsumerProc* proc;
+		void* clientData;
+	};
+
+private:
+	GopCache* m_pCache;
+	int m_iStreamId;
+	int m_iSubsessionId;
+
+	FrameBuffer* m_pParameterSets[3]; // VPS, SPS, PPS, one NAL unit each
+	std::vector<GopCacheFrame> m_listFrames; // From the last key frame
+	std::vector<GopCacheFrame> m_listPrefix; // Without slice, since the last slice
+	size_t m_iBytes; // Capacity of the buffers kept
+	std::atomic<bool> m_bCaching; // Frames are appended, read without the mutex to prepare them
+
+	// Locked before the mutex of the GopCache, the list is changed with both locked
+	pthread_mutex_t m_mutexConsumers;
+	std::vector<Consumer> m_listConsumers;
+
+	// Least recently used first, in the list of the GopCache
+	GopCacheEntry* m_pLruPrev;
+	GopCacheEntry* m_pLruNext;
+};
+
+//////////////////////////////////
+// GopCache declaration
+//////////////////////////////////
+
+struct GopCacheStats
+{
+	uint64_t iBudget;
+	uint64_t iBytes;
+	uint64_t iEntries;
+	uint64_t iEvictions;
+	uint64_t iAttaches;
+	uint64_t iFramesServed; // From the cache, when attaching
+};
+
+// Process-wide memory budget of the GOP caches. When the frames kept by all the
+// entries exceed it, the entries are evicted in least recently used order: an
+// entry is used when a consumer attaches, and for each frame while it has some.
+class GopCache
+{
+public:
+	static GopCache* getInstance();
+
+	// In bytes, 0 disables the cache. Must be called before the first entry is created.
+	void setBudget(size_t iBudget);
+	bool isEnabled() const { return m_iBudget > 0; }
+
+	GopCacheEntry* createEntry(int iStreamId, int iSubsessionId);
+	// The consumers must be detached
+	void releaseEntry(GopCacheEntry* pEntry);
+
+	void getStats(GopCacheStats& stats);
+
+private:
+	GopCache();
+	~GopCache();
+
+	friend class GopCacheEntry;
+
+	// Called with the mutex locked
+	void linkEntry(GopCacheEntry* pEntry);
+	void unlinkEntry(GopCacheEntry* pEntry);
+	void touchEntry(GopCacheEntry* pEntry);
+	void addBytes(int64_t iBytes);
+	void evict();
+	void updateMetrics();
+
+private:
+	pthread_mutex_t m_mutex;
+	size_t m_iBudget;
+	size_t m_iBytes;
+	uint64_t m_iEntries;
+	uint64_t m_iEvictions;
+	uint64_t m_iAttaches;
+	uint64_t m_iFramesServed;
+
+	GopCacheEntry* m_pLruHead; // Least recently used
+	GopCacheEntry* m_pLruTail;
+};
+
+#endif /* GOPCACHE_H_ */
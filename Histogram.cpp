@@ -0,0 +1,92 @@
+/*
+ * Histogram.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include "Histogram.h"
+
+//////////////////////////////////
+// Histogram definition
+//////////////////////////////////
+
+Histogram::Histogram()
+{
+	for(int i=0; i<HISTOGRAM_BUCKET_COUNT; i++){
+		m_buckets[i] = 0;
+	}
+	m_iCount = 0;
+	m_iMax = 0;
+}
+
+int Histogram::getBucketIndex(uint64_t iValue)
+{
+	if(iValue < HISTOGRAM_SUB_BUCKET_COUNT){
+		return (int)iValue;
+	}
+	int iMsb = 63 - __builtin_clzll(iValue);
+	if(iMsb >= HISTOGRAM_MAX_VALUE_BITS){
+		return HISTOGRAM_BUCKET_COUNT - 1;
+	}
+	int iShift = iMsb - HISTOGRAM_SUB_BUCKET_BITS;
+	return (iShift + 1) * HISTOGRAM_SUB_BUCKET_COUNT + (int)((iValue >> iShift) - HISTOGRAM_SUB_BUCKET_COUNT);
+}
+
+uint64_t Histogram::getBucketHighestValue(int iIndex)
+{
+	if(iIndex < HISTOGRAM_SUB_BUCKET_COUNT){
+		return iIndex;
+	}
+	int iShift = iIndex / HISTOGRAM_SUB_BUCKET_COUNT - 1;
+	uint64_t iSubBucket = HISTOGRAM_SUB_BUCKET_COUNT + (iIndex % HISTOGRAM_SUB_BUCKET_COUNT);
+	return ((iSubBucket + 1) << iShift) - 1;
+}
+
+void Histogram::record(uint64_t iValue)
+{
+	// Single writer: no need of read-modify-write instructions
+	std::atomic<uint32_t>& bucket = m_buckets[getBucketIndex(iValue)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_iCount.store(m_iCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if(iValue > m_iMax.load(std::memory_order_relaxed)){
+		m_iMax.store(iValue, std::memory_order_relaxed);
+	}
+}
+
+uint64_t Histogram::getCount() const
+{
+	return m_iCount.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMax() const
+{
+	return m_iMax.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getValueAtPercentile(double dPercentile) const
+{
+	// Sum the buckets rather than use the count, which may be updated in between
+	uint64_t iTotal = 0;
+	for(int i=0; i<HISTOGRAM_BUCKET_COUNT; i++){
+		iTotal += m_buckets[i].load(std::memory_order_relaxed);
+	}
+	if(iTotal == 0){
+		return 0;
+	}
+
+	uint64_t iRank = (uint64_t)(dPercentile / 100.0 * iTotal + 0.5);
+	if(iRank < 1){
+		iRank = 1;
+	}
+	uint64_t iSum = 0;
+	for(int i=0; i<HISTOGRAM_BUCKET_COUNT; i++){
+		iSum += m_buckets[i].load(std::memory_order_relaxed);
+		if(iSum >= iRank){
+			// Never above the highest recorded value
+			uint64_t iValue = getBucketHighestValue(i);
+			uint64_t iMax = getMax();
+			return (iValue < iMax ? iValue : iMax);
+		}
+	}
+	return getMax();
+}
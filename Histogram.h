@@ -0,0 +1,48 @@
+/*
+ * Histogram.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#define HISTOGRAM_SUB_BUCKET_BITS 5 // 32 buckets per power of two, about 3% of precision
+#define HISTOGRAM_SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_VALUE_BITS 27 // Values above 2^27 (134 seconds in microseconds) are counted in the last bucket
+#define HISTOGRAM_BUCKET_COUNT ((HISTOGRAM_MAX_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+//////////////////////////////////
+// Histogram declaration
+//////////////////////////////////
+
+// Log-linear histogram of fixed size, in the manner of HdrHistogram: the
+// values below HISTOGRAM_SUB_BUCKET_COUNT are counted exactly, each power of
+// two above is split in HISTOGRAM_SUB_BUCKET_COUNT buckets. A single thread
+// records at a time, any thread may read.
+class Histogram
+{
+public:
+	Histogram();
+
+	void record(uint64_t iValue);
+
+	uint64_t getCount() const;
+	uint64_t getMax() const;
+	// Highest value of the bucket holding the given percentile, between 0 and 100
+	uint64_t getValueAtPercentile(double dPercentile) const;
+
+	static int getBucketIndex(uint64_t iValue);
+	static uint64_t getBucketHighestValue(int iIndex);
+
+private:
+	std::atomic<uint32_t> m_buckets[HISTOGRAM_BUCKET_COUNT];
+	std::atomic<uint64_t> m_iCount;
+	std::atomic<uint64_t> m_iMax;
+};
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,366 @@
+/*
+ * InterleavedDemux.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "EpollTaskScheduler.h"
+#include "ReceiveGroupsock.h"
+#include "InterleavedDemux.h"
+
+#define INTERLEAVED_LOCAL_READ_SIZE 16384 // The requests of live555 are small
+
+//////////////////////////////////
+// InterleavedDemux definition
+//////////////////////////////////
+
+InterleavedDemux::InterleavedDemux(EpollTaskScheduler* pEpollScheduler, MediaSession* pMediaSession, InterleavedStats* pStats)
+{
+	m_pEpollScheduler = pEpollScheduler;
+	m_pMediaSession = pMediaSession;
+	m_pStats = pStats;
+
+	m_iConnectionFd = -1;
+	m_iLocalFd = -1;
+	m_iConnectionMask = 0;
+	m_iLocalMask = 0;
+	m_bConnectionEnded = false;
+	m_bLocalEnded = false;
+
+	m_pBuffer = NULL;
+	m_iStart = 0;
+	m_iEnd = 0;
+
+	memset(m_channels, 0, sizeof(m_channels));
+}
+
+InterleavedDemux::~InterleavedDemux()
+{
+	stop();
+
+	// The sources are deleted with the session
+	MediaSubsessionIterator iter(*m_pMediaSession);
+	MediaSubsession* pSubsession;
+	while((pSubsession = iter.next()) != NULL){
+		if(pSubsession->rtpSource()){
+			m_pEpollScheduler->forgetSocketlessHandler(pSubsession->rtpSource());
+		}
+		if(pSubsession->rtcpInstance()){
+			m_pEpollScheduler->forgetSocketlessHandler(pSubsession->rtcpInstance());
+		}
+	}
+
+	if(m_pBuffer){
+		free(m_pBuffer);
+		m_pBuffer = NULL;
+	}
+}
+
+bool InterleavedDemux::start(int socketNum)
+{
+	if(m_iConnectionFd >= 0 || socketNum < 0){
+		return false;
+	}
+
+	int iConnectionFd = fcntl(socketNum, F_DUPFD_CLOEXEC, 0);
+	if(iConnectionFd < 0){
+		return false;
+	}
+	int iFlags = fcntl(iConnectionFd, F_GETFL, 0);
+	fcntl(iConnectionFd, F_SETFL, iFlags | O_NONBLOCK);
+
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0){
+		close(iConnectionFd);
+		return false;
+	}
+	// From now on, live555 reads and writes the socket pair
+	if(!m_pEpollScheduler->redirectSocket(socketNum, fds[1])){
+		close(fds[0]);
+		close(fds[1]);
+		close(iConnectionFd);
+		return false;
+	}
+	close(fds[1]);
+
+	m_iConnectionFd = iConnectionFd;
+	m_iLocalFd = fds[0];
+	if(!m_pBuffer){
+		m_pBuffer = (uint8_t*)malloc(INTERLEAVED_BUFFER_SIZE);
+	}
+	m_iStart = 0;
+	m_iEnd = 0;
+	updateHandlers();
+	return true;
+}
+
+void InterleavedDemux::stop()
+{
+	if(m_iConnectionFd < 0){
+		return;
+	}
+
+	// The last requests of live555 (the TEARDOWN) are sent before closing
+	if(!m_bLocalEnded){
+		readLocal();
+	}
+	flushToConnection();
+
+	m_pEpollScheduler->setBackgroundHandling(m_iConnectionFd, 0, NULL, NULL);
+	m_pEpollScheduler->setBackgroundHandling(m_iLocalFd, 0, NULL, NULL);
+	close(m_iConnectionFd);
+	close(m_iLocalFd);
+	m_iConnectionFd = -1;
+	m_iLocalFd = -1;
+	m_iConnectionMask = 0;
+	m_iLocalMask = 0;
+	m_listToLocal.clear();
+	m_listToConnection.clear();
+}
+
+void InterleavedDemux::updateHandlers()
+{
+	int iConnectionMask = 0;
+	if(!m_bConnectionEnded && m_listToLocal.size() < INTERLEAVED_MAX_BACKLOG){
+		iConnectionMask |= SOCKET_READABLE;
+	}
+	if(!m_listToConnection.empty()){
+		iConnectionMask |= SOCKET_WRITABLE;
+	}
+	if(iConnectionMask != m_iConnectionMask){
+		m_iConnectionMask = iConnectionMask;
+		m_pEpollScheduler->setBackgroundHandling(m_iConnectionFd, iConnectionMask, InterleavedDemux::connectionHandler, this);
+	}
+
+	int iLocalMask = 0;
+	if(!m_bLocalEnded){
+		iLocalMask |= SOCKET_READABLE;
+		if(!m_listToLocal.empty()){
+			iLocalMask |= SOCKET_WRITABLE;
+		}
+	}
+	if(iLocalMask != m_iLocalMask){
+		m_iLocalMask = iLocalMask;
+		m_pEpollScheduler->setBackgroundHandling(m_iLocalFd, iLocalMask, InterleavedDemux::localHandler, this);
+	}
+}
+
+void InterleavedDemux::connectionHandler(void* clientData, int mask)
+{
+	InterleavedDemux* pDemux = (InterleavedDemux*)clientData;
+	if(mask & SOCKET_WRITABLE){
+		pDemux->flushToConnection();
+	}
+	if(mask & SOCKET_READABLE){
+		pDemux->readConnection();
+	}
+	pDemux->updateHandlers();
+}
+
+void InterleavedDemux::localHandler(void* clientData, int mask)
+{
+	InterleavedDemux* pDemux = (InterleavedDemux*)clientData;
+	if(mask & SOCKET_WRITABLE){
+		pDemux->flushToLocal();
+	}
+	if(mask & SOCKET_READABLE){
+		pDemux->readLocal();
+	}
+	pDemux->updateHandlers();
+}
+
+void InterleavedDemux::readConnection()
+{
+	ssize_t iRead = read(m_iConnectionFd, m_pBuffer + m_iEnd, INTERLEAVED_BUFFER_SIZE - m_iEnd);
+	if(iRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+		return;
+	}
+	if(iRead <= 0){
+		// live555 gets the end of the connection, after the bytes not parsed
+		m_bConnectionEnded = true;
+		forwardToLocal(m_pBuffer + m_iStart, m_iEnd - m_iStart);
+		m_iStart = 0;
+		m_iEnd = 0;
+		flushToLocal();
+		return;
+	}
+
+	m_pStats->iReads++;
+	m_pStats->iBytes += iRead;
+	m_iEnd += iRead;
+	parse();
+}
+
+void InterleavedDemux::parse()
+{
+	while(m_iStart < m_iEnd){
+		const uint8_t* p = m_pBuffer + m_iStart;
+		size_t iAvailable = m_iEnd - m_iStart;
+
+		if(p[0] != '$'){
+			// RTSP message, up to the next frame as live555 splits them
+			const uint8_t* pFrame = (const uint8_t*)memchr(p, '$', iAvailable);
+			size_t iSize = (pFrame ? (size_t)(pFrame - p) : iAvailable);
+			forwardToLocal(p, iSize);
+			m_iStart += iSize;
+			continue;
+		}
+
+		// '$', channel and size of the payload in network order
+		if(iAvailable < 4){
+			break;
+		}
+		unsigned iSize = ((unsigned)p[2] << 8) | p[3];
+		if(iAvailable < 4 + (size_t)iSize){
+			break;
+		}
+		m_iStart += 4 + iSize;
+		if(!deliver(p[1], p + 4, iSize)){
+			forwardToLocal(p, 4 + iSize);
+			m_pStats->iForwarded++;
+		}
+	}
+
+	// The start of the next frame is kept at the beginning of the buffer
+	if(m_iStart == m_iEnd){
+		m_iStart = 0;
+		m_iEnd = 0;
+	}else if(m_iStart > 0){
+		memmove(m_pBuffer, m_pBuffer + m_iStart, m_iEnd - m_iStart);
+		m_iEnd -= m_iStart;
+		m_iStart = 0;
+	}
+}
+
+bool InterleavedDemux::deliver(uint8_t iChannel, const uint8_t* pData, unsigned iSize)
+{
+	Channel& channel = m_channels[iChannel];
+	if(!channel.bResolved){
+		resolveChannel(iChannel);
+	}
+	if(!channel.pGroupsock || !channel.handlerProc){
+		return false;
+	}
+	if(channel.pSubsession && !channel.pSubsession->sink){
+		// The source doesn't read anymore, live555 skips its packets as well
+		m_pStats->iDropped++;
+		return true;
+	}
+
+	channel.pGroupsock->setPendingPacket(pData, iSize);
+	(*channel.handlerProc)(channel.clientData, SOCKET_READABLE);
+	if(channel.pGroupsock->hasPendingPacket()){
+		channel.pGroupsock->clearPendingPacket();
+		m_pStats->iDropped++;
+	}else{
+		m_pStats->iPackets++;
+	}
+	return true;
+}
+
+void InterleavedDemux::resolveChannel(uint8_t iChannel)
+{
+	Channel& channel = m_channels[iChannel];
+	channel.bResolved = true;
+
+	MediaSubsessionIterator iter(*m_pMediaSession);
+	MediaSubsession* pSubsession;
+	while((pSubsession = iter.next()) != NULL){
+		if(pSubsession->sessionId() == NULL){
+			continue; // Not set up, its channels are not assigned
+		}
+		if(pSubsession->rtpChannelId == iChannel && pSubsession->rtpSource()){
+			channel.pSubsession = pSubsession;
+			channel.pGroupsock = dynamic_cast<ReceiveGroupsock*>(pSubsession->rtpSource()->RTPgs());
+			channel.clientData = pSubsession->rtpSource();
+			break;
+		}
+		if(pSubsession->rtcpChannelId == iChannel && pSubsession->rtcpInstance()){
+			channel.pSubsession = NULL;
+			channel.pGroupsock = dynamic_cast<ReceiveGroupsock*>(pSubsession->rtcpInstance()->RTCPgs());
+			channel.clientData = pSubsession->rtcpInstance();
+			break;
+		}
+	}
+	if(channel.clientData){
+		channel.handlerProc = m_pEpollScheduler->getSocketlessHandler(channel.clientData);
+	}
+}
+
+void InterleavedDemux::forwardToLocal(const uint8_t* pData, size_t iSize)
+{
+	if(iSize == 0 || m_bLocalEnded){
+		return;
+	}
+	// After the bytes already waiting, to keep the order
+	size_t iWritten = 0;
+	if(m_listToLocal.empty()){
+		ssize_t iRes = send(m_iLocalFd, pData, iSize, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(iRes > 0){
+			iWritten = (size_t)iRes;
+		}
+	}
+	if(iWritten < iSize){
+		m_listToLocal.insert(m_listToLocal.end(), pData + iWritten, pData + iSize);
+	}
+}
+
+void InterleavedDemux::flushToLocal()
+{
+	if(!m_listToLocal.empty()){
+		ssize_t iRes = send(m_iLocalFd, m_listToLocal.data(), m_listToLocal.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(iRes > 0){
+			m_listToLocal.erase(m_listToLocal.begin(), m_listToLocal.begin() + iRes);
+		}else if(iRes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+			m_listToLocal.clear(); // live555 closed its end
+		}
+	}
+	if(m_bConnectionEnded && m_listToLocal.empty()){
+		shutdown(m_iLocalFd, SHUT_WR);
+	}
+}
+
+void InterleavedDemux::readLocal()
+{
+	uint8_t buffer[INTERLEAVED_LOCAL_READ_SIZE];
+	ssize_t iRead = read(m_iLocalFd, buffer, sizeof(buffer));
+	if(iRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+		return;
+	}
+	if(iRead <= 0){
+		// The RTSP client is closed
+		m_bLocalEnded = true;
+		return;
+	}
+
+	size_t iWritten = 0;
+	if(m_listToConnection.empty() && !m_bConnectionEnded){
+		ssize_t iRes = send(m_iConnectionFd, buffer, iRead, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(iRes > 0){
+			iWritten = (size_t)iRes;
+		}
+	}
+	if(iWritten < (size_t)iRead && !m_bConnectionEnded){
+		m_listToConnection.insert(m_listToConnection.end(), buffer + iWritten, buffer + iRead);
+	}
+}
+
+void InterleavedDemux::flushToConnection()
+{
+	if(m_listToConnection.empty()){
+		return;
+	}
+	ssize_t iRes = send(m_iConnectionFd, m_listToConnection.data(), m_listToConnection.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	if(iRes > 0){
+		m_listToConnection.erase(m_listToConnection.begin(), m_listToConnection.begin() + iRes);
+	}else if(iRes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+		m_listToConnection.clear(); // The end of the connection is given to live555 by the read
+	}
+}
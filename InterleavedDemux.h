@@ -0,0 +1,111 @@
+/*
+ * InterleavedDemux.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef INTERLEAVEDDEMUX_H_
+#define INTERLEAVEDDEMUX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <liveMedia.hh>
+
+#define INTERLEAVED_BUFFER_SIZE (256*1024) // Read at once from the RTSP connection
+#define INTERLEAVED_MAX_BACKLOG (1024*1024) // Bytes waiting for live555, the connection is not read above
+
+class EpollTaskScheduler;
+class ReceiveGroupsock;
+
+struct InterleavedStats
+{
+	uint64_t iReads; // read() calls returning data
+	uint64_t iBytes;
+	uint64_t iPackets; // Given to their source
+	uint64_t iForwarded; // RTP/RTCP packets given to live555 with the RTSP messages
+	uint64_t iDropped; // Not read by their source
+};
+
+//////////////////////////////////
+// InterleavedDemux declaration
+//////////////////////////////////
+
+// Receives the RTP and RTCP packets interleaved in the RTSP connection
+// (RFC 2326, section 10.12) of a session set up with TCP.
+//
+// live555 reads each packet with several small reads (the '$', the channel,
+// the size then the payload). Once the session plays, the connection is read
+// by chunks of INTERLEAVED_BUFFER_SIZE instead, and the '$' frames are
+// parsed in the chunk: the payload is given to the ReceiveGroupsock of the
+// RTP source or RTCP instance of its channel, and its handler is called, so
+// the payload is only copied into the packet buffer of live555.
+//
+// The RTSP client keeps its socket number, which is redirected to one end of
+// a socket pair: the RTSP messages of the server, and the frames of a channel
+// without a known handler, are written to the other end, where live555 reads
+// them as from the connection. What live555 writes (requests, RTCP receiver
+// reports) is copied to the connection.
+//
+// Requires the EpollTaskScheduler, keeping the socketless handlers. Used by
+// the event loop of the stream only, and deleted outside of its handlers.
+class InterleavedDemux
+{
+public:
+	InterleavedDemux(EpollTaskScheduler* pEpollScheduler, MediaSession* pMediaSession, InterleavedStats* pStats);
+	virtual ~InterleavedDemux();
+
+	// Once the session plays, from the response handler of the PLAY, so that
+	// live555 is not in the middle of a frame. Returns false on error, live555
+	// reading the connection as before then.
+	bool start(int socketNum);
+
+	static void connectionHandler(void* clientData, int mask);
+	static void localHandler(void* clientData, int mask);
+
+private:
+	struct Channel
+	{
+		bool bResolved;
+		MediaSubsession* pSubsession; // NULL for a RTCP channel
+		ReceiveGroupsock* pGroupsock;
+		TaskScheduler::BackgroundHandlerProc* handlerProc;
+		void* clientData;
+	};
+
+	void readConnection();
+	void readLocal();
+	void parse();
+	bool deliver(uint8_t iChannel, const uint8_t* pData, unsigned iSize);
+	void resolveChannel(uint8_t iChannel);
+	void forwardToLocal(const uint8_t* pData, size_t iSize);
+	void flushToLocal();
+	void flushToConnection();
+	void updateHandlers();
+	void stop();
+
+private:
+	EpollTaskScheduler* m_pEpollScheduler;
+	MediaSession* m_pMediaSession;
+	InterleavedStats* m_pStats;
+
+	int m_iConnectionFd; // Duplicate of the RTSP connection, -1 if not started
+	int m_iLocalFd; // Our end of the socket pair, live555 has the other one
+	int m_iConnectionMask; // Conditions watched on each one
+	int m_iLocalMask;
+	bool m_bConnectionEnded;
+	bool m_bLocalEnded;
+
+	uint8_t* m_pBuffer;
+	size_t m_iStart; // First byte not parsed
+	size_t m_iEnd;
+
+	std::vector<uint8_t> m_listToLocal; // Not written yet to the socket pair
+	std::vector<uint8_t> m_listToConnection; // Not written yet to the connection
+
+	Channel m_channels[256];
+};
+
+#endif /* INTERLEAVEDDEMUX_H_ */
@@ -0,0 +1,81 @@
+/*
+ * LoopClock.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <time.h>
+
+#include "LoopClock.h"
+
+// Of the thread, the cache is used only during an iteration
+static __thread bool g_bLoopClockActive = false;
+static __thread bool g_bLoopClockValid = false;
+static __thread int64_t g_iLoopClockUs = 0;
+static __thread int64_t g_iLoopWallClockUs = 0;
+
+static int64_t loop_clock_read_wall_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void loop_clock_refresh()
+{
+	g_iLoopClockUs = LoopClock::readNowUs();
+	g_iLoopWallClockUs = loop_clock_read_wall_us();
+	g_bLoopClockValid = true;
+}
+
+//////////////////////////////////
+// LoopClock definition
+//////////////////////////////////
+
+void LoopClock::beginIteration()
+{
+	g_bLoopClockActive = true;
+	g_bLoopClockValid = false;
+}
+
+void LoopClock::endIteration()
+{
+	g_bLoopClockActive = false;
+	g_bLoopClockValid = false;
+}
+
+int64_t LoopClock::readNowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t LoopClock::nowUs()
+{
+	if(!g_bLoopClockActive){
+		return readNowUs();
+	}
+	if(!g_bLoopClockValid){
+		loop_clock_refresh();
+	}
+	return g_iLoopClockUs;
+}
+
+int64_t LoopClock::wallClockUs()
+{
+	if(!g_bLoopClockActive){
+		return loop_clock_read_wall_us();
+	}
+	if(!g_bLoopClockValid){
+		loop_clock_refresh();
+	}
+	return g_iLoopWallClockUs;
+}
+
+void LoopClock::wallClock(struct timeval& tv)
+{
+	int64_t iWallClockUs = wallClockUs();
+	tv.tv_sec = (time_t)(iWallClockUs / 1000000);
+	tv.tv_usec = (suseconds_t)(iWallClockUs % 1000000);
+}
@@ -0,0 +1,39 @@
+/*
+ * LoopClock.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef LOOPCLOCK_H_
+#define LOOPCLOCK_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+//////////////////////////////////
+// LoopClock declaration
+//////////////////////////////////
+
+// Time of the current iteration of the event loop of the thread. The clocks
+// are read once per iteration, by the first handler asking for them, instead
+// of once per frame or packet. The monotonic clock is for the durations and
+// the timeouts, immune to the jumps of the wall clock; the wall clock is
+// for the timestamps compared with other hosts. Out of an iteration, or in a
+// thread without event loop, each call reads the clock.
+class LoopClock
+{
+public:
+	// Called by the scheduler around each iteration
+	static void beginIteration();
+	static void endIteration();
+
+	// In microseconds
+	static int64_t nowUs();
+	static int64_t wallClockUs();
+	static void wallClock(struct timeval& tv);
+
+	// Read without cache
+	static int64_t readNowUs();
+};
+
+#endif /* LOOPCLOCK_H_ */
@@ -0,0 +1,696 @@
+/*
+ * Metrics.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "Metrics.h"
+
+static const char* g_szPhaseNames[METRICS_PHASE_COUNT] = { "options", "describe", "setup", "play", "handshake", "first_frame", "admission" };
+
+static int64_t metrics_now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void metrics_append_label_value(std::string& szOutput, const char* szValue)
+{
+	for(const char* p = szValue; *p; p++){
+		if(*p == '\\' || *p == '"'){
+			szOutput += '\\';
+			szOutput += *p;
+		}else if(*p == '\n'){
+			szOutput += "\\n";
+		}else{
+			szOutput += *p;
+		}
+	}
+}
+
+static void metrics_append_header(std::string& szOutput, const char* szName, const char* szType, const char* szHelp)
+{
+	szOutput += "# HELP ";
+	szOutput += szName;
+	szOutput += ' ';
+	szOutput += szHelp;
+	szOutput += "\n# TYPE ";
+	szOutput += szName;
+	szOutput += ' ';
+	szOutput += szType;
+	szOutput += '\n';
+}
+
+static void metrics_append_sample(std::string& szOutput, const char* szName, const std::string& szLabels, double dValue)
+{
+	char szValue[64];
+	snprintf(szValue, sizeof(szValue), "%.17g", dValue);
+	szOutput += szName;
+	if(!szLabels.empty()){
+		szOutput += '{';
+		szOutput += szLabels;
+		szOutput += '}';
+	}
+	szOutput += ' ';
+	szOutput += szValue;
+	szOutput += '\n';
+}
+
+//////////////////////////////////
+// StreamMetrics definition
+//////////////////////////////////
+
+StreamMetrics::StreamMetrics(int iStreamId, const char* szURL)
+{
+	m_iStreamId = iStreamId;
+
+	// Never export the credentials given in the URL
+	m_szURL = strdup(szURL ? szURL : "");
+	char* szScheme = strstr(m_szURL, "://");
+	if(szScheme){
+		char* szHost = szScheme + 3;
+		char* szAt = strchr(szHost, '@');
+		char* szSlash = strchr(szHost, '/');
+		if(szAt && (!szSlash || szAt < szSlash)){
+			memmove(szHost, szAt + 1, strlen(szAt + 1) + 1);
+		}
+	}
+
+	m_szState = "idle";
+	m_iAttempts = 0;
+	m_iByteRate = 0;
+	m_iFrameRate = 0;
+	m_iKeepalivesSent = 0;
+	m_iKeepalivesSkipped = 0;
+	for(int i=0; i<METRICS_PHASE_COUNT; i++){
+		m_iPhaseDurationUs[i] = -1;
+	}
+
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		SubsessionMetrics& subsession = m_subsessions[i];
+		subsession.bUsed = false;
+		subsession.iFrames = 0;
+		subsession.iBytes = 0;
+		subsession.iTruncatedFrames = 0;
+		subsession.iLastFrameTimeUs = 0;
+		subsession.bRTCPSync = false;
+		subsession.iKeyFrames = 0;
+		subsession.iGopLength = 0;
+		subsession.iPictureRateMilli = 0;
+		subsession.iWidth = 0;
+		subsession.iHeight = 0;
+		subsession.iPacketsReceived = 0;
+		subsession.iPacketsLost = 0;
+		subsession.iJitterUs = 0;
+		subsession.iReceiveBufferSize = 0;
+		subsession.iReceiveBufferAdjustments = 0;
+		subsession.iSocketDrops = 0;
+		subsession.iReorderThresholdUs = 0;
+		subsession.iReorderedPackets = 0;
+		subsession.iReorderGivenUp = 0;
+		subsession.pFrameInterval = NULL;
+		subsession.pLatency = NULL;
+		m_szMedium[i][0] = '\0';
+		m_szCodec[i][0] = '\0';
+	}
+	pthread_mutex_init(&m_mutexLabels, NULL);
+}
+
+StreamMetrics::~StreamMetrics()
+{
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		if(m_subsessions[i].pFrameInterval){
+			delete m_subsessions[i].pFrameInterval;
+			m_subsessions[i].pFrameInterval = NULL;
+		}
+		if(m_subsessions[i].pLatency){
+			delete m_subsessions[i].pLatency;
+			m_subsessions[i].pLatency = NULL;
+		}
+	}
+	pthread_mutex_destroy(&m_mutexLabels);
+	if(m_szURL){
+		free(m_szURL);
+		m_szURL = NULL;
+	}
+}
+
+void StreamMetrics::setSubsession(int iSubsessionId, const char* szMedium, const char* szCodec)
+{
+	if(iSubsessionId < 0 || iSubsessionId >= METRICS_MAX_SUBSESSIONS){
+		return;
+	}
+	pthread_mutex_lock(&m_mutexLabels);
+	snprintf(m_szMedium[iSubsessionId], METRICS_LABEL_SIZE, "%s", szMedium);
+	snprintf(m_szCodec[iSubsessionId], METRICS_LABEL_SIZE, "%s", szCodec);
+	// Only allocated for the subsessions really used, a histogram takes a few KB
+	if(!m_subsessions[iSubsessionId].pFrameInterval){
+		m_subsessions[iSubsessionId].pFrameInterval = new Histogram();
+		m_subsessions[iSubsessionId].pLatency = new Histogram();
+	}
+	m_subsessions[iSubsessionId].bUsed = true;
+	pthread_mutex_unlock(&m_mutexLabels);
+}
+
+SubsessionMetrics* StreamMetrics::getSubsession(int iSubsessionId)
+{
+	if(iSubsessionId < 0 || iSubsessionId >= METRICS_MAX_SUBSESSIONS){
+		return NULL;
+	}
+	return &m_subsessions[iSubsessionId];
+}
+
+bool StreamMetrics::getSubsessionName(int iSubsessionId, char* szName, size_t iSize)
+{
+	if(iSubsessionId < 0 || iSubsessionId >= METRICS_MAX_SUBSESSIONS){
+		return false;
+	}
+	bool bUsed = false;
+	pthread_mutex_lock(&m_mutexLabels);
+	if(m_subsessions[iSubsessionId].bUsed){
+		snprintf(szName, iSize, "%s/%s", m_szMedium[iSubsessionId], m_szCodec[iSubsessionId]);
+		bUsed = true;
+	}
+	pthread_mutex_unlock(&m_mutexLabels);
+	return bUsed;
+}
+
+void StreamMetrics::setState(const char* szState)
+{
+	m_szState.store(szState, std::memory_order_relaxed);
+}
+
+void StreamMetrics::setPhaseDuration(MetricsPhase phase, int64_t iDurationUs)
+{
+	m_iPhaseDurationUs[phase].store(iDurationUs, std::memory_order_relaxed);
+}
+
+uint64_t StreamMetrics::getTotalFrames() const
+{
+	uint64_t iTotal = 0;
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		iTotal += m_subsessions[i].iFrames.load(std::memory_order_relaxed);
+	}
+	return iTotal;
+}
+
+uint64_t StreamMetrics::getTotalBytes() const
+{
+	uint64_t iTotal = 0;
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		iTotal += m_subsessions[i].iBytes.load(std::memory_order_relaxed);
+	}
+	return iTotal;
+}
+
+uint64_t StreamMetrics::getTotalTruncatedFrames() const
+{
+	uint64_t iTotal = 0;
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		iTotal += m_subsessions[i].iTruncatedFrames.load(std::memory_order_relaxed);
+	}
+	return iTotal;
+}
+
+//////////////////////////////////
+// MetricsRegistry definition
+//////////////////////////////////
+
+MetricsRegistry* MetricsRegistry::getInstance()
+{
+	// Never destroyed, the streams may be updated until the very end of the process
+	static MetricsRegistry* pInstance = new MetricsRegistry();
+	return pInstance;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+	pthread_mutex_init(&m_mutexStreams, NULL);
+	m_admission.bEnabled = false;
+	m_admission.iQueueDepth = 0;
+	m_admission.iHandshakes = 0;
+	m_admission.iAdmitted = 0;
+	m_gopCache.bEnabled = false;
+	m_gopCache.iBudget = 0;
+	m_gopCache.iBytes = 0;
+	m_gopCache.iEntries = 0;
+	m_gopCache.iEvictions = 0;
+	m_gopCache.iAttaches = 0;
+	m_gopCache.iFramesServed = 0;
+	m_restream.bEnabled = false;
+	m_restream.iClients = 0;
+	m_restream.iFramesSent = 0;
+	m_restream.iBytesSent = 0;
+	m_restream.iFramesDropped = 0;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+	for(size_t i=0; i<m_listStreams.size(); i++){
+		delete m_listStreams[i];
+	}
+	m_listStreams.clear();
+	pthread_mutex_destroy(&m_mutexStreams);
+}
+
+StreamMetrics* MetricsRegistry::createStream(int iStreamId, const char* szURL)
+{
+	StreamMetrics* pStream = new StreamMetrics(iStreamId, szURL);
+	pthread_mutex_lock(&m_mutexStreams);
+	m_listStreams.push_back(pStream);
+	pthread_mutex_unlock(&m_mutexStreams);
+	return pStream;
+}
+
+void MetricsRegistry::render(std::string& szOutput)
+{
+	pthread_mutex_lock(&m_mutexStreams);
+	std::vector<StreamMetrics*> listStreams = m_listStreams;
+	pthread_mutex_unlock(&m_mutexStreams);
+
+	int64_t iNowUs = metrics_now_us();
+
+	// The samples of a metric must be grouped, so build the labels first
+	std::vector<std::string> listStreamLabels(listStreams.size());
+	std::vector<std::string> listSubsessionLabels(listStreams.size() * METRICS_MAX_SUBSESSIONS);
+	char szBuf[64];
+	for(size_t i=0; i<listStreams.size(); i++){
+		StreamMetrics* pStream = listStreams[i];
+		snprintf(szBuf, sizeof(szBuf), "stream=\"%d\"", pStream->m_iStreamId);
+		listStreamLabels[i] = szBuf;
+
+		pthread_mutex_lock(&pStream->m_mutexLabels);
+		for(int j=0; j<METRICS_MAX_SUBSESSIONS; j++){
+			if(!pStream->m_subsessions[j].bUsed.load(std::memory_order_relaxed)){
+				continue;
+			}
+			std::string& szLabels = listSubsessionLabels[i*METRICS_MAX_SUBSESSIONS + j];
+			snprintf(szBuf, sizeof(szBuf), "stream=\"%d\",subsession=\"%d\",medium=\"", pStream->m_iStreamId, j);
+			szLabels = szBuf;
+			metrics_append_label_value(szLabels, pStream->m_szMedium[j]);
+			szLabels += "\",codec=\"";
+			metrics_append_label_value(szLabels, pStream->m_szCodec[j]);
+			szLabels += '"';
+		}
+		pthread_mutex_unlock(&pStream->m_mutexLabels);
+	}
+
+	if(m_admission.bEnabled.load(std::memory_order_relaxed)){
+		metrics_append_header(szOutput, "livemedia_admission_queue_depth", "gauge", "Streams waiting to start their RTSP handshake");
+		metrics_append_sample(szOutput, "livemedia_admission_queue_depth", "", m_admission.iQueueDepth.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_admission_handshakes", "gauge", "RTSP handshakes admitted and in progress");
+		metrics_append_sample(szOutput, "livemedia_admission_handshakes", "", m_admission.iHandshakes.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_admission_admitted_total", "counter", "RTSP handshakes admitted");
+		metrics_append_sample(szOutput, "livemedia_admission_admitted_total", "", (double)m_admission.iAdmitted.load(std::memory_order_relaxed));
+
+		const double dQuantiles[] = { 0.5, 0.99, 1 };
+		metrics_append_header(szOutput, "livemedia_admission_wait_seconds", "summary", "Wait of the streams before their RTSP handshake");
+		for(size_t k=0; k<sizeof(dQuantiles)/sizeof(dQuantiles[0]); k++){
+			snprintf(szBuf, sizeof(szBuf), "quantile=\"%g\"", dQuantiles[k]);
+			metrics_append_sample(szOutput, "livemedia_admission_wait_seconds", szBuf,
+					(double)m_admission.waitTime.getValueAtPercentile(dQuantiles[k] * 100) / 1000000.0);
+		}
+		metrics_append_sample(szOutput, "livemedia_admission_wait_seconds_count", "", (double)m_admission.waitTime.getCount());
+	}
+
+	if(m_gopCache.bEnabled.load(std::memory_order_relaxed)){
+		metrics_append_header(szOutput, "livemedia_gop_cache_budget_bytes", "gauge", "Memory budget of the GOP caches");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_budget_bytes", "", (double)m_gopCache.iBudget.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_gop_cache_bytes", "gauge", "Memory of the frames kept by the GOP caches");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_bytes", "", (double)m_gopCache.iBytes.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_gop_cache_entries", "gauge", "Subsessions having a GOP cache");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_entries", "", (double)m_gopCache.iEntries.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_gop_cache_evictions_total", "counter", "GOP caches evicted to stay in the budget");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_evictions_total", "", (double)m_gopCache.iEvictions.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_gop_cache_attaches_total", "counter", "Consumers attached to a GOP cache");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_attaches_total", "", (double)m_gopCache.iAttaches.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_gop_cache_frames_served_total", "counter", "Cached frames given to the consumers when attaching");
+		metrics_append_sample(szOutput, "livemedia_gop_cache_frames_served_total", "", (double)m_gopCache.iFramesServed.load(std::memory_order_relaxed));
+	}
+
+	if(m_restream.bEnabled.load(std::memory_order_relaxed)){
+		metrics_append_header(szOutput, "livemedia_restream_clients", "gauge", "Clients playing a restreamed subsession");
+		metrics_append_sample(szOutput, "livemedia_restream_clients", "", (double)m_restream.iClients.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_restream_frames_sent_total", "counter", "NAL units sent to the restream clients");
+		metrics_append_sample(szOutput, "livemedia_restream_frames_sent_total", "", (double)m_restream.iFramesSent.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_restream_bytes_sent_total", "counter", "Bytes of the NAL units sent to the restream clients");
+		metrics_append_sample(szOutput, "livemedia_restream_bytes_sent_total", "", (double)m_restream.iBytesSent.load(std::memory_order_relaxed));
+		metrics_append_header(szOutput, "livemedia_restream_frames_dropped_total", "counter", "Frames dropped for the restream clients too slow");
+		metrics_append_sample(szOutput, "livemedia_restream_frames_dropped_total", "", (double)m_restream.iFramesDropped.load(std::memory_order_relaxed));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_info", "gauge", "Stream URL and state");
+	for(size_t i=0; i<listStreams.size(); i++){
+		std::string szLabels = listStreamLabels[i] + ",url=\"";
+		metrics_append_label_value(szLabels, listStreams[i]->m_szURL);
+		szLabels += "\",state=\"";
+		szLabels += listStreams[i]->m_szState.load(std::memory_order_relaxed);
+		szLabels += '"';
+		metrics_append_sample(szOutput, "livemedia_stream_info", szLabels, 1);
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_reconnects_total", "counter", "Connection attempts after the first one");
+	for(size_t i=0; i<listStreams.size(); i++){
+		int iAttempts = listStreams[i]->m_iAttempts.load(std::memory_order_relaxed);
+		metrics_append_sample(szOutput, "livemedia_stream_reconnects_total", listStreamLabels[i], (iAttempts > 1 ? iAttempts - 1 : 0));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_keepalives_total", "counter", "RTSP requests sent to keep the session alive");
+	for(size_t i=0; i<listStreams.size(); i++){
+		metrics_append_sample(szOutput, "livemedia_stream_keepalives_total", listStreamLabels[i],
+				(double)listStreams[i]->m_iKeepalivesSent.load(std::memory_order_relaxed));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_keepalives_skipped_total", "counter", "Keepalives not sent, the session being kept alive by RTCP");
+	for(size_t i=0; i<listStreams.size(); i++){
+		metrics_append_sample(szOutput, "livemedia_stream_keepalives_skipped_total", listStreamLabels[i],
+				(double)listStreams[i]->m_iKeepalivesSkipped.load(std::memory_order_relaxed));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_bitrate_bytes_per_second", "gauge", "Received bytes per second, smoothed");
+	for(size_t i=0; i<listStreams.size(); i++){
+		metrics_append_sample(szOutput, "livemedia_stream_bitrate_bytes_per_second", listStreamLabels[i],
+				(double)listStreams[i]->m_iByteRate.load(std::memory_order_relaxed));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_frame_rate", "gauge", "Received frames per second, smoothed");
+	for(size_t i=0; i<listStreams.size(); i++){
+		metrics_append_sample(szOutput, "livemedia_stream_frame_rate", listStreamLabels[i],
+				(double)listStreams[i]->m_iFrameRate.load(std::memory_order_relaxed));
+	}
+
+	metrics_append_header(szOutput, "livemedia_stream_handshake_phase_seconds", "gauge", "Duration of the last RTSP handshake phases");
+	for(size_t i=0; i<listStreams.size(); i++){
+		for(int j=0; j<METRICS_PHASE_COUNT; j++){
+			int64_t iDurationUs = listStreams[i]->m_iPhaseDurationUs[j].load(std::memory_order_relaxed);
+			if(iDurationUs >= 0){
+				std::string szLabels = listStreamLabels[i] + ",phase=\"" + g_szPhaseNames[j] + "\"";
+				metrics_append_sample(szOutput, "livemedia_stream_handshake_phase_seconds", szLabels, (double)iDurationUs / 1000000.0);
+			}
+		}
+	}
+
+	// Per subsession metrics
+	const char* szSubsessionNames[] = {
+		"livemedia_subsession_frames_total",
+		"livemedia_subsession_bytes_total",
+		"livemedia_subsession_truncated_frames_total",
+		"livemedia_subsession_seconds_since_last_frame",
+		"livemedia_subsession_rtcp_synchronized",
+		"livemedia_subsession_packets_received_total",
+		"livemedia_subsession_packets_lost_total",
+		"livemedia_subsession_jitter_seconds",
+		"livemedia_subsession_key_frames_total",
+		"livemedia_subsession_gop_length_pictures",
+		"livemedia_subsession_picture_rate",
+		"livemedia_subsession_video_width",
+		"livemedia_subsession_video_height",
+		"livemedia_subsession_receive_buffer_bytes",
+		"livemedia_subsession_receive_buffer_adjustments_total",
+		"livemedia_subsession_socket_drops_total",
+		"livemedia_subsession_reorder_threshold_seconds",
+		"livemedia_subsession_reordered_packets_total",
+		"livemedia_subsession_reorder_given_up_packets_total",
+	};
+	const char* szSubsessionTypes[] = { "counter", "counter", "counter", "gauge", "gauge", "counter", "counter", "gauge",
+			"counter", "gauge", "gauge", "gauge", "gauge", "gauge", "counter", "counter", "gauge", "counter", "counter" };
+	const char* szSubsessionHelps[] = {
+		"Received frames",
+		"Received bytes",
+		"Frames truncated by a too small receive buffer",
+		"Time since the last frame",
+		"Whether the presentation times are synchronized using RTCP",
+		"Received RTP packets, for the current connection",
+		"Lost RTP packets, for the current connection",
+		"RTP interarrival jitter",
+		"Key frames, with --parse-nal or --record",
+		"Pictures of the last GOP",
+		"Pictures per second over the last GOP",
+		"Width of the pictures, from the SPS",
+		"Height of the pictures, from the SPS",
+		"Kernel receive buffer of the RTP socket, with UDP",
+		"Resizes of the receive buffer of the RTP socket",
+		"RTP datagrams dropped by the kernel, the receive buffer being full",
+		"Time a missing RTP packet is waited for by the reordering buffer",
+		"RTP packets arrived out of order in time, with UDP",
+		"RTP packets given up on by the reordering buffer, lost or arrived too late, with UDP",
+	};
+	for(size_t iMetric=0; iMetric<sizeof(szSubsessionNames)/sizeof(szSubsessionNames[0]); iMetric++){
+		metrics_append_header(szOutput, szSubsessionNames[iMetric], szSubsessionTypes[iMetric], szSubsessionHelps[iMetric]);
+		for(size_t i=0; i<listStreams.size(); i++){
+			for(int j=0; j<METRICS_MAX_SUBSESSIONS; j++){
+				const std::string& szLabels = listSubsessionLabels[i*METRICS_MAX_SUBSESSIONS + j];
+				if(szLabels.empty()){
+					continue;
+				}
+				SubsessionMetrics& subsession = listStreams[i]->m_subsessions[j];
+				double dValue = 0;
+				switch(iMetric){
+				case 0: dValue = (double)subsession.iFrames.load(std::memory_order_relaxed); break;
+				case 1: dValue = (double)subsession.iBytes.load(std::memory_order_relaxed); break;
+				case 2: dValue = (double)subsession.iTruncatedFrames.load(std::memory_order_relaxed); break;
+				case 3: {
+					int64_t iLastFrameTimeUs = subsession.iLastFrameTimeUs.load(std::memory_order_relaxed);
+					if(iLastFrameTimeUs == 0){
+						continue; // No frame yet
+					}
+					dValue = (double)(iNowUs - iLastFrameTimeUs) / 1000000.0;
+					break;
+				}
+				case 4: dValue = (subsession.bRTCPSync.load(std::memory_order_relaxed) ? 1 : 0); break;
+				case 5: dValue = (double)subsession.iPacketsReceived.load(std::memory_order_relaxed); break;
+				case 6: dValue = (double)subsession.iPacketsLost.load(std::memory_order_relaxed); break;
+				case 7: dValue = (double)subsession.iJitterUs.load(std::memory_order_relaxed) / 1000000.0; break;
+				case 8: dValue = (double)subsession.iKeyFrames.load(std::memory_order_relaxed); break;
+				case 14: dValue = (double)subsession.iReceiveBufferAdjustments.load(std::memory_order_relaxed); break;
+				case 15: dValue = (double)subsession.iSocketDrops.load(std::memory_order_relaxed); break;
+				case 17: dValue = (double)subsession.iReorderedPackets.load(std::memory_order_relaxed); break;
+				case 18: dValue = (double)subsession.iReorderGivenUp.load(std::memory_order_relaxed); break;
+				default: {
+					// Only known for the parsed video subsessions, the UDP ones for the buffer, and the RTP ones for the threshold
+					int64_t iValue = 0;
+					switch(iMetric){
+					case 9: iValue = subsession.iGopLength.load(std::memory_order_relaxed); break;
+					case 10: iValue = subsession.iPictureRateMilli.load(std::memory_order_relaxed); break;
+					case 11: iValue = subsession.iWidth.load(std::memory_order_relaxed); break;
+					case 12: iValue = subsession.iHeight.load(std::memory_order_relaxed); break;
+					case 13: iValue = (int64_t)subsession.iReceiveBufferSize.load(std::memory_order_relaxed); break;
+					case 16: iValue = (int64_t)subsession.iReorderThresholdUs.load(std::memory_order_relaxed); break;
+					}
+					if(iValue == 0){
+						continue;
+					}
+					if(iMetric == 10){
+						dValue = (double)iValue / 1000.0;
+					}else if(iMetric == 16){
+						dValue = (double)iValue / 1000000.0;
+					}else{
+						dValue = (double)iValue;
+					}
+					break;
+				}
+				}
+				metrics_append_sample(szOutput, szSubsessionNames[iMetric], szLabels, dValue);
+			}
+		}
+	}
+
+	// Histograms, as summaries
+	const char* szHistogramNames[] = { "livemedia_subsession_frame_interval_seconds", "livemedia_subsession_latency_seconds" };
+	const char* szHistogramHelps[] = {
+		"Delta of the presentation times of the successive frames",
+		"Arrival time minus presentation time, once synchronized using RTCP",
+	};
+	const double dQuantiles[] = { 0.5, 0.99, 0.999, 1 };
+	for(int iHistogram=0; iHistogram<2; iHistogram++){
+		const char* szName = szHistogramNames[iHistogram];
+		std::string szCountName = std::string(szName) + "_count";
+		metrics_append_header(szOutput, szName, "summary", szHistogramHelps[iHistogram]);
+		for(size_t i=0; i<listStreams.size(); i++){
+			for(int j=0; j<METRICS_MAX_SUBSESSIONS; j++){
+				const std::string& szLabels = listSubsessionLabels[i*METRICS_MAX_SUBSESSIONS + j];
+				if(szLabels.empty()){
+					continue;
+				}
+				SubsessionMetrics& subsession = listStreams[i]->m_subsessions[j];
+				Histogram* pHistogram = (iHistogram == 0 ? subsession.pFrameInterval : subsession.pLatency);
+				if(!pHistogram || pHistogram->getCount() == 0){
+					continue;
+				}
+				for(size_t k=0; k<sizeof(dQuantiles)/sizeof(dQuantiles[0]); k++){
+					snprintf(szBuf, sizeof(szBuf), ",quantile=\"%g\"", dQuantiles[k]);
+					metrics_append_sample(szOutput, szName, szLabels + szBuf,
+							(double)pHistogram->getValueAtPercentile(dQuantiles[k] * 100) / 1000000.0);
+				}
+				metrics_append_sample(szOutput, szCountName.c_str(), szLabels, (double)pHistogram->getCount());
+			}
+		}
+	}
+}
+
+//////////////////////////////////
+// MetricsHttpServer definition
+//////////////////////////////////
+
+MetricsHttpServer* MetricsHttpServer::createNew(TaskScheduler& scheduler, int iPort)
+{
+	int iListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(iListenFd < 0){
+		return NULL;
+	}
+	int iReuse = 1;
+	setsockopt(iListenFd, SOL_SOCKET, SO_REUSEADDR, &iReuse, sizeof(iReuse));
+
+	// Local only, the metrics are not meant to be exposed
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(iPort);
+	if(bind(iListenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(iListenFd, METRICS_HTTP_MAX_CLIENTS) != 0){
+		close(iListenFd);
+		return NULL;
+	}
+
+	return new MetricsHttpServer(scheduler, iListenFd);
+}
+
+MetricsHttpServer::MetricsHttpServer(TaskScheduler& scheduler, int iListenFd)
+	: m_scheduler(scheduler)
+{
+	m_iListenFd = iListenFd;
+	m_scheduler.turnOnBackgroundReadHandling(m_iListenFd, incomingConnectionHandler, this);
+}
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+	while(!m_listClients.empty()){
+		closeClient(m_listClients.back());
+	}
+	if(m_iListenFd >= 0){
+		m_scheduler.turnOffBackgroundReadHandling(m_iListenFd);
+		close(m_iListenFd);
+		m_iListenFd = -1;
+	}
+}
+
+void MetricsHttpServer::incomingConnectionHandler(void* clientData, int /*mask*/)
+{
+	((MetricsHttpServer*)clientData)->acceptClients();
+}
+
+void MetricsHttpServer::clientReadHandler(void* clientData, int /*mask*/)
+{
+	Client* pClient = (Client*)clientData;
+	pClient->pServer->readRequest(pClient);
+}
+
+void MetricsHttpServer::clientWriteHandler(void* clientData, int /*mask*/)
+{
+	Client* pClient = (Client*)clientData;
+	pClient->pServer->writeResponse(pClient);
+}
+
+void MetricsHttpServer::acceptClients()
+{
+	while(true){
+		int fd = accept4(m_iListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0){
+			return;
+		}
+		if(m_listClients.size() >= METRICS_HTTP_MAX_CLIENTS){
+			close(fd);
+			continue;
+		}
+		Client* pClient = new Client();
+		pClient->pServer = this;
+		pClient->fd = fd;
+		pClient->iRequestLength = 0;
+		pClient->iSent = 0;
+		m_listClients.push_back(pClient);
+		m_scheduler.setBackgroundHandling(fd, SOCKET_READABLE, clientReadHandler, pClient);
+	}
+}
+
+void MetricsHttpServer::readRequest(Client* pClient)
+{
+	ssize_t iRes = recv(pClient->fd, pClient->szRequest + pClient->iRequestLength,
+			sizeof(pClient->szRequest) - 1 - pClient->iRequestLength, 0);
+	if(iRes == 0 || (iRes < 0 && errno != EAGAIN && errno != EINTR)){
+		closeClient(pClient);
+		return;
+	}
+	if(iRes < 0){
+		return;
+	}
+	pClient->iRequestLength += iRes;
+	pClient->szRequest[pClient->iRequestLength] = '\0';
+
+	// Wait for the end of the headers
+	if(!strstr(pClient->szRequest, "\r\n\r\n") && !strstr(pClient->szRequest, "\n\n")){
+		if(pClient->iRequestLength >= sizeof(pClient->szRequest) - 1){
+			closeClient(pClient);
+		}
+		return;
+	}
+
+	std::string szBody;
+	const char* szStatus = "200 OK";
+	if(strncmp(pClient->szRequest, "GET /metrics ", 13) == 0 || strncmp(pClient->szRequest, "GET /metrics?", 13) == 0){
+		MetricsRegistry::getInstance()->render(szBody);
+	}else{
+		szStatus = "404 Not Found";
+		szBody = "Not found\n";
+	}
+
+	char szHeader[256];
+	snprintf(szHeader, sizeof(szHeader),
+			"HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+			szStatus, (int)szBody.size());
+	pClient->szResponse = szHeader;
+	pClient->szResponse += szBody;
+	pClient->iSent = 0;
+	m_scheduler.setBackgroundHandling(pClient->fd, SOCKET_WRITABLE, clientWriteHandler, pClient);
+	writeResponse(pClient);
+}
+
+void MetricsHttpServer::writeResponse(Client* pClient)
+{
+	while(pClient->iSent < pClient->szResponse.size()){
+		ssize_t iRes = send(pClient->fd, pClient->szResponse.data() + pClient->iSent,
+				pClient->szResponse.size() - pClient->iSent, MSG_NOSIGNAL);
+		if(iRes < 0){
+			if(errno == EAGAIN || errno == EINTR){
+				return; // Called again when the socket is writable
+			}
+			break;
+		}
+		pClient->iSent += iRes;
+	}
+	closeClient(pClient);
+}
+
+void MetricsHttpServer::closeClient(Client* pClient)
+{
+	m_scheduler.disableBackgroundHandling(pClient->fd);
+	close(pClient->fd);
+	for(size_t i=0; i<m_listClients.size(); i++){
+		if(m_listClients[i] == pClient){
+			m_listClients.erase(m_listClients.begin() + i);
+			break;
+		}
+	}
+	delete pClient;
+}
@@ -0,0 +1,222 @@
+/*
+ * Metrics.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <UsageEnvironment.hh>
+
+#include "Histogram.h"
+
+#define METRICS_MAX_SUBSESSIONS 8
+#define METRICS_LABEL_SIZE 32
+#define METRICS_HTTP_MAX_CLIENTS 16
+#define METRICS_HTTP_REQUEST_SIZE 2048
+
+//////////////////////////////////
+// Metrics declaration
+//////////////////////////////////
+
+// Handshake phases whose last duration is kept
+enum MetricsPhase
+{
+	METRICS_PHASE_OPTIONS = 0,
+	METRICS_PHASE_DESCRIBE,
+	METRICS_PHASE_SETUP,
+	METRICS_PHASE_PLAY,
+	METRICS_PHASE_HANDSHAKE, // From the first request to the PLAY response
+	METRICS_PHASE_FIRST_FRAME, // From the first request to the first frame
+	METRICS_PHASE_ADMISSION, // Wait for the admission controller, before the first request
+	METRICS_PHASE_COUNT,
+};
+
+// Updated by the event loop of the stream with relaxed atomics, read by the
+// scrape from any thread. The counters are kept across the reconnections.
+struct SubsessionMetrics
+{
+	std::atomic<bool> bUsed;
+	std::atomic<uint64_t> iFrames;
+	std::atomic<uint64_t> iBytes;
+	std::atomic<uint64_t> iTruncatedFrames;
+	std::atomic<int64_t> iLastFrameTimeUs; // Wall clock
+	std::atomic<bool> bRTCPSync;
+
+	// Of the H264/H265 subsessions whose NAL units are parsed
+	std::atomic<uint64_t> iKeyFrames;
+	std::atomic<int> iGopLength; // In pictures, 0 if unknown
+	std::atomic<int64_t> iPictureRateMilli; // Pictures per 1000 seconds
+	std::atomic<int> iWidth;
+	std::atomic<int> iHeight;
+
+	// Copied from the RTPReceptionStatsDB by the event loop of the stream
+	std::atomic<uint64_t> iPacketsReceived;
+	std::atomic<uint64_t> iPacketsLost;
+	std::atomic<uint64_t> iJitterUs;
+
+	// Socket of the UDP subsessions, sized by the ReceiveBufferTuner
+	std::atomic<uint64_t> iReceiveBufferSize; // 0 with TCP
+	std::atomic<uint64_t> iReceiveBufferAdjustments;
+	std::atomic<uint64_t> iSocketDrops; // Datagrams dropped by the kernel
+
+	// Reordering buffer of live555, adjusted by the ReorderWindow with UDP
+	std::atomic<uint64_t> iReorderThresholdUs;
+	std::atomic<uint64_t> iReorderedPackets; // Arrived out of order, in time
+	std::atomic<uint64_t> iReorderGivenUp; // Lost, or arrived too late
+
+	// In microseconds, allocated with the labels of the subsession
+	Histogram* pFrameInterval; // Delta of the presentation times
+	Histogram* pLatency; // Arrival time minus presentation time, once synchronized using RTCP
+};
+
+class StreamMetrics
+{
+public:
+	StreamMetrics(int iStreamId, const char* szURL);
+	~StreamMetrics();
+
+	// Rarely called, the labels are protected by a mutex
+	void setSubsession(int iSubsessionId, const char* szMedium, const char* szCodec);
+
+	SubsessionMetrics* getSubsession(int iSubsessionId);
+	// Returns false if the subsession has never been set up
+	bool getSubsessionName(int iSubsessionId, char* szName, size_t iSize);
+
+	void setState(const char* szState);
+	void setPhaseDuration(MetricsPhase phase, int64_t iDurationUs);
+
+	uint64_t getTotalFrames() const;
+	uint64_t getTotalBytes() const;
+	uint64_t getTotalTruncatedFrames() const;
+
+	void render(std::string& szOutput, int64_t iNowUs);
+
+public:
+	int m_iStreamId;
+	char* m_szURL; // Without the credentials
+
+	std::atomic<const char*> m_szState; // Static string
+	std::atomic<int> m_iAttempts;
+	std::atomic<uint64_t> m_iByteRate;
+	std::atomic<uint64_t> m_iFrameRate;
+	std::atomic<int64_t> m_iPhaseDurationUs[METRICS_PHASE_COUNT];
+	std::atomic<uint64_t> m_iKeepalivesSent;
+	std::atomic<uint64_t> m_iKeepalivesSkipped; // The session being kept alive by RTCP
+
+	SubsessionMetrics m_subsessions[METRICS_MAX_SUBSESSIONS];
+
+private:
+	friend class MetricsRegistry;
+	pthread_mutex_t m_mutexLabels;
+	char m_szMedium[METRICS_MAX_SUBSESSIONS][METRICS_LABEL_SIZE];
+	char m_szCodec[METRICS_MAX_SUBSESSIONS][METRICS_LABEL_SIZE];
+};
+
+// Admission controller of the new RTSP sessions, updated under its mutex
+struct AdmissionMetrics
+{
+	std::atomic<bool> bEnabled;
+	std::atomic<int> iQueueDepth;
+	std::atomic<int> iHandshakes; // Admitted, not yet playing
+	std::atomic<uint64_t> iAdmitted;
+	Histogram waitTime; // In microseconds
+};
+
+// GOP caches of the subsessions, updated under the mutex of the GopCache
+struct GopCacheMetrics
+{
+	std::atomic<bool> bEnabled;
+	std::atomic<uint64_t> iBudget;
+	std::atomic<uint64_t> iBytes;
+	std::atomic<uint64_t> iEntries;
+	std::atomic<uint64_t> iEvictions;
+	std::atomic<uint64_t> iAttaches;
+	std::atomic<uint64_t> iFramesServed;
+};
+
+// RTSP server restreaming the subsessions, updated by its event loop
+struct RestreamMetrics
+{
+	std::atomic<bool> bEnabled;
+	std::atomic<uint64_t> iClients;
+	std::atomic<uint64_t> iFramesSent;
+	std::atomic<uint64_t> iBytesSent;
+	std::atomic<uint64_t> iFramesDropped;
+};
+
+// All the streams of the process. A stream metrics is never freed before the
+// registry, so a scrape can read it while the stream is being closed.
+class MetricsRegistry
+{
+public:
+	static MetricsRegistry* getInstance();
+
+	StreamMetrics* createStream(int iStreamId, const char* szURL);
+
+	// Prometheus text format 0.0.4, as served with "Content-Type: text/plain; version=0.0.4"
+	void render(std::string& szOutput);
+
+public:
+	AdmissionMetrics m_admission;
+	GopCacheMetrics m_gopCache;
+	RestreamMetrics m_restream;
+
+private:
+	MetricsRegistry();
+	~MetricsRegistry();
+
+private:
+	pthread_mutex_t m_mutexStreams;
+	std::vector<StreamMetrics*> m_listStreams;
+};
+
+//////////////////////////////////
+// MetricsHttpServer declaration
+//////////////////////////////////
+
+// Minimal HTTP server answering GET /metrics, run by the TaskScheduler of an
+// event loop: the sockets are non blocking, so a slow client never blocks it.
+class MetricsHttpServer
+{
+public:
+	static MetricsHttpServer* createNew(TaskScheduler& scheduler, int iPort);
+	virtual ~MetricsHttpServer();
+
+private:
+	MetricsHttpServer(TaskScheduler& scheduler, int iListenFd);
+
+	struct Client
+	{
+		MetricsHttpServer* pServer;
+		int fd;
+		char szRequest[METRICS_HTTP_REQUEST_SIZE];
+		size_t iRequestLength;
+		std::string szResponse;
+		size_t iSent;
+	};
+
+	static void incomingConnectionHandler(void* clientData, int mask);
+	static void clientReadHandler(void* clientData, int mask);
+	static void clientWriteHandler(void* clientData, int mask);
+
+	void acceptClients();
+	void readRequest(Client* pClient);
+	void writeResponse(Client* pClient);
+	void closeClient(Client* pClient);
+
+private:
+	TaskScheduler& m_scheduler;
+	int m_iListenFd;
+	std::vector<Client*> m_listClients;
+};
+
+#endif /* METRICS_H_ */
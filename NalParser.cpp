@@ -0,0 +1,577 @@
+/*
+ * NalParser.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NAL_PARSER_X86
+#endif
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NAL_PARSER_NEON
+#endif
+
+#include "NalParser.h"
+
+/////////////////////////////////
+// NAL scanning functions
+/////////////////////////////////
+
+// All the searches look for 00 00 followed by a given byte
+typedef const uint8_t* (NalFindFunc)(const uint8_t* pData, const uint8_t* pEnd, uint8_t iThirdByte);
+
+static const uint8_t* nal_find_scalar(const uint8_t* pData, const uint8_t* pEnd, uint8_t iThirdByte)
+{
+	for(const uint8_t* p = pData; p + 3 <= pEnd; p++){
+		if(p[0] == 0 && p[1] == 0 && p[2] == iThirdByte){
+			return p;
+		}
+	}
+	return pEnd;
+}
+
+// Each block compares three overlapping loads, so a sequence crossing two blocks is found too
+
+#if defined(NAL_PARSER_X86) && defined(__SSE2__)
+static const uint8_t* nal_find_sse2(const uint8_t* pData, const uint8_t* pEnd, uint8_t iThirdByte)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i third = _mm_set1_epi8((char)iThirdByte);
+	const uint8_t* p = pData;
+	while(pEnd - p >= 16 + 2){
+		__m128i v0 = _mm_loadu_si128((const __m128i*)p);
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(p + 1));
+		__m128i v2 = _mm_loadu_si128((const __m128i*)(p + 2));
+		__m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(v0, zero), _mm_cmpeq_epi8(v1, zero)), _mm_cmpeq_epi8(v2, third));
+		unsigned iMask = (unsigned)_mm_movemask_epi8(match);
+		if(iMask){
+			return p + __builtin_ctz(iMask);
+		}
+		p += 16;
+	}
+	return nal_find_scalar(p, pEnd, iThirdByte);
+}
+#endif
+
+#if defined(NAL_PARSER_X86)
+__attribute__((target("avx2")))
+static const uint8_t* nal_find_avx2(const uint8_t* pData, const uint8_t* pEnd, uint8_t iThirdByte)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i third = _mm256_set1_epi8((char)iThirdByte);
+	const uint8_t* p = pData;
+	while(pEnd - p >= 32 + 2){
+		__m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+		__m256i v1 = _mm256_loadu_si256((const __m256i*)(p + 1));
+		__m256i v2 = _mm256_loadu_si256((const __m256i*)(p + 2));
+		__m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v0, zero), _mm256_cmpeq_epi8(v1, zero)), _mm256_cmpeq_epi8(v2, third));
+		unsigned iMask = (unsigned)_mm256_movemask_epi8(match);
+		if(iMask){
+			return p + __builtin_ctz(iMask);
+		}
+		p += 32;
+	}
+	return nal_find_scalar(p, pEnd, iThirdByte);
+}
+#endif
+
+#if defined(NAL_PARSER_NEON)
+static const uint8_t* nal_find_neon(const uint8_t* pData, const uint8_t* pEnd, uint8_t iThirdByte)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t third = vdupq_n_u8(iThirdByte);
+	const uint8_t* p = pData;
+	while(pEnd - p >= 16 + 2){
+		uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(p), zero), vceqq_u8(vld1q_u8(p + 1), zero)), vceqq_u8(vld1q_u8(p + 2), third));
+		// No movemask on NEON: narrowing gives 4 bits per byte
+		uint64_t iMask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+		if(iMask){
+			return p + (__builtin_ctzll(iMask) >> 2);
+		}
+		p += 16;
+	}
+	return nal_find_scalar(p, pEnd, iThirdByte);
+}
+#endif
+
+struct NalFindImpl
+{
+	NalFindFunc* pFunc;
+	const char* szName;
+};
+
+static NalFindImpl nal_select_find()
+{
+	NalFindImpl impl = { nal_find_scalar, "scalar" };
+#if defined(NAL_PARSER_X86)
+	// May run before the constructors of libgcc
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		impl.pFunc = nal_find_avx2;
+		impl.szName = "avx2";
+		return impl;
+	}
+#if defined(__SSE2__)
+	impl.pFunc = nal_find_sse2;
+	impl.szName = "sse2";
+#endif
+#elif defined(NAL_PARSER_NEON)
+	impl.pFunc = nal_find_neon;
+	impl.szName = "neon";
+#endif
+	return impl;
+}
+
+static const NalFindImpl g_nalFind = nal_select_find();
+
+const uint8_t* nal_find_start_code(const uint8_t* pData, const uint8_t* pEnd)
+{
+	return g_nalFind.pFunc(pData, pEnd, 1);
+}
+
+const uint8_t* nal_find_emulation_prevention(const uint8_t* pData, const uint8_t* pEnd)
+{
+	return g_nalFind.pFunc(pData, pEnd, 3);
+}
+
+const uint8_t* nal_find_start_code_scalar(const uint8_t* pData, const uint8_t* pEnd)
+{
+	return nal_find_scalar(pData, pEnd, 1);
+}
+
+const uint8_t* nal_find_emulation_prevention_scalar(const uint8_t* pData, const uint8_t* pEnd)
+{
+	return nal_find_scalar(pData, pEnd, 3);
+}
+
+const char* nal_get_simd_name()
+{
+	return g_nalFind.szName;
+}
+
+size_t nal_unescape(const uint8_t* pData, size_t iSize, uint8_t* pOut)
+{
+	const uint8_t* pEnd = pData + iSize;
+	const uint8_t* pRun = pData;
+	uint8_t* pDst = pOut;
+	for(;;){
+		const uint8_t* p = nal_find_emulation_prevention(pRun, pEnd);
+		if(p == pEnd){
+			break;
+		}
+		// Keep the two zeros, drop the 03
+		size_t iRunSize = (p + 2) - pRun;
+		memmove(pDst, pRun, iRunSize);
+		pDst += iRunSize;
+		pRun = p + 3;
+	}
+	size_t iRunSize = pEnd - pRun;
+	memmove(pDst, pRun, iRunSize);
+	pDst += iRunSize;
+	return pDst - pOut;
+}
+
+/////////////////////////////////
+// Bit reader of the RBSP
+/////////////////////////////////
+
+struct NalBitReader
+{
+	const uint8_t* pData;
+	size_t iSize;
+	size_t iBit;
+	bool bError;
+};
+
+static uint32_t nal_read_bits(NalBitReader& reader, int iCount)
+{
+	uint32_t iValue = 0;
+	for(int i=0; i<iCount; i++){
+		if(reader.iBit >= reader.iSize * 8){
+			reader.bError = true;
+			return 0;
+		}
+		iValue = (iValue << 1) | ((reader.pData[reader.iBit >> 3] >> (7 - (reader.iBit & 7))) & 1);
+		reader.iBit++;
+	}
+	return iValue;
+}
+
+static void nal_skip_bits(NalBitReader& reader, size_t iCount)
+{
+	reader.iBit += iCount;
+	if(reader.iBit > reader.iSize * 8){
+		reader.bError = true;
+	}
+}
+
+// Exp-Golomb codes
+static uint32_t nal_read_ue(NalBitReader& reader)
+{
+	int iLeadingZeros = 0;
+	while(nal_read_bits(reader, 1) == 0){
+		if(reader.bError || ++iLeadingZeros > 31){
+			reader.bError = true;
+			return 0;
+		}
+	}
+	return ((1u << iLeadingZeros) - 1) + nal_read_bits(reader, iLeadingZeros);
+}
+
+static int32_t nal_read_se(NalBitReader& reader)
+{
+	uint32_t iValue = nal_read_ue(reader);
+	return ((iValue & 1) ? (int32_t)((iValue + 1) / 2) : -(int32_t)(iValue / 2));
+}
+
+//////////////////////////////////
+// NalParser definition
+//////////////////////////////////
+
+NalParser::NalParser(NalCodec codec)
+{
+	m_codec = codec;
+	m_pFrameData = NULL;
+	m_iPictureCount = 0;
+	m_iKeyFrameCount = 0;
+	m_iGopLength = 0;
+	m_dFps = 0;
+	m_dReportedFps = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+	memset(m_keyFrames, 0, sizeof(m_keyFrames));
+	m_iKeyFrameIndex = 0;
+}
+
+bool NalParser::getCodec(const char* szCodecName, NalCodec* pCodec)
+{
+	if(strcmp(szCodecName, "H264") == 0){
+		*pCodec = NAL_CODEC_H264;
+		return true;
+	}
+	if(strcmp(szCodecName, "H265") == 0){
+		*pCodec = NAL_CODEC_H265;
+		return true;
+	}
+	return false;
+}
+
+void NalParser::parseFrame(const uint8_t* pData, size_t iSize, int64_t iPresentationTimeUs, NalFrameInfo& info)
+{
+	info.iFlags = 0;
+	info.iUnitCount = 0;
+	m_pFrameData = pData;
+
+	bool bAnnexB = (iSize >= 4 && pData[0] == 0 && pData[1] == 0 && (pData[2] == 1 || (pData[2] == 0 && pData[3] == 1)));
+	if(!bAnnexB){
+		classifyUnit(pData, iSize, info);
+	}else{
+		info.iFlags |= NAL_FRAME_ANNEX_B;
+		const uint8_t* pEnd = pData + iSize;
+		const uint8_t* pStartCode = nal_find_start_code(pData, pEnd);
+		while(pStartCode < pEnd){
+			const uint8_t* pUnit = pStartCode + 3;
+			const uint8_t* pNextStartCode = nal_find_start_code(pUnit, pEnd);
+			// The first zero of a 4 bytes start code, and the trailing zeros, are not part of the unit
+			const uint8_t* pUnitEnd = pNextStartCode;
+			while(pUnitEnd > pUnit && pUnitEnd[-1] == 0){
+				pUnitEnd--;
+			}
+			if(pUnitEnd > pUnit){
+				classifyUnit(pUnit, pUnitEnd - pUnit, info);
+			}
+			pStartCode = pNextStartCode;
+		}
+	}
+
+	if(info.iFlags & NAL_FRAME_NEW_PICTURE){
+		newPicture((info.iFlags & NAL_FRAME_KEY_FRAME) != 0, iPresentationTimeUs, info);
+	}
+}
+
+void NalParser::classifyUnit(const uint8_t* pData, size_t iSize, NalFrameInfo& info)
+{
+	int iType;
+	NalUnitClass unitClass = NAL_UNIT_OTHER;
+	bool bFirstSlice = false;
+
+	if(m_codec == NAL_CODEC_H264){
+		iType = pData[0] & 0x1F;
+		if(iType >= 1 && iType <= 5){
+			unitClass = (iType == 5 ? NAL_UNIT_IDR : NAL_UNIT_SLICE);
+			// first_mb_in_slice is 0, its Exp-Golomb code is a single 1
+			bFirstSlice = (iSize > 1 && (pData[1] & 0x80));
+		}else if(iType == 6){
+			unitClass = NAL_UNIT_SEI;
+		}else if(iType == 7){
+			unitClass = NAL_UNIT_SPS;
+		}else if(iType == 8){
+			unitClass = NAL_UNIT_PPS;
+		}else if(iType == 9){
+			unitClass = NAL_UNIT_AUD;
+		}
+	}else{
+		iType = (pData[0] >> 1) & 0x3F;
+		if(iType <= 9 || (iType >= 16 && iType <= 21)){
+			unitClass = (iType >= 16 ? NAL_UNIT_IDR : NAL_UNIT_SLICE);
+			// first_slice_segment_in_pic_flag, after the 2 bytes header
+			bFirstSlice = (iSize > 2 && (pData[2] & 0x80));
+		}else if(iType == 32){
+			unitClass = NAL_UNIT_VPS;
+		}else if(iType == 33){
+			unitClass = NAL_UNIT_SPS;
+		}else if(iType == 34){
+			unitClass = NAL_UNIT_PPS;
+		}else if(iType == 35){
+			unitClass = NAL_UNIT_AUD;
+		}else if(iType == 39 || iType == 40){
+			unitClass = NAL_UNIT_SEI;
+		}
+	}
+
+	switch(unitClass){
+	case NAL_UNIT_SLICE:
+	case NAL_UNIT_IDR:
+		info.iFlags |= NAL_FRAME_SLICE;
+		if(bFirstSlice){
+			info.iFlags |= NAL_FRAME_NEW_PICTURE;
+			if(unitClass == NAL_UNIT_IDR){
+				info.iFlags |= NAL_FRAME_KEY_FRAME;
+			}
+		}
+		break;
+	case NAL_UNIT_SPS: {
+		info.iFlags |= NAL_FRAME_PARAMETER_SETS;
+		int iWidth = 0;
+		int iHeight = 0;
+		if(readSps(pData, iSize, &iWidth, &iHeight) && (iWidth != m_iWidth || iHeight != m_iHeight)){
+			m_iWidth = iWidth;
+			m_iHeight = iHeight;
+			info.iFlags |= NAL_FRAME_SIZE_CHANGED;
+		}
+		break;
+	}
+	case NAL_UNIT_PPS:
+	case NAL_UNIT_VPS:
+		info.iFlags |= NAL_FRAME_PARAMETER_SETS;
+		break;
+	case NAL_UNIT_SEI:
+		info.iFlags |= NAL_FRAME_SEI;
+		break;
+	default:
+		break;
+	}
+
+	if(info.iUnitCount < NAL_PARSER_MAX_UNITS){
+		NalUnit& unit = info.units[info.iUnitCount++];
+		unit.iOffset = (uint32_t)(pData - m_pFrameData);
+		unit.iSize = (uint32_t)iSize;
+		unit.iType = (uint8_t)iType;
+		unit.iClass = (uint8_t)unitClass;
+	}
+}
+
+void NalParser::newPicture(bool bKeyFrame, int64_t iPresentationTimeUs, NalFrameInfo& info)
+{
+	uint64_t iPictureNumber = m_iPictureCount++;
+	if(!bKeyFrame){
+		return;
+	}
+
+	if(m_iKeyFrameCount > 0){
+		const NalKeyFrame& lastKeyFrame = m_keyFrames[(m_iKeyFrameIndex + NAL_PARSER_KEY_FRAME_INDEX_SIZE - 1) % NAL_PARSER_KEY_FRAME_INDEX_SIZE];
+		int iGopLength = (int)(iPictureNumber - lastKeyFrame.iPictureNumber);
+		int64_t iDurationUs = iPresentationTimeUs - lastKeyFrame.iPresentationTimeUs;
+		if(iDurationUs > 0){
+			m_dFps = (double)iGopLength * 1000000.0 / (double)iDurationUs;
+		}
+
+		// The small variations of the frame rate are not reported
+		bool bFpsChanged = (m_dFps > 0 && (m_dReportedFps <= 0 || fabs(m_dFps - m_dReportedFps) > m_dReportedFps * NAL_PARSER_FPS_CHANGE_RATIO));
+		if(iGopLength != m_iGopLength || bFpsChanged){
+			m_iGopLength = iGopLength;
+			m_dReportedFps = m_dFps;
+			info.iFlags |= NAL_FRAME_GOP_CHANGED;
+		}
+	}
+
+	NalKeyFrame& keyFrame = m_keyFrames[m_iKeyFrameIndex];
+	keyFrame.iPresentationTimeUs = iPresentationTimeUs;
+	keyFrame.iPictureNumber = iPictureNumber;
+	m_iKeyFrameIndex = (m_iKeyFrameIndex + 1) % NAL_PARSER_KEY_FRAME_INDEX_SIZE;
+	m_iKeyFrameCount++;
+}
+
+void NalParser::getKeyFrames(std::vector<NalKeyFrame>& listKeyFrames) const
+{
+	size_t iCount = (m_iKeyFrameCount < NAL_PARSER_KEY_FRAME_INDEX_SIZE ? (size_t)m_iKeyFrameCount : NAL_PARSER_KEY_FRAME_INDEX_SIZE);
+	listKeyFrames.clear();
+	for(size_t i=0; i<iCount; i++){
+		listKeyFrames.push_back(m_keyFrames[(m_iKeyFrameIndex + NAL_PARSER_KEY_FRAME_INDEX_SIZE - iCount + i) % NAL_PARSER_KEY_FRAME_INDEX_SIZE]);
+	}
+}
+
+bool NalParser::getLastKeyFrame(NalKeyFrame& keyFrame) const
+{
+	if(m_iKeyFrameCount == 0){
+		return false;
+	}
+	keyFrame = m_keyFrames[(m_iKeyFrameIndex + NAL_PARSER_KEY_FRAME_INDEX_SIZE - 1) % NAL_PARSER_KEY_FRAME_INDEX_SIZE];
+	return true;
+}
+
+bool NalParser::readSps(const uint8_t* pData, size_t iSize, int* pWidth, int* pHeight)
+{
+	// The fields read are at the beginning
+	uint8_t rbsp[NAL_PARSER_SPS_MAX_SIZE];
+	size_t iRbspSize = nal_unescape(pData, (iSize < sizeof(rbsp) ? iSize : sizeof(rbsp)), rbsp);
+
+	bool bResult;
+	if(m_codec == NAL_CODEC_H264){
+		bResult = readH264Sps(rbsp, iRbspSize, pWidth, pHeight);
+	}else{
+		bResult = readH265Sps(rbsp, iRbspSize, pWidth, pHeight);
+	}
+	return (bResult && *pWidth > 0 && *pWidth <= 16384 && *pHeight > 0 && *pHeight <= 16384);
+}
+
+bool NalParser::readH264Sps(const uint8_t* pRbsp, size_t iSize, int* pWidth, int* pHeight)
+{
+	NalBitReader reader = { pRbsp, iSize, 8, false }; // After the NAL header
+
+	uint32_t iProfile = nal_read_bits(reader, 8);
+	nal_skip_bits(reader, 16); // Constraint flags, level
+	nal_read_ue(reader); // seq_parameter_set_id
+
+	uint32_t iChromaFormat = 1;
+	bool bSeparateColourPlane = false;
+	if(iProfile == 100 || iProfile == 110 || iProfile == 122 || iProfile == 244 || iProfile == 44 || iProfile == 83 ||
+			iProfile == 86 || iProfile == 118 || iProfile == 128 || iProfile == 138 || iProfile == 139 || iProfile == 134 || iProfile == 135)
+	{
+		iChromaFormat = nal_read_ue(reader);
+		if(iChromaFormat == 3){
+			bSeparateColourPlane = nal_read_bits(reader, 1);
+		}
+		nal_read_ue(reader); // bit_depth_luma_minus8
+		nal_read_ue(reader); // bit_depth_chroma_minus8
+		nal_skip_bits(reader, 1); // qpprime_y_zero_transform_bypass_flag
+		if(nal_read_bits(reader, 1)){ // seq_scaling_matrix_present_flag
+			int iListCount = (iChromaFormat != 3 ? 8 : 12);
+			for(int i=0; i<iListCount && !reader.bError; i++){
+				if(!nal_read_bits(reader, 1)){
+					continue;
+				}
+				int iListSize = (i < 6 ? 16 : 64);
+				int iLastScale = 8;
+				int iNextScale = 8;
+				for(int j=0; j<iListSize && !reader.bError; j++){
+					if(iNextScale != 0){
+						iNextScale = (iLastScale + nal_read_se(reader) + 256) % 256;
+					}
+					iLastScale = (iNextScale == 0 ? iLastScale : iNextScale);
+				}
+			}
+		}
+	}
+
+	nal_read_ue(reader); // log2_max_frame_num_minus4
+	uint32_t iPocType = nal_read_ue(reader);
+	if(iPocType == 0){
+		nal_read_ue(reader); // log2_max_pic_order_cnt_lsb_minus4
+	}else if(iPocType == 1){
+		nal_skip_bits(reader, 1);
+		nal_read_se(reader);
+		nal_read_se(reader);
+		uint32_t iCycleLength = nal_read_ue(reader);
+		if(iCycleLength > 255){
+			return false;
+		}
+		for(uint32_t i=0; i<iCycleLength && !reader.bError; i++){
+			nal_read_se(reader);
+		}
+	}
+	nal_read_ue(reader); // max_num_ref_frames
+	nal_skip_bits(reader, 1); // gaps_in_frame_num_value_allowed_flag
+	uint32_t iWidthInMbs = nal_read_ue(reader) + 1;
+	uint32_t iHeightInMapUnits = nal_read_ue(reader) + 1;
+	uint32_t iFrameMbsOnly = nal_read_bits(reader, 1);
+	if(!iFrameMbsOnly){
+		nal_skip_bits(reader, 1); // mb_adaptive_frame_field_flag
+	}
+	nal_skip_bits(reader, 1); // direct_8x8_inference_flag
+	uint32_t iCropLeft = 0, iCropRight = 0, iCropTop = 0, iCropBottom = 0;
+	if(nal_read_bits(reader, 1)){
+		iCropLeft = nal_read_ue(reader);
+		iCropRight = nal_read_ue(reader);
+		iCropTop = nal_read_ue(reader);
+		iCropBottom = nal_read_ue(reader);
+	}
+	if(reader.bError){
+		return false;
+	}
+
+	uint32_t iCropUnitX = 1;
+	uint32_t iCropUnitY = 2 - iFrameMbsOnly;
+	if(!bSeparateColourPlane && iChromaFormat != 0){
+		iCropUnitX = (iChromaFormat == 3 ? 1 : 2);
+		iCropUnitY *= (iChromaFormat == 1 ? 2 : 1);
+	}
+	*pWidth = (int)(iWidthInMbs * 16) - (int)(iCropUnitX * (iCropLeft + iCropRight));
+	*pHeight = (int)((2 - iFrameMbsOnly) * iHeightInMapUnits * 16) - (int)(iCropUnitY * (iCropTop + iCropBottom));
+	return true;
+}
+
+bool NalParser::readH265Sps(const uint8_t* pRbsp, size_t iSize, int* pWidth, int* pHeight)
+{
+	NalBitReader reader = { pRbsp, iSize, 16, false }; // After the NAL header
+
+	nal_skip_bits(reader, 4); // sps_video_parameter_set_id
+	uint32_t iMaxSubLayers = nal_read_bits(reader, 3); // Minus 1
+	nal_skip_bits(reader, 1); // sps_temporal_id_nesting_flag
+
+	// profile_tier_level(1, sps_max_sub_layers_minus1)
+	nal_skip_bits(reader, 88 + 8); // General profile and level
+	bool bSubLayerProfile[8];
+	bool bSubLayerLevel[8];
+	for(uint32_t i=0; i<iMaxSubLayers; i++){
+		bSubLayerProfile[i] = nal_read_bits(reader, 1);
+		bSubLayerLevel[i] = nal_read_bits(reader, 1);
+	}
+	if(iMaxSubLayers > 0){
+		nal_skip_bits(reader, 2 * (8 - iMaxSubLayers));
+	}
+	for(uint32_t i=0; i<iMaxSubLayers; i++){
+		nal_skip_bits(reader, (bSubLayerProfile[i] ? 88 : 0) + (bSubLayerLevel[i] ? 8 : 0));
+	}
+
+	nal_read_ue(reader); // sps_seq_parameter_set_id
+	uint32_t iChromaFormat = nal_read_ue(reader);
+	bool bSeparateColourPlane = false;
+	if(iChromaFormat == 3){
+		bSeparateColourPlane = nal_read_bits(reader, 1);
+	}
+	uint32_t iWidth = nal_read_ue(reader);
+	uint32_t iHeight = nal_read_ue(reader);
+	if(nal_read_bits(reader, 1)){ // conformance_window_flag
+		uint32_t iLeft = nal_read_ue(reader);
+		uint32_t iRight = nal_read_ue(reader);
+		uint32_t iTop = nal_read_ue(reader);
+		uint32_t iBottom = nal_read_ue(reader);
+		uint32_t iSubWidth = ((iChromaFormat == 1 || iChromaFormat == 2) && !bSeparateColourPlane ? 2 : 1);
+		uint32_t iSubHeight = (iChromaFormat == 1 && !bSeparateColourPlane ? 2 : 1);
+		iWidth -= iSubWidth * (iLeft + iRight);
+		iHeight -= iSubHeight * (iTop + iBottom);
+	}
+	if(reader.bError){
+		return false;
+	}
+
+	*pWidth = (int)iWidth;
+	*pHeight = (int)iHeight;
+	return true;
+}
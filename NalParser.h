@@ -0,0 +1,143 @@
+/*
+ * NalParser.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef NALPARSER_H_
+#define NALPARSER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#define NAL_PARSER_MAX_UNITS 32 // Of a frame, the next ones are not classified
+#define NAL_PARSER_KEY_FRAME_INDEX_SIZE 64 // Last key frames kept
+#define NAL_PARSER_FPS_CHANGE_RATIO 0.1 // Relative change of the frame rate reported
+#define NAL_PARSER_SPS_MAX_SIZE 256 // Bigger parameter sets are not read
+
+enum NalCodec
+{
+	NAL_CODEC_H264 = 0,
+	NAL_CODEC_H265,
+};
+
+enum NalUnitClass
+{
+	NAL_UNIT_OTHER = 0,
+	NAL_UNIT_SLICE, // Not a random access point
+	NAL_UNIT_IDR, // IDR for H264, IRAP (BLA, IDR, CRA) for H265
+	NAL_UNIT_SPS,
+	NAL_UNIT_PPS,
+	NAL_UNIT_VPS,
+	NAL_UNIT_SEI,
+	NAL_UNIT_AUD,
+};
+
+// Flags of a frame
+#define NAL_FRAME_KEY_FRAME 0x01 // First slice of an IDR picture
+#define NAL_FRAME_NEW_PICTURE 0x02 // First slice of a picture
+#define NAL_FRAME_SLICE 0x04
+#define NAL_FRAME_PARAMETER_SETS 0x08
+#define NAL_FRAME_SEI 0x10
+#define NAL_FRAME_ANNEX_B 0x20 // The NAL units have their start codes
+#define NAL_FRAME_GOP_CHANGED 0x40 // The GOP length or the frame rate changed, at this key frame
+#define NAL_FRAME_SIZE_CHANGED 0x80 // A SPS of another resolution
+
+struct NalUnit
+{
+	uint32_t iOffset; // After the start code
+	uint32_t iSize;
+	uint8_t iType;
+	uint8_t iClass;
+};
+
+struct NalFrameInfo
+{
+	unsigned iFlags;
+	unsigned iUnitCount;
+	NalUnit units[NAL_PARSER_MAX_UNITS];
+};
+
+struct NalKeyFrame
+{
+	int64_t iPresentationTimeUs;
+	uint64_t iPictureNumber;
+};
+
+//////////////////////////////////
+// NAL scanning functions
+//////////////////////////////////
+
+// Returns the first 00 00 01 start code, or pEnd. Vectorized with AVX2, SSE2
+// or NEON when the CPU has it.
+const uint8_t* nal_find_start_code(const uint8_t* pData, const uint8_t* pEnd);
+// Returns the first 00 00 03 sequence, whose 03 is an emulation prevention byte, or pEnd
+const uint8_t* nal_find_emulation_prevention(const uint8_t* pData, const uint8_t* pEnd);
+// Byte by byte versions, for the comparisons
+const uint8_t* nal_find_start_code_scalar(const uint8_t* pData, const uint8_t* pEnd);
+const uint8_t* nal_find_emulation_prevention_scalar(const uint8_t* pData, const uint8_t* pEnd);
+// Name of the instruction set used
+const char* nal_get_simd_name();
+
+// Removes the emulation prevention bytes of a NAL unit, pOut may be pData.
+// Returns the size of the RBSP.
+size_t nal_unescape(const uint8_t* pData, size_t iSize, uint8_t* pOut);
+
+//////////////////////////////////
+// NalParser declaration
+//////////////////////////////////
+
+// Classifies the NAL units of the frames of a H264 or H265 subsession, and
+// follows the stream: pictures, GOP length, frame rate, resolution, and an
+// index of the last key frames. A frame is a single NAL unit without start
+// code as delivered by live555, or several NAL units in Annex B format.
+class NalParser
+{
+public:
+	NalParser(NalCodec codec);
+
+	// Returns false if the codec has no NAL units
+	static bool getCodec(const char* szCodecName, NalCodec* pCodec);
+
+	void parseFrame(const uint8_t* pData, size_t iSize, int64_t iPresentationTimeUs, NalFrameInfo& info);
+
+	NalCodec getCodec() const { return m_codec; }
+	uint64_t getPictureCount() const { return m_iPictureCount; }
+	uint64_t getKeyFrameCount() const { return m_iKeyFrameCount; }
+	// Of the last complete GOP, 0 if unknown
+	int getGopLength() const { return m_iGopLength; }
+	double getFps() const { return m_dFps; }
+	// 0 if no SPS was read
+	int getWidth() const { return m_iWidth; }
+	int getHeight() const { return m_iHeight; }
+
+	// From the oldest to the last one
+	void getKeyFrames(std::vector<NalKeyFrame>& listKeyFrames) const;
+	bool getLastKeyFrame(NalKeyFrame& keyFrame) const;
+
+private:
+	void classifyUnit(const uint8_t* pData, size_t iSize, NalFrameInfo& info);
+	void newPicture(bool bKeyFrame, int64_t iPresentationTimeUs, NalFrameInfo& info);
+	bool readSps(const uint8_t* pData, size_t iSize, int* pWidth, int* pHeight);
+	bool readH264Sps(const uint8_t* pRbsp, size_t iSize, int* pWidth, int* pHeight);
+	bool readH265Sps(const uint8_t* pRbsp, size_t iSize, int* pWidth, int* pHeight);
+
+private:
+	NalCodec m_codec;
+	const uint8_t* m_pFrameData; // Frame being parsed
+
+	uint64_t m_iPictureCount;
+	uint64_t m_iKeyFrameCount;
+	int m_iGopLength;
+	double m_dFps;
+	double m_dReportedFps; // With the last GOP change
+	int m_iWidth;
+	int m_iHeight;
+
+	NalKeyFrame m_keyFrames[NAL_PARSER_KEY_FRAME_INDEX_SIZE];
+	size_t m_iKeyFrameIndex; // Next entry written
+};
+
+#endif /* NALPARSER_H_ */
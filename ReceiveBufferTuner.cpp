@@ -0,0 +1,163 @@
+/*
+ * ReceiveBufferTuner.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+
+#include <algorithm>
+
+#include "ReceiveBufferTuner.h"
+
+//////////////////////////////////
+// ReceiveBufferTuner definition
+//////////////////////////////////
+
+ReceiveBufferTuner::ReceiveBufferTuner(int fd, bool bVideo, unsigned iBandwidthKbps)
+{
+	m_fd = fd;
+	m_bVideo = bVideo;
+	m_iBandwidthKbps = iBandwidthKbps;
+
+	m_iRequestedSize = 0;
+	m_iSize = 0;
+	m_iPreviousSize = 0;
+	m_lastReason = RECEIVE_BUFFER_REASON_SDP;
+
+	m_bDropCounter = false;
+	m_iLastDrops = 0;
+	m_iNewDrops = 0;
+
+	m_iLastBytes = 0;
+	m_iLastSampleUs = 0;
+	m_iBitrate = 0;
+	m_iLowSamples = 0;
+}
+
+const char* ReceiveBufferTuner::getReasonName(ReceiveBufferReason reason)
+{
+	switch(reason){
+	case RECEIVE_BUFFER_REASON_SDP: return "sdp";
+	case RECEIVE_BUFFER_REASON_BITRATE: return "bitrate";
+	case RECEIVE_BUFFER_REASON_DROPS: return "drops";
+	case RECEIVE_BUFFER_REASON_SHRINK: return "shrink";
+	}
+	return "unknown";
+}
+
+size_t ReceiveBufferTuner::getSizeForBitrate(uint64_t iBitrate)
+{
+	uint64_t iSize = iBitrate / 8 * RECEIVE_BUFFER_DURATION / 1000;
+	return (size_t)std::min(std::max(iSize, (uint64_t)RECEIVE_BUFFER_MIN_SIZE), (uint64_t)RECEIVE_BUFFER_MAX_SIZE);
+}
+
+bool ReceiveBufferTuner::start()
+{
+	// The counter starts with the socket, the datagrams received before are already counted
+	m_bDropCounter = readDrops(m_iLastDrops);
+
+	size_t iSize;
+	if(m_iBandwidthKbps > 0){
+		iSize = getSizeForBitrate((uint64_t)m_iBandwidthKbps * 1000);
+	}else{
+		iSize = (m_bVideo ? RECEIVE_BUFFER_VIDEO_DEFAULT_SIZE : RECEIVE_BUFFER_AUDIO_DEFAULT_SIZE);
+	}
+	resize(iSize, RECEIVE_BUFFER_REASON_SDP);
+	return m_iSize > 0;
+}
+
+bool ReceiveBufferTuner::sample(uint64_t iTotalBytes, int64_t iNowUs)
+{
+	m_iNewDrops = 0;
+	uint64_t iDrops;
+	if(m_bDropCounter && readDrops(iDrops)){
+		m_iNewDrops = (iDrops > m_iLastDrops ? iDrops - m_iLastDrops : 0);
+		m_iLastDrops = iDrops;
+	}
+
+	bool bFirstSample = (m_iLastSampleUs == 0);
+	if(!bFirstSample && iNowUs > m_iLastSampleUs && iTotalBytes >= m_iLastBytes){
+		m_iBitrate = (iTotalBytes - m_iLastBytes) * 8 * 1000000 / (uint64_t)(iNowUs - m_iLastSampleUs);
+	}
+	m_iLastBytes = iTotalBytes;
+	m_iLastSampleUs = iNowUs;
+	if(bFirstSample){
+		return false;
+	}
+
+	size_t iTarget = getSizeForBitrate(m_iBitrate);
+
+	// The bitrate is a mean over the sample, the drops show the bursts it misses
+	if(m_iNewDrops > 0){
+		m_iLowSamples = 0;
+		return resize(std::max(m_iRequestedSize * 2, iTarget), RECEIVE_BUFFER_REASON_DROPS);
+	}
+
+	if(iTarget > m_iRequestedSize * RECEIVE_BUFFER_GROW_MARGIN / 100){
+		m_iLowSamples = 0;
+		return resize(iTarget, RECEIVE_BUFFER_REASON_BITRATE);
+	}
+
+	// Slowly, and not while the stream sends nothing
+	if(m_iBitrate > 0 && iTarget * 4 < m_iRequestedSize){
+		m_iLowSamples++;
+		if(m_iLowSamples >= RECEIVE_BUFFER_SHRINK_SAMPLES){
+			m_iLowSamples = 0;
+			return resize(std::max(iTarget * 2, m_iRequestedSize / 2), RECEIVE_BUFFER_REASON_SHRINK);
+		}
+	}else{
+		m_iLowSamples = 0;
+	}
+	return false;
+}
+
+bool ReceiveBufferTuner::resize(size_t iRequestedSize, ReceiveBufferReason reason)
+{
+	iRequestedSize = std::min(std::max(iRequestedSize, (size_t)RECEIVE_BUFFER_MIN_SIZE), (size_t)RECEIVE_BUFFER_MAX_SIZE);
+	if(iRequestedSize == m_iRequestedSize){
+		return false;
+	}
+
+	// Above net.core.rmem_max only with CAP_NET_ADMIN
+	int iValue = (int)iRequestedSize;
+	if(setsockopt(m_fd, SOL_SOCKET, SO_RCVBUFFORCE, &iValue, sizeof(iValue)) != 0){
+		setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &iValue, sizeof(iValue));
+	}
+	m_iRequestedSize = iRequestedSize;
+
+	int iSize = 0;
+	socklen_t iLength = sizeof(iSize);
+	if(getsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &iSize, &iLength) != 0){
+		return false;
+	}
+
+	// Capped by rmem_max, asking more again changes nothing
+	if((size_t)iSize == m_iSize){
+		return false;
+	}
+	m_iPreviousSize = m_iSize;
+	m_iSize = (size_t)iSize;
+	m_lastReason = reason;
+	return true;
+}
+
+bool ReceiveBufferTuner::readDrops(uint64_t& iDrops)
+{
+#ifdef SO_MEMINFO
+	uint32_t memInfo[SK_MEMINFO_VARS];
+	socklen_t iLength = sizeof(memInfo);
+	memset(memInfo, 0, sizeof(memInfo));
+	if(getsockopt(m_fd, SOL_SOCKET, SO_MEMINFO, memInfo, &iLength) != 0 || iLength <= SK_MEMINFO_DROPS * sizeof(uint32_t)){
+		return false;
+	}
+	iDrops = memInfo[SK_MEMINFO_DROPS];
+	return true;
+#else
+	(void)iDrops;
+	return false;
+#endif
+}
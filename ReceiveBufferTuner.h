@@ -0,0 +1,88 @@
+/*
+ * ReceiveBufferTuner.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef RECEIVEBUFFERTUNER_H_
+#define RECEIVEBUFFERTUNER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RECEIVE_BUFFER_MIN_SIZE 65536
+#define RECEIVE_BUFFER_MAX_SIZE (32*1024*1024)
+#define RECEIVE_BUFFER_VIDEO_DEFAULT_SIZE 2000000 // If the SDP gives no bitrate
+#define RECEIVE_BUFFER_AUDIO_DEFAULT_SIZE 100000
+#define RECEIVE_BUFFER_DURATION 500 // In ms of the stream, for the bursts of the key frames and the stalls of the event loop
+#define RECEIVE_BUFFER_GROW_MARGIN 125 // In percent of the current size, below it the bitrate doesn't grow the buffer
+#define RECEIVE_BUFFER_SHRINK_SAMPLES 12 // Samples without drop and with a low bitrate before shrinking
+
+enum ReceiveBufferReason
+{
+	RECEIVE_BUFFER_REASON_SDP = 0, // Initial size, from the b=AS line or the medium
+	RECEIVE_BUFFER_REASON_BITRATE, // The measured bitrate needs more
+	RECEIVE_BUFFER_REASON_DROPS, // The kernel dropped datagrams
+	RECEIVE_BUFFER_REASON_SHRINK, // The measured bitrate needs much less
+};
+
+//////////////////////////////////
+// ReceiveBufferTuner declaration
+//////////////////////////////////
+
+// Size of the kernel receive buffer of the RTP socket of a UDP subsession.
+// It starts from the bitrate of the SDP, then it follows the bitrate measured
+// and the datagrams dropped by the kernel for this socket, which are read
+// with SO_MEMINFO (the counter also reported by SO_RXQ_OVFL). Used by the
+// event loop of the stream only.
+class ReceiveBufferTuner
+{
+public:
+	// The bandwidth is in kbps, 0 if unknown
+	ReceiveBufferTuner(int fd, bool bVideo, unsigned iBandwidthKbps);
+
+	// Applies the initial size, returns false if the socket refuses it
+	bool start();
+
+	// Called periodically with the total bytes received by the subsession.
+	// Returns true if the buffer was resized.
+	bool sample(uint64_t iTotalBytes, int64_t iNowUs);
+
+	// As reported by the kernel, which doubles the requested size for its bookkeeping
+	size_t getSize() const { return m_iSize; }
+	size_t getPreviousSize() const { return m_iPreviousSize; }
+	ReceiveBufferReason getLastReason() const { return m_lastReason; }
+	// Datagrams dropped by the kernel since the last sample
+	uint64_t getNewDrops() const { return m_iNewDrops; }
+	uint64_t getBitrate() const { return m_iBitrate; } // In bits per second, measured over the last sample
+	bool hasDropCounter() const { return m_bDropCounter; }
+
+	static const char* getReasonName(ReceiveBufferReason reason);
+	// To hold RECEIVE_BUFFER_DURATION of the stream
+	static size_t getSizeForBitrate(uint64_t iBitrate);
+
+private:
+	bool resize(size_t iRequestedSize, ReceiveBufferReason reason);
+	bool readDrops(uint64_t& iDrops);
+
+private:
+	int m_fd;
+	bool m_bVideo;
+	unsigned m_iBandwidthKbps;
+
+	size_t m_iRequestedSize;
+	size_t m_iSize;
+	size_t m_iPreviousSize;
+	ReceiveBufferReason m_lastReason;
+
+	bool m_bDropCounter; // SO_MEMINFO is supported
+	uint64_t m_iLastDrops;
+	uint64_t m_iNewDrops;
+
+	uint64_t m_iLastBytes;
+	int64_t m_iLastSampleUs; // 0 before the first sample
+	uint64_t m_iBitrate;
+	int m_iLowSamples; // Successive samples that would allow shrinking
+};
+
+#endif /* RECEIVEBUFFERTUNER_H_ */
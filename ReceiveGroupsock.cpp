@@ -0,0 +1,106 @@
+/*
+ * ReceiveGroupsock.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "EpollTaskScheduler.h"
+#include "ReceiveGroupsock.h"
+
+//////////////////////////////////
+// ReceiveGroupsock definition
+//////////////////////////////////
+
+ReceiveGroupsock::ReceiveGroupsock(UsageEnvironment& env, struct sockaddr_storage const& groupAddr, Port port, u_int8_t ttl, EpollTaskScheduler* pEpollScheduler)
+	: Groupsock(env, groupAddr, port, ttl)
+{
+	m_pEpollScheduler = pEpollScheduler;
+	m_pPendingData = NULL;
+	m_iPendingSize = 0;
+}
+
+ReceiveGroupsock::~ReceiveGroupsock()
+{
+}
+
+void ReceiveGroupsock::setPendingPacket(const uint8_t* pData, unsigned iSize)
+{
+	m_pPendingData = pData;
+	m_iPendingSize = iSize;
+}
+
+void ReceiveGroupsock::clearPendingPacket()
+{
+	m_pPendingData = NULL;
+	m_iPendingSize = 0;
+}
+
+Boolean ReceiveGroupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize, unsigned& bytesRead, struct sockaddr_storage& fromAddressAndPort)
+{
+	if(m_pPendingData){
+		// Truncated like a datagram larger than the buffer
+		bytesRead = std::min(m_iPendingSize, bufferMaxSize);
+		memcpy(buffer, m_pPendingData, bytesRead);
+		// No address, the packet comes from the RTSP connection
+		memset(&fromAddressAndPort, 0, sizeof(fromAddressAndPort));
+		clearPendingPacket();
+		return True;
+	}
+	if(m_pEpollScheduler && m_pEpollScheduler->readBatchedDatagram(socketNum(), buffer, bufferMaxSize, bytesRead, fromAddressAndPort)){
+		return True;
+	}
+	return Groupsock::handleRead(buffer, bufferMaxSize, bytesRead, fromAddressAndPort);
+}
+
+//////////////////////////////////
+// ReceiveMediaSubsession definition
+//////////////////////////////////
+
+ReceiveMediaSubsession::ReceiveMediaSubsession(MediaSession& parent, EpollTaskScheduler* pEpollScheduler)
+	: MediaSubsession(parent)
+{
+	m_pEpollScheduler = pEpollScheduler;
+}
+
+ReceiveMediaSubsession::~ReceiveMediaSubsession()
+{
+}
+
+Groupsock* ReceiveMediaSubsession::createGroupsock(struct sockaddr_storage const& groupOrAddr, Port port)
+{
+	// Same TTL as the default implementation
+	return new ReceiveGroupsock(parentSession().envir(), groupOrAddr, port, 255, m_pEpollScheduler);
+}
+
+//////////////////////////////////
+// ReceiveMediaSession definition
+//////////////////////////////////
+
+ReceiveMediaSession* ReceiveMediaSession::createNew(UsageEnvironment& env, char const* sdpDescription, EpollTaskScheduler* pEpollScheduler)
+{
+	ReceiveMediaSession* pSession = new ReceiveMediaSession(env, pEpollScheduler);
+	if(!pSession->initializeWithSDP(sdpDescription)){
+		Medium::close(pSession);
+		return NULL;
+	}
+	return pSession;
+}
+
+ReceiveMediaSession::ReceiveMediaSession(UsageEnvironment& env, EpollTaskScheduler* pEpollScheduler)
+	: MediaSession(env)
+{
+	m_pEpollScheduler = pEpollScheduler;
+}
+
+ReceiveMediaSession::~ReceiveMediaSession()
+{
+}
+
+MediaSubsession* ReceiveMediaSession::createNewMediaSubsession()
+{
+	return new ReceiveMediaSubsession(*this, m_pEpollScheduler);
+}
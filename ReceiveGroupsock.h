@@ -0,0 +1,85 @@
+/*
+ * ReceiveGroupsock.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef RECEIVEGROUPSOCK_H_
+#define RECEIVEGROUPSOCK_H_
+
+#include <stdint.h>
+
+#include <liveMedia.hh>
+
+class EpollTaskScheduler;
+
+//////////////////////////////////
+// ReceiveGroupsock declaration
+//////////////////////////////////
+
+// Groupsock receiving the RTP and RTCP packets of a subsession. Its read,
+// called by the handler of the RTP source or the RTCP instance, takes the
+// packet given by setPendingPacket() if any (demultiplexed from the RTSP
+// connection), then the datagram from the batch received by the scheduler for
+// its socket if any, and reads the socket otherwise.
+class ReceiveGroupsock : public Groupsock
+{
+public:
+	ReceiveGroupsock(UsageEnvironment& env, struct sockaddr_storage const& groupAddr, Port port, u_int8_t ttl, EpollTaskScheduler* pEpollScheduler);
+	virtual ~ReceiveGroupsock();
+
+	// The packet is not copied, it must be valid until read or cleared
+	void setPendingPacket(const uint8_t* pData, unsigned iSize);
+	bool hasPendingPacket() const { return (m_pPendingData != NULL); }
+	void clearPendingPacket();
+
+public:
+	// Redefined virtual functions
+	virtual Boolean handleRead(unsigned char* buffer, unsigned bufferMaxSize, unsigned& bytesRead, struct sockaddr_storage& fromAddressAndPort);
+
+private:
+	EpollTaskScheduler* m_pEpollScheduler; // NULL with select
+	const uint8_t* m_pPendingData;
+	unsigned m_iPendingSize;
+};
+
+//////////////////////////////////
+// ReceiveMediaSubsession declaration
+//////////////////////////////////
+
+class ReceiveMediaSubsession : public MediaSubsession
+{
+public:
+	ReceiveMediaSubsession(MediaSession& parent, EpollTaskScheduler* pEpollScheduler);
+	virtual ~ReceiveMediaSubsession();
+
+protected:
+	// Redefined virtual functions
+	virtual Groupsock* createGroupsock(struct sockaddr_storage const& groupOrAddr, Port port);
+
+private:
+	EpollTaskScheduler* m_pEpollScheduler;
+};
+
+//////////////////////////////////
+// ReceiveMediaSession declaration
+//////////////////////////////////
+
+// MediaSession whose subsessions receive with ReceiveGroupsock
+class ReceiveMediaSession : public MediaSession
+{
+public:
+	static ReceiveMediaSession* createNew(UsageEnvironment& env, char const* sdpDescription, EpollTaskScheduler* pEpollScheduler);
+
+protected:
+	ReceiveMediaSession(UsageEnvironment& env, EpollTaskScheduler* pEpollScheduler);
+	virtual ~ReceiveMediaSession();
+
+	// Redefined virtual functions
+	virtual MediaSubsession* createNewMediaSubsession();
+
+private:
+	EpollTaskScheduler* m_pEpollScheduler;
+};
+
+#endif /* RECEIVEGROUPSOCK_H_ */
@@ -0,0 +1,798 @@
+/*
+ * Recording.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include <algorithm>
+
+#include "LoopClock.h"
+#include "Recording.h"
+
+// Without liburing, the few system calls needed are made directly
+static int recording_uring_setup(unsigned iEntries, struct io_uring_params* pParams)
+{
+	return (int)syscall(__NR_io_uring_setup, iEntries, pParams);
+}
+
+static int recording_uring_enter(int fd, unsigned iToSubmit, unsigned iMinComplete, unsigned iFlags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, iToSubmit, iMinComplete, iFlags, NULL, 0);
+}
+
+static int recording_uring_register(int fd, unsigned iOpcode, void* pArg, unsigned iArgCount)
+{
+	return (int)syscall(__NR_io_uring_register, fd, iOpcode, pArg, iArgCount);
+}
+
+struct RecordingFile
+{
+	int fd;
+	uint64_t iOffset; // End of the data appended, written or not
+	FrameBuffer* pBuffer; // Being filled
+	unsigned iPending; // Writes not completed, with io_uring
+	bool bClosing;
+	bool bDirect; // Opened with O_DIRECT
+	bool bPadded; // The last write goes beyond the end of the data
+};
+
+// Returns false if the padding of the last write could not be removed
+static bool recording_close_file(RecordingFile* pFile)
+{
+	bool bRes = true;
+	if(pFile->bPadded){
+		bRes = (ftruncate(pFile->fd, (off_t)pFile->iOffset) == 0);
+	}
+	close(pFile->fd);
+	delete pFile;
+	return bRes;
+}
+
+// A write given to io_uring, the iovec must live until its completion
+struct RecordingUringWrite
+{
+	RecordingFile* pFile;
+	FrameBuffer* pBuffer;
+	struct iovec iov;
+};
+
+//////////////////////////////////
+// RecordingWriter definition
+//////////////////////////////////
+
+RecordingWriter* RecordingWriter::createNew(TaskScheduler& scheduler, bool bUseUring)
+{
+	RecordingWriter* pWriter = new RecordingWriter(&scheduler);
+	if(bUseUring && pWriter->setupUring()){
+		return pWriter;
+	}
+	if(!pWriter->startThread()){
+		delete pWriter;
+		return NULL;
+	}
+	return pWriter;
+}
+
+RecordingWriter* RecordingWriter::createShared()
+{
+	RecordingWriter* pWriter = new RecordingWriter(NULL);
+	if(!pWriter->startThread()){
+		delete pWriter;
+		return NULL;
+	}
+	return pWriter;
+}
+
+RecordingWriter::RecordingWriter(TaskScheduler* pScheduler)
+{
+	m_pScheduler = pScheduler;
+	m_submitTask = NULL;
+
+	m_bUring = false;
+	m_iUringFd = -1;
+	m_iEventFd = -1;
+	m_pSqRing = NULL;
+	m_iSqRingSize = 0;
+	m_pCqRing = NULL;
+	m_iCqRingSize = 0;
+	m_pSqes = NULL;
+	m_iSqesSize = 0;
+	m_pSqHead = NULL;
+	m_pSqTail = NULL;
+	m_pSqMask = NULL;
+	m_pSqArray = NULL;
+	m_pCqHead = NULL;
+	m_pCqTail = NULL;
+	m_pCqMask = NULL;
+	m_pCqes = NULL;
+	m_iInFlight = 0;
+	m_iUnsubmitted = 0;
+	m_iRingEntries = 0;
+
+	m_bThreadStarted = false;
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_cond, NULL);
+	m_bStopThread = false;
+
+	m_iBytesSubmitted = 0;
+	m_iBytesWritten = 0;
+	m_iBytesFailed = 0;
+	m_iWrites = 0;
+	m_iFailedWrites = 0;
+	m_iFilesOpened = 0;
+	m_iDroppedFrames = 0;
+}
+
+RecordingWriter::~RecordingWriter()
+{
+	drain();
+
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void RecordingWriter::drain()
+{
+	flush();
+
+	if(m_bUring){
+		while(m_iInFlight > 0 || !m_listQueued.empty()){
+			submitToUring();
+			reapCompletions(true);
+		}
+		releaseUring();
+	}
+
+	if(m_bThreadStarted){
+		// The thread empties its queue before stopping
+		pthread_mutex_lock(&m_mutex);
+		m_bStopThread = true;
+		pthread_cond_signal(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+		pthread_join(m_thread, NULL);
+		m_bThreadStarted = false;
+	}
+}
+
+RecordingFile* RecordingWriter::openFile(const char* szPath)
+{
+	int fd = open(szPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0){
+		return NULL;
+	}
+	m_iFilesOpened.fetch_add(1, std::memory_order_relaxed);
+
+	RecordingFile* pFile = new RecordingFile();
+	pFile->fd = fd;
+	pFile->iOffset = 0;
+	pFile->pBuffer = NULL;
+	pFile->iPending = 0;
+	pFile->bClosing = false;
+	// Set after the creation: some file systems refuse it, the file is written through the page cache then
+	int iFlags = fcntl(fd, F_GETFL);
+	pFile->bDirect = (iFlags >= 0 && fcntl(fd, F_SETFL, iFlags | O_DIRECT) == 0);
+	pFile->bPadded = false;
+	return pFile;
+}
+
+void RecordingWriter::append(RecordingFile* pFile, const void* pData, size_t iSize)
+{
+	const uint8_t* pSrc = (const uint8_t*)pData;
+	while(iSize > 0){
+		if(!pFile->pBuffer){
+			pFile->pBuffer = FramePool::getInstance()->acquire(RECORDING_BUFFER_SIZE);
+			if(!pFile->pBuffer){
+				// Keep the offsets of the index right, the hole is left unwritten
+				m_iFailedWrites.fetch_add(1, std::memory_order_relaxed);
+				pFile->iOffset += iSize;
+				return;
+			}
+			pFile->pBuffer->setSize(0);
+		}
+
+		FrameBuffer* pBuffer = pFile->pBuffer;
+		size_t iCopySize = std::min(iSize, RECORDING_BUFFER_SIZE - pBuffer->size());
+		memcpy(pBuffer->data() + pBuffer->size(), pSrc, iCopySize);
+		pBuffer->setSize(pBuffer->size() + iCopySize);
+		pFile->iOffset += iCopySize;
+		pSrc += iCopySize;
+		iSize -= iCopySize;
+
+		if(pBuffer->size() == RECORDING_BUFFER_SIZE){
+			queueBuffer(pFile);
+		}
+	}
+}
+
+uint64_t RecordingWriter::getFileSize(RecordingFile* pFile) const
+{
+	return pFile->iOffset;
+}
+
+void RecordingWriter::closeFile(RecordingFile* pFile)
+{
+	if(pFile->pBuffer){
+		if(pFile->pBuffer->size() > 0){
+			queueBuffer(pFile);
+		}else{
+			pFile->pBuffer->unref();
+			pFile->pBuffer = NULL;
+		}
+	}
+
+	if(m_bUring){
+		pFile->bClosing = true;
+		closeWhenWritten(pFile);
+	}else{
+		// After the writes of the file in the queue of the thread
+		Write write;
+		write.pFile = pFile;
+		write.pBuffer = NULL;
+		write.iOffset = 0;
+		queueWrite(write);
+	}
+}
+
+void RecordingWriter::queueBuffer(RecordingFile* pFile)
+{
+	Write write;
+	write.pFile = pFile;
+	write.pBuffer = pFile->pBuffer;
+	write.iOffset = pFile->iOffset - pFile->pBuffer->size();
+	pFile->pBuffer = NULL;
+
+	if(pFile->bDirect && (write.iOffset % RECORDING_DIRECT_ALIGN) != 0){
+		// After a hole left by a failed allocation, the next writes are not aligned anymore
+		int iFlags = fcntl(pFile->fd, F_GETFL);
+		if(iFlags >= 0){
+			fcntl(pFile->fd, F_SETFL, iFlags & ~O_DIRECT);
+		}
+		pFile->bDirect = false;
+	}else if(pFile->bDirect && (write.pBuffer->size() % RECORDING_DIRECT_ALIGN) != 0){
+		// The last write of the file, the capacity of the buffer is a multiple of the alignment
+		size_t iSize = write.pBuffer->size();
+		size_t iPaddedSize = (iSize + RECORDING_DIRECT_ALIGN - 1) / RECORDING_DIRECT_ALIGN * RECORDING_DIRECT_ALIGN;
+		memset(write.pBuffer->data() + iSize, 0, iPaddedSize - iSize);
+		write.pBuffer->setSize(iPaddedSize);
+		pFile->bPadded = true;
+	}
+	m_iBytesSubmitted.fetch_add(write.pBuffer->size(), std::memory_order_relaxed);
+	if(m_bUring){
+		pFile->iPending++;
+	}
+	queueWrite(write);
+}
+
+void RecordingWriter::queueWrite(const Write& write)
+{
+	if(!m_pScheduler){
+		// Nothing to batch the writes with, the other threads may be writing too
+		pthread_mutex_lock(&m_mutex);
+		m_listThreadQueue.push_back(write);
+		pthread_cond_signal(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+		return;
+	}
+
+	m_listQueued.push_back(write);
+	if(m_listQueued.size() >= RECORDING_SUBMIT_BATCH){
+		flush();
+	}else if(!m_submitTask){
+		// The writes of the other streams of the loop are submitted together
+		m_submitTask = m_pScheduler->scheduleDelayedTask(RECORDING_SUBMIT_DELAY, (TaskFunc*)RecordingWriter::submitTaskHandler, this);
+	}
+}
+
+void RecordingWriter::submitTaskHandler(void* clientData)
+{
+	RecordingWriter* pWriter = (RecordingWriter*)clientData;
+	pWriter->m_submitTask = NULL;
+	pWriter->flush();
+}
+
+void RecordingWriter::flush()
+{
+	if(m_submitTask){
+		m_pScheduler->unscheduleDelayedTask(m_submitTask);
+		m_submitTask = NULL;
+	}
+	if(m_listQueued.empty()){
+		return;
+	}
+
+	if(m_bUring){
+		// What doesn't fit in the ring is submitted on the next completions
+		submitToUring();
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_listThreadQueue.insert(m_listThreadQueue.end(), m_listQueued.begin(), m_listQueued.end());
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	m_listQueued.clear();
+}
+
+bool RecordingWriter::isBacklogged() const
+{
+	uint64_t iWritten = m_iBytesWritten.load(std::memory_order_relaxed) + m_iBytesFailed.load(std::memory_order_relaxed);
+	uint64_t iSubmitted = m_iBytesSubmitted.load(std::memory_order_relaxed);
+	return (iSubmitted - iWritten > RECORDING_MAX_PENDING_SIZE);
+}
+
+void RecordingWriter::addDroppedFrame()
+{
+	m_iDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordingWriter::getStats(RecordingStats& stats) const
+{
+	stats.iBytesSubmitted = m_iBytesSubmitted.load(std::memory_order_relaxed);
+	stats.iBytesWritten = m_iBytesWritten.load(std::memory_order_relaxed);
+	stats.iWrites = m_iWrites.load(std::memory_order_relaxed);
+	stats.iFailedWrites = m_iFailedWrites.load(std::memory_order_relaxed);
+	stats.iFilesOpened = m_iFilesOpened.load(std::memory_order_relaxed);
+	stats.iDroppedFrames = m_iDroppedFrames.load(std::memory_order_relaxed);
+	stats.bUring = m_bUring;
+}
+
+bool RecordingWriter::setupUring()
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	m_iUringFd = recording_uring_setup(RECORDING_URING_ENTRIES, &params);
+	if(m_iUringFd < 0){
+		m_iUringFd = -1;
+		return false;
+	}
+
+	m_iSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_iCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		m_iSqRingSize = std::max(m_iSqRingSize, m_iCqRingSize);
+		m_iCqRingSize = 0;
+	}
+
+	m_pSqRing = mmap(NULL, m_iSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iUringFd, IORING_OFF_SQ_RING);
+	if(m_pSqRing == MAP_FAILED){
+		m_pSqRing = NULL;
+		releaseUring();
+		return false;
+	}
+	if(m_iCqRingSize > 0){
+		m_pCqRing = mmap(NULL, m_iCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iUringFd, IORING_OFF_CQ_RING);
+		if(m_pCqRing == MAP_FAILED){
+			m_pCqRing = NULL;
+			releaseUring();
+			return false;
+		}
+	}else{
+		m_pCqRing = m_pSqRing;
+	}
+	m_iSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	m_pSqes = mmap(NULL, m_iSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_iUringFd, IORING_OFF_SQES);
+	if(m_pSqes == MAP_FAILED){
+		m_pSqes = NULL;
+		releaseUring();
+		return false;
+	}
+
+	m_pSqHead = (unsigned*)((char*)m_pSqRing + params.sq_off.head);
+	m_pSqTail = (unsigned*)((char*)m_pSqRing + params.sq_off.tail);
+	m_pSqMask = (unsigned*)((char*)m_pSqRing + params.sq_off.ring_mask);
+	m_pSqArray = (unsigned*)((char*)m_pSqRing + params.sq_off.array);
+	m_pCqHead = (unsigned*)((char*)m_pCqRing + params.cq_off.head);
+	m_pCqTail = (unsigned*)((char*)m_pCqRing + params.cq_off.tail);
+	m_pCqMask = (unsigned*)((char*)m_pCqRing + params.cq_off.ring_mask);
+	m_pCqes = (char*)m_pCqRing + params.cq_off.cqes;
+	m_iRingEntries = params.sq_entries;
+
+	// The completions wake up the event loop through an eventfd
+	m_iEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_iEventFd < 0 || recording_uring_register(m_iUringFd, IORING_REGISTER_EVENTFD, &m_iEventFd, 1) < 0){
+		releaseUring();
+		return false;
+	}
+	m_pScheduler->setBackgroundHandling(m_iEventFd, SOCKET_READABLE, (TaskScheduler::BackgroundHandlerProc*)RecordingWriter::completionHandler, this);
+
+	m_bUring = true;
+	return true;
+}
+
+void RecordingWriter::releaseUring()
+{
+	if(m_iEventFd >= 0){
+		if(m_bUring){
+			m_pScheduler->disableBackgroundHandling(m_iEventFd);
+		}
+		close(m_iEventFd);
+		m_iEventFd = -1;
+	}
+	if(m_pSqes){
+		munmap(m_pSqes, m_iSqesSize);
+		m_pSqes = NULL;
+	}
+	if(m_pCqRing && m_pCqRing != m_pSqRing){
+		munmap(m_pCqRing, m_iCqRingSize);
+	}
+	m_pCqRing = NULL;
+	if(m_pSqRing){
+		munmap(m_pSqRing, m_iSqRingSize);
+		m_pSqRing = NULL;
+	}
+	if(m_iUringFd >= 0){
+		close(m_iUringFd);
+		m_iUringFd = -1;
+	}
+	m_bUring = false;
+}
+
+bool RecordingWriter::submitToUring()
+{
+	unsigned iTail = *m_pSqTail;
+	unsigned iMask = *m_pSqMask;
+	unsigned iToSubmit = 0;
+
+	size_t iQueued = 0;
+	while(iQueued < m_listQueued.size() && m_iInFlight < m_iRingEntries){
+		const Write& write = m_listQueued[iQueued];
+
+		RecordingUringWrite* pUringWrite = new RecordingUringWrite();
+		pUringWrite->pFile = write.pFile;
+		pUringWrite->pBuffer = write.pBuffer;
+		pUringWrite->iov.iov_base = write.pBuffer->data();
+		pUringWrite->iov.iov_len = write.pBuffer->size();
+
+		unsigned iIndex = iTail & iMask;
+		struct io_uring_sqe* pSqe = &((struct io_uring_sqe*)m_pSqes)[iIndex];
+		memset(pSqe, 0, sizeof(*pSqe));
+		pSqe->opcode = IORING_OP_WRITEV;
+		pSqe->fd = write.pFile->fd;
+		pSqe->addr = (uint64_t)(uintptr_t)&pUringWrite->iov;
+		pSqe->len = 1;
+		pSqe->off = write.iOffset;
+		pSqe->user_data = (uint64_t)(uintptr_t)pUringWrite;
+		m_pSqArray[iIndex] = iIndex;
+
+		iTail++;
+		iToSubmit++;
+		m_iInFlight++;
+		iQueued++;
+	}
+	m_listQueued.erase(m_listQueued.begin(), m_listQueued.begin() + iQueued);
+
+	if(iToSubmit == 0){
+		return true;
+	}
+
+	// One system call for the whole batch
+	__atomic_store_n(m_pSqTail, iTail, __ATOMIC_RELEASE);
+	m_iUnsubmitted += iToSubmit;
+
+	// The entries left by a short submission are submitted again with the new ones
+	while(m_iUnsubmitted > 0){
+		int iResult = recording_uring_enter(m_iUringFd, m_iUnsubmitted, 0, 0);
+		if(iResult < 0 && errno == EINTR){
+			continue;
+		}
+		int iError = (iResult < 0 ? errno : EIO);
+		if(iResult > 0){
+			// What the kernel consumed, rather than the count returned
+			m_iUnsubmitted = iTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+			continue;
+		}
+		if((iError == EAGAIN || iError == EBUSY) && m_iInFlight > m_iUnsubmitted){
+			// Out of resources until completions are reaped, the rest is submitted then
+			return false;
+		}
+		failUnsubmitted(-iError);
+		return false;
+	}
+	return true;
+}
+
+void RecordingWriter::failUnsubmitted(int iError)
+{
+	// Taken back from the tail of the ring, the kernel only reads it when entered
+	unsigned iTail = *m_pSqTail;
+	unsigned iMask = *m_pSqMask;
+	while(m_iUnsubmitted > 0){
+		iTail--;
+		struct io_uring_sqe* pSqe = &((struct io_uring_sqe*)m_pSqes)[iTail & iMask];
+		RecordingUringWrite* pUringWrite = (RecordingUringWrite*)(uintptr_t)pSqe->user_data;
+		m_iUnsubmitted--;
+		m_iInFlight--;
+
+		Write write;
+		write.pFile = pUringWrite->pFile;
+		write.pBuffer = pUringWrite->pBuffer;
+		write.iOffset = 0;
+		delete pUringWrite;
+		completeWrite(&write, iError);
+	}
+	__atomic_store_n(m_pSqTail, iTail, __ATOMIC_RELEASE);
+}
+
+void RecordingWriter::reapCompletions(bool bWait)
+{
+	if(bWait && m_iInFlight > m_iUnsubmitted){
+		recording_uring_enter(m_iUringFd, 0, 1, IORING_ENTER_GETEVENTS);
+	}
+
+	unsigned iHead = *m_pCqHead;
+	unsigned iTail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+	unsigned iMask = *m_pCqMask;
+	while(iHead != iTail){
+		struct io_uring_cqe* pCqe = &((struct io_uring_cqe*)m_pCqes)[iHead & iMask];
+		RecordingUringWrite* pUringWrite = (RecordingUringWrite*)(uintptr_t)pCqe->user_data;
+		int iResult = pCqe->res;
+		iHead++;
+
+		m_iInFlight--;
+		Write write;
+		write.pFile = pUringWrite->pFile;
+		write.pBuffer = pUringWrite->pBuffer;
+		write.iOffset = 0;
+		delete pUringWrite;
+		completeWrite(&write, iResult);
+	}
+	__atomic_store_n(m_pCqHead, iHead, __ATOMIC_RELEASE);
+
+	// Room was made in the ring, or the kernel has resources again
+	if((!m_listQueued.empty() || m_iUnsubmitted > 0) && !bWait){
+		submitToUring();
+	}
+}
+
+void RecordingWriter::completionHandler(void* clientData, int /*mask*/)
+{
+	RecordingWriter* pWriter = (RecordingWriter*)clientData;
+	uint64_t iCount;
+	while(read(pWriter->m_iEventFd, &iCount, sizeof(iCount)) > 0){
+	}
+	pWriter->reapCompletions(false);
+}
+
+void RecordingWriter::completeWrite(Write* pWrite, int iResult)
+{
+	if(iResult >= 0 && (size_t)iResult == pWrite->pBuffer->size()){
+		m_iBytesWritten.fetch_add(iResult, std::memory_order_relaxed);
+		m_iWrites.fetch_add(1, std::memory_order_relaxed);
+	}else{
+		// Short writes of a regular file only happen when the disk is full
+		m_iFailedWrites.fetch_add(1, std::memory_order_relaxed);
+		m_iBytesFailed.fetch_add(pWrite->pBuffer->size(), std::memory_order_relaxed);
+	}
+	pWrite->pBuffer->unref();
+
+	RecordingFile* pFile = pWrite->pFile;
+	pFile->iPending--;
+	closeWhenWritten(pFile);
+}
+
+void RecordingWriter::closeWhenWritten(RecordingFile* pFile)
+{
+	if(pFile->bClosing && pFile->iPending == 0){
+		if(!recording_close_file(pFile)){
+			m_iFailedWrites.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+bool RecordingWriter::startThread()
+{
+	if(pthread_create(&m_thread, NULL, RecordingWriter::writerThread, this) != 0){
+		return false;
+	}
+	m_bThreadStarted = true;
+	return true;
+}
+
+void* RecordingWriter::writerThread(void* arg)
+{
+	((RecordingWriter*)arg)->runThread();
+	return NULL;
+}
+
+void RecordingWriter::runThread()
+{
+	std::vector<Write> listWrites;
+	for(;;){
+		pthread_mutex_lock(&m_mutex);
+		while(m_listThreadQueue.empty() && !m_bStopThread){
+			pthread_cond_wait(&m_cond, &m_mutex);
+		}
+		if(m_listThreadQueue.empty()){
+			pthread_mutex_unlock(&m_mutex);
+			break;
+		}
+		listWrites.assign(m_listThreadQueue.begin(), m_listThreadQueue.end());
+		m_listThreadQueue.clear();
+		pthread_mutex_unlock(&m_mutex);
+
+		for(size_t i=0; i<listWrites.size(); i++){
+			Write& write = listWrites[i];
+			if(!write.pBuffer){
+				if(!recording_close_file(write.pFile)){
+					m_iFailedWrites.fetch_add(1, std::memory_order_relaxed);
+				}
+				continue;
+			}
+
+			const uint8_t* pData = write.pBuffer->data();
+			size_t iRemaining = write.pBuffer->size();
+			uint64_t iOffset = write.iOffset;
+			while(iRemaining > 0){
+				ssize_t iWritten = pwrite(write.pFile->fd, pData, iRemaining, iOffset);
+				if(iWritten < 0 && errno == EINTR){
+					continue;
+				}
+				if(iWritten <= 0){
+					break;
+				}
+				pData += iWritten;
+				iRemaining -= iWritten;
+				iOffset += iWritten;
+			}
+			if(iRemaining == 0){
+				m_iBytesWritten.fetch_add(write.pBuffer->size(), std::memory_order_relaxed);
+				m_iWrites.fetch_add(1, std::memory_order_relaxed);
+			}else{
+				m_iFailedWrites.fetch_add(1, std::memory_order_relaxed);
+				m_iBytesFailed.fetch_add(write.pBuffer->size(), std::memory_order_relaxed);
+			}
+			write.pBuffer->unref();
+		}
+		listWrites.clear();
+	}
+}
+
+//////////////////////////////////
+// RecordingTrack definition
+//////////////////////////////////
+
+bool recording_make_directories(const char* szPath)
+{
+	std::string szDirectory = szPath;
+	for(size_t i=1; i<=szDirectory.size(); i++){
+		if(i == szDirectory.size() || szDirectory[i] == '/'){
+			std::string szParent = szDirectory.substr(0, i);
+			if(mkdir(szParent.c_str(), 0755) != 0 && errno != EEXIST){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+RecordingTrack::RecordingTrack(RecordingWriter* pWriter, const char* szDirectory, const char* szName, const char* szExtension, int iSegmentDuration)
+{
+	m_pWriter = pWriter;
+	m_szDirectory = szDirectory;
+	m_szName = szName;
+	m_szExtension = szExtension;
+	m_iSegmentDurationUs = (int64_t)(iSegmentDuration > 0 ? iSegmentDuration : 60) * 1000000;
+
+	m_pDataFile = NULL;
+	m_pIndexFile = NULL;
+	m_iSegmentStartUs = 0;
+	m_iSegmentCount = 0;
+	m_bOpenFailed = false;
+}
+
+RecordingTrack::~RecordingTrack()
+{
+	closeSegment();
+}
+
+bool RecordingTrack::openSegment(int64_t iNowUs)
+{
+	m_iSegmentStartUs = iNowUs;
+
+	// Named after the UTC start time, a suffix is added if a segment already started in the same second
+	time_t iTime = (time_t)(LoopClock::wallClockUs() / 1000000);
+	struct tm tmTime;
+	gmtime_r(&iTime, &tmTime);
+	char szTime[32];
+	strftime(szTime, sizeof(szTime), "%Y%m%dT%H%M%SZ", &tmTime);
+
+	std::string szBase = m_szDirectory + "/" + m_szName + "-" + szTime;
+	for(int i=0; i<10 && !m_pDataFile; i++){
+		std::string szPath = szBase;
+		if(i > 0){
+			char szSuffix[16];
+			snprintf(szSuffix, sizeof(szSuffix), "-%d", i);
+			szPath += szSuffix;
+		}
+		m_pDataFile = m_pWriter->openFile((szPath + "." + m_szExtension).c_str());
+		if(m_pDataFile){
+			m_pIndexFile = m_pWriter->openFile((szPath + ".idx").c_str());
+			if(!m_pIndexFile){
+				m_pWriter->closeFile(m_pDataFile);
+				m_pDataFile = NULL;
+			}
+		}
+		if(!m_pDataFile && errno != EEXIST){
+			break;
+		}
+	}
+
+	m_bOpenFailed = (m_pDataFile == NULL);
+	if(m_pDataFile){
+		m_iSegmentCount++;
+	}
+	return (m_pDataFile != NULL);
+}
+
+void RecordingTrack::closeSegment()
+{
+	if(m_pDataFile){
+		m_pWriter->closeFile(m_pDataFile);
+		m_pDataFile = NULL;
+	}
+	if(m_pIndexFile){
+		m_pWriter->closeFile(m_pIndexFile);
+		m_pIndexFile = NULL;
+	}
+}
+
+void RecordingTrack::addFrame(const uint8_t* pPrefix, size_t iPrefixSize, const uint8_t* pData, size_t iSize,
+		int64_t iPresentationTimeUs, bool bSyncPoint)
+{
+	// Rather than using more and more memory, the segment is ended and the next one starts at a sync point
+	if(m_pWriter->isBacklogged()){
+		closeSegment();
+		m_pWriter->addDroppedFrame();
+		return;
+	}
+
+	// Monotonic: a jump of the wall clock neither stops nor hastens the rotation
+	int64_t iNowUs = LoopClock::nowUs();
+	int64_t iElapsedUs = iNowUs - m_iSegmentStartUs;
+
+	if(!m_pDataFile){
+		// A segment starts with a sync point, after a failure the next attempt waits for a whole segment
+		if(!bSyncPoint || (m_bOpenFailed && iElapsedUs < m_iSegmentDurationUs)){
+			return;
+		}
+		if(!openSegment(iNowUs)){
+			return;
+		}
+	}else if(iElapsedUs >= m_iSegmentDurationUs && bSyncPoint){
+		closeSegment();
+		if(!openSegment(iNowUs)){
+			return;
+		}
+	}else if(iElapsedUs >= 2*m_iSegmentDurationUs){
+		// No sync point for too long: the segment is ended, and the frames are
+		// dropped until the next one, which starts a new segment
+		closeSegment();
+		return;
+	}
+
+	RecordingIndexEntry entry;
+	entry.iOffset = m_pWriter->getFileSize(m_pDataFile);
+	entry.iSize = (uint32_t)(iPrefixSize + iSize);
+	entry.iFlags = (bSyncPoint ? RECORDING_FLAG_SYNC_POINT : 0);
+	entry.iPresentationTimeUs = iPresentationTimeUs;
+
+	if(iPrefixSize > 0){
+		m_pWriter->append(m_pDataFile, pPrefix, iPrefixSize);
+	}
+	m_pWriter->append(m_pDataFile, pData, iSize);
+	m_pWriter->append(m_pIndexFile, &entry, sizeof(entry));
+}
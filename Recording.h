@@ -0,0 +1,212 @@
+/*
+ * Recording.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef RECORDING_H_
+#define RECORDING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <UsageEnvironment.hh>
+
+#include "FramePool.h"
+
+#define RECORDING_BUFFER_SIZE (1024*1024) // Size of a write, the buffers of the FramePool are page aligned
+#define RECORDING_DIRECT_ALIGN 4096 // Offset and size of the writes with O_DIRECT, a multiple of the logical block size
+#define RECORDING_URING_ENTRIES 256 // Writes in flight per event loop
+#define RECORDING_SUBMIT_BATCH 32 // Writes queued before a submission
+#define RECORDING_SUBMIT_DELAY 5000 // Longest wait of a queued write before its submission, in microseconds
+#define RECORDING_MAX_PENDING_SIZE (64*1024*1024) // Above, the frames are dropped until the storage catches up
+
+#define RECORDING_FLAG_SYNC_POINT 1 // A decoder can start at this frame
+
+//////////////////////////////////
+// RecordingWriter declaration
+//////////////////////////////////
+
+// Entry of the index file of a segment, one per frame
+struct RecordingIndexEntry
+{
+	uint64_t iOffset; // In the data file
+	uint32_t iSize;
+	uint32_t iFlags;
+	int64_t iPresentationTimeUs;
+};
+
+struct RecordingStats
+{
+	uint64_t iBytesSubmitted;
+	uint64_t iBytesWritten;
+	uint64_t iWrites;
+	uint64_t iFailedWrites;
+	uint64_t iFilesOpened;
+	uint64_t iDroppedFrames;
+	bool bUring;
+};
+
+struct RecordingFile;
+
+// Writes of the files of an event loop. The data is appended to page aligned
+// buffers, each full buffer being one write: they are batched and submitted
+// to io_uring, whose completions are read by the event loop, or handed to a
+// writer thread if io_uring is not available. The event loop never waits for
+// the storage, except to open the files.
+//
+// A writer created by createShared() has no event loop: it can be used by
+// several threads, each file being written by one of them, and each write is
+// handed at once to its writer thread.
+//
+// The files are written with O_DIRECT when their file system supports it, the
+// frames going from the buffers to the disk without filling the page cache.
+// The last write of a file is padded to RECORDING_DIRECT_ALIGN, and the file
+// truncated to its size once written.
+class RecordingWriter
+{
+public:
+	static RecordingWriter* createNew(TaskScheduler& scheduler, bool bUseUring);
+	static RecordingWriter* createShared();
+	virtual ~RecordingWriter();
+
+	RecordingFile* openFile(const char* szPath);
+	void append(RecordingFile* pFile, const void* pData, size_t iSize);
+	// Only returns the offset, written by the last appends of the file
+	uint64_t getFileSize(RecordingFile* pFile) const;
+	// The file is closed once its last write is done
+	void closeFile(RecordingFile* pFile);
+
+	// Submits the queued writes
+	void flush();
+	// Waits for all the writes, nothing can be written afterwards
+	void drain();
+
+	// The storage is too slow for the streams
+	bool isBacklogged() const;
+	void addDroppedFrame();
+
+	void getStats(RecordingStats& stats) const;
+
+private:
+	RecordingWriter(TaskScheduler* pScheduler);
+
+	struct Write
+	{
+		RecordingFile* pFile;
+		FrameBuffer* pBuffer; // NULL to close the file
+		uint64_t iOffset;
+	};
+
+	void queueBuffer(RecordingFile* pFile);
+	void queueWrite(const Write& write);
+
+	// io_uring
+	bool setupUring();
+	void releaseUring();
+	bool submitToUring();
+	void failUnsubmitted(int iError);
+	void reapCompletions(bool bWait);
+	void completeWrite(Write* pWrite, int iResult);
+	void closeWhenWritten(RecordingFile* pFile);
+	static void completionHandler(void* clientData, int mask);
+
+	// Writer thread
+	bool startThread();
+	static void* writerThread(void* arg);
+	void runThread();
+
+	static void submitTaskHandler(void* clientData);
+
+private:
+	TaskScheduler* m_pScheduler; // NULL if shared
+	TaskToken m_submitTask;
+	std::vector<Write> m_listQueued;
+
+	bool m_bUring;
+	int m_iUringFd;
+	int m_iEventFd;
+	void* m_pSqRing;
+	size_t m_iSqRingSize;
+	void* m_pCqRing;
+	size_t m_iCqRingSize;
+	void* m_pSqes;
+	size_t m_iSqesSize;
+	unsigned* m_pSqHead;
+	unsigned* m_pSqTail;
+	unsigned* m_pSqMask;
+	unsigned* m_pSqArray;
+	unsigned* m_pCqHead;
+	unsigned* m_pCqTail;
+	unsigned* m_pCqMask;
+	void* m_pCqes;
+	unsigned m_iInFlight; // Given to the ring and not completed
+	unsigned m_iUnsubmitted; // Of them, still in the submission ring, not consumed by the kernel
+	unsigned m_iRingEntries;
+
+	pthread_t m_thread;
+	bool m_bThreadStarted;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond;
+	std::deque<Write> m_listThreadQueue;
+	bool m_bStopThread;
+
+	std::atomic<uint64_t> m_iBytesSubmitted;
+	std::atomic<uint64_t> m_iBytesWritten;
+	std::atomic<uint64_t> m_iBytesFailed;
+	std::atomic<uint64_t> m_iWrites;
+	std::atomic<uint64_t> m_iFailedWrites;
+	std::atomic<uint64_t> m_iFilesOpened;
+	std::atomic<uint64_t> m_iDroppedFrames;
+};
+
+//////////////////////////////////
+// RecordingTrack declaration
+//////////////////////////////////
+
+// Frames of a subsession written in segments of a fixed duration: a data file
+// and an index file of RecordingIndexEntry, named after the start time of the
+// segment. A segment always starts with a sync point: the next one starts at
+// the first sync point once the duration is elapsed. A segment without sync
+// point for twice the duration, or during which the writer was backlogged, is
+// ended at once and the frames are dropped until the next sync point.
+class RecordingTrack
+{
+public:
+	RecordingTrack(RecordingWriter* pWriter, const char* szDirectory, const char* szName, const char* szExtension, int iSegmentDuration);
+	~RecordingTrack();
+
+	// The prefix, such as a start code, is written before the frame in the data file
+	void addFrame(const uint8_t* pPrefix, size_t iPrefixSize, const uint8_t* pData, size_t iSize,
+			int64_t iPresentationTimeUs, bool bSyncPoint);
+
+	int getSegmentCount() const { return m_iSegmentCount; }
+
+private:
+	bool openSegment(int64_t iNowUs);
+	void closeSegment();
+
+private:
+	RecordingWriter* m_pWriter;
+	std::string m_szDirectory;
+	std::string m_szName;
+	std::string m_szExtension;
+	int64_t m_iSegmentDurationUs;
+
+	RecordingFile* m_pDataFile;
+	RecordingFile* m_pIndexFile;
+	int64_t m_iSegmentStartUs; // Monotonic clock
+	int m_iSegmentCount;
+	bool m_bOpenFailed;
+};
+
+// Creates the missing directories of the path
+bool recording_make_directories(const char* szPath);
+
+#endif /* RECORDING_H_ */
@@ -0,0 +1,194 @@
+/*
+ * ReorderWindow.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "ReorderWindow.h"
+
+//////////////////////////////////
+// ReorderWindow definition
+//////////////////////////////////
+
+ReorderWindow::ReorderWindow(ReorderMode mode)
+{
+	m_mode = mode;
+	m_iThresholdUs = getInitialThreshold(mode);
+	m_iPreviousThresholdUs = m_iThresholdUs;
+
+	m_bStarted = false;
+	m_iHighestSeqNum = 0;
+	m_iOldestGap = 0;
+	memset(m_packets, 0, sizeof(m_packets));
+
+	memset(m_samples, 0, sizeof(m_samples));
+	m_iNextSample = 0;
+
+	m_iReordered = 0;
+	m_iGivenUp = 0;
+	m_iLate = 0;
+	m_iMaxDepth = 0;
+	m_iMaxLatenessUs = 0;
+}
+
+unsigned ReorderWindow::getInitialThreshold(ReorderMode mode)
+{
+	return (mode == REORDER_MODE_COMPLETENESS ? REORDER_COMPLETENESS_INITIAL_THRESHOLD : REORDER_LATENCY_INITIAL_THRESHOLD);
+}
+
+const char* ReorderWindow::getModeName(ReorderMode mode)
+{
+	switch(mode){
+	case REORDER_MODE_LATENCY: return "latency";
+	case REORDER_MODE_COMPLETENESS: return "completeness";
+	}
+	return "unknown";
+}
+
+bool ReorderWindow::getMode(const char* szName, ReorderMode* pMode)
+{
+	if(strcmp(szName, "latency") == 0){
+		*pMode = REORDER_MODE_LATENCY;
+		return true;
+	}
+	if(strcmp(szName, "completeness") == 0){
+		*pMode = REORDER_MODE_COMPLETENESS;
+		return true;
+	}
+	return false;
+}
+
+void ReorderWindow::reset(uint32_t iSeqNum)
+{
+	m_iHighestSeqNum = iSeqNum;
+	m_iOldestGap = iSeqNum + 1;
+	Packet& packet = m_packets[iSeqNum % REORDER_WINDOW_HISTORY];
+	packet.iSeqNum = iSeqNum;
+	packet.state = PACKET_STATE_RECEIVED;
+	packet.iGapStartUs = 0;
+	m_bStarted = true;
+}
+
+void ReorderWindow::notePacket(uint16_t iSeqNum, int64_t iNowUs)
+{
+	if(!m_bStarted){
+		// Extended from the second cycle, so the history before the first packet doesn't wrap
+		reset(0x10000 + iSeqNum);
+		return;
+	}
+
+	int16_t iDelta = (int16_t)(iSeqNum - (uint16_t)m_iHighestSeqNum);
+	if(iDelta > 0){
+		// A jump longer than the history is a new sequence, not a gap
+		if(iDelta >= REORDER_WINDOW_HISTORY){
+			reset(m_iHighestSeqNum + iDelta);
+			return;
+		}
+
+		// The skipped packets are waited for from now
+		for(uint32_t i=m_iHighestSeqNum+1; i!=m_iHighestSeqNum+iDelta; i++){
+			Packet& packet = m_packets[i % REORDER_WINDOW_HISTORY];
+			packet.iSeqNum = i;
+			packet.state = PACKET_STATE_MISSING;
+			packet.iGapStartUs = iNowUs;
+		}
+		m_iHighestSeqNum += iDelta;
+		Packet& packet = m_packets[m_iHighestSeqNum % REORDER_WINDOW_HISTORY];
+		packet.iSeqNum = m_iHighestSeqNum;
+		packet.state = PACKET_STATE_RECEIVED;
+		packet.iGapStartUs = 0;
+	}else if(iDelta < 0 && -iDelta < REORDER_WINDOW_HISTORY){
+		uint32_t iExtSeqNum = m_iHighestSeqNum + iDelta;
+		Packet& packet = m_packets[iExtSeqNum % REORDER_WINDOW_HISTORY];
+		if(packet.iSeqNum == iExtSeqNum && packet.state != PACKET_STATE_RECEIVED){
+			if(packet.state == PACKET_STATE_MISSING){
+				m_iReordered++;
+			}else{
+				m_iLate++;
+			}
+			addSample(iNowUs - packet.iGapStartUs, -iDelta, iNowUs);
+			packet.state = PACKET_STATE_RECEIVED;
+		}
+	}
+	// Otherwise a duplicate, or too old to be followed
+
+	expireGaps(iNowUs);
+}
+
+void ReorderWindow::expireGaps(int64_t iNowUs)
+{
+	// The gaps are opened in the order of the sequence numbers, so the first one
+	// still in time ends the search
+	if((int32_t)(m_iHighestSeqNum - m_iOldestGap) >= REORDER_WINDOW_HISTORY){
+		m_iOldestGap = m_iHighestSeqNum - REORDER_WINDOW_HISTORY + 1;
+	}
+	while((int32_t)(m_iHighestSeqNum - m_iOldestGap) > 0){
+		Packet& packet = m_packets[m_iOldestGap % REORDER_WINDOW_HISTORY];
+		if(packet.iSeqNum == m_iOldestGap && packet.state == PACKET_STATE_MISSING){
+			if(iNowUs - packet.iGapStartUs <= (int64_t)m_iThresholdUs){
+				break;
+			}
+			packet.state = PACKET_STATE_GIVEN_UP;
+			m_iGivenUp++;
+		}
+		m_iOldestGap++;
+	}
+}
+
+void ReorderWindow::addSample(int64_t iLatenessUs, int iDepth, int64_t iNowUs)
+{
+	Sample& sample = m_samples[m_iNextSample];
+	sample.iTimeUs = iNowUs;
+	sample.iLatenessUs = (unsigned)std::max((int64_t)0, std::min(iLatenessUs, (int64_t)REORDER_COMPLETENESS_MAX_THRESHOLD * 2));
+	sample.iDepth = iDepth;
+	m_iNextSample = (m_iNextSample + 1) % REORDER_WINDOW_SAMPLES;
+}
+
+bool ReorderWindow::sample(int64_t iNowUs)
+{
+	unsigned listLateness[REORDER_WINDOW_SAMPLES];
+	int iCount = 0;
+	m_iMaxDepth = 0;
+	for(int i=0; i<REORDER_WINDOW_SAMPLES; i++){
+		const Sample& sample = m_samples[i];
+		if(sample.iTimeUs == 0 || iNowUs - sample.iTimeUs > (int64_t)REORDER_WINDOW_SAMPLE_DURATION * 1000000){
+			continue;
+		}
+		listLateness[iCount++] = sample.iLatenessUs;
+		m_iMaxDepth = std::max(m_iMaxDepth, sample.iDepth);
+	}
+
+	// With half again as margin: the live view lets the rare latest ones go, the recording waits for them
+	unsigned iTargetUs = 0;
+	m_iMaxLatenessUs = 0;
+	if(iCount > 0){
+		std::sort(listLateness, listLateness + iCount);
+		m_iMaxLatenessUs = listLateness[iCount-1];
+		if(m_mode == REORDER_MODE_COMPLETENESS){
+			iTargetUs = m_iMaxLatenessUs * 3 / 2;
+		}else{
+			iTargetUs = listLateness[(iCount-1) * 95 / 100] * 3 / 2;
+		}
+	}
+	if(m_mode == REORDER_MODE_COMPLETENESS){
+		iTargetUs = std::min(std::max(iTargetUs, (unsigned)REORDER_COMPLETENESS_MIN_THRESHOLD), (unsigned)REORDER_COMPLETENESS_MAX_THRESHOLD);
+	}else{
+		iTargetUs = std::min(std::max(iTargetUs, (unsigned)REORDER_LATENCY_MIN_THRESHOLD), (unsigned)REORDER_LATENCY_MAX_THRESHOLD);
+	}
+
+	// Grows at once, shrinks by half at most
+	if(iTargetUs < m_iThresholdUs / 2){
+		iTargetUs = m_iThresholdUs / 2;
+	}
+	unsigned iChangeUs = (iTargetUs > m_iThresholdUs ? iTargetUs - m_iThresholdUs : m_iThresholdUs - iTargetUs);
+	if(iChangeUs == 0 || iChangeUs * 100 < m_iThresholdUs * REORDER_WINDOW_HYSTERESIS){
+		return false;
+	}
+	m_iPreviousThresholdUs = m_iThresholdUs;
+	m_iThresholdUs = iTargetUs;
+	return true;
+}
@@ -0,0 +1,116 @@
+/*
+ * ReorderWindow.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef REORDERWINDOW_H_
+#define REORDERWINDOW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REORDER_WINDOW_HISTORY 1024 // Sequence numbers followed behind the highest one, a power of 2
+#define REORDER_WINDOW_SAMPLES 256 // Late arrivals kept to compute the threshold
+#define REORDER_WINDOW_SAMPLE_DURATION 30 // In seconds, older late arrivals are forgotten
+#define REORDER_WINDOW_HYSTERESIS 10 // In percent of the threshold, smaller changes are not applied
+
+// In microseconds
+#define REORDER_LATENCY_MIN_THRESHOLD 10000
+#define REORDER_LATENCY_MAX_THRESHOLD 200000
+#define REORDER_LATENCY_INITIAL_THRESHOLD 50000
+#define REORDER_COMPLETENESS_MIN_THRESHOLD 100000
+#define REORDER_COMPLETENESS_MAX_THRESHOLD 1000000
+#define REORDER_COMPLETENESS_INITIAL_THRESHOLD 200000
+
+enum ReorderMode
+{
+	REORDER_MODE_LATENCY = 0, // Live view: a missing packet is waited for as long as most late ones need
+	REORDER_MODE_COMPLETENESS, // Recording: as long as the latest one needed
+};
+
+//////////////////////////////////
+// ReorderWindow declaration
+//////////////////////////////////
+
+// Time the reordering buffer of live555 waits for a missing RTP packet before
+// giving up on it. Every packet of the subsession is given in its arrival
+// order with its sequence number: a gap opens when a packet is skipped, and is
+// closed by the missing packet arriving late, or given up once older than the
+// threshold. The threshold follows the recent late arrivals, those in time as
+// well as those arriving after being given up on. Used by the event loop of
+// the stream only.
+class ReorderWindow
+{
+public:
+	ReorderWindow(ReorderMode mode);
+
+	// Called for each RTP packet, in the order of arrival
+	void notePacket(uint16_t iSeqNum, int64_t iNowUs);
+
+	// Called periodically. Returns true if the threshold was changed.
+	bool sample(int64_t iNowUs);
+
+	unsigned getThreshold() const { return m_iThresholdUs; } // In microseconds
+	unsigned getPreviousThreshold() const { return m_iPreviousThresholdUs; }
+	ReorderMode getMode() const { return m_mode; }
+
+	// Totals since the creation
+	uint64_t getReordered() const { return m_iReordered; } // Arrived out of order, in time
+	uint64_t getGivenUp() const { return m_iGivenUp; } // Lost, or arriving too late
+	uint64_t getLate() const { return m_iLate; } // Arrived after being given up on
+	// Over the late arrivals kept
+	int getMaxDepth() const { return m_iMaxDepth; } // In packets behind the highest one
+	unsigned getMaxLateness() const { return m_iMaxLatenessUs; } // In microseconds
+
+	static unsigned getInitialThreshold(ReorderMode mode);
+	static const char* getModeName(ReorderMode mode);
+	static bool getMode(const char* szName, ReorderMode* pMode);
+
+private:
+	void reset(uint32_t iSeqNum);
+	void addSample(int64_t iLatenessUs, int iDepth, int64_t iNowUs);
+	void expireGaps(int64_t iNowUs);
+
+private:
+	enum PacketState
+	{
+		PACKET_STATE_RECEIVED = 0,
+		PACKET_STATE_MISSING,
+		PACKET_STATE_GIVEN_UP,
+	};
+
+	struct Packet
+	{
+		uint32_t iSeqNum; // Extended with the wraps
+		uint8_t state;
+		int64_t iGapStartUs; // Arrival of the packet after the gap
+	};
+
+	struct Sample
+	{
+		int64_t iTimeUs; // 0 if unused
+		unsigned iLatenessUs;
+		int iDepth;
+	};
+
+	ReorderMode m_mode;
+	unsigned m_iThresholdUs;
+	unsigned m_iPreviousThresholdUs;
+
+	bool m_bStarted;
+	uint32_t m_iHighestSeqNum; // Extended
+	Packet m_packets[REORDER_WINDOW_HISTORY]; // By extended sequence number modulo the size
+	uint32_t m_iOldestGap; // Extended sequence number from which the gaps are searched for expiration
+
+	Sample m_samples[REORDER_WINDOW_SAMPLES];
+	int m_iNextSample;
+
+	uint64_t m_iReordered;
+	uint64_t m_iGivenUp;
+	uint64_t m_iLate;
+	int m_iMaxDepth;
+	unsigned m_iMaxLatenessUs;
+};
+
+#endif /* REORDERWINDOW_H_ */
@@ -0,0 +1,531 @@
+/*
+ * Restream.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "Restream.h"
+#include "Metrics.h"
+#include "NalParser.h"
+
+//////////////////////////////////
+// RestreamMediaSubsession declaration
+//////////////////////////////////
+
+// A track of a stream, each client having its own source
+class RestreamMediaSubsession : public OnDemandServerMediaSubsession
+{
+public:
+	static RestreamMediaSubsession* createNew(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId,
+			const RestreamTrackInfo& info);
+
+protected:
+	RestreamMediaSubsession(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId,
+			const RestreamTrackInfo& info);
+
+	virtual FramedSource* createNewStreamSource(unsigned clientSessionId, unsigned& estBitrate);
+	virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic, FramedSource* inputSource);
+
+private:
+	RestreamServer* m_pServer;
+	int m_iStreamId;
+	int m_iSubsessionId;
+	bool m_bH265;
+	std::string m_szSPropParameterSets;
+	std::string m_szSPropVPS;
+	std::string m_szSPropSPS;
+	std::string m_szSPropPPS;
+	unsigned m_iBandwidth;
+};
+
+//////////////////////////////////
+// RestreamMediaSubsession definition
+//////////////////////////////////
+
+RestreamMediaSubsession* RestreamMediaSubsession::createNew(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId,
+		const RestreamTrackInfo& info)
+{
+	return new RestreamMediaSubsession(env, pServer, iStreamId, iSubsessionId, info);
+}
+
+RestreamMediaSubsession::RestreamMediaSubsession(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId,
+		const RestreamTrackInfo& info)
+	: OnDemandServerMediaSubsession(env, False)
+{
+	m_pServer = pServer;
+	m_iStreamId = iStreamId;
+	m_iSubsessionId = iSubsessionId;
+	m_bH265 = (strcmp(info.szCodecName, "H265") == 0);
+	m_szSPropParameterSets = (info.szSPropParameterSets ? info.szSPropParameterSets : "");
+	m_szSPropVPS = (info.szSPropVPS ? info.szSPropVPS : "");
+	m_szSPropSPS = (info.szSPropSPS ? info.szSPropSPS : "");
+	m_szSPropPPS = (info.szSPropPPS ? info.szSPropPPS : "");
+	m_iBandwidth = info.iBandwidth;
+}
+
+FramedSource* RestreamMediaSubsession::createNewStreamSource(unsigned clientSessionId, unsigned& estBitrate)
+{
+	estBitrate = (m_iBandwidth > 0 ? m_iBandwidth : RESTREAM_DEFAULT_BITRATE);
+
+	// The session id is 0 for the source only used to build the SDP
+	FramedSource* pSource = RestreamFrameSource::createNew(envir(), m_pServer, m_iStreamId, m_iSubsessionId, clientSessionId != 0);
+	// The frames are NAL units, so the framers only look at their type
+	if(m_bH265){
+		return H265VideoStreamDiscreteFramer::createNew(envir(), pSource);
+	}
+	return H264VideoStreamDiscreteFramer::createNew(envir(), pSource);
+}
+
+RTPSink* RestreamMediaSubsession::createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic, FramedSource* /*inputSource*/)
+{
+	// The parameter sets of the camera SDP, the clients also get them in-band from the cache
+	if(m_bH265){
+		return H265VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				m_szSPropVPS.c_str(), m_szSPropSPS.c_str(), m_szSPropPPS.c_str());
+	}
+	return H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic, m_szSPropParameterSets.c_str());
+}
+
+//////////////////////////////////
+// RestreamFrameSource definition
+//////////////////////////////////
+
+RestreamFrameSource* RestreamFrameSource::createNew(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId, bool bAttach)
+{
+	return new RestreamFrameSource(env, pServer, iStreamId, iSubsessionId, bAttach);
+}
+
+RestreamFrameSource::RestreamFrameSource(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId, bool bAttach)
+	: FramedSource(env)
+{
+	m_pServer = pServer;
+	m_iStreamId = iStreamId;
+	m_iSubsessionId = iSubsessionId;
+	m_bAttached = bAttach;
+	pthread_mutex_init(&m_mutex, NULL);
+	m_iQueuedBytes = 0;
+	m_iUnitOffset = 0;
+	m_bWaitKeyFrame = true;
+	m_bSignaled = false;
+
+	if(m_bAttached){
+		m_pServer->addSource(this);
+	}
+}
+
+RestreamFrameSource::~RestreamFrameSource()
+{
+	// No frame is queued anymore once detached
+	if(m_bAttached){
+		m_pServer->removeSource(this);
+	}
+	clearQueue();
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void RestreamFrameSource::clearQueue()
+{
+	for(size_t i=0; i<m_listFrames.size(); i++){
+		m_listFrames[i].pBuffer->unref();
+	}
+	m_listFrames.clear();
+	m_iQueuedBytes = 0;
+	m_iUnitOffset = 0;
+}
+
+void RestreamFrameSource::gopCacheConsumer(void* clientData, const GopCacheFrame& frame)
+{
+	((RestreamFrameSource*)clientData)->queueFrame(frame);
+}
+
+void RestreamFrameSource::queueFrame(const GopCacheFrame& frame)
+{
+	bool bKeyFrame = ((frame.iFlags & NAL_FRAME_KEY_FRAME) != 0);
+	bool bParameterSets = ((frame.iFlags & NAL_FRAME_PARAMETER_SETS) && !(frame.iFlags & NAL_FRAME_SLICE));
+	size_t iDropped = 0;
+	bool bSignal = false;
+
+	// Copied before locking, the frames are given by one thread at a time
+	FrameBuffer* pBuffer = NULL;
+	if(!m_bWaitKeyFrame || bKeyFrame || bParameterSets){
+		pBuffer = FramePool::getInstance()->keep(frame.pBuffer);
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	if(m_listFrames.size() >= RESTREAM_CLIENT_QUEUE_SIZE ||
+			(pBuffer && m_iQueuedBytes + pBuffer->capacity() > RESTREAM_CLIENT_QUEUE_BYTES)){
+		// The client is too slow: restart from the next key frame rather than sending a broken GOP
+		iDropped = m_listFrames.size();
+		clearQueue();
+		m_bWaitKeyFrame = true;
+	}
+	if(pBuffer && (!m_bWaitKeyFrame || bKeyFrame || bParameterSets)){
+		GopCacheFrame queuedFrame = frame;
+		queuedFrame.pBuffer = pBuffer;
+		m_listFrames.push_back(queuedFrame);
+		m_iQueuedBytes += pBuffer->capacity();
+		pBuffer = NULL;
+		if(bKeyFrame){
+			m_bWaitKeyFrame = false;
+		}
+		bSignal = (m_listFrames.size() == 1);
+	}else{
+		iDropped++;
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	if(pBuffer){
+		pBuffer->unref();
+	}
+
+	if(iDropped > 0){
+		m_pServer->addFramesDropped(iDropped);
+	}
+	// Otherwise the source is already busy with the previous frames
+	if(bSignal){
+		m_pServer->signalSource(this);
+	}
+}
+
+void RestreamFrameSource::doGetNextFrame()
+{
+	deliverQueuedFrame();
+}
+
+void RestreamFrameSource::deliverQueuedFrame()
+{
+	if(!isCurrentlyAwaitingData()){
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	if(m_listFrames.empty()){
+		// Signaled by the next frame queued
+		pthread_mutex_unlock(&m_mutex);
+		return;
+	}
+
+	const GopCacheFrame& frame = m_listFrames.front();
+	const uint8_t* pData = frame.pBuffer->data();
+	const uint8_t* pEnd = pData + frame.pBuffer->size();
+	const uint8_t* pUnit = pData;
+	const uint8_t* pUnitEnd = pEnd;
+	bool bLastUnit = true;
+	if(frame.iFlags & NAL_FRAME_ANNEX_B){
+		// One NAL unit per call, the discrete framer takes a single one
+		if(m_iUnitOffset == 0){
+			const uint8_t* pStartCode = nal_find_start_code(pData, pEnd);
+			m_iUnitOffset = (pStartCode < pEnd ? pStartCode + 3 - pData : 0);
+		}
+		pUnit = pData + m_iUnitOffset;
+		const uint8_t* pNext = nal_find_start_code(pUnit, pEnd);
+		pUnitEnd = pNext;
+		// The zero byte of a four bytes start code belongs to the next one
+		while(pUnitEnd > pUnit && pUnitEnd[-1] == 0){
+			pUnitEnd--;
+		}
+		bLastUnit = (pNext >= pEnd);
+		m_iUnitOffset = (bLastUnit ? 0 : pNext + 3 - pData);
+	}
+
+	size_t iUnitSize = pUnitEnd - pUnit;
+	if(iUnitSize > fMaxSize){
+		fFrameSize = fMaxSize;
+		fNumTruncatedBytes = (unsigned)(iUnitSize - fMaxSize);
+	}else{
+		fFrameSize = (unsigned)iUnitSize;
+		fNumTruncatedBytes = 0;
+	}
+	memcpy(fTo, pUnit, fFrameSize);
+	fPresentationTime = frame.presentationTime;
+	fDurationInMicroseconds = 0;
+
+	FrameBuffer* pReleasedBuffer = NULL;
+	if(bLastUnit){
+		pReleasedBuffer = frame.pBuffer;
+		m_iQueuedBytes -= pReleasedBuffer->capacity();
+		m_listFrames.pop_front();
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	if(pReleasedBuffer){
+		pReleasedBuffer->unref();
+	}
+	m_pServer->addFrameSent(fFrameSize);
+
+	FramedSource::afterGetting(this);
+}
+
+//////////////////////////////////
+// RestreamServer definition
+//////////////////////////////////
+
+RestreamServer* RestreamServer::createNew(UsageEnvironment& env, int iPort, size_t iMaxFrameSize)
+{
+	// The biggest NAL unit given to the packetizers
+	if(OutPacketBuffer::maxSize < iMaxFrameSize){
+		OutPacketBuffer::maxSize = (unsigned)iMaxFrameSize;
+	}
+
+	RTSPServer* pRTSPServer = RTSPServer::createNew(env, Port(iPort));
+	if(!pRTSPServer){
+		return NULL;
+	}
+	return new RestreamServer(env, pRTSPServer, iPort);
+}
+
+RestreamServer::RestreamServer(UsageEnvironment& env, RTSPServer* pRTSPServer, int iPort)
+	: m_env(env)
+{
+	m_pRTSPServer = pRTSPServer;
+	m_iPort = iPort;
+	pthread_mutex_init(&m_mutexTracks, NULL);
+	m_tracksChangedTrigger = m_env.taskScheduler().createEventTrigger(tracksChangedHandler);
+	pthread_mutex_init(&m_mutexReady, NULL);
+	m_sourcesReadyTrigger = m_env.taskScheduler().createEventTrigger(sourcesReadyHandler);
+	m_iClients = 0;
+	m_iFramesSent = 0;
+	m_iBytesSent = 0;
+	m_iFramesDropped = 0;
+
+	MetricsRegistry::getInstance()->m_restream.bEnabled.store(true, std::memory_order_relaxed);
+}
+
+RestreamServer::~RestreamServer()
+{
+	// The client sessions, then their sources, are closed with the server
+	Medium::close(m_pRTSPServer);
+	m_pRTSPServer = NULL;
+	m_mapSessions.clear();
+
+	m_env.taskScheduler().deleteEventTrigger(m_tracksChangedTrigger);
+	m_env.taskScheduler().deleteEventTrigger(m_sourcesReadyTrigger);
+
+	for(size_t i=0; i<m_listTracks.size(); i++){
+		delete m_listTracks[i];
+	}
+	m_listTracks.clear();
+	pthread_mutex_destroy(&m_mutexTracks);
+	pthread_mutex_destroy(&m_mutexReady);
+}
+
+RestreamServer::Track* RestreamServer::findTrack(int iStreamId, int iSubsessionId)
+{
+	for(size_t i=0; i<m_listTracks.size(); i++){
+		if(m_listTracks[i]->iStreamId == iStreamId && m_listTracks[i]->iSubsessionId == iSubsessionId){
+			return m_listTracks[i];
+		}
+	}
+	return NULL;
+}
+
+void RestreamServer::addTrack(int iStreamId, int iSubsessionId, const RestreamTrackInfo& info, GopCacheEntry* pEntry)
+{
+	bool bNewTrack = false;
+
+	pthread_mutex_lock(&m_mutexTracks);
+	Track* pTrack = findTrack(iStreamId, iSubsessionId);
+	if(!pTrack){
+		pTrack = new Track();
+		pTrack->iStreamId = iStreamId;
+		pTrack->iSubsessionId = iSubsessionId;
+		pTrack->szCodecName = info.szCodecName;
+		pTrack->szSPropParameterSets = (info.szSPropParameterSets ? info.szSPropParameterSets : "");
+		pTrack->szSPropVPS = (info.szSPropVPS ? info.szSPropVPS : "");
+		pTrack->szSPropSPS = (info.szSPropSPS ? info.szSPropSPS : "");
+		pTrack->szSPropPPS = (info.szSPropPPS ? info.szSPropPPS : "");
+		pTrack->iBandwidth = info.iBandwidth;
+		pTrack->pEntry = NULL;
+		pTrack->bPublished = false;
+		m_listTracks.push_back(pTrack);
+		bNewTrack = true;
+	}
+
+	// The clients of the previous session go on with the new one
+	pTrack->pEntry = pEntry;
+	for(size_t i=0; i<pTrack->listSources.size(); i++){
+		pEntry->attach(RestreamFrameSource::gopCacheConsumer, pTrack->listSources[i]);
+	}
+	pthread_mutex_unlock(&m_mutexTracks);
+
+	if(bNewTrack){
+		m_env.taskScheduler().triggerEvent(m_tracksChangedTrigger, this);
+	}
+}
+
+void RestreamServer::removeTrack(int iStreamId, int iSubsessionId)
+{
+	pthread_mutex_lock(&m_mutexTracks);
+	Track* pTrack = findTrack(iStreamId, iSubsessionId);
+	if(pTrack && pTrack->pEntry){
+		for(size_t i=0; i<pTrack->listSources.size(); i++){
+			pTrack->pEntry->detach(RestreamFrameSource::gopCacheConsumer, pTrack->listSources[i]);
+		}
+		pTrack->pEntry = NULL;
+	}
+	pthread_mutex_unlock(&m_mutexTracks);
+}
+
+void RestreamServer::tracksChangedHandler(void* clientData)
+{
+	((RestreamServer*)clientData)->publishTracks();
+}
+
+void RestreamServer::publishTracks()
+{
+	// Copied, the live555 objects are created without the mutex
+	std::vector<Track> listNewTracks;
+	pthread_mutex_lock(&m_mutexTracks);
+	for(size_t i=0; i<m_listTracks.size(); i++){
+		Track* pTrack = m_listTracks[i];
+		if(!pTrack->bPublished){
+			pTrack->bPublished = true;
+			listNewTracks.push_back(*pTrack);
+			listNewTracks.back().listSources.clear();
+		}
+	}
+	pthread_mutex_unlock(&m_mutexTracks);
+
+	for(size_t i=0; i<listNewTracks.size(); i++){
+		const Track& track = listNewTracks[i];
+		ServerMediaSession* pSession = NULL;
+		std::map<int, ServerMediaSession*>::iterator iter = m_mapSessions.find(track.iStreamId);
+		bool bNewSession = (iter == m_mapSessions.end());
+		if(bNewSession){
+			char szName[32];
+			snprintf(szName, sizeof(szName), "stream%d", track.iStreamId);
+			pSession = ServerMediaSession::createNew(m_env, szName, szName, "Restreamed by TestLiveMedia");
+			m_mapSessions[track.iStreamId] = pSession;
+		}else{
+			pSession = iter->second;
+		}
+
+		RestreamTrackInfo info;
+		info.szCodecName = track.szCodecName.c_str();
+		info.szSPropParameterSets = track.szSPropParameterSets.c_str();
+		info.szSPropVPS = track.szSPropVPS.c_str();
+		info.szSPropSPS = track.szSPropSPS.c_str();
+		info.szSPropPPS = track.szSPropPPS.c_str();
+		info.iBandwidth = track.iBandwidth;
+		pSession->addSubsession(RestreamMediaSubsession::createNew(m_env, this, track.iStreamId, track.iSubsessionId, info));
+		if(bNewSession){
+			m_pRTSPServer->addServerMediaSession(pSession);
+		}
+	}
+}
+
+void RestreamServer::addSource(RestreamFrameSource* pSource)
+{
+	pthread_mutex_lock(&m_mutexTracks);
+	Track* pTrack = findTrack(pSource->m_iStreamId, pSource->m_iSubsessionId);
+	if(pTrack){
+		pTrack->listSources.push_back(pSource);
+		if(pTrack->pEntry){
+			pTrack->pEntry->attach(RestreamFrameSource::gopCacheConsumer, pSource);
+		}
+	}
+	pthread_mutex_unlock(&m_mutexTracks);
+	m_iClients.fetch_add(1, std::memory_order_relaxed);
+	updateMetrics();
+}
+
+void RestreamServer::removeSource(RestreamFrameSource* pSource)
+{
+	pthread_mutex_lock(&m_mutexTracks);
+	Track* pTrack = findTrack(pSource->m_iStreamId, pSource->m_iSubsessionId);
+	if(pTrack){
+		std::vector<RestreamFrameSource*>::iterator iter = std::find(pTrack->listSources.begin(), pTrack->listSources.end(), pSource);
+		if(iter != pTrack->listSources.end()){
+			pTrack->listSources.erase(iter);
+			if(pTrack->pEntry){
+				pTrack->pEntry->detach(RestreamFrameSource::gopCacheConsumer, pSource);
+			}
+		}
+	}
+	pthread_mutex_unlock(&m_mutexTracks);
+
+	pthread_mutex_lock(&m_mutexReady);
+	std::vector<RestreamFrameSource*>::iterator iter = std::find(m_listReadySources.begin(), m_listReadySources.end(), pSource);
+	if(iter != m_listReadySources.end()){
+		m_listReadySources.erase(iter);
+	}
+	pthread_mutex_unlock(&m_mutexReady);
+	std::replace(m_listDeliveredSources.begin(), m_listDeliveredSources.end(), pSource, (RestreamFrameSource*)NULL);
+
+	m_iClients.fetch_sub(1, std::memory_order_relaxed);
+	updateMetrics();
+}
+
+void RestreamServer::signalSource(RestreamFrameSource* pSource)
+{
+	bool bTrigger = false;
+	pthread_mutex_lock(&m_mutexReady);
+	if(!pSource->m_bSignaled){
+		pSource->m_bSignaled = true;
+		bTrigger = m_listReadySources.empty();
+		m_listReadySources.push_back(pSource);
+	}
+	pthread_mutex_unlock(&m_mutexReady);
+
+	// One trigger for all the sources ready, the event loop runs it once
+	if(bTrigger){
+		m_env.taskScheduler().triggerEvent(m_sourcesReadyTrigger, this);
+	}
+}
+
+void RestreamServer::sourcesReadyHandler(void* clientData)
+{
+	((RestreamServer*)clientData)->deliverReadySources();
+}
+
+void RestreamServer::deliverReadySources()
+{
+	pthread_mutex_lock(&m_mutexReady);
+	m_listDeliveredSources.swap(m_listReadySources);
+	for(size_t i=0; i<m_listDeliveredSources.size(); i++){
+		m_listDeliveredSources[i]->m_bSignaled = false;
+	}
+	pthread_mutex_unlock(&m_mutexReady);
+
+	// A client may be closed while sending to another one
+	for(size_t i=0; i<m_listDeliveredSources.size(); i++){
+		if(m_listDeliveredSources[i]){
+			m_listDeliveredSources[i]->deliverQueuedFrame();
+		}
+	}
+	m_listDeliveredSources.clear();
+	updateMetrics();
+}
+
+void RestreamServer::addFrameSent(size_t iSize)
+{
+	m_iFramesSent.fetch_add(1, std::memory_order_relaxed);
+	m_iBytesSent.fetch_add(iSize, std::memory_order_relaxed);
+}
+
+void RestreamServer::addFramesDropped(size_t iCount)
+{
+	m_iFramesDropped.fetch_add(iCount, std::memory_order_relaxed);
+}
+
+void RestreamServer::updateMetrics()
+{
+	RestreamMetrics& metrics = MetricsRegistry::getInstance()->m_restream;
+	metrics.iClients.store(m_iClients.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	metrics.iFramesSent.store(m_iFramesSent.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	metrics.iBytesSent.store(m_iBytesSent.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	metrics.iFramesDropped.store(m_iFramesDropped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void RestreamServer::getStats(RestreamStats& stats) const
+{
+	stats.iClients = m_iClients.load(std::memory_order_relaxed);
+	stats.iFramesSent = m_iFramesSent.load(std::memory_order_relaxed);
+	stats.iBytesSent = m_iBytesSent.load(std::memory_order_relaxed);
+	stats.iFramesDropped = m_iFramesDropped.load(std::memory_order_relaxed);
+}
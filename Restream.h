@@ -0,0 +1,179 @@
+/*
+ * Restream.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef RESTREAM_H_
+#define RESTREAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <liveMedia.hh>
+
+#include "GopCache.h"
+
+#define RESTREAM_CLIENT_QUEUE_SIZE 2048 // Frames waiting to be sent to a client, more than the longest cached GOP
+#define RESTREAM_CLIENT_QUEUE_BYTES (32*1024*1024) // Capacity of the buffers held by the queue of a client
+#define RESTREAM_DEFAULT_GOP_CACHE_SIZE 256 // In MB, if no budget is given for the GOP cache
+#define RESTREAM_DEFAULT_BITRATE 4000 // In kbps, if the SDP gives none
+
+class RestreamServer;
+
+// Description of an ingested subsession, from the SDP of the camera
+struct RestreamTrackInfo
+{
+	const char* szCodecName; // H264 or H265
+	const char* szSPropParameterSets; // H264
+	const char* szSPropVPS; // H265
+	const char* szSPropSPS;
+	const char* szSPropPPS;
+	unsigned iBandwidth; // In kbps, 0 if unknown
+};
+
+//////////////////////////////////
+// RestreamFrameSource declaration
+//////////////////////////////////
+
+// Source of a client of the RTSP server, fed by the GopCacheEntry of the
+// subsession: the frames are queued by reference from the event loop of the
+// stream, and copied only into the RTP packets of the client, except the live
+// frames using a small part of their receive buffer, copied to a buffer of
+// their size so that a slow client doesn't hold the receive buffers. Its first
+// frames are the cached GOP, so the client starts at once with a key frame.
+class RestreamFrameSource : public FramedSource
+{
+public:
+	// Not attached for the source used to build the SDP
+	static RestreamFrameSource* createNew(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId, bool bAttach);
+
+	// Called by the GopCacheEntry, from the event loop of the stream
+	static void gopCacheConsumer(void* clientData, const GopCacheFrame& frame);
+
+	// Called by the event loop of the server
+	void deliverQueuedFrame();
+
+protected:
+	RestreamFrameSource(UsageEnvironment& env, RestreamServer* pServer, int iStreamId, int iSubsessionId, bool bAttach);
+	virtual ~RestreamFrameSource();
+
+	virtual void doGetNextFrame();
+
+private:
+	void queueFrame(const GopCacheFrame& frame);
+	void clearQueue();
+
+private:
+	friend class RestreamServer;
+	RestreamServer* m_pServer;
+	int m_iStreamId;
+	int m_iSubsessionId;
+	bool m_bAttached;
+
+	pthread_mutex_t m_mutex;
+	std::deque<GopCacheFrame> m_listFrames; // A reference of each buffer is held
+	size_t m_iQueuedBytes; // Capacity of the buffers of the queue
+	size_t m_iUnitOffset; // Of the next NAL unit in an Annex B frame, 0 before the first one
+	bool m_bWaitKeyFrame; // At the start and after an overflow, changed by the feeding thread only
+
+	bool m_bSignaled; // In the ready list of the server, under its mutex
+};
+
+//////////////////////////////////
+// RestreamServer declaration
+//////////////////////////////////
+
+struct RestreamStats
+{
+	uint64_t iClients; // Currently playing
+	uint64_t iFramesSent; // NAL units given to the packetizers
+	uint64_t iBytesSent;
+	uint64_t iFramesDropped; // By the clients too slow
+};
+
+// RTSP server of an event loop, serving each ingested stream as
+// rtsp://host:port/stream<N> with the H264/H265 subsessions of the camera. The
+// upstream session is the only one opened to the camera whatever the number of
+// clients. The tracks are added by the sinks from the event loop of their
+// stream, and are kept when the stream reconnects, so the clients are fed
+// again once it plays.
+class RestreamServer
+{
+public:
+	static RestreamServer* createNew(UsageEnvironment& env, int iPort, size_t iMaxFrameSize);
+	virtual ~RestreamServer();
+
+	// From any thread
+	void addTrack(int iStreamId, int iSubsessionId, const RestreamTrackInfo& info, GopCacheEntry* pEntry);
+	// The entry is detached from the clients
+	void removeTrack(int iStreamId, int iSubsessionId);
+
+	int getPort() const { return m_iPort; }
+	void getStats(RestreamStats& stats) const;
+
+private:
+	RestreamServer(UsageEnvironment& env, RTSPServer* pRTSPServer, int iPort);
+
+	struct Track
+	{
+		int iStreamId;
+		int iSubsessionId;
+		std::string szCodecName;
+		std::string szSPropParameterSets;
+		std::string szSPropVPS;
+		std::string szSPropSPS;
+		std::string szSPropPPS;
+		unsigned iBandwidth;
+		GopCacheEntry* pEntry; // NULL while the stream is down
+		std::vector<RestreamFrameSource*> listSources;
+		bool bPublished;
+	};
+
+	// Called with the mutex of the tracks locked
+	Track* findTrack(int iStreamId, int iSubsessionId);
+
+	// Called by the sources, in the event loop of the server
+	friend class RestreamFrameSource;
+	void addSource(RestreamFrameSource* pSource);
+	void removeSource(RestreamFrameSource* pSource);
+	// From any thread, when the queue of the source gets a frame
+	void signalSource(RestreamFrameSource* pSource);
+	void addFrameSent(size_t iSize);
+	void addFramesDropped(size_t iCount);
+	void updateMetrics();
+
+	static void tracksChangedHandler(void* clientData);
+	void publishTracks();
+	static void sourcesReadyHandler(void* clientData);
+	void deliverReadySources();
+
+private:
+	UsageEnvironment& m_env;
+	RTSPServer* m_pRTSPServer;
+	int m_iPort;
+
+	pthread_mutex_t m_mutexTracks;
+	std::vector<Track*> m_listTracks;
+	EventTriggerId m_tracksChangedTrigger;
+	std::map<int, ServerMediaSession*> m_mapSessions; // By stream, used by the event loop of the server only
+
+	pthread_mutex_t m_mutexReady;
+	std::vector<RestreamFrameSource*> m_listReadySources;
+	EventTriggerId m_sourcesReadyTrigger;
+	std::vector<RestreamFrameSource*> m_listDeliveredSources; // Being delivered, NULL once removed
+
+	std::atomic<uint64_t> m_iClients;
+	std::atomic<uint64_t> m_iFramesSent;
+	std::atomic<uint64_t> m_iBytesSent;
+	std::atomic<uint64_t> m_iFramesDropped;
+};
+
+#endif /* RESTREAM_H_ */
@@ -0,0 +1,238 @@
+/*
+ * SdpCache.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SdpCache.h"
+
+#define SDP_CACHE_FREE_SLOT 0
+#define SDP_CACHE_DELETED_SLOT 1 // Keeps the probing sequences going through it
+
+//////////////////////////////////
+// SdpCache definition
+//////////////////////////////////
+
+SdpCache* SdpCache::getInstance()
+{
+	static SdpCache* pInstance = new SdpCache();
+	return pInstance;
+}
+
+SdpCache::SdpCache()
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	m_fd = -1;
+	m_pMapping = NULL;
+	m_iMappingSize = 0;
+	m_pEntries = NULL;
+}
+
+SdpCache::~SdpCache()
+{
+	close();
+	pthread_mutex_destroy(&m_mutex);
+}
+
+bool SdpCache::open(const char* szPath)
+{
+	close();
+
+	// The SDP may hold credentials of the cameras
+	int fd = ::open(szPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if(fd < 0){
+		return false;
+	}
+
+	size_t iMappingSize = sizeof(SdpCacheHeader) + (size_t)SDP_CACHE_SLOT_COUNT * sizeof(SdpCacheEntry);
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		::close(fd);
+		return false;
+	}
+	bool bReset = ((size_t)st.st_size != iMappingSize);
+	if(bReset && (ftruncate(fd, 0) != 0 || ftruncate(fd, iMappingSize) != 0)){
+		::close(fd);
+		return false;
+	}
+
+	void* pMapping = mmap(NULL, iMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(pMapping == MAP_FAILED){
+		::close(fd);
+		return false;
+	}
+
+	SdpCacheHeader* pHeader = (SdpCacheHeader*)pMapping;
+	if(bReset || memcmp(pHeader->szMagic, SDP_CACHE_MAGIC, sizeof(pHeader->szMagic)) != 0 ||
+			pHeader->iSlotCount != SDP_CACHE_SLOT_COUNT || pHeader->iEntrySize != sizeof(SdpCacheEntry))
+	{
+		memset(pMapping, 0, iMappingSize);
+		memcpy(pHeader->szMagic, SDP_CACHE_MAGIC, sizeof(pHeader->szMagic));
+		pHeader->iSlotCount = SDP_CACHE_SLOT_COUNT;
+		pHeader->iEntrySize = sizeof(SdpCacheEntry);
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_fd = fd;
+	m_pMapping = pMapping;
+	m_iMappingSize = iMappingSize;
+	m_pEntries = (SdpCacheEntry*)((char*)pMapping + sizeof(SdpCacheHeader));
+	pthread_mutex_unlock(&m_mutex);
+	return true;
+}
+
+void SdpCache::close()
+{
+	pthread_mutex_lock(&m_mutex);
+	if(m_pMapping){
+		munmap(m_pMapping, m_iMappingSize);
+		m_pMapping = NULL;
+		m_iMappingSize = 0;
+		m_pEntries = NULL;
+	}
+	if(m_fd >= 0){
+		::close(m_fd);
+		m_fd = -1;
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool SdpCache::isOpen() const
+{
+	return (m_pEntries != NULL);
+}
+
+uint64_t SdpCache::hash(const char* szData, size_t iSize, uint64_t iHash)
+{
+	// FNV-1a
+	for(size_t i=0; i<iSize; i++){
+		iHash ^= (uint8_t)szData[i];
+		iHash *= 1099511628211ULL;
+	}
+	return iHash;
+}
+
+uint64_t SdpCache::getContentHash(const SdpCacheEntry* pEntry)
+{
+	uint64_t iHash = hash(pEntry->szURL, strnlen(pEntry->szURL, SDP_CACHE_URL_SIZE));
+	iHash = hash(pEntry->szBaseURL, strnlen(pEntry->szBaseURL, SDP_CACHE_URL_SIZE), iHash);
+	iHash = hash(pEntry->szSdp, (pEntry->iSdpLength < SDP_CACHE_SDP_SIZE ? pEntry->iSdpLength : SDP_CACHE_SDP_SIZE), iHash);
+	return (iHash != 0 ? iHash : 1);
+}
+
+SdpCacheEntry* SdpCache::findSlot(const char* szURL, uint64_t iURLHash)
+{
+	SdpCacheEntry* pFreeSlot = NULL;
+	for(int i=0; i<SDP_CACHE_SLOT_COUNT; i++){
+		SdpCacheEntry* pEntry = &m_pEntries[(iURLHash + i) % SDP_CACHE_SLOT_COUNT];
+		if(pEntry->iURLHash == SDP_CACHE_FREE_SLOT){
+			return (pFreeSlot ? pFreeSlot : pEntry);
+		}
+		if(pEntry->iURLHash == SDP_CACHE_DELETED_SLOT){
+			if(!pFreeSlot){
+				pFreeSlot = pEntry;
+			}
+			continue;
+		}
+		if(pEntry->iURLHash == iURLHash && strncmp(pEntry->szURL, szURL, SDP_CACHE_URL_SIZE) == 0){
+			return pEntry;
+		}
+	}
+	return pFreeSlot;
+}
+
+static uint64_t getURLHash(const char* szURL)
+{
+	uint64_t iHash = SdpCache::hash(szURL, strlen(szURL));
+	// The lowest values mark the free and deleted slots
+	return (iHash > SDP_CACHE_DELETED_SLOT ? iHash : iHash + 2);
+}
+
+bool SdpCache::lookup(const char* szURL, int iMaxAgeSec, char** pszSdp, char** pszBaseURL, int* pAgeSec)
+{
+	if(strlen(szURL) >= SDP_CACHE_URL_SIZE){
+		return false;
+	}
+	uint64_t iURLHash = getURLHash(szURL);
+
+	bool bFound = false;
+	pthread_mutex_lock(&m_mutex);
+	if(m_pEntries){
+		SdpCacheEntry* pEntry = findSlot(szURL, iURLHash);
+		if(pEntry && pEntry->iURLHash == iURLHash && pEntry->iSdpLength < SDP_CACHE_SDP_SIZE &&
+				pEntry->iContentHash == getContentHash(pEntry))
+		{
+			int64_t iAgeSec = (int64_t)time(NULL) - pEntry->iStoredTime;
+			if(iAgeSec >= 0 && iAgeSec <= iMaxAgeSec){
+				*pszSdp = strndup(pEntry->szSdp, pEntry->iSdpLength);
+				*pszBaseURL = strndup(pEntry->szBaseURL, SDP_CACHE_URL_SIZE);
+				*pAgeSec = (int)iAgeSec;
+				bFound = true;
+			}
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+	return bFound;
+}
+
+void SdpCache::store(const char* szURL, const char* szBaseURL, const char* szSdp)
+{
+	size_t iSdpLength = strlen(szSdp);
+	if(strlen(szURL) >= SDP_CACHE_URL_SIZE || strlen(szBaseURL) >= SDP_CACHE_URL_SIZE || iSdpLength >= SDP_CACHE_SDP_SIZE){
+		return;
+	}
+	uint64_t iURLHash = getURLHash(szURL);
+
+	pthread_mutex_lock(&m_mutex);
+	if(m_pEntries){
+		SdpCacheEntry* pEntry = findSlot(szURL, iURLHash);
+		if(pEntry){
+			bool bSame = (pEntry->iURLHash == iURLHash && pEntry->iSdpLength == iSdpLength &&
+					strcmp(pEntry->szBaseURL, szBaseURL) == 0 && memcmp(pEntry->szSdp, szSdp, iSdpLength) == 0 &&
+					pEntry->iContentHash == getContentHash(pEntry));
+			if(!bSame){
+				// Invalid until the end of the copy, if the process is killed meanwhile
+				pEntry->iContentHash = 0;
+				pEntry->iURLHash = iURLHash;
+				memset(pEntry->szURL, 0, sizeof(pEntry->szURL));
+				strcpy(pEntry->szURL, szURL);
+				memset(pEntry->szBaseURL, 0, sizeof(pEntry->szBaseURL));
+				strcpy(pEntry->szBaseURL, szBaseURL);
+				memcpy(pEntry->szSdp, szSdp, iSdpLength);
+				pEntry->szSdp[iSdpLength] = '\0';
+				pEntry->iSdpLength = (uint32_t)iSdpLength;
+				pEntry->iContentHash = getContentHash(pEntry);
+			}
+			// An unchanged SDP only touches the page of its date
+			pEntry->iStoredTime = (int64_t)time(NULL);
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void SdpCache::invalidate(const char* szURL)
+{
+	if(strlen(szURL) >= SDP_CACHE_URL_SIZE){
+		return;
+	}
+	uint64_t iURLHash = getURLHash(szURL);
+
+	pthread_mutex_lock(&m_mutex);
+	if(m_pEntries){
+		SdpCacheEntry* pEntry = findSlot(szURL, iURLHash);
+		if(pEntry && pEntry->iURLHash == iURLHash){
+			pEntry->iContentHash = 0;
+			pEntry->iURLHash = SDP_CACHE_DELETED_SLOT;
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,81 @@
+/*
+ * SdpCache.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef SDPCACHE_H_
+#define SDPCACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SDP_CACHE_MAGIC "SDPCACH1"
+#define SDP_CACHE_SLOT_COUNT 2048 // Twice the streams of a big site, the probing stays short
+#define SDP_CACHE_URL_SIZE 512
+#define SDP_CACHE_SDP_SIZE 4096
+
+//////////////////////////////////
+// SdpCache declaration
+//////////////////////////////////
+
+// Layout of the file, mapped as is: a header then a hash table of fixed size
+// slots, indexed by the hash of the URL with linear probing.
+struct SdpCacheEntry
+{
+	uint64_t iURLHash; // 0 for a free slot
+	uint64_t iContentHash; // Of the URLs and the SDP, detects an entry half written
+	int64_t iStoredTime; // Wall clock, in seconds
+	uint32_t iSdpLength;
+	uint32_t iReserved;
+	char szURL[SDP_CACHE_URL_SIZE];
+	char szBaseURL[SDP_CACHE_URL_SIZE]; // Given by the DESCRIBE response, used for the SETUP
+	char szSdp[SDP_CACHE_SDP_SIZE];
+};
+
+struct SdpCacheHeader
+{
+	char szMagic[8];
+	uint32_t iSlotCount;
+	uint32_t iEntrySize;
+};
+
+// Process-wide cache of the last good SDP of each URL, kept in a memory
+// mapped file so it survives the restarts. Used from every shard, the
+// accesses are protected by a mutex: they happen once per attempt.
+class SdpCache
+{
+public:
+	static SdpCache* getInstance();
+
+	// Creates the file if needed, a file of another layout is reset
+	bool open(const char* szPath);
+	void close();
+	bool isOpen() const;
+
+	// Returns false if the URL is unknown, corrupted or older than iMaxAgeSec.
+	// The strings are allocated with malloc.
+	bool lookup(const char* szURL, int iMaxAgeSec, char** pszSdp, char** pszBaseURL, int* pAgeSec);
+	void store(const char* szURL, const char* szBaseURL, const char* szSdp);
+	void invalidate(const char* szURL);
+
+	static uint64_t hash(const char* szData, size_t iSize, uint64_t iHash = 14695981039346656037ULL);
+
+private:
+	SdpCache();
+	~SdpCache();
+
+	// Slot of the URL, or the first free slot of its probing sequence if absent, NULL if the table is full
+	SdpCacheEntry* findSlot(const char* szURL, uint64_t iURLHash);
+	static uint64_t getContentHash(const SdpCacheEntry* pEntry);
+
+private:
+	pthread_mutex_t m_mutex;
+	int m_fd;
+	void* m_pMapping;
+	size_t m_iMappingSize;
+	SdpCacheEntry* m_pEntries;
+};
+
+#endif /* SDPCACHE_H_ */
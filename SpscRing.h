@@ -0,0 +1,155 @@
+/*
+ * SpscRing.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define SPSC_RING_CACHE_LINE_SIZE 64
+
+//////////////////////////////////
+// SpscRing declaration
+//////////////////////////////////
+
+// Bounded lock-free ring with a single producer thread and a single consumer
+// thread. The producer never waits: when the ring is full, the item is refused
+// and counted as dropped. Each side keeps a copy of the index of the other one,
+// so the shared cache lines are only read when the copy says full or empty.
+template<typename T>
+class SpscRing
+{
+public:
+	// The capacity is rounded up to a power of two
+	SpscRing(size_t iCapacity);
+	~SpscRing();
+
+	// Producer side, a batch is pushed entirely or not at all
+	bool push(const T& item);
+	bool pushBatch(const T* pItems, size_t iCount);
+
+	// Consumer side, returns the number of items copied to pItems
+	size_t popBatch(T* pItems, size_t iMaxCount);
+
+	// May be called from any thread
+	size_t size() const;
+	size_t capacity() const { return m_iMask + 1; }
+	uint64_t getPushCount() const { return m_iPushCount.load(std::memory_order_relaxed); }
+	uint64_t getDropCount() const { return m_iDropCount.load(std::memory_order_relaxed); }
+	size_t getHighWater() const { return m_iHighWater.load(std::memory_order_relaxed); }
+
+private:
+	T* m_pItems;
+	size_t m_iMask;
+
+	// Written by the consumer
+	alignas(SPSC_RING_CACHE_LINE_SIZE) std::atomic<size_t> m_iHead;
+	size_t m_iCachedTail;
+
+	// Written by the producer
+	alignas(SPSC_RING_CACHE_LINE_SIZE) std::atomic<size_t> m_iTail;
+	size_t m_iCachedHead;
+	std::atomic<uint64_t> m_iPushCount;
+	std::atomic<uint64_t> m_iDropCount;
+	std::atomic<size_t> m_iHighWater;
+};
+
+//////////////////////////////////
+// SpscRing definition
+//////////////////////////////////
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t iCapacity)
+{
+	size_t iSize = 1;
+	while(iSize < iCapacity){
+		iSize <<= 1;
+	}
+	m_pItems = new T[iSize];
+	m_iMask = iSize - 1;
+
+	m_iHead = 0;
+	m_iCachedTail = 0;
+	m_iTail = 0;
+	m_iCachedHead = 0;
+	m_iPushCount = 0;
+	m_iDropCount = 0;
+	m_iHighWater = 0;
+}
+
+template<typename T>
+SpscRing<T>::~SpscRing()
+{
+	if(m_pItems){
+		delete[] m_pItems;
+		m_pItems = NULL;
+	}
+}
+
+template<typename T>
+bool SpscRing<T>::push(const T& item)
+{
+	return pushBatch(&item, 1);
+}
+
+template<typename T>
+bool SpscRing<T>::pushBatch(const T* pItems, size_t iCount)
+{
+	size_t iTail = m_iTail.load(std::memory_order_relaxed);
+	if(iTail + iCount - m_iCachedHead > m_iMask + 1){
+		m_iCachedHead = m_iHead.load(std::memory_order_acquire);
+		if(iTail + iCount - m_iCachedHead > m_iMask + 1){
+			m_iDropCount.fetch_add(iCount, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	for(size_t i=0; i<iCount; i++){
+		m_pItems[(iTail + i) & m_iMask] = pItems[i];
+	}
+	m_iTail.store(iTail + iCount, std::memory_order_release);
+
+	m_iPushCount.fetch_add(iCount, std::memory_order_relaxed);
+	size_t iSize = iTail + iCount - m_iCachedHead;
+	if(iSize > m_iHighWater.load(std::memory_order_relaxed)){
+		m_iHighWater.store(iSize, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+template<typename T>
+size_t SpscRing<T>::popBatch(T* pItems, size_t iMaxCount)
+{
+	size_t iHead = m_iHead.load(std::memory_order_relaxed);
+	if(m_iCachedTail == iHead){
+		m_iCachedTail = m_iTail.load(std::memory_order_acquire);
+	}
+
+	size_t iCount = m_iCachedTail - iHead;
+	if(iCount > iMaxCount){
+		iCount = iMaxCount;
+	}
+	for(size_t i=0; i<iCount; i++){
+		pItems[i] = m_pItems[(iHead + i) & m_iMask];
+	}
+	if(iCount > 0){
+		m_iHead.store(iHead + iCount, std::memory_order_release);
+	}
+	return iCount;
+}
+
+template<typename T>
+size_t SpscRing<T>::size() const
+{
+	size_t iTail = m_iTail.load(std::memory_order_acquire);
+	size_t iHead = m_iHead.load(std::memory_order_acquire);
+	return (iTail >= iHead ? iTail - iHead : 0);
+}
+
+#endif /* SPSCRING_H_ */
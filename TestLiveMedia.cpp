@@ -5,28 +5,65 @@
  *      Author: ebeuque
  */
 
+#include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include <liveMedia_version.hh>
 #include <liveMedia.hh>
 #include <BasicUsageEnvironment.hh>
 #include <H264VideoRTPSource.hh>
 
-// Don't include GroupsockHelper.hh due to the conflict on gettimeofday()
-// Declaration from "GroupsockHelper.hh" :
-unsigned increaseReceiveBufferTo(UsageEnvironment& env, int socket, unsigned requestedSize);
+#include "EpollTaskScheduler.h"
+#include "FramePool.h"
+#include "FrameConsumer.h"
+#include "AsyncLogger.h"
+#include "Metrics.h"
+#include "SdpCache.h"
+#include "AdmissionController.h"
+#include "Recording.h"
+#include "NalParser.h"
+#include "GopCache.h"
+#include "Restream.h"
+#include "ReceiveBufferTuner.h"
+#include "ReorderWindow.h"
+#include "ReceiveGroupsock.h"
+#include "InterleavedDemux.h"
+#include "LoopClock.h"
+#include "TimerWheel.h"
 
 #define TIMEOUT_CHECKALIVE 10000000
+
+#define KEEPALIVE_DEFAULT_SESSION_TIMEOUT 60 // In seconds, of RFC 2326 when the server gives none
+#define KEEPALIVE_MIN_INTERVAL 5000000
 #define DEBUG_PRINT_NPT 1
 
+#define LOAD_SAMPLING_PERIOD 5000000
+#define LOAD_BYTES_PER_FRAME 2000 // Cost of a frame, expressed in bytes, in the shard load
+#define LOAD_BYTES_PER_STREAM 10000 // Cost of a stream with no measure yet
+
+#define RETRY_HEALTHY_TIME 60000000 // A stream playing this long is retried at once
+#define RETRY_IMMEDIATE_JITTER 1000000 // Spread of the immediate retries, so the streams of a site don't reconnect together
+
+#define ADMISSION_POLL_PERIOD 1000000 // While streams wait for a handshake slot, in case a release is missed
+
 /////////////////////////////////
 // Utility function declaration
 /////////////////////////////////
 
 char* p_strconcat(const char* str1, ...);
 void p_log(const char* format, ...);
+void p_log_set_context(int iStreamId, int iAttempt);
 int64_t p_timeval_diffms(const timeval& tv1, const timeval& tv2);
 void timer_text(const char* szFormat, const struct timeval* tv, char* buf, size_t size);
 
@@ -39,14 +76,18 @@ void timer_text(const char* szFormat, const struct timeval* tv, char* buf, size_
 //////////////////////////////////
 
 class LiveMediaModuleContext;
+class LiveMediaStreamContext;
 
 class CustomRTSPClient : public RTSPClient
 {
 public:
-	static CustomRTSPClient* createNew(LiveMediaModuleContext* pLiveMediaModuleContext, char const* rtspURL, int iVerbosityLevel);
+	static CustomRTSPClient* createNew(LiveMediaStreamContext* pLiveMediaStreamContext, char const* rtspURL, int iVerbosityLevel);
+
+	// Base of the SETUP URLs, when the session is created without DESCRIBE
+	void setSessionBaseURL(char const* szBaseURL);
 
 protected:
-	CustomRTSPClient(LiveMediaModuleContext* pLiveMediaModuleContext, char const* rtspURL, int iVerbosityLevel);
+	CustomRTSPClient(LiveMediaStreamContext* pLiveMediaStreamContext, char const* rtspURL, int iVerbosityLevel);
 	virtual ~CustomRTSPClient();
 
 public:
@@ -57,42 +98,134 @@ public:
 	static void continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString);
 
 	static void handlePingWithOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString);
+	static void handlePingWithGET_PARAMETER(RTSPClient* rtspClient, int resultCode, char* resultString);
 	static void subsessionAfterPlaying(void* clientData);
 	static void subsessionByeHandler(void* clientData);
 	static void streamCheckStreamInitializedHandler(void* clientData);
 	static void streamCheckAliveHandler(void* clientData);
+	static void streamKeepaliveHandler(void* clientData);
 	static void streamTimerHandler(void* clientData);
+	static void streamCloseHandler(void* clientData);
+	static void streamRestartHandler(void* clientData);
 
 private:
-	LiveMediaModuleContext* m_pLiveMediaModuleContext;
+	LiveMediaStreamContext* m_pLiveMediaStreamContext;
+};
+
+//////////////////////////////////
+// FrameProcessor declaration
+//////////////////////////////////
+
+// Work done on the frames of a subsession once received: classification of
+// the H264/H265 NAL units, GOP cache feeding the restream clients, recording.
+// Run by the sink in the event loop, or by the consumer thread of the stream
+// when the frames are handed off. Shared by the sink and the frames queued
+// for the consumer, it is deleted with the last reference: a frame consumed
+// after its subsession is closed still has it.
+class FrameProcessor
+{
+public:
+	// NULL if there is nothing to do with the frames of the subsession
+	static FrameProcessor* createNew(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId,
+			SubsessionMetrics* pSubsessionMetrics);
+
+	void ref();
+	void unref();
+
+	// The buffer is only read, the GOP cache takes its own reference
+	void processFrame(FrameBuffer* pBuffer, const struct timeval& presentationTime, bool bTruncated);
+
+	// Consumer of the FrameConsumerPool, releases the reference held by the frame
+	static void frameConsumer(void* clientData, const FrameDescriptor& frame);
+
+	// NULL if the GOP cache is disabled or the codec has no key frames
+	GopCacheEntry* getGopCacheEntry() const { return m_pGopCacheEntry; }
+
+private:
+	FrameProcessor(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId,
+			SubsessionMetrics* pSubsessionMetrics);
+	~FrameProcessor();
+
+	void parseNalUnits(FrameBuffer* pBuffer, const struct timeval& presentationTime);
+	// The NAL units are given for H264/H265 if they are parsed, which they are not when the end of the frame was truncated
+	void recordFrame(const uint8_t* pData, unsigned frameSize, const struct timeval& presentationTime, const NalFrameInfo* pNalInfo, bool bTruncated);
+	void addParameterSets(const char* szSProp);
+
+private:
+	std::atomic<int> m_iRefCount;
+	int m_iStreamId; // For the logs
+	int m_iAttempt;
+	char m_szName[64]; // <medium>/<codec>
+	SubsessionMetrics* m_pSubsessionMetrics;
+
+	// Classification of the NAL units, GOP and key frame index of the H264/H265 subsessions
+	NalParser* m_pNalParser;
+	NalFrameInfo m_nalInfo;
+	// Frames from the last key frame, for the consumers attached later
+	GopCacheEntry* m_pGopCacheEntry;
+
+	// Segment files written through the RecordingWriter, NULL if not recording. The H264/H265 NAL
+	// units get a start code, and the parameter sets of the SDP are written before a key frame that
+	// doesn't follow them in-band, so that each segment can be decoded from its first frame.
+	RecordingTrack* m_pTrack;
+	std::vector<uint8_t> m_parameterSets; // Of the SDP, with their start codes
+	bool m_bParameterSetsInBand; // The last frame was a parameter set
 };
 
 //////////////////////////////////
 // Custom MediaSink declaration
 //////////////////////////////////
 
-#define DUMMY_SINK_RECEIVE_BUFFER_SIZE 2000000
+#define DUMMY_SINK_MIN_BUFFER_SIZE 4096 // For audio and metadata, whose frames are small
+#define DUMMY_SINK_VIDEO_MIN_BUFFER_SIZE 131072
+#define DUMMY_SINK_MAX_BUFFER_SIZE (16*1024*1024) // Default limit of the growth
 
 class DummySink: public MediaSink
 {
 public:
-	static DummySink* createNew(LiveMediaModuleContext* pLiveMediaModuleContext);
+	static DummySink* createNew(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId);
 
-private:
-	DummySink(LiveMediaModuleContext* pLiveMediaModuleContext);
+	static size_t getInitialBufferSize(MediaSubsession& mediaSubSession, size_t iMaxSize);
+
+	SubsessionMetrics* getMetrics() const { return m_pSubsessionMetrics; }
+
+	// Follows the bitrate and the kernel drops, called periodically
+	void sampleReceiveBuffer(int64_t iNowUs);
+	// Follows the late packets, called periodically
+	void sampleReorderWindow();
+
+protected:
+	DummySink(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId);
 	virtual ~DummySink();
 
+private:
 	static void afterGettingFrame(void* clientData, unsigned frameSize, unsigned numTruncatedBytes,
 			struct timeval presentationTime, unsigned durationInMicroseconds);
 	void afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes, struct timeval presentationTime, unsigned /*durationInMicroseconds*/);
+	// Each RTP packet read from the socket, before the reordering buffer
+	static void rtpPacketHandler(void* clientData, unsigned char* packet, unsigned& packetSize);
 
 private:
 	Boolean continuePlaying();
+	void growBuffer(unsigned frameSize, unsigned numTruncatedBytes);
 
-private:
-	LiveMediaModuleContext* m_pLiveMediaModuleContext;
-	u_int8_t* m_pReceiveBuffer;
+protected:
+	LiveMediaStreamContext* m_pLiveMediaStreamContext;
+	FrameBuffer* m_pFrameBuffer; // Buffer of the frame being received, from the FramePool
+	size_t m_iReceiveBufferSize;
 	MediaSubsession& m_mediaSubSession;
+	int m_iSubsessionId;
+	SubsessionMetrics* m_pSubsessionMetrics;
+
+	// Per-frame work after the reception, NULL if none
+	FrameProcessor* m_pFrameProcessor;
+
+	// Socket buffer of the UDP subsessions, NULL with TCP
+	ReceiveBufferTuner* m_pReceiveBufferTuner;
+	// Reordering threshold of the UDP subsessions, NULL with TCP which keeps the order
+	ReorderWindow* m_pReorderWindow;
+	uint64_t m_iReportedReordered; // Already added to the metrics
+	uint64_t m_iReportedGivenUp;
 
 	struct timeval m_tvLastPresentationTime;
 };
@@ -101,6 +234,8 @@ private:
 // Custom BasicUsageEnvironment declaration
 /////////////////////////////////////////////
 
+#define CUSTOM_ENV_LINE_SIZE 1024 // Longer lines are split
+
 class CustomBasicUsageEnvironment : public BasicUsageEnvironment
 {
 public:
@@ -119,62 +254,360 @@ public:
 	UsageEnvironment& operator<<(void* p);
 
 private:
-	char* m_szCurMsg;
+	char m_szLine[CUSTOM_ENV_LINE_SIZE];
+	size_t m_iLineLength;
 };
 
 /////////////////////////////////////////////
-// LiveMediaModuleContext declaration
+// Custom BasicTaskScheduler declaration
 /////////////////////////////////////////////
 
-class LiveMediaModuleContext
+// The select scheduler of live555, with the LoopClock cached per step. The
+// wait and the handlers are in the same call, so the time is read lazily by
+// the first handler.
+class CustomBasicTaskScheduler : public BasicTaskScheduler
 {
 public:
-	LiveMediaModuleContext(int iVerbosityLevel);
-	virtual ~LiveMediaModuleContext();
+	static BasicTaskScheduler* createNew();
+
+protected:
+	CustomBasicTaskScheduler();
+
+	virtual void SingleStep(unsigned maxDelayTime);
+};
+
+/////////////////////////////////////////////
+// LiveMediaStreamContext declaration
+/////////////////////////////////////////////
+
+// Each stream runs its own RTSP state machine, all the streams sharing
+// the scheduler and the environment of the LiveMediaModuleContext
+enum LiveMediaStreamState
+{
+	STREAM_STATE_IDLE = 0,
+	STREAM_STATE_OPTIONS,
+	STREAM_STATE_DESCRIBE,
+	STREAM_STATE_SETUP,
+	STREAM_STATE_PLAY,
+	STREAM_STATE_PLAYING,
+	STREAM_STATE_TEARDOWN,
+	STREAM_STATE_WAIT_RETRY,
+	STREAM_STATE_WAIT_ADMISSION,
+	STREAM_STATE_CLOSED,
+};
+
+const char* streamStateName(LiveMediaStreamState state);
+
+// Request keeping the RTSP session alive
+enum KeepaliveMethod
+{
+	KEEPALIVE_METHOD_UNKNOWN = 0, // GET_PARAMETER is tried first
+	KEEPALIVE_METHOD_GET_PARAMETER,
+	KEEPALIVE_METHOD_OPTIONS,
+};
+
+class LiveMediaStreamContext
+{
+public:
+	LiveMediaStreamContext(LiveMediaModuleContext* pLiveMediaModuleContext, int iStreamId, const char* szMRL, const char* szUser, const char* szPass);
+	virtual ~LiveMediaStreamContext();
 	void reset();
-	void setWithPingOptions(bool bEnable);
+	void setState(LiveMediaStreamState state);
 	void cleanSesssion();
 	void continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString);
 	void handlePingWithOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString);
+	void handlePingWithGET_PARAMETER(RTSPClient* rtspClient, int resultCode, char* resultString);
 	void continueAfterDESCRIBE(RTSPClient* rtspClient, int resultCode, char* resultString);
+	bool createMediaSession(const char* szSdpDescription);
+	void setupSubsessions(RTSPClient* rtspClient);
+	void revalidateSdp(RTSPClient* rtspClient);
 	void setupNextSubsession(RTSPClient* rtspClient);
+	bool initiateSubsession(MediaSubsession* pSubsession);
+	void sendSetup(RTSPClient* rtspClient, MediaSubsession* pSubsession);
+	void sendPlay(RTSPClient* rtspClient);
+	void pipelineRemainingSetups(RTSPClient* rtspClient);
+	MediaSubsession* popPendingSetup(bool bSuccess);
+	void fallBackToSerialHandshake(RTSPClient* rtspClient);
 	void continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString);
 	void continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString);
 	void subsessionAfterPlaying(RTSPClient* rtspClient, MediaSubsession* subsession);
 	void subsessionByeHandler(RTSPClient* rtspClient, MediaSubsession* subsession);
 	void streamCheckStreamInitializedHandler(CustomRTSPClient* rtspClient);
 	void streamCheckAliveHandler(CustomRTSPClient* rtspClient);
+	void streamKeepaliveHandler(CustomRTSPClient* rtspClient);
+	void scheduleKeepalive();
+	void sendKeepalive();
+	bool isKeptAliveByRTCP(int64_t iWindowUs);
 	void streamTimerHandler(CustomRTSPClient* rtspClient);
+	void streamCloseHandler();
+	void streamRestartHandler();
 	void shutdownStream(RTSPClient* rtspClient);
 	void closeStream(RTSPClient* rtspClient);
-	int start(const char* szMRL, const char* szUser, const char* szPass, bool bTCP);
+	void scheduleRestart(int64_t iDelayUs);
+	int64_t nextRetryDelay();
+	void sampleLoad(int64_t iNowUs);
+	void sampleReceptionStats(int64_t iNowUs);
+	void logHistograms();
+	void firstFrameReceived();
+	uint64_t getLoad() const;
+	bool start();
+	bool startHandshake();
+	void stop();
 
 public:
-	TaskScheduler* m_scheduler;
+	LiveMediaModuleContext* m_pLiveMediaModuleContext;
 	UsageEnvironment* m_env;
 
-	char m_eventLoopWatchVariable;
+	int m_iStreamId;
+	int m_iAttempt;
+	char* m_szMRL;
+	char* m_szUser;
+	char* m_szPass;
 
-	bool m_bTransportUDP;
+	LiveMediaStreamState m_state;
+
+	Authenticator* m_pAuth;
 	RTSPClient* m_pRtspClient;
 	MediaSession* m_pMediaSession;
+	InterleavedDemux* m_pInterleavedDemux; // With the session if the interleaved packets are demultiplexed
 	MediaSubsessionIterator* m_pMediaSubsessionIterator;
 	MediaSubsession* m_pMediaSubsession;
-	TaskToken m_streamInitializedTask;
-	TaskToken m_streamTimerTask;
-	TaskToken m_streamCheckAliveTask;
+	// On the TimerWheel of the shard, re-armed often and rarely expiring
+	WheelTimer m_streamInitializedTimer;
+	WheelTimer m_streamTimer;
+	WheelTimer m_streamCheckAliveTimer;
+	WheelTimer m_streamKeepaliveTimer;
+	TaskToken m_streamCloseTask;
+	TaskToken m_streamRestartTask;
 	double m_duration;
 
+	// Decorrelated jitter backoff, kept across reconnections
+	int64_t m_iRetryDelayUs; // Last delay
+	unsigned int m_iRandomSeed;
+	int64_t m_iPlayingStartUs; // On the monotonic clock, 0 if not playing
+
+	// Admission of the handshake, the streams down for the longest time going first
+	AdmissionTicket m_admissionTicket;
+	int64_t m_iDownSinceUs; // On the monotonic clock, 0 if not known
+
 	bool m_bError;
 
+	bool m_bStreamInitialized;
+
+	// Fast start: no OPTIONS, the SETUP after the first one and the PLAY are pipelined
+	bool m_bFastStart; // For this attempt
+	bool m_bFastStartFailed; // The server refused it once, kept across reconnections
+	bool m_bRestartAtOnce; // Restart without the retry delay, with the serial handshake, a new DESCRIBE or a new session
+	std::vector<MediaSubsession*> m_listPendingSetups; // Pipelined SETUP waiting for their response
+
+	bool m_bSdpFromCache; // The session of this attempt is created from the SDP cache, without DESCRIBE
+
+	KeepaliveMethod m_keepaliveMethod; // Supported by the server, kept across reconnections
+	int64_t m_iKeepaliveIntervalUs; // Half the session timeout of this attempt
+
+	int64_t m_iLastPacketUs; // On the monotonic clock, 0 if none
+
+	// Written by the sinks, read by the load sampling and the metrics endpoint
+	StreamMetrics* m_pMetrics;
+	int64_t m_iStateChangeUs; // On the monotonic clock
+	int64_t m_iHandshakeStartUs; // 0 before the first request of the attempt
+	bool m_bFirstFrameReceived;
+
+	// Frames handed to the consumer threads, NULL if they are consumed in the event loop
+	FrameRing* m_pFrameRing;
+	int m_iSubsessionCount;
+
+	// Size of the video receive buffer learnt from the truncated frames, kept across reconnections
+	size_t m_iVideoBufferSize;
+
+	// Measured rates, kept across reconnections and read from any shard
+	uint64_t m_iLastSampleBytes;
+	uint64_t m_iLastSampleFrames;
+	int64_t m_iLastSampleUs; // 0 before the first sample
+	std::atomic<uint64_t> m_iByteRate;
+	std::atomic<uint64_t> m_iFrameRate;
+};
+
+/////////////////////////////////////////////
+// LiveMediaModuleContext declaration
+/////////////////////////////////////////////
+
+class LiveMediaShardPool;
+
+enum LiveMediaSchedulerType
+{
+	SCHEDULER_SELECT = 0, // live555 BasicTaskScheduler
+	SCHEDULER_EPOLL,
+};
+
+class LiveMediaModuleContext
+{
+public:
+	LiveMediaModuleContext(int iVerbosityLevel, LiveMediaSchedulerType schedulerType);
+	virtual ~LiveMediaModuleContext();
+	void reset();
+	void setWithPingOptions(bool bEnable);
+	void setRTCPKeepalive(bool bEnable);
+	void setTransportTCP(bool bTCP);
+	void setRetry(bool bRetry, int iRetryDelay, int iRetryMaxDelay);
+	void setMaxFrameSize(size_t iMaxFrameSize);
+	void setFrameConsumerPool(FrameConsumerPool* pFrameConsumerPool, RecordingWriter* pConsumerRecordingWriter);
+	void setMetricsPort(int iMetricsPort);
+	void setDuration(int iDurationSec);
+	void setFastStart(bool bFastStart);
+	void setSdpCacheMaxAge(int iSdpCacheMaxAge);
+	void setRecording(const char* szRecordPath, int iSegmentDuration, bool bUseUring);
+	void setParseNalUnits(bool bParseNalUnits);
+	void setBatchReceive(bool bBatchReceive);
+	void setStreamReceive(bool bStreamReceive);
+	void setReorderMode(ReorderMode reorderMode);
+	void setShardPool(LiveMediaShardPool* pShardPool, int iShardId);
+	LiveMediaStreamContext* addStream(const char* szMRL, const char* szUser, const char* szPass);
+	void attachStream(LiveMediaStreamContext* pStream);
+	void detachStream(LiveMediaStreamContext* pStream);
+	void adoptStream(LiveMediaStreamContext* pStream);
+	void streamClosed(LiveMediaStreamContext* pStream);
+	void stopEventLoop();
+	int start();
+
+	static void adoptStreamsHandler(void* clientData);
+	static void stopEventLoopHandler(void* clientData);
+	static void loadSamplingHandler(void* clientData);
+	static void durationElapsedHandler(void* clientData);
+	static void streamAdmittedCallback(void* clientData);
+	static void admissionHandler(void* clientData);
+	static void admissionPollHandler(void* clientData);
+	void adoptStreams();
+	void admitStreams();
+	void scheduleAdmissionPoll();
+	void sampleLoad();
+
+public:
+	TaskScheduler* m_scheduler;
+	EpollTaskScheduler* m_pEpollScheduler; // Same as m_scheduler, NULL with select
+	TimerWheel* m_pTimerWheel; // Timers of the streams, on m_scheduler
+	UsageEnvironment* m_env;
+
+	LiveMediaShardPool* m_pShardPool;
+	int m_iShardId;
+
+	char m_eventLoopWatchVariable;
+
+	bool m_bTransportUDP;
+
 	int m_iVerbosityLevel;
 	bool m_bVerbose;
 
-	bool m_bStreamInitialized;
+	bool m_bWithPingOptions;
+	// No ping while the server sends RTCP, our receiver reports keeping the session alive
+	bool m_bRTCPKeepalive;
 
-	timeval m_tvLastPacket;
+	bool m_bFastStart;
 
-	bool m_bWithPingOptions;
+	// Age above which a cached SDP is not used, in seconds
+	int m_iSdpCacheMaxAge;
+
+	// The NAL units of the H264/H265 frames are parsed, always done for the recording
+	bool m_bParseNalUnits;
+
+	// The RTP sockets of the UDP subsessions are read by recvmmsg(), only with epoll
+	bool m_bBatchReceive;
+
+	// The RTSP socket carrying the interleaved RTP/RTCP is read by chunks and demultiplexed, only with epoll
+	bool m_bStreamReceive;
+	InterleavedStats m_interleavedStats;
+
+	// How long the missing RTP packets are waited for
+	ReorderMode m_reorderMode;
+
+	// Recording of the frames, disabled if there is no path
+	char* m_szRecordPath;
+	int m_iRecordSegmentDuration; // In seconds
+	bool m_bRecordUring;
+	RecordingWriter* m_pRecordingWriter; // Of this shard, while the event loop runs, NULL with the consumer threads
+	RecordingWriter* m_pConsumerRecordingWriter; // Shared by the consumer threads, NULL without them
+
+	// Shared by all the shards, served by the event loop of the first one, NULL if disabled
+	RestreamServer* m_pRestreamServer;
+
+	bool m_bRetry;
+	int m_iRetryDelay; // Base of the backoff
+	int m_iRetryMaxDelay; // Cap of the backoff
+
+	size_t m_iMaxFrameSize;
+
+	FrameConsumerPool* m_pFrameConsumerPool;
+
+	// The metrics endpoint is served by the event loop, 0 if disabled
+	int m_iMetricsPort;
+
+	// All the streams are stopped after this time, 0 to run until they end
+	int m_iDurationSec;
+	TaskToken m_durationTask;
+
+	std::vector<LiveMediaStreamContext*> m_listStreams;
+	int m_iActiveStreamCount;
+
+	// Streams moved from another shard, waiting to be adopted by this shard thread
+	pthread_mutex_t m_mutexStreamsInbox;
+	std::vector<LiveMediaStreamContext*> m_listStreamsInbox;
+	EventTriggerId m_adoptStreamsTrigger;
+	EventTriggerId m_stopEventLoopTrigger;
+
+	// Streams of this shard admitted by the AdmissionController, from any thread
+	EventTriggerId m_admissionTrigger;
+	TaskToken m_admissionPollTask;
+
+	TaskToken m_loadSamplingTask;
+	std::atomic<uint64_t> m_iLoad;
+};
+
+/////////////////////////////////////////////
+// LiveMediaShardPool declaration
+/////////////////////////////////////////////
+
+// Spread the streams over several LiveMediaModuleContext, each one running
+// its own event loop in its own thread
+class LiveMediaShardPool
+{
+public:
+	LiveMediaShardPool(int iShardCount, int iVerbosityLevel, LiveMediaSchedulerType schedulerType);
+	virtual ~LiveMediaShardPool();
+	void setWithPingOptions(bool bEnable);
+	void setRTCPKeepalive(bool bEnable);
+	void setTransportTCP(bool bTCP);
+	void setRetry(bool bRetry, int iRetryDelay, int iRetryMaxDelay);
+	void setMaxFrameSize(size_t iMaxFrameSize);
+	void setFrameConsumerPool(FrameConsumerPool* pFrameConsumerPool, RecordingWriter* pConsumerRecordingWriter);
+	void setMetricsPort(int iMetricsPort);
+	void setDuration(int iDurationSec);
+	void setFastStart(bool bFastStart);
+	void setSdpCacheMaxAge(int iSdpCacheMaxAge);
+	void setRecording(const char* szRecordPath, int iSegmentDuration, bool bUseUring);
+	void setParseNalUnits(bool bParseNalUnits);
+	void setRestreamPort(int iRestreamPort);
+	void setBatchReceive(bool bBatchReceive);
+	void setStreamReceive(bool bStreamReceive);
+	void setReorderMode(ReorderMode reorderMode);
+	LiveMediaStreamContext* addStream(const char* szMRL, const char* szUser, const char* szPass);
+	LiveMediaModuleContext* pickShard(LiveMediaStreamContext* pStream, LiveMediaModuleContext* pCurrentShard);
+	void streamEnded();
+	void stop();
+	int start();
+
+	static void* shardThread(void* arg);
+
+public:
+	std::vector<LiveMediaModuleContext*> m_listShards;
+	std::vector<pthread_t> m_listThreads;
+	std::vector<int> m_listShardResults;
+
+	int m_iStreamCount; // Added, to spread them over the shards
+	std::atomic<int> m_iActiveStreamCount;
+
+	// The subsessions are restreamed by a RTSP server on this port, 0 if disabled
+	int m_iRestreamPort;
+	RestreamServer* m_pRestreamServer; // While the shards run
 };
 
 
@@ -227,23 +660,29 @@ char* p_strconcat(const char* str1, ...)
 	return szResult;
 }
 
-static int g_iAttempt = 0;
+// Stream being processed, set by the callbacks before they dispatch to the stream context.
+// Each shard thread has its own.
+static __thread int g_iStreamId = 0;
+static __thread int g_iAttempt = 0;
+
+// Last ID given to a stream, whichever module or shard adds it. The IDs are
+// never reused, so a stream keeps its logs, metrics, recording directory and
+// restream URL apart from the others.
+static std::atomic<int> g_iLastStreamId(0);
 
 void p_log(const char* format, ...)
 {
-	timeval tvNow;
-	gettimeofday(&tvNow, NULL);
-	char szBufTime[50];
-	timer_text("%Y-%m-%d %H:%M:%S", &tvNow, szBufTime, 50);
-	fprintf(stderr, "[%s::%d] ", szBufTime, g_iAttempt);
-
+	// Timestamp and output are done by the logger thread
 	va_list args;
 	va_start(args, format);
-	vfprintf(stderr, format, args);
-	fflush(stderr);
+	AsyncLogger::getInstance()->vlog(g_iStreamId, g_iAttempt, format, args);
 	va_end(args);
+}
 
-	fprintf(stderr, "\n");
+void p_log_set_context(int iStreamId, int iAttempt)
+{
+	g_iStreamId = iStreamId;
+	g_iAttempt = iAttempt;
 }
 
 int64_t p_timeval_diffms(const timeval& tv1, const timeval& tv2)
@@ -267,103 +706,358 @@ void timer_text(const char* szFormat, const struct timeval* tv, char* buf, size_
 // Custom RTSPClient declaration
 //////////////////////////////////
 
-CustomRTSPClient* CustomRTSPClient::createNew(LiveMediaModuleContext* pLiveMediaModuleContext, char const* rtspURL, int iVerbosityLevel)
+CustomRTSPClient* CustomRTSPClient::createNew(LiveMediaStreamContext* pLiveMediaStreamContext, char const* rtspURL, int iVerbosityLevel)
 {
-	return new CustomRTSPClient(pLiveMediaModuleContext, rtspURL, iVerbosityLevel);
+	return new CustomRTSPClient(pLiveMediaStreamContext, rtspURL, iVerbosityLevel);
 }
 
-CustomRTSPClient::CustomRTSPClient(LiveMediaModuleContext* pLiveMediaModuleContext, char const* rtspURL, int iVerbosityLevel)
+CustomRTSPClient::CustomRTSPClient(LiveMediaStreamContext* pLiveMediaStreamContext, char const* rtspURL, int iVerbosityLevel)
 #if LIVEMEDIA_LIBRARY_VERSION_INT < 1385424000
-	: RTSPClient(*pLiveMediaModuleContext->m_env, rtspURL, iVerbosityLevel, NULL, 0)
+	: RTSPClient(*pLiveMediaStreamContext->m_env, rtspURL, iVerbosityLevel, NULL, 0)
 #else
-	: RTSPClient(*pLiveMediaModuleContext->m_env, rtspURL, iVerbosityLevel, NULL, 0, -1)
+	: RTSPClient(*pLiveMediaStreamContext->m_env, rtspURL, iVerbosityLevel, NULL, 0, -1)
 #endif
 {
-	m_pLiveMediaModuleContext = pLiveMediaModuleContext;
+	m_pLiveMediaStreamContext = pLiveMediaStreamContext;
 }
 
 CustomRTSPClient::~CustomRTSPClient()
 {
 }
 
+void CustomRTSPClient::setSessionBaseURL(char const* szBaseURL)
+{
+	setBaseURL(szBaseURL);
+}
+
 void CustomRTSPClient::continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
-	((CustomRTSPClient*)rtspClient)->m_pLiveMediaModuleContext->continueAfterOPTIONS(rtspClient, resultCode, resultString);
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->continueAfterOPTIONS(rtspClient, resultCode, resultString);
 }
 
 void CustomRTSPClient::continueAfterDESCRIBE(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
-	((CustomRTSPClient*)rtspClient)->m_pLiveMediaModuleContext->continueAfterDESCRIBE(rtspClient, resultCode, resultString);
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->continueAfterDESCRIBE(rtspClient, resultCode, resultString);
 }
 
 void CustomRTSPClient::continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
-	((CustomRTSPClient*)rtspClient)->m_pLiveMediaModuleContext->continueAfterSETUP(rtspClient, resultCode, resultString);
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->continueAfterSETUP(rtspClient, resultCode, resultString);
 }
 
 void CustomRTSPClient::continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
-	((CustomRTSPClient*)rtspClient)->m_pLiveMediaModuleContext->continueAfterPLAY(rtspClient, resultCode, resultString);
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->continueAfterPLAY(rtspClient, resultCode, resultString);
 }
 
 void CustomRTSPClient::handlePingWithOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
-	((CustomRTSPClient*)rtspClient)->m_pLiveMediaModuleContext->handlePingWithOPTIONS(rtspClient, resultCode, resultString);
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->handlePingWithOPTIONS(rtspClient, resultCode, resultString);
+}
+
+void CustomRTSPClient::handlePingWithGET_PARAMETER(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+	LiveMediaStreamContext* pStream = ((CustomRTSPClient*)rtspClient)->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->handlePingWithGET_PARAMETER(rtspClient, resultCode, resultString);
 }
 
 void CustomRTSPClient::subsessionAfterPlaying(void* clientData)
 {
 	MediaSubsession* subsession = (MediaSubsession*)clientData;
 	CustomRTSPClient* rtspClient = (CustomRTSPClient*)(subsession->miscPtr);
-	rtspClient->m_pLiveMediaModuleContext->subsessionAfterPlaying(rtspClient, subsession);
+	LiveMediaStreamContext* pStream = rtspClient->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->subsessionAfterPlaying(rtspClient, subsession);
 }
 
 void CustomRTSPClient::subsessionByeHandler(void* clientData)
 {
 	MediaSubsession* subsession = (MediaSubsession*)clientData;
 	CustomRTSPClient* rtspClient = (CustomRTSPClient*)(subsession->miscPtr);
-	rtspClient->m_pLiveMediaModuleContext->subsessionByeHandler(rtspClient, subsession);
+	LiveMediaStreamContext* pStream = rtspClient->m_pLiveMediaStreamContext;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->subsessionByeHandler(rtspClient, subsession);
 }
 
 void CustomRTSPClient::streamCheckStreamInitializedHandler(void* clientData)
 {
-	((CustomRTSPClient*)clientData)->m_pLiveMediaModuleContext->streamCheckStreamInitializedHandler((CustomRTSPClient*)clientData);
+	// Timers of the stream context, armed only while it has a RTSP client
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamCheckStreamInitializedHandler((CustomRTSPClient*)pStream->m_pRtspClient);
 }
 
 void CustomRTSPClient::streamCheckAliveHandler(void* clientData)
 {
-	((CustomRTSPClient*)clientData)->m_pLiveMediaModuleContext->streamCheckAliveHandler((CustomRTSPClient*)clientData);
+	// Timers of the stream context, armed only while it has a RTSP client
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamCheckAliveHandler((CustomRTSPClient*)pStream->m_pRtspClient);
+}
+
+void CustomRTSPClient::streamKeepaliveHandler(void* clientData)
+{
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamKeepaliveHandler((CustomRTSPClient*)pStream->m_pRtspClient);
 }
 
 void CustomRTSPClient::streamTimerHandler(void* clientData)
 {
-	((CustomRTSPClient*)clientData)->m_pLiveMediaModuleContext->streamTimerHandler((CustomRTSPClient*)clientData);
+	// Timers of the stream context, armed only while it has a RTSP client
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamTimerHandler((CustomRTSPClient*)pStream->m_pRtspClient);
+}
+
+void CustomRTSPClient::streamCloseHandler(void* clientData)
+{
+	// The RTSP client is destroyed by this task, so the stream context is passed directly
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamCloseHandler();
+}
+
+void CustomRTSPClient::streamRestartHandler(void* clientData)
+{
+	LiveMediaStreamContext* pStream = (LiveMediaStreamContext*)clientData;
+	p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+	pStream->streamRestartHandler();
 }
 
 //////////////////////////////////
 // Custom MediaSink definition
 //////////////////////////////////
 
-DummySink* DummySink::createNew(LiveMediaModuleContext* pLiveMediaModuleContext)
+DummySink* DummySink::createNew(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId)
 {
-	return new DummySink(pLiveMediaModuleContext);
+	return new DummySink(pLiveMediaStreamContext, mediaSubSession, iSubsessionId);
 }
 
-DummySink::DummySink(LiveMediaModuleContext* pLiveMediaModuleContext)
-	: MediaSink(*pLiveMediaModuleContext->m_env), m_mediaSubSession(*pLiveMediaModuleContext->m_pMediaSubsession)
+DummySink::DummySink(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId)
+	: MediaSink(*pLiveMediaStreamContext->m_env), m_mediaSubSession(mediaSubSession)
 {
-	m_pLiveMediaModuleContext = pLiveMediaModuleContext;
+	m_pLiveMediaStreamContext = pLiveMediaStreamContext;
+	m_iSubsessionId = iSubsessionId;
+	// Subsessions beyond the limit share the counters of the last one
+	int iMetricsId = std::min(iSubsessionId, METRICS_MAX_SUBSESSIONS-1);
+	pLiveMediaStreamContext->m_pMetrics->setSubsession(iMetricsId, mediaSubSession.mediumName(), mediaSubSession.codecName());
+	m_pSubsessionMetrics = pLiveMediaStreamContext->m_pMetrics->getSubsession(iMetricsId);
+
+	LiveMediaModuleContext* pModule = pLiveMediaStreamContext->m_pLiveMediaModuleContext;
+	m_pFrameProcessor = FrameProcessor::createNew(pLiveMediaStreamContext, mediaSubSession, iSubsessionId, m_pSubsessionMetrics);
+
+	// The restream clients are fed from the GOP cache
+	GopCacheEntry* pGopCacheEntry = (m_pFrameProcessor ? m_pFrameProcessor->getGopCacheEntry() : NULL);
+	if(pGopCacheEntry && pModule->m_pRestreamServer){
+		RestreamTrackInfo info;
+		info.szCodecName = (strcmp(mediaSubSession.codecName(), "H265") == 0 ? "H265" : "H264");
+		info.szSPropParameterSets = mediaSubSession.fmtp_spropparametersets();
+		info.szSPropVPS = mediaSubSession.fmtp_spropvps();
+		info.szSPropSPS = mediaSubSession.fmtp_spropsps();
+		info.szSPropPPS = mediaSubSession.fmtp_sproppps();
+		info.iBandwidth = mediaSubSession.bandwidth();
+		pModule->m_pRestreamServer->addTrack(pLiveMediaStreamContext->m_iStreamId, iSubsessionId, info, pGopCacheEntry);
+	}
+
+	m_pFrameBuffer = NULL;
+	m_iReceiveBufferSize = getInitialBufferSize(m_mediaSubSession, pLiveMediaStreamContext->m_pLiveMediaModuleContext->m_iMaxFrameSize);
+	// A previous attempt may have seen bigger frames
+	if(strcmp(m_mediaSubSession.mediumName(), "video") == 0 && m_iReceiveBufferSize < pLiveMediaStreamContext->m_iVideoBufferSize){
+		m_iReceiveBufferSize = pLiveMediaStreamContext->m_iVideoBufferSize;
+	}
+
+	// Before PLAY, so the first key frame already fits
+	m_pReceiveBufferTuner = NULL;
+	RTPSource* pRTPSource = mediaSubSession.rtpSource();
+	if(pModule->m_bTransportUDP && pRTPSource){
+		bool bVideo = (strcmp(mediaSubSession.mediumName(), "video") == 0);
+		m_pReceiveBufferTuner = new ReceiveBufferTuner(pRTPSource->RTPgs()->socketNum(), bVideo, mediaSubSession.bandwidth());
+		if(m_pReceiveBufferTuner->start()){
+			p_log("[Access::livemedia] %s/%s socket receive buffer: %zu bytes (%u kbps in the SDP)%s", mediaSubSession.mediumName(),
+					mediaSubSession.codecName(), m_pReceiveBufferTuner->getSize(), mediaSubSession.bandwidth(),
+					(m_pReceiveBufferTuner->hasDropCounter() ? "" : ", kernel drops not available"));
+		}
+		m_pSubsessionMetrics->iReceiveBufferSize.store(m_pReceiveBufferTuner->getSize(), std::memory_order_relaxed);
+
+		// Before the source starts reading, the setting is dropped with its handler
+		if(pModule->m_bBatchReceive){
+			pModule->m_pEpollScheduler->setBatchReceive(pRTPSource->RTPgs()->socketNum(), true);
+		}
+	}
 
-	m_pReceiveBuffer = new u_int8_t[DUMMY_SINK_RECEIVE_BUFFER_SIZE];
+	// Same initial threshold as set by initiateSubsession()
+	m_pReorderWindow = NULL;
+	m_iReportedReordered = 0;
+	m_iReportedGivenUp = 0;
+	if(pRTPSource){
+		m_pSubsessionMetrics->iReorderThresholdUs.store(ReorderWindow::getInitialThreshold(pModule->m_reorderMode), std::memory_order_relaxed);
+		if(pModule->m_bTransportUDP){
+			m_pReorderWindow = new ReorderWindow(pModule->m_reorderMode);
+			pRTPSource->setAuxilliaryReadHandler(DummySink::rtpPacketHandler, this);
+		}
+	}
 
 	timerclear(&m_tvLastPresentationTime);
 }
 
 DummySink::~DummySink()
 {
-	if(m_pReceiveBuffer){
-		delete[] m_pReceiveBuffer;
-		m_pReceiveBuffer = NULL;
+	// Make sure the source doesn't write in the buffer anymore before giving it back
+	stopPlaying();
+	if(m_pFrameBuffer){
+		m_pFrameBuffer->unref();
+		m_pFrameBuffer = NULL;
+	}
+	if(m_pFrameProcessor){
+		// The restream clients are detached from the GOP cache before it is released with the last reference
+		LiveMediaModuleContext* pModule = m_pLiveMediaStreamContext->m_pLiveMediaModuleContext;
+		if(m_pFrameProcessor->getGopCacheEntry() && pModule->m_pRestreamServer){
+			pModule->m_pRestreamServer->removeTrack(m_pLiveMediaStreamContext->m_iStreamId, m_iSubsessionId);
+		}
+		m_pFrameProcessor->unref();
+		m_pFrameProcessor = NULL;
+	}
+	if(m_pReceiveBufferTuner){
+		delete m_pReceiveBufferTuner;
+		m_pReceiveBufferTuner = NULL;
+	}
+	if(m_pReorderWindow){
+		if(m_mediaSubSession.rtpSource()){
+			m_mediaSubSession.rtpSource()->setAuxilliaryReadHandler(NULL, NULL);
+		}
+		delete m_pReorderWindow;
+		m_pReorderWindow = NULL;
+	}
+}
+
+void DummySink::sampleReceiveBuffer(int64_t iNowUs)
+{
+	if(!m_pReceiveBufferTuner){
+		return;
+	}
+
+	// The bytes of the subsessions beyond the metrics limit are counted with the last one
+	ReceiveBufferTuner* pTuner = m_pReceiveBufferTuner;
+	bool bResized = pTuner->sample(m_pSubsessionMetrics->iBytes.load(std::memory_order_relaxed), iNowUs);
+	if(pTuner->getNewDrops() > 0){
+		m_pSubsessionMetrics->iSocketDrops.fetch_add(pTuner->getNewDrops(), std::memory_order_relaxed);
+	}
+	if(bResized){
+		m_pSubsessionMetrics->iReceiveBufferSize.store(pTuner->getSize(), std::memory_order_relaxed);
+		m_pSubsessionMetrics->iReceiveBufferAdjustments.fetch_add(1, std::memory_order_relaxed);
+		p_log("[Access::livemedia] %s/%s socket receive buffer: %zu -> %zu bytes (%s, %.2f Mbps, %llu datagram(s) dropped)",
+				m_mediaSubSession.mediumName(), m_mediaSubSession.codecName(), pTuner->getPreviousSize(), pTuner->getSize(),
+				ReceiveBufferTuner::getReasonName(pTuner->getLastReason()), (double)pTuner->getBitrate() / 1000000.0,
+				(unsigned long long)pTuner->getNewDrops());
+	}else if(pTuner->getNewDrops() > 0){
+		p_log("[Access::livemedia] %s/%s %llu datagram(s) dropped by the kernel, the socket receive buffer is at its limit of %zu bytes",
+				m_mediaSubSession.mediumName(), m_mediaSubSession.codecName(), (unsigned long long)pTuner->getNewDrops(), pTuner->getSize());
+	}
+}
+
+void DummySink::rtpPacketHandler(void* clientData, unsigned char* packet, unsigned& packetSize)
+{
+	// RTP version 2, the RTCP packets multiplexed on the same port are skipped
+	if(packetSize < 12 || (packet[0] & 0xC0) != 0x80 || ((packet[1] & 0x7F) >= 72 && (packet[1] & 0x7F) <= 76)){
+		return;
+	}
+	DummySink* sink = (DummySink*)clientData;
+	sink->m_pReorderWindow->notePacket((uint16_t)((packet[2] << 8) | packet[3]), LoopClock::nowUs());
+}
+
+void DummySink::sampleReorderWindow()
+{
+	if(!m_pReorderWindow){
+		return;
+	}
+
+	ReorderWindow* pWindow = m_pReorderWindow;
+	bool bChanged = pWindow->sample(LoopClock::nowUs());
+	m_pSubsessionMetrics->iReorderedPackets.fetch_add(pWindow->getReordered() - m_iReportedReordered, std::memory_order_relaxed);
+	m_pSubsessionMetrics->iReorderGivenUp.fetch_add(pWindow->getGivenUp() - m_iReportedGivenUp, std::memory_order_relaxed);
+	m_iReportedReordered = pWindow->getReordered();
+	m_iReportedGivenUp = pWindow->getGivenUp();
+	if(bChanged){
+		m_mediaSubSession.rtpSource()->setPacketReorderingThresholdTime(pWindow->getThreshold());
+		m_pSubsessionMetrics->iReorderThresholdUs.store(pWindow->getThreshold(), std::memory_order_relaxed);
+		p_log("[Access::livemedia] %s/%s reorder threshold: %u -> %u ms (%s first, late by up to %u ms and %d packet(s), %llu reordered, %llu given up, %llu too late)",
+				m_mediaSubSession.mediumName(), m_mediaSubSession.codecName(), pWindow->getPreviousThreshold() / 1000, pWindow->getThreshold() / 1000,
+				ReorderWindow::getModeName(pWindow->getMode()), pWindow->getMaxLateness() / 1000, pWindow->getMaxDepth(),
+				(unsigned long long)pWindow->getReordered(), (unsigned long long)pWindow->getGivenUp(), (unsigned long long)pWindow->getLate());
+	}
+}
+
+size_t DummySink::getInitialBufferSize(MediaSubsession& mediaSubSession, size_t iMaxSize)
+{
+	size_t iSize = DUMMY_SINK_MIN_BUFFER_SIZE;
+
+	if(strcmp(mediaSubSession.mediumName(), "video") == 0){
+		iSize = DUMMY_SINK_VIDEO_MIN_BUFFER_SIZE;
+
+		// Half a second of the announced bitrate (b=AS, in kbps), a key frame is much bigger than the others
+		size_t iBandwidthSize = (size_t)mediaSubSession.bandwidth() * 1000 / 8 / 2;
+		if(iBandwidthSize > iSize){
+			iSize = iBandwidthSize;
+		}
+
+		// A quarter of byte per pixel covers the key frames of H264/H265, JPEG frames are all key frames
+		size_t iPixelCount = (size_t)mediaSubSession.videoWidth() * mediaSubSession.videoHeight();
+		size_t iPictureSize = iPixelCount / 4;
+		if(strcmp(mediaSubSession.codecName(), "JPEG") == 0){
+			iPictureSize = iPixelCount / 2;
+		}
+		if(iPictureSize > iSize){
+			iSize = iPictureSize;
+		}
+	}
+
+	if(iSize > iMaxSize){
+		iSize = iMaxSize;
+	}
+	return iSize;
+}
+
+void DummySink::growBuffer(unsigned frameSize, unsigned numTruncatedBytes)
+{
+	uint64_t iTruncatedFrames = m_pSubsessionMetrics->iTruncatedFrames.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	size_t iMaxSize = m_pLiveMediaStreamContext->m_pLiveMediaModuleContext->m_iMaxFrameSize;
+	size_t iNeededSize = (size_t)frameSize + numTruncatedBytes;
+	if(m_iReceiveBufferSize >= iMaxSize){
+		if(m_pLiveMediaStreamContext->m_pLiveMediaModuleContext->m_bVerbose){
+			p_log("[Access::livemedia] %s/%s frame of %d bytes truncated, the buffer is at its maximum of %d bytes (%llu truncated frame(s))",
+					m_mediaSubSession.mediumName(), m_mediaSubSession.codecName(), (int)iNeededSize, (int)iMaxSize, (unsigned long long)iTruncatedFrames);
+		}
+		return;
+	}
+
+	// Grow geometrically, so that a stream whose frames keep growing is not truncated at each step
+	size_t iNewSize = m_iReceiveBufferSize * 2;
+	if(iNewSize < iNeededSize){
+		iNewSize = iNeededSize;
+	}
+	if(iNewSize > iMaxSize){
+		iNewSize = iMaxSize;
+	}
+	p_log("[Access::livemedia] %s/%s frame of %d bytes truncated, growing the buffer from %d to %d bytes (%llu truncated frame(s))",
+			m_mediaSubSession.mediumName(), m_mediaSubSession.codecName(), (int)iNeededSize, (int)m_iReceiveBufferSize, (int)iNewSize,
+			(unsigned long long)iTruncatedFrames);
+	m_iReceiveBufferSize = iNewSize;
+
+	if(strcmp(m_mediaSubSession.mediumName(), "video") == 0 && m_pLiveMediaStreamContext->m_iVideoBufferSize < iNewSize){
+		m_pLiveMediaStreamContext->m_iVideoBufferSize = iNewSize;
 	}
 }
 
@@ -371,6 +1065,7 @@ void DummySink::afterGettingFrame(void* clientData, unsigned frameSize, unsigned
 		struct timeval presentationTime, unsigned durationInMicroseconds)
 {
 	DummySink* sink = (DummySink*)clientData;
+	p_log_set_context(sink->m_pLiveMediaStreamContext->m_iStreamId, sink->m_pLiveMediaStreamContext->m_iAttempt);
 	sink->afterGettingFrame(frameSize, numTruncatedBytes, presentationTime, durationInMicroseconds);
 }
 
@@ -382,10 +1077,12 @@ void DummySink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes
 	timerclear(&tvDiff);
 	if(timerisset(&m_tvLastPresentationTime)){
 		timersub(&presentationTime, &m_tvLastPresentationTime, &tvDiff);
+		int64_t iDiffUs = (int64_t)tvDiff.tv_sec*1000000 + tvDiff.tv_usec;
+		m_pSubsessionMetrics->pFrameInterval->record(iDiffUs > 0 ? iDiffUs : 0);
 	}
 	timercpy(&m_tvLastPresentationTime, &presentationTime);
 
-	if(m_pLiveMediaModuleContext->m_iVerbosityLevel >= 3){
+	if(m_pLiveMediaStreamContext->m_pLiveMediaModuleContext->m_iVerbosityLevel >= 3){
 		// Data type
 		envir() << m_mediaSubSession.mediumName() << "/" << m_mediaSubSession.codecName() << ":";
 
@@ -414,31 +1111,75 @@ void DummySink::afterGettingFrame(unsigned frameSize, unsigned numTruncatedBytes
 	#endif
 		envir() << "\n";
 	}
-	bool bRes = true;
 
+	// Read once for all the frames of the iteration
 	timeval tvNow;
-	gettimeofday(&tvNow, NULL);
+	LoopClock::wallClock(tvNow);
 
-	if(numTruncatedBytes > 0){
-		bRes = false;
+	// The end of the frame is lost, but the next ones will fit: the stream goes on
+	bool bTruncated = (numTruncatedBytes > 0);
+	if(bTruncated){
+		growBuffer(frameSize, numTruncatedBytes);
 	}
 
-	if(bRes){
-		bool bRTCPSync = true;
-		if (m_mediaSubSession.rtpSource() != NULL && !m_mediaSubSession.rtpSource()->hasBeenSynchronizedUsingRTCP()) {
-			bRTCPSync = false;
+	bool bRTCPSync = true;
+	if (m_mediaSubSession.rtpSource() != NULL && !m_mediaSubSession.rtpSource()->hasBeenSynchronizedUsingRTCP()) {
+		bRTCPSync = false;
+	}
+
+	if(m_pFrameBuffer){
+		m_pFrameBuffer->setSize(frameSize);
+		FrameRing* pFrameRing = m_pLiveMediaStreamContext->m_pFrameRing;
+		if(m_pFrameProcessor && pFrameRing){
+			// The consumer thread gets the references of the buffer and of the processor. A frame much
+			// smaller than the receive buffer is copied, so that a late consumer doesn't hold a ring of them.
+			m_pFrameProcessor->ref();
+			FrameDescriptor frame;
+			frame.pBuffer = FramePool::getInstance()->keep(m_pFrameBuffer);
+			frame.presentationTime = presentationTime;
+			frame.iStreamId = m_pLiveMediaStreamContext->m_iStreamId;
+			frame.iSubsessionId = m_iSubsessionId;
+			frame.bRTCPSync = bRTCPSync;
+			frame.bTruncated = bTruncated;
+			frame.pClientData = m_pFrameProcessor;
+			if(pFrameRing->push(frame)){
+				m_pLiveMediaStreamContext->m_pLiveMediaModuleContext->m_pFrameConsumerPool->notify(frame.iStreamId);
+			}else{
+				// The consumer is late, the frame is dropped rather than delaying the event loop
+				frame.pBuffer->unref();
+				m_pFrameProcessor->unref();
+			}
+			// Given back to the pool if copied, to receive the next frame
+			m_pFrameBuffer->unref();
+		}else{
+			if(m_pFrameProcessor){
+				m_pFrameProcessor->processFrame(m_pFrameBuffer, presentationTime, bTruncated);
+			}
+			// The frame is not kept, give back the buffer so that it can be used by another sink
+			m_pFrameBuffer->unref();
 		}
-		// Keep last packet time
-		timercpy(&m_pLiveMediaModuleContext->m_tvLastPacket, &tvNow);
+		m_pFrameBuffer = NULL;
 	}
 
-	// Then continue, to request the next frame of data:
-	if(bRes){
-		continuePlaying();
-	}else{
-		p_log("[Access::livemedia] Cannot demux data");
-		fSource->close(*m_pLiveMediaModuleContext->m_env, m_mediaSubSession.mediumName());
+	// Keep last packet time
+	m_pLiveMediaStreamContext->m_iLastPacketUs = LoopClock::nowUs();
+	if(!m_pLiveMediaStreamContext->m_bFirstFrameReceived){
+		m_pLiveMediaStreamContext->firstFrameReceived();
+	}
+
+	// Count for the metrics and the shard load
+	m_pSubsessionMetrics->iBytes.fetch_add(frameSize, std::memory_order_relaxed);
+	m_pSubsessionMetrics->iFrames.fetch_add(1, std::memory_order_relaxed);
+	m_pSubsessionMetrics->iLastFrameTimeUs.store((int64_t)tvNow.tv_sec*1000000 + tvNow.tv_usec, std::memory_order_relaxed);
+	m_pSubsessionMetrics->bRTCPSync.store(bRTCPSync, std::memory_order_relaxed);
+	if(bRTCPSync){
+		// The presentation time is on the wall clock of the sender only once synchronized
+		int64_t iLatencyUs = (int64_t)(tvNow.tv_sec - presentationTime.tv_sec)*1000000 + (tvNow.tv_usec - presentationTime.tv_usec);
+		m_pSubsessionMetrics->pLatency->record(iLatencyUs > 0 ? iLatencyUs : 0);
 	}
+
+	// Then continue, to request the next frame of data:
+	continuePlaying();
 }
 
 Boolean DummySink::continuePlaying()
@@ -446,7 +1187,14 @@ Boolean DummySink::continuePlaying()
 	//p_log("[Access::livemedia] continuePlaying: %d bytes", fSource->maxFrameSize());
 	if (fSource){
 		// Request the next frame of data from our input source. "afterGettingFrame()" will get called later, when it arrives:
-		fSource->getNextFrame(m_pReceiveBuffer, DUMMY_SINK_RECEIVE_BUFFER_SIZE,
+		if(!m_pFrameBuffer){
+			m_pFrameBuffer = FramePool::getInstance()->acquire(m_iReceiveBufferSize);
+			if(!m_pFrameBuffer){
+				p_log("[Access::livemedia] Cannot continue playing, no memory for a buffer of %d bytes", (int)m_iReceiveBufferSize);
+				return False;
+			}
+		}
+		fSource->getNextFrame(m_pFrameBuffer->data(), m_pFrameBuffer->capacity(),
 				afterGettingFrame, this,
 				onSourceClosure, this);
 		return True;
@@ -456,68 +1204,275 @@ Boolean DummySink::continuePlaying()
 	}
 }
 
-/////////////////////////////////////////////
-// Custom BasicUsageEnvironment definition
-/////////////////////////////////////////////
+//////////////////////////////////
+// FrameProcessor definition
+//////////////////////////////////
 
-CustomBasicUsageEnvironment::CustomBasicUsageEnvironment(TaskScheduler& taskScheduler)
-	: BasicUsageEnvironment(taskScheduler)
-{
-	m_szCurMsg = NULL;
-}
+static const uint8_t g_startCode[4] = { 0, 0, 0, 1 };
 
-BasicUsageEnvironment* CustomBasicUsageEnvironment::createNew(TaskScheduler& taskScheduler)
+FrameProcessor* FrameProcessor::createNew(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId,
+		SubsessionMetrics* pSubsessionMetrics)
 {
-	return new CustomBasicUsageEnvironment(taskScheduler);
+	FrameProcessor* pProcessor = new FrameProcessor(pLiveMediaStreamContext, mediaSubSession, iSubsessionId, pSubsessionMetrics);
+	if(!pProcessor->m_pNalParser && !pProcessor->m_pTrack){
+		pProcessor->unref();
+		return NULL;
+	}
+	return pProcessor;
 }
 
-void CustomBasicUsageEnvironment::printOutput()
+FrameProcessor::FrameProcessor(LiveMediaStreamContext* pLiveMediaStreamContext, MediaSubsession& mediaSubSession, int iSubsessionId,
+		SubsessionMetrics* pSubsessionMetrics)
 {
-	if(m_szCurMsg){
-		size_t iLen = strlen(m_szCurMsg);
-		if(m_szCurMsg[iLen-1] == '\n')
-		{
-			char delim[] = "\n";
-			char *szLine = strtok(m_szCurMsg, delim);
-
-			while(szLine != NULL)
-			{
-				iLen = strlen(szLine);
-				if(szLine[iLen-1] == '\r'){
-					p_log("[LibLiveMedia] %.*s", iLen-1, szLine);
-				}else{
-					p_log("[LibLiveMedia] %.*s", iLen, szLine);
-				}
-				szLine = strtok(NULL, delim);
-			}
-
-			free(m_szCurMsg);
-			m_szCurMsg = NULL;
+	m_iRefCount = 1;
+	m_iStreamId = pLiveMediaStreamContext->m_iStreamId;
+	m_iAttempt = pLiveMediaStreamContext->m_iAttempt;
+	snprintf(m_szName, sizeof(m_szName), "%s/%s", mediaSubSession.mediumName(), mediaSubSession.codecName());
+	m_pSubsessionMetrics = pSubsessionMetrics;
+
+	// With the consumer threads, the frames are recorded by them
+	LiveMediaModuleContext* pModule = pLiveMediaStreamContext->m_pLiveMediaModuleContext;
+	RecordingWriter* pRecordingWriter = (pModule->m_pFrameConsumerPool ? pModule->m_pConsumerRecordingWriter : pModule->m_pRecordingWriter);
+
+	// The recording and the GOP cache need the key frames
+	m_pNalParser = NULL;
+	m_pGopCacheEntry = NULL;
+	NalCodec codec;
+	bool bGopCache = GopCache::getInstance()->isEnabled();
+	if((pModule->m_bParseNalUnits || pRecordingWriter || bGopCache) && NalParser::getCodec(mediaSubSession.codecName(), &codec)){
+		m_pNalParser = new NalParser(codec);
+		if(bGopCache){
+			m_pGopCacheEntry = GopCache::getInstance()->createEntry(m_iStreamId, iSubsessionId);
 		}
 	}
-}
 
-void CustomBasicUsageEnvironment::appendLog(const char *szNewLog)
-{
-	if(m_szCurMsg){
-		char* szTmp;
-		szTmp = p_strconcat(m_szCurMsg, szNewLog, NULL);
-		free(m_szCurMsg);
-		m_szCurMsg = szTmp;
+	m_pTrack = NULL;
+	m_bParameterSetsInBand = false;
+	if(!pRecordingWriter){
+		return;
+	}
+
+	if(strcmp(mediaSubSession.codecName(), "H264") == 0){
+		addParameterSets(mediaSubSession.fmtp_spropparametersets());
+	}else if(strcmp(mediaSubSession.codecName(), "H265") == 0){
+		addParameterSets(mediaSubSession.fmtp_spropvps());
+		addParameterSets(mediaSubSession.fmtp_spropsps());
+		addParameterSets(mediaSubSession.fmtp_sproppps());
+	}
+
+	// <path>/stream<id>/<subsession>-<medium>-<codec>-<start time>.<codec>
+	char szDirectory[1024];
+	snprintf(szDirectory, sizeof(szDirectory), "%s/stream%d", pModule->m_szRecordPath, m_iStreamId);
+	char szName[128];
+	snprintf(szName, sizeof(szName), "%d-%s-%s", iSubsessionId, mediaSubSession.mediumName(), mediaSubSession.codecName());
+	char szExtension[32];
+	snprintf(szExtension, sizeof(szExtension), "%s", mediaSubSession.codecName());
+	for(char* c = szExtension; *c; c++){
+		*c = tolower(*c);
+	}
+
+	if(!recording_make_directories(szDirectory)){
+		p_log("[Access::livemedia] Cannot create the recording directory %s: %s", szDirectory, strerror(errno));
 	}else{
-		m_szCurMsg = strdup(szNewLog);
+		m_pTrack = new RecordingTrack(pRecordingWriter, szDirectory, szName, szExtension, pModule->m_iRecordSegmentDuration);
 	}
 }
 
-UsageEnvironment& CustomBasicUsageEnvironment::operator<<(char const* str)
+FrameProcessor::~FrameProcessor()
 {
-	//BasicUsageEnvironment::operator <<(str);
-	if (str == NULL){
-		appendLog("(NULL)");
-	}else{
-		appendLog(str);
+	if(m_pTrack){
+		delete m_pTrack;
+		m_pTrack = NULL;
+	}
+	if(m_pGopCacheEntry){
+		GopCache::getInstance()->releaseEntry(m_pGopCacheEntry);
+		m_pGopCacheEntry = NULL;
+	}
+	if(m_pNalParser){
+		delete m_pNalParser;
+		m_pNalParser = NULL;
+	}
+}
+
+void FrameProcessor::ref()
+{
+	m_iRefCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameProcessor::unref()
+{
+	// The last user may be the sink in the event loop or a consumer thread
+	if(m_iRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1){
+		delete this;
+	}
+}
+
+void FrameProcessor::frameConsumer(void* /*clientData*/, const FrameDescriptor& frame)
+{
+	FrameProcessor* pProcessor = (FrameProcessor*)frame.pClientData;
+	if(pProcessor){
+		p_log_set_context(pProcessor->m_iStreamId, pProcessor->m_iAttempt);
+		pProcessor->processFrame(frame.pBuffer, frame.presentationTime, frame.bTruncated);
+		pProcessor->unref();
+	}
+}
+
+void FrameProcessor::processFrame(FrameBuffer* pBuffer, const struct timeval& presentationTime, bool bTruncated)
+{
+	unsigned frameSize = (unsigned)pBuffer->size();
+
+	// A truncated frame is not indexed nor cached, its last NAL unit is incomplete
+	const NalFrameInfo* pNalInfo = NULL;
+	if(m_pNalParser && frameSize > 0 && !bTruncated){
+		parseNalUnits(pBuffer, presentationTime);
+		pNalInfo = &m_nalInfo;
+	}
+	if(m_pTrack){
+		recordFrame(pBuffer->data(), frameSize, presentationTime, pNalInfo, bTruncated);
+	}
+	if(m_pGopCacheEntry && pNalInfo){
+		// Keeps its own reference of the buffer
+		m_pGopCacheEntry->addFrame(pBuffer, presentationTime, *pNalInfo);
+	}else if(m_pGopCacheEntry && bTruncated){
+		m_pGopCacheEntry->dropFrame();
+	}
+}
+
+void FrameProcessor::parseNalUnits(FrameBuffer* pBuffer, const struct timeval& presentationTime)
+{
+	int64_t iPresentationTimeUs = (int64_t)presentationTime.tv_sec*1000000 + presentationTime.tv_usec;
+	m_pNalParser->parseFrame(pBuffer->data(), pBuffer->size(), iPresentationTimeUs, m_nalInfo);
+
+	if(m_nalInfo.iFlags & NAL_FRAME_KEY_FRAME){
+		m_pSubsessionMetrics->iKeyFrames.fetch_add(1, std::memory_order_relaxed);
+	}
+	if(m_nalInfo.iFlags & NAL_FRAME_GOP_CHANGED){
+		p_log("[Access::livemedia] %s GOP of %d pictures at %.2f fps", m_szName, m_pNalParser->getGopLength(), m_pNalParser->getFps());
+		m_pSubsessionMetrics->iGopLength.store(m_pNalParser->getGopLength(), std::memory_order_relaxed);
+	}
+	if(m_nalInfo.iFlags & NAL_FRAME_SIZE_CHANGED){
+		p_log("[Access::livemedia] %s resolution %dx%d", m_szName, m_pNalParser->getWidth(), m_pNalParser->getHeight());
+		m_pSubsessionMetrics->iWidth.store(m_pNalParser->getWidth(), std::memory_order_relaxed);
+		m_pSubsessionMetrics->iHeight.store(m_pNalParser->getHeight(), std::memory_order_relaxed);
+	}
+	if(m_nalInfo.iFlags & NAL_FRAME_KEY_FRAME){
+		// Updated at each GOP, the small variations are not logged
+		m_pSubsessionMetrics->iPictureRateMilli.store((int64_t)(m_pNalParser->getFps() * 1000), std::memory_order_relaxed);
+	}
+}
+
+void FrameProcessor::addParameterSets(const char* szSProp)
+{
+	if(!szSProp || !*szSProp){
+		return;
+	}
+	unsigned iRecordCount = 0;
+	SPropRecord* pRecords = parseSPropParameterSets(szSProp, iRecordCount);
+	for(unsigned i=0; i<iRecordCount; i++){
+		m_parameterSets.insert(m_parameterSets.end(), g_startCode, g_startCode + sizeof(g_startCode));
+		m_parameterSets.insert(m_parameterSets.end(), pRecords[i].sPropBytes, pRecords[i].sPropBytes + pRecords[i].sPropLength);
+	}
+	delete[] pRecords;
+}
+
+void FrameProcessor::recordFrame(const uint8_t* pData, unsigned frameSize, const struct timeval& presentationTime, const NalFrameInfo* pNalInfo, bool bTruncated)
+{
+	if(frameSize == 0){
+		return;
+	}
+	int64_t iPresentationTimeUs = (int64_t)presentationTime.tv_sec*1000000 + presentationTime.tv_usec;
+
+	if(bTruncated){
+		// Kept for the decoder to conceal, but a segment never starts on it
+		bool bAnnexB = (frameSize >= 3 && pData[0] == 0 && pData[1] == 0 && (pData[2] == 1 || (frameSize >= 4 && pData[2] == 0 && pData[3] == 1)));
+		bool bPrefix = (m_pNalParser && !bAnnexB);
+		m_pTrack->addFrame(bPrefix ? g_startCode : NULL, bPrefix ? sizeof(g_startCode) : 0, pData, frameSize, iPresentationTimeUs, false);
+		m_bParameterSetsInBand = false;
+		return;
+	}
+
+	if(!pNalInfo){
+		// Each frame can be decoded alone, as far as the recording is concerned
+		m_pTrack->addFrame(NULL, 0, pData, frameSize, iPresentationTimeUs, true);
+		return;
+	}
+
+	// The frames in Annex B format already have their start codes
+	bool bAnnexB = (pNalInfo->iFlags & NAL_FRAME_ANNEX_B);
+	const uint8_t* pPrefix = (bAnnexB ? NULL : g_startCode);
+	size_t iPrefixSize = (bAnnexB ? 0 : sizeof(g_startCode));
+	bool bSlice = (pNalInfo->iFlags & NAL_FRAME_SLICE);
+	bool bParameterSets = (pNalInfo->iFlags & NAL_FRAME_PARAMETER_SETS);
+	bool bKeyFrame = (pNalInfo->iFlags & NAL_FRAME_KEY_FRAME);
+
+	if(!bSlice && bParameterSets){
+		// The first parameter set of a group starts the key frame
+		m_pTrack->addFrame(pPrefix, iPrefixSize, pData, frameSize, iPresentationTimeUs, !m_bParameterSetsInBand);
+		m_bParameterSetsInBand = true;
+	}else if(!bSlice){
+		// SEI, AUD: attached to the next picture
+		m_pTrack->addFrame(pPrefix, iPrefixSize, pData, frameSize, iPresentationTimeUs, false);
+	}else if(bKeyFrame && !bParameterSets && !m_bParameterSetsInBand && !m_parameterSets.empty()){
+		// The server only sends them in the SDP
+		m_parameterSets.insert(m_parameterSets.end(), pPrefix, pPrefix + iPrefixSize);
+		m_pTrack->addFrame(m_parameterSets.data(), m_parameterSets.size(), pData, frameSize, iPresentationTimeUs, true);
+		m_parameterSets.resize(m_parameterSets.size() - iPrefixSize);
+	}else{
+		m_pTrack->addFrame(pPrefix, iPrefixSize, pData, frameSize, iPresentationTimeUs, bKeyFrame && !m_bParameterSetsInBand);
+		m_bParameterSetsInBand = false;
+	}
+}
+
+/////////////////////////////////////////////
+// Custom BasicUsageEnvironment definition
+/////////////////////////////////////////////
+
+CustomBasicUsageEnvironment::CustomBasicUsageEnvironment(TaskScheduler& taskScheduler)
+	: BasicUsageEnvironment(taskScheduler)
+{
+	m_iLineLength = 0;
+}
+
+BasicUsageEnvironment* CustomBasicUsageEnvironment::createNew(TaskScheduler& taskScheduler)
+{
+	return new CustomBasicUsageEnvironment(taskScheduler);
+}
+
+void CustomBasicUsageEnvironment::printOutput()
+{
+	size_t iLen = m_iLineLength;
+	if(iLen > 0 && m_szLine[iLen-1] == '\r'){
+		iLen--;
+	}
+	p_log("[LibLiveMedia] %.*s", (int)iLen, m_szLine);
+	m_iLineLength = 0;
+}
+
+void CustomBasicUsageEnvironment::appendLog(const char *szNewLog)
+{
+	// Lines are built in place, each complete one being logged
+	for(const char* szCurrent = szNewLog; *szCurrent; szCurrent++){
+		if(*szCurrent == '\n'){
+			if(m_iLineLength > 0){
+				printOutput();
+			}
+		}else{
+			if(m_iLineLength == sizeof(m_szLine)){
+				printOutput();
+			}
+			m_szLine[m_iLineLength++] = *szCurrent;
+		}
+	}
+}
+
+UsageEnvironment& CustomBasicUsageEnvironment::operator<<(char const* str)
+{
+	//BasicUsageEnvironment::operator <<(str);
+	if (str == NULL){
+		appendLog("(NULL)");
+	}else{
+		appendLog(str);
 	}
-	printOutput();
 	return *this;
 }
 
@@ -526,7 +1481,6 @@ UsageEnvironment& CustomBasicUsageEnvironment::operator<<(int i)
 	char buf[20];
 	sprintf(buf, "%d", i);
 	appendLog(buf);
-	printOutput();
 	return *this;
 }
 
@@ -535,7 +1489,6 @@ UsageEnvironment& CustomBasicUsageEnvironment::operator<<(unsigned u)
 	char buf[20];
 	sprintf(buf, "%u", u);
 	appendLog(buf);
-	printOutput();
 	return *this;
 }
 
@@ -543,7 +1496,6 @@ UsageEnvironment& CustomBasicUsageEnvironment::operator<<(double d) {
 	char buf[50];
 	sprintf(buf, "%f", d);
 	appendLog(buf);
-	printOutput();
 	return *this;
 }
 
@@ -552,103 +1504,202 @@ UsageEnvironment& CustomBasicUsageEnvironment::operator<<(void* p)
 	char buf[20];
 	sprintf(buf, "%p", p);
 	appendLog(buf);
-	printOutput();
 	return *this;
 }
 
+/////////////////////////////////////////////
+// Custom BasicTaskScheduler definition
+/////////////////////////////////////////////
+
+CustomBasicTaskScheduler::CustomBasicTaskScheduler()
+	: BasicTaskScheduler(10000)
+{
+
+}
+
+BasicTaskScheduler* CustomBasicTaskScheduler::createNew()
+{
+	return new CustomBasicTaskScheduler();
+}
+
+void CustomBasicTaskScheduler::SingleStep(unsigned maxDelayTime)
+{
+	LoopClock::beginIteration();
+	BasicTaskScheduler::SingleStep(maxDelayTime);
+	LoopClock::endIteration();
+}
+
 ////////////////////////////
 // Private context instance
 ////////////////////////////
 
+const char* streamStateName(LiveMediaStreamState state)
+{
+	switch(state){
+	case STREAM_STATE_IDLE: return "idle";
+	case STREAM_STATE_OPTIONS: return "options";
+	case STREAM_STATE_DESCRIBE: return "describe";
+	case STREAM_STATE_SETUP: return "setup";
+	case STREAM_STATE_PLAY: return "play";
+	case STREAM_STATE_PLAYING: return "playing";
+	case STREAM_STATE_TEARDOWN: return "teardown";
+	case STREAM_STATE_WAIT_RETRY: return "wait-retry";
+	case STREAM_STATE_WAIT_ADMISSION: return "wait-admission";
+	case STREAM_STATE_CLOSED: return "closed";
+	}
+	return "unknown";
+}
 
-LiveMediaModuleContext::LiveMediaModuleContext(int iVerbosityLevel)
+LiveMediaStreamContext::LiveMediaStreamContext(LiveMediaModuleContext* pLiveMediaModuleContext, int iStreamId, const char* szMRL, const char* szUser, const char* szPass)
 {
-	m_iVerbosityLevel = iVerbosityLevel;
-	m_scheduler = BasicTaskScheduler::createNew();
+	m_pLiveMediaModuleContext = pLiveMediaModuleContext;
+	m_env = pLiveMediaModuleContext->m_env;
 
-	if(m_iVerbosityLevel > 0) {
-		m_env = CustomBasicUsageEnvironment::createNew(*m_scheduler);
-		m_bVerbose = true;
-	}else{
-		m_env = BasicUsageEnvironment::createNew(*m_scheduler);
-		m_bVerbose = false;
-	}
-	m_eventLoopWatchVariable = 0;
-	m_bTransportUDP = true;
+	m_iStreamId = iStreamId;
+	m_iAttempt = 0;
+	m_szMRL = (szMRL ? strdup(szMRL) : NULL);
+	m_szUser = (szUser ? strdup(szUser) : NULL);
+	m_szPass = (szPass ? strdup(szPass) : NULL);
+
+	m_state = STREAM_STATE_IDLE;
+
+	m_pAuth = NULL;
 	m_pRtspClient = NULL;
 	m_pMediaSession = NULL;
+	m_pInterleavedDemux = NULL;
 	m_pMediaSubsessionIterator = NULL;
 	m_pMediaSubsession = NULL;
-	m_streamInitializedTask = NULL;
-	m_streamTimerTask = NULL;
-	m_streamCheckAliveTask = NULL;
+	TimerWheel::initTimer(&m_streamInitializedTimer, CustomRTSPClient::streamCheckStreamInitializedHandler, this);
+	TimerWheel::initTimer(&m_streamTimer, CustomRTSPClient::streamTimerHandler, this);
+	TimerWheel::initTimer(&m_streamCheckAliveTimer, CustomRTSPClient::streamCheckAliveHandler, this);
+	TimerWheel::initTimer(&m_streamKeepaliveTimer, CustomRTSPClient::streamKeepaliveHandler, this);
+	m_streamCloseTask = NULL;
+	m_streamRestartTask = NULL;
 	m_duration = 0;
+	m_iRetryDelayUs = 0;
+	m_iRandomSeed = (unsigned int)(time(NULL) ^ getpid() ^ (iStreamId * 2654435761u));
+	m_iPlayingStartUs = 0;
+	AdmissionController::getInstance()->initTicket(&m_admissionTicket, (szMRL ? szMRL : ""));
+	m_iDownSinceUs = 0;
 	m_bError = false;
-	timerclear(&m_tvLastPacket);
-	m_bWithPingOptions = true;
+	m_iLastPacketUs = 0;
 
 	m_bStreamInitialized = false;
+
+	m_bFastStart = false;
+	m_bFastStartFailed = false;
+	m_bRestartAtOnce = false;
+	m_bSdpFromCache = false;
+	m_keepaliveMethod = KEEPALIVE_METHOD_UNKNOWN;
+	m_iKeepaliveIntervalUs = 0;
+
+	m_pMetrics = MetricsRegistry::getInstance()->createStream(iStreamId, szMRL);
+	m_iStateChangeUs = 0;
+	m_iHandshakeStartUs = 0;
+	m_bFirstFrameReceived = false;
+	m_pFrameRing = NULL;
+	if(pLiveMediaModuleContext->m_pFrameConsumerPool){
+		m_pFrameRing = pLiveMediaModuleContext->m_pFrameConsumerPool->createRing(iStreamId);
+	}
+	m_iSubsessionCount = 0;
+	m_iVideoBufferSize = 0;
+	m_iLastSampleBytes = 0;
+	m_iLastSampleFrames = 0;
+	m_iLastSampleUs = 0;
+	m_iByteRate = 0;
+	m_iFrameRate = 0;
 }
 
-LiveMediaModuleContext::~LiveMediaModuleContext()
+LiveMediaStreamContext::~LiveMediaStreamContext()
 {
-	cleanSesssion();
-	if(m_env) {
-		m_env->reclaim();
-		m_env = NULL;
+	stop();
+	if(m_szMRL){
+		free(m_szMRL);
+		m_szMRL = NULL;
 	}
-	if(m_scheduler){
-		delete m_scheduler;
-		m_scheduler = NULL;
+	if(m_szUser){
+		free(m_szUser);
+		m_szUser = NULL;
+	}
+	if(m_szPass){
+		free(m_szPass);
+		m_szPass = NULL;
 	}
 }
 
-void LiveMediaModuleContext::reset()
+void LiveMediaStreamContext::reset()
 {
 	p_log("[Access::livemedia] Reseting");
-	m_eventLoopWatchVariable = 0;
 	m_bError = false;
 	m_duration = 0;
-	timerclear(&m_tvLastPacket);
+	m_iLastPacketUs = 0;
 	p_log("[Access::livemedia] Reseting done");
 }
 
-void LiveMediaModuleContext::setWithPingOptions(bool bEnable)
+void LiveMediaStreamContext::setState(LiveMediaStreamState state)
 {
-	m_bWithPingOptions = bEnable;
+	if(m_pLiveMediaModuleContext->m_bVerbose){
+		p_log("[Access::livemedia] Stream state %s -> %s", streamStateName(m_state), streamStateName(state));
+	}
+
+	// Time spent in the handshake phase being left
+	int64_t iNowUs = LoopClock::nowUs();
+	int64_t iDurationUs = iNowUs - m_iStateChangeUs;
+	switch(m_state){
+	case STREAM_STATE_OPTIONS: m_pMetrics->setPhaseDuration(METRICS_PHASE_OPTIONS, iDurationUs); break;
+	case STREAM_STATE_DESCRIBE: m_pMetrics->setPhaseDuration(METRICS_PHASE_DESCRIBE, iDurationUs); break;
+	case STREAM_STATE_SETUP: m_pMetrics->setPhaseDuration(METRICS_PHASE_SETUP, iDurationUs); break;
+	case STREAM_STATE_PLAY: m_pMetrics->setPhaseDuration(METRICS_PHASE_PLAY, iDurationUs); break;
+	default: break;
+	}
+	if((state == STREAM_STATE_OPTIONS || state == STREAM_STATE_DESCRIBE || state == STREAM_STATE_SETUP) && m_iHandshakeStartUs == 0){
+		// The first request of the attempt, OPTIONS is skipped by the fast start and DESCRIBE by the SDP cache
+		m_iHandshakeStartUs = iNowUs;
+	}else if(state == STREAM_STATE_PLAYING && m_iHandshakeStartUs != 0){
+		m_pMetrics->setPhaseDuration(METRICS_PHASE_HANDSHAKE, iNowUs - m_iHandshakeStartUs);
+	}
+	if(state == STREAM_STATE_PLAYING){
+		m_iPlayingStartUs = iNowUs;
+		m_iDownSinceUs = 0;
+		// The handshake is over, give its slot to the next stream
+		AdmissionController::getInstance()->release(&m_admissionTicket);
+	}else if(m_state == STREAM_STATE_PLAYING){
+		m_iDownSinceUs = iNowUs;
+	}
+	m_iStateChangeUs = iNowUs;
+
+	m_state = state;
+	m_pMetrics->setState(streamStateName(state));
 }
 
-void LiveMediaModuleContext::cleanSesssion()
+void LiveMediaStreamContext::cleanSesssion()
 {
 	if(m_pMediaSubsessionIterator){
 		delete m_pMediaSubsessionIterator;
 		m_pMediaSubsessionIterator = NULL;
 	}
+	if(m_pInterleavedDemux){
+		delete m_pInterleavedDemux;
+		m_pInterleavedDemux = NULL;
+	}
 	if(m_pMediaSession){
 		Medium::close(m_pMediaSession);
 		m_pMediaSession = NULL;
 	}
+	m_pMediaSubsession = NULL;
+	m_listPendingSetups.clear();
 
-	if(m_streamTimerTask) {
-		m_env->taskScheduler().unscheduleDelayedTask(m_streamTimerTask);
-		m_streamTimerTask = NULL;
-	}
-
-	if(m_streamCheckAliveTask) {
-		m_env->taskScheduler().unscheduleDelayedTask(m_streamCheckAliveTask);
-		m_streamCheckAliveTask = NULL;
-	}
-
-	if(m_streamInitializedTask) {
-		m_env->taskScheduler().unscheduleDelayedTask(m_streamInitializedTask);
-		m_streamInitializedTask = NULL;
-	}
+	TimerWheel* pTimerWheel = m_pLiveMediaModuleContext->m_pTimerWheel;
+	pTimerWheel->cancel(&m_streamTimer);
+	pTimerWheel->cancel(&m_streamCheckAliveTimer);
+	pTimerWheel->cancel(&m_streamKeepaliveTimer);
+	pTimerWheel->cancel(&m_streamInitializedTimer);
 
 	m_duration = 0;
-	timerclear(&m_tvLastPacket);
+	m_iLastPacketUs = 0;
 }
 
-void LiveMediaModuleContext::continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
+void LiveMediaStreamContext::continueAfterOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
 	do {
 		if (resultCode != 0) {
@@ -659,8 +1710,11 @@ void LiveMediaModuleContext::continueAfterOPTIONS(RTSPClient* rtspClient, int re
 		}
 
 		p_log("[Access::livemedia] Got a OPTIONS description: %s", resultString);
+		// The methods of the Public header
+		m_keepaliveMethod = (resultString && strstr(resultString, "GET_PARAMETER") ? KEEPALIVE_METHOD_GET_PARAMETER : KEEPALIVE_METHOD_OPTIONS);
 		delete[] resultString;
-		
+
+		setState(STREAM_STATE_DESCRIBE);
 		m_pRtspClient->sendDescribeCommand(CustomRTSPClient::continueAfterDESCRIBE);
 
 		return;
@@ -669,7 +1723,7 @@ void LiveMediaModuleContext::continueAfterOPTIONS(RTSPClient* rtspClient, int re
 	shutdownStream(rtspClient);
 }
 
-void LiveMediaModuleContext::handlePingWithOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
+void LiveMediaStreamContext::handlePingWithOPTIONS(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
 	do {
 		if (resultCode != 0) {
@@ -688,98 +1742,174 @@ void LiveMediaModuleContext::handlePingWithOPTIONS(RTSPClient* rtspClient, int r
 	//shutdownStream(rtspClient);
 }
 
-void LiveMediaModuleContext::continueAfterDESCRIBE(RTSPClient* rtspClient, int resultCode, char* resultString)
+void LiveMediaStreamContext::handlePingWithGET_PARAMETER(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+	if(resultCode == 454){
+		// Session Not Found, the server has lost it and it cannot be kept alive anymore
+		p_log("[Access::livemedia] Session lost by the server (%s), reconnecting", resultString);
+		delete[] resultString;
+		m_bRestartAtOnce = true;
+		shutdownStream(rtspClient);
+		return;
+	}
+	if((resultCode == 405 || resultCode == 501) && m_keepaliveMethod != KEEPALIVE_METHOD_OPTIONS){
+		// Method Not Allowed or Not Implemented, the session is kept alive by OPTIONS from now.
+		// Any other error (401, 5xx, ...) is not a matter of method.
+		p_log("[Access::livemedia] GET_PARAMETER not supported (%s), keepalive with OPTIONS", resultString);
+		m_keepaliveMethod = KEEPALIVE_METHOD_OPTIONS;
+		delete[] resultString;
+		m_pRtspClient->sendOptionsCommand(CustomRTSPClient::handlePingWithOPTIONS);
+		return;
+	}
+	if(resultCode != 0){
+		p_log("[Access::livemedia] Failed to get a GET_PARAMETER response: %s", resultString);
+	}else{
+		m_keepaliveMethod = KEEPALIVE_METHOD_GET_PARAMETER;
+	}
+	delete[] resultString;
+}
+
+void LiveMediaStreamContext::continueAfterDESCRIBE(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
 	do {
 		if (resultCode != 0) {
 			m_bError = true;
 			p_log("[Access::livemedia] Failed to get a SDP description: %s", resultString);
 			delete[] resultString;
+			if(m_bFastStart && resultCode > 0){
+				// Some servers want an OPTIONS first
+				fallBackToSerialHandshake(rtspClient);
+				return;
+			}
 			break;
 		}
 
 		char* const szSdpDescription = resultString;
-		if(m_bVerbose){
+		if(m_pLiveMediaModuleContext->m_bVerbose){
 			p_log("[Access::livemedia] Got a SDP description : %s", szSdpDescription);
 		}else{
 			p_log("[Access::livemedia] Got a SDP description");
 		}
 		// Create a media session object from this SDP description:
-		m_pMediaSession = MediaSession::createNew(*m_env, szSdpDescription);
+		bool bCreated = createMediaSession(szSdpDescription);
+		if(bCreated && SdpCache::getInstance()->isOpen()){
+			// The base URL may have been changed by the Content-Base of the response
+			SdpCache::getInstance()->store(m_szMRL, rtspClient->url(), szSdpDescription);
+		}
 		delete[] szSdpDescription; // because we don't need it anymore
-		if (m_pMediaSession == NULL) {
+		if(!bCreated){
 			m_bError = true;
-			p_log("[Access::livemedia] Failed to create a MediaSession object from the SDP description: %s", m_env->getResultMsg());
 			break;
-		} else if (!m_pMediaSession->hasSubsessions()) {
-			m_bError = true;
-			p_log("[Access::livemedia] This session has no media subsessions");
-			break;
-		}
-		p_log("[Access::livemedia] Session name: %s", m_pMediaSession->sessionName());
-
-		// Display transport mode used
-		if(m_bTransportUDP){
-			p_log("[Access::livemedia] Using transport UDP");
-		}else{
-			p_log("[Access::livemedia] Using transport TCP");
 		}
 
-		// Then, create and set up our data source objects for the session. We do this by iterating over the session's 'subsessions',
-		// calling "MediaSubsession::initiate()", and then sending a RTSP "SETUP" command, on each one.
-		// (Each 'subsession' will have its own data source.)
-		m_pMediaSubsessionIterator = new MediaSubsessionIterator(*m_pMediaSession);
-		setupNextSubsession(rtspClient);
+		setupSubsessions(rtspClient);
 		return;
 	} while (0);
 	// An unrecoverable error occurred with this stream.
 	shutdownStream(rtspClient);
 }
 
-void LiveMediaModuleContext::setupNextSubsession(RTSPClient* rtspClient)
+bool LiveMediaStreamContext::createMediaSession(const char* szSdpDescription)
 {
-	m_pMediaSubsession = m_pMediaSubsessionIterator->next();
-	if (m_pMediaSubsession != NULL) {
-		p_log("[Access::livemedia] Initiate %s/%s subsession", m_pMediaSubsession->mediumName(), m_pMediaSubsession->codecName());
-		if (!m_pMediaSubsession->initiate()) {
-			p_log("[Access::livemedia] Failed to initiate the %s/%s subsession: %s",
-					m_pMediaSubsession->mediumName(), m_pMediaSubsession->codecName(), m_env->getResultMsg());
-			setupNextSubsession(rtspClient); // give up on this subsession; go to the next one
-		} else {
-			if (true /*m_pMediaSubsession->rtcpIsMuxed()*/) {
-				p_log("[Access::livemedia] Initiated the %s/%s subsession (client port %d)",
-						m_pMediaSubsession->mediumName(), m_pMediaSubsession->codecName(), m_pMediaSubsession->clientPortNum());
-			} else {
-				p_log("[Access::livemedia] Initiated the %s/%s subsession (client ports %d-%d)",
-						m_pMediaSubsession->mediumName(), m_pMediaSubsession->codecName(), m_pMediaSubsession->clientPortNum(), m_pMediaSubsession->clientPortNum()+1);
-			}
+	// Its groupsocks take the datagrams received by batches
+	m_pMediaSession = ReceiveMediaSession::createNew(*m_env, szSdpDescription, m_pLiveMediaModuleContext->m_pEpollScheduler);
+	if (m_pMediaSession == NULL) {
+		p_log("[Access::livemedia] Failed to create a MediaSession object from the SDP description: %s", m_env->getResultMsg());
+		return false;
+	} else if (!m_pMediaSession->hasSubsessions()) {
+		p_log("[Access::livemedia] This session has no media subsessions");
+		Medium::close(m_pMediaSession);
+		m_pMediaSession = NULL;
+		return false;
+	}
+	p_log("[Access::livemedia] Session name: %s", m_pMediaSession->sessionName());
+	if(m_pLiveMediaModuleContext->m_bStreamReceive){
+		m_pInterleavedDemux = new InterleavedDemux(m_pLiveMediaModuleContext->m_pEpollScheduler, m_pMediaSession, &m_pLiveMediaModuleContext->m_interleavedStats);
+	}
+	return true;
+}
 
-			size_t iReceiveBuffer = 0;
-			if(strcmp(m_pMediaSubsession->mediumName(), "video") == 0){
-				iReceiveBuffer = 2000000;  // For video we use 2MB socket buffer
-			}else if(strcmp(m_pMediaSubsession->mediumName(), "audio") == 0){
-				iReceiveBuffer = 100000; // For audio we use 100KB socket buffer 
-			}
+void LiveMediaStreamContext::setupSubsessions(RTSPClient* rtspClient)
+{
+	// Display transport mode used
+	if(m_pLiveMediaModuleContext->m_bTransportUDP){
+		p_log("[Access::livemedia] Using transport UDP");
+	}else{
+		p_log("[Access::livemedia] Using transport TCP");
+	}
 
-			if(m_pMediaSubsession->rtpSource() != NULL) {
-				// For some media we may need to adjust the socket buffer
-				int fd = m_pMediaSubsession->rtpSource()->RTPgs()->socketNum();
-				if(iReceiveBuffer > 0){
-					increaseReceiveBufferTo(*m_env, fd, iReceiveBuffer);
-				}
+	// Then, create and set up our data source objects for the session. We do this by iterating over the session's 'subsessions',
+	// calling "MediaSubsession::initiate()", and then sending a RTSP "SETUP" command, on each one.
+	// (Each 'subsession' will have its own data source.)
+	setState(STREAM_STATE_SETUP);
+	m_pMediaSubsessionIterator = new MediaSubsessionIterator(*m_pMediaSession);
+	setupNextSubsession(rtspClient);
+}
 
-				// Increase the RTP reorder timebuffer just a bit 
-				m_pMediaSubsession->rtpSource()->setPacketReorderingThresholdTime(200000);
-			}
+void LiveMediaStreamContext::revalidateSdp(RTSPClient* rtspClient)
+{
+	p_log("[Access::livemedia] Cached SDP description refused by the server, restarting with DESCRIBE");
+	SdpCache::getInstance()->invalidate(m_szMRL);
+	m_bRestartAtOnce = true;
+	shutdownStream(rtspClient);
+}
 
+void LiveMediaStreamContext::setupNextSubsession(RTSPClient* rtspClient)
+{
+	m_pMediaSubsession = m_pMediaSubsessionIterator->next();
+	if (m_pMediaSubsession != NULL) {
+		if (!initiateSubsession(m_pMediaSubsession)) {
+			setupNextSubsession(rtspClient); // give up on this subsession; go to the next one
+		} else {
 			// Continue setting up this subsession, by sending a RTSP "SETUP" command:
-			Boolean bStreamUsingTCP = (m_bTransportUDP ? False : True);
-			rtspClient->sendSetupCommand(*m_pMediaSubsession, CustomRTSPClient::continueAfterSETUP, False, bStreamUsingTCP);
+			sendSetup(rtspClient, m_pMediaSubsession);
 		}
 		return;
 	}
 
 	// We've finished setting up all of the subsessions. Now, send a RTSP "PLAY" command to start the streaming:
+	sendPlay(rtspClient);
+}
+
+bool LiveMediaStreamContext::initiateSubsession(MediaSubsession* pSubsession)
+{
+	p_log("[Access::livemedia] Initiate %s/%s subsession", pSubsession->mediumName(), pSubsession->codecName());
+	if (!pSubsession->initiate()) {
+		p_log("[Access::livemedia] Failed to initiate the %s/%s subsession: %s",
+				pSubsession->mediumName(), pSubsession->codecName(), m_env->getResultMsg());
+		return false;
+	}
+
+	if (true /*pSubsession->rtcpIsMuxed()*/) {
+		p_log("[Access::livemedia] Initiated the %s/%s subsession (client port %d)",
+				pSubsession->mediumName(), pSubsession->codecName(), pSubsession->clientPortNum());
+	} else {
+		p_log("[Access::livemedia] Initiated the %s/%s subsession (client ports %d-%d)",
+				pSubsession->mediumName(), pSubsession->codecName(), pSubsession->clientPortNum(), pSubsession->clientPortNum()+1);
+	}
+
+	// The socket buffer is sized by the sink, from the bitrate
+	if(pSubsession->rtpSource() != NULL) {
+		// Adjusted by the sink from the late packets
+		pSubsession->rtpSource()->setPacketReorderingThresholdTime(ReorderWindow::getInitialThreshold(m_pLiveMediaModuleContext->m_reorderMode));
+	}
+	return true;
+}
+
+void LiveMediaStreamContext::sendSetup(RTSPClient* rtspClient, MediaSubsession* pSubsession)
+{
+	Boolean bStreamUsingTCP = (m_pLiveMediaModuleContext->m_bTransportUDP ? False : True);
+	// Without DESCRIBE, the credentials are given with the first SETUP. Given again, they would reset the digest nonce.
+	Authenticator* pAuth = NULL;
+	if(m_bSdpFromCache && m_iSubsessionCount == 0 && m_listPendingSetups.empty()){
+		pAuth = m_pAuth;
+	}
+	rtspClient->sendSetupCommand(*pSubsession, CustomRTSPClient::continueAfterSETUP, False, bStreamUsingTCP, False, pAuth);
+}
+
+void LiveMediaStreamContext::sendPlay(RTSPClient* rtspClient)
+{
+	setState(STREAM_STATE_PLAY);
 #if LIVEMEDIA_LIBRARY_VERSION_INT >= 1385424000
 	if (m_pMediaSession->absStartTime() != NULL) {
 		// Special case: The stream is indexed by 'absolute' time, so send an appropriate "PLAY" command:
@@ -793,8 +1923,57 @@ void LiveMediaModuleContext::setupNextSubsession(RTSPClient* rtspClient)
 #endif
 }
 
-void LiveMediaModuleContext::continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString)
+void LiveMediaStreamContext::pipelineRemainingSetups(RTSPClient* rtspClient)
 {
+	// The session ID given by the first SETUP is sent with the next requests, so they no longer have to wait
+	int iPipelined = 0;
+	while ((m_pMediaSubsession = m_pMediaSubsessionIterator->next()) != NULL) {
+		if (initiateSubsession(m_pMediaSubsession)) {
+			m_listPendingSetups.push_back(m_pMediaSubsession);
+			sendSetup(rtspClient, m_pMediaSubsession);
+			iPipelined++;
+		}
+	}
+	p_log("[Access::livemedia] Fast start: %d SETUP pipelined with the PLAY", iPipelined);
+	sendPlay(rtspClient);
+}
+
+MediaSubsession* LiveMediaStreamContext::popPendingSetup(bool bSuccess)
+{
+	// The responses are usually in the order of the requests, but a successful SETUP is recognized
+	// with certainty by the session ID it gives to its subsession
+	size_t iIndex = 0;
+	for(size_t i=0; i<m_listPendingSetups.size(); i++){
+		if((m_listPendingSetups[i]->sessionId() != NULL) == bSuccess){
+			iIndex = i;
+			break;
+		}
+	}
+	MediaSubsession* pSubsession = m_listPendingSetups[iIndex];
+	m_listPendingSetups.erase(m_listPendingSetups.begin() + iIndex);
+	return pSubsession;
+}
+
+void LiveMediaStreamContext::fallBackToSerialHandshake(RTSPClient* rtspClient)
+{
+	p_log("[Access::livemedia] Fast start refused by the server, using the serial handshake from now on");
+	m_bFastStartFailed = true;
+	m_bRestartAtOnce = true;
+	shutdownStream(rtspClient);
+}
+
+void LiveMediaStreamContext::continueAfterSETUP(RTSPClient* rtspClient, int resultCode, char* resultString)
+{
+	if(m_state == STREAM_STATE_TEARDOWN){
+		// A pipelined request answered after a failure
+		delete[] resultString;
+		return;
+	}
+	if(!m_listPendingSetups.empty()){
+		m_pMediaSubsession = popPendingSetup(resultCode == 0);
+	}
+
+	bool bSuccess = false;
 	do {
 		if (resultCode != 0) {
 			m_bError = true;
@@ -814,7 +1993,7 @@ void LiveMediaModuleContext::continueAfterSETUP(RTSPClient* rtspClient, int resu
 		// Having successfully setup the subsession, create a data sink for it, and call "startPlaying()" on it.
 		// (This will prepare the data sink to receive data; the actual flow of data from the client won't start happening until later,
 		// after we've sent a RTSP "PLAY" command.)
-		m_pMediaSubsession->sink = DummySink::createNew(this);
+		m_pMediaSubsession->sink = DummySink::createNew(this, *m_pMediaSubsession, m_iSubsessionCount++);
 		// perhaps use your own custom "MediaSink" subclass instead
 		if (m_pMediaSubsession->sink == NULL) {
 			m_bError = true;
@@ -832,21 +2011,59 @@ void LiveMediaModuleContext::continueAfterSETUP(RTSPClient* rtspClient, int resu
 			m_pMediaSubsession->rtcpInstance()->setByeHandler(CustomRTSPClient::subsessionByeHandler, m_pMediaSubsession);
 		}
 
-		m_streamCheckAliveTask = m_env->taskScheduler().scheduleDelayedTask(TIMEOUT_CHECKALIVE, (TaskFunc*)CustomRTSPClient::streamCheckAliveHandler, rtspClient);
-
+		// One check alive task per stream, whatever the number of subsessions
+		if(!TimerWheel::isArmed(&m_streamCheckAliveTimer)) {
+			m_pLiveMediaModuleContext->m_pTimerWheel->arm(&m_streamCheckAliveTimer, TIMEOUT_CHECKALIVE);
+		}
+		bSuccess = true;
 	} while (0);
 	delete[] resultString;
+
+	if(m_bSdpFromCache && !bSuccess && resultCode > 0){
+		revalidateSdp(rtspClient);
+		return;
+	}
+	if(m_bFastStart){
+		if(!bSuccess && resultCode > 0){
+			fallBackToSerialHandshake(rtspClient);
+			return;
+		}
+		if(m_state != STREAM_STATE_SETUP){
+			return; // The PLAY is already sent
+		}
+		if(bSuccess && m_pMediaSubsession->sessionId() != NULL){
+			pipelineRemainingSetups(rtspClient);
+			return;
+		}
+		// Without a session ID, the next SETUP would open another session
+	}
 	// Set up the next subsession, if any:
 	setupNextSubsession(rtspClient);
 }
 
-void LiveMediaModuleContext::continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString)
+void LiveMediaStreamContext::continueAfterPLAY(RTSPClient* rtspClient, int resultCode, char* resultString)
 {
+	if(m_state == STREAM_STATE_TEARDOWN){
+		// A pipelined request answered after a failure
+		delete[] resultString;
+		return;
+	}
+
 	Boolean success = False;
 	do {
 		if (resultCode != 0) {
 			m_bError = true;
 			p_log("[Access::livemedia] Failed to start playing session: %s", resultString);
+			if(m_bSdpFromCache && resultCode > 0){
+				delete[] resultString;
+				revalidateSdp(rtspClient);
+				return;
+			}
+			if(m_bFastStart && resultCode > 0){
+				delete[] resultString;
+				fallBackToSerialHandshake(rtspClient);
+				return;
+			}
 			break;
 		}
 		// Set a timer to be handled at the end of the stream's expected duration (if the stream does not already signal its end
@@ -856,11 +2073,22 @@ void LiveMediaModuleContext::continueAfterPLAY(RTSPClient* rtspClient, int resul
 		if (m_duration > 0) {
 			unsigned const delaySlop = 2; // number of seconds extra to delay, after the stream's expected duration. (This is optional.)
 			m_duration += delaySlop;
-			unsigned uSecsToDelay = (unsigned)(m_duration*1000000);
-			m_streamTimerTask = m_env->taskScheduler().scheduleDelayedTask(uSecsToDelay, (TaskFunc*)CustomRTSPClient::streamTimerHandler, rtspClient);
+			int64_t uSecsToDelay = (int64_t)(m_duration*1000000);
+			m_pLiveMediaModuleContext->m_pTimerWheel->arm(&m_streamTimer, uSecsToDelay);
+		}
+
+		// From the response, live555 being between two frames of the connection
+		if(m_pInterleavedDemux && !m_pInterleavedDemux->start(rtspClient->socketNum())){
+			p_log("[Access::livemedia] Failed to demultiplex the interleaved packets, read by live555: %s", strerror(errno));
 		}
 
 		m_bStreamInitialized = true;
+		setState(STREAM_STATE_PLAYING);
+		scheduleKeepalive();
+		if(m_pLiveMediaModuleContext->m_bWithPingOptions && m_pLiveMediaModuleContext->m_bVerbose){
+			p_log("[Access::livemedia] Keepalive every %d s with %s (session timeout %u s)", (int)(m_iKeepaliveIntervalUs / 1000000),
+					(m_keepaliveMethod == KEEPALIVE_METHOD_OPTIONS ? "OPTIONS" : "GET_PARAMETER"), rtspClient->sessionTimeoutParameter());
+		}
 
 		if (m_duration > 0) {
 			p_log("[Access::livemedia] Started playing session (for up to %f seconds)", m_duration);
@@ -876,7 +2104,7 @@ void LiveMediaModuleContext::continueAfterPLAY(RTSPClient* rtspClient, int resul
 	}
 }
 
-void LiveMediaModuleContext::subsessionAfterPlaying(RTSPClient* rtspClient, MediaSubsession* subsession)
+void LiveMediaStreamContext::subsessionAfterPlaying(RTSPClient* rtspClient, MediaSubsession* subsession)
 {
 	// Begin by closing this subsession's stream:
 	Medium::close(subsession->sink);
@@ -891,7 +2119,7 @@ void LiveMediaModuleContext::subsessionAfterPlaying(RTSPClient* rtspClient, Medi
 	shutdownStream(rtspClient);
 }
 
-void LiveMediaModuleContext::subsessionByeHandler(RTSPClient* rtspClient, MediaSubsession* subsession)
+void LiveMediaStreamContext::subsessionByeHandler(RTSPClient* rtspClient, MediaSubsession* subsession)
 {
 	p_log("[Access::livemedia] Received RTCP \"BYE\" on %s/%s subsession",
 			subsession->mediumName(), subsession->codecName());
@@ -899,55 +2127,145 @@ void LiveMediaModuleContext::subsessionByeHandler(RTSPClient* rtspClient, MediaS
 	subsessionAfterPlaying(rtspClient, subsession);
 }
 
-void LiveMediaModuleContext::streamCheckStreamInitializedHandler(CustomRTSPClient* rtspClient)
+void LiveMediaStreamContext::streamCheckStreamInitializedHandler(CustomRTSPClient* rtspClient)
 {
 	if(!m_bStreamInitialized){
 		p_log("[Access::livemedia] Stream not initialized in %d ms", 30000);
-		m_streamInitializedTask = NULL;
 		// Shutdown the stream
 		shutdownStream(rtspClient);
 	}
 }
 
-void LiveMediaModuleContext::streamCheckAliveHandler(CustomRTSPClient* rtspClient)
+void LiveMediaStreamContext::streamCheckAliveHandler(CustomRTSPClient* rtspClient)
 {
-	timeval tvNow;
-	gettimeofday(&tvNow, NULL);
-
-	if(m_streamCheckAliveTask) {
-		m_env->taskScheduler().unscheduleDelayedTask(m_streamCheckAliveTask);
-		m_streamCheckAliveTask = NULL;
-	}
-
-	int64_t iDiffMs = p_timeval_diffms(tvNow, m_tvLastPacket);
+	int64_t iDiffMs = (LoopClock::nowUs() - m_iLastPacketUs) / 1000;
 	if(iDiffMs > 30000)
 	{
 		m_bError = true; // Timeout is an error
 		p_log("[Access::livemedia] No data received in the last %d ms", 30000);
-		m_streamCheckAliveTask = NULL;
 		// Shutdown the stream
 		shutdownStream(rtspClient);
 	}else{
-        // Some stream have a session timeout, so we need to send a command to tell we are alive
-		// Axis camera with firmware >= 5.60
-		if(m_bWithPingOptions){
-			m_pRtspClient->sendOptionsCommand(CustomRTSPClient::handlePingWithOPTIONS);
-		}
-
-		m_streamCheckAliveTask = m_env->taskScheduler().scheduleDelayedTask(TIMEOUT_CHECKALIVE, (TaskFunc*)CustomRTSPClient::streamCheckAliveHandler, rtspClient);
+		m_pLiveMediaModuleContext->m_pTimerWheel->arm(&m_streamCheckAliveTimer, TIMEOUT_CHECKALIVE);
 	}
 }
 
-void LiveMediaModuleContext::streamTimerHandler(CustomRTSPClient* rtspClient)
+void LiveMediaStreamContext::scheduleKeepalive()
 {
-	m_streamTimerTask = NULL;
-	// Shutdown the stream
-	shutdownStream(rtspClient);
-}
-
-void LiveMediaModuleContext::shutdownStream(RTSPClient* rtspClient)
+	// Some stream have a session timeout, so we need to send a command to tell we are alive
+	// Axis camera with firmware >= 5.60
+	if(!m_pLiveMediaModuleContext->m_bWithPingOptions){
+		return;
+	}
+
+	unsigned iTimeoutSec = m_pRtspClient->sessionTimeoutParameter();
+	if(iTimeoutSec == 0){
+		iTimeoutSec = KEEPALIVE_DEFAULT_SESSION_TIMEOUT;
+	}
+	m_iKeepaliveIntervalUs = std::max((int64_t)iTimeoutSec * 1000000 / 2, (int64_t)KEEPALIVE_MIN_INTERVAL);
+
+	// Each stream pings at its own phase of the interval, the golden ratio spreading
+	// the consecutive stream ids evenly whenever they were started
+	double dPhase = m_iStreamId * 0.6180339887;
+	dPhase -= (int64_t)dPhase;
+	int64_t iPhaseUs = (int64_t)(dPhase * m_iKeepaliveIntervalUs);
+	int64_t iDelayUs = m_iKeepaliveIntervalUs - ((LoopClock::nowUs() - iPhaseUs) % m_iKeepaliveIntervalUs + m_iKeepaliveIntervalUs) % m_iKeepaliveIntervalUs;
+	if(iDelayUs < m_iKeepaliveIntervalUs / 4){
+		// Too close to the PLAY, or to the previous ping
+		iDelayUs += m_iKeepaliveIntervalUs;
+	}
+	m_pLiveMediaModuleContext->m_pTimerWheel->arm(&m_streamKeepaliveTimer, iDelayUs);
+}
+
+bool LiveMediaStreamContext::isKeptAliveByRTCP(int64_t iWindowUs)
 {
+	// The server handling RTCP counts our receiver reports as activity (RFC 2326,
+	// section 12.37), it is trusted to if every subsession got a recent sender report
+	if(!m_pMediaSession){
+		return false;
+	}
+	int64_t iNowUs = LoopClock::wallClockUs();
+	bool bHasSubsession = false;
+	MediaSubsessionIterator iter(*m_pMediaSession);
+	MediaSubsession* pSubsession;
+	while((pSubsession = iter.next()) != NULL){
+		RTPSource* pRTPSource = pSubsession->rtpSource();
+		if(!pRTPSource || !pSubsession->sink){
+			continue;
+		}
+		if(!pSubsession->rtcpInstance()){
+			return false;
+		}
+		int64_t iLastSRUs = 0;
+		RTPReceptionStatsDB::Iterator statsIter(pRTPSource->receptionStatsDB());
+		RTPReceptionStats* pStats;
+		while((pStats = statsIter.next(True)) != NULL){
+			const timeval& tvSR = pStats->lastReceivedSR_time();
+			iLastSRUs = std::max(iLastSRUs, (int64_t)tvSR.tv_sec * 1000000 + tvSR.tv_usec);
+		}
+		if(iLastSRUs == 0 || iNowUs - iLastSRUs > iWindowUs){
+			return false;
+		}
+		bHasSubsession = true;
+	}
+	return bHasSubsession;
+}
+
+void LiveMediaStreamContext::sendKeepalive()
+{
+	if(m_keepaliveMethod == KEEPALIVE_METHOD_OPTIONS || !m_pMediaSession){
+		m_pRtspClient->sendOptionsCommand(CustomRTSPClient::handlePingWithOPTIONS);
+	}else{
+		// Empty, only to refresh the session
+		m_pRtspClient->sendGetParameterCommand(*m_pMediaSession, CustomRTSPClient::handlePingWithGET_PARAMETER, "");
+	}
+}
+
+void LiveMediaStreamContext::streamKeepaliveHandler(CustomRTSPClient* /*rtspClient*/)
+{
+	if(m_pLiveMediaModuleContext->m_bRTCPKeepalive && isKeptAliveByRTCP(m_iKeepaliveIntervalUs)){
+		m_pMetrics->m_iKeepalivesSkipped.fetch_add(1, std::memory_order_relaxed);
+	}else{
+		sendKeepalive();
+		m_pMetrics->m_iKeepalivesSent.fetch_add(1, std::memory_order_relaxed);
+	}
+	scheduleKeepalive();
+}
+
+void LiveMediaStreamContext::streamTimerHandler(CustomRTSPClient* rtspClient)
+{
+	// Shutdown the stream
+	shutdownStream(rtspClient);
+}
+
+void LiveMediaStreamContext::streamCloseHandler()
+{
+	m_streamCloseTask = NULL;
+	closeStream(m_pRtspClient);
+	if(m_bRestartAtOnce && m_pLiveMediaModuleContext->m_eventLoopWatchVariable == 0){
+		// Not a failure of the stream, so the retry delay is not applied
+		m_bRestartAtOnce = false;
+		scheduleRestart(0);
+		return;
+	}
+	m_pLiveMediaModuleContext->streamClosed(this);
+}
+
+void LiveMediaStreamContext::streamRestartHandler()
+{
+	m_streamRestartTask = NULL;
+	if(!start()){
+		m_pLiveMediaModuleContext->streamClosed(this);
+	}
+}
+
+void LiveMediaStreamContext::shutdownStream(RTSPClient* rtspClient)
+{
+	if(m_state == STREAM_STATE_TEARDOWN || m_state == STREAM_STATE_WAIT_RETRY || m_state == STREAM_STATE_CLOSED){
+		return; // Already being shutdown
+	}
 	p_log("[Access::livemedia] Stream shutdown");
+	setState(STREAM_STATE_TEARDOWN);
 	// First, check whether any subsessions have still to be closed:
 	if (m_pMediaSession != NULL) {
 		Boolean someSubsessionsWereActive = False;
@@ -963,88 +2281,1187 @@ void LiveMediaModuleContext::shutdownStream(RTSPClient* rtspClient)
 				someSubsessionsWereActive = True;
 			}
 		}
-		if (someSubsessionsWereActive) {
-			// Send a RTSP "TEARDOWN" command, to tell the server to shutdown the stream.
-			// Don't bother handling the response to the "TEARDOWN".
-			rtspClient->sendTeardownCommand(*m_pMediaSession, NULL);
+		if (someSubsessionsWereActive) {
+			// Send a RTSP "TEARDOWN" command, to tell the server to shutdown the stream.
+			// Don't bother handling the response to the "TEARDOWN".
+			rtspClient->sendTeardownCommand(*m_pMediaSession, NULL);
+		}
+	}
+	// The RTSP client may be the caller of this function, so it is closed from a new task.
+	// Only this stream is ended, the event loop keeps running for the others.
+	m_streamCloseTask = m_env->taskScheduler().scheduleDelayedTask(0, (TaskFunc*)CustomRTSPClient::streamCloseHandler, this);
+}
+
+void LiveMediaStreamContext::closeStream(RTSPClient* rtspClient)
+{
+	p_log("[Access::livemedia] Closing the stream.");
+	cleanSesssion();
+	if(rtspClient){
+		Medium::close(rtspClient);
+	}
+	uint64_t iTruncatedFrames = m_pMetrics->getTotalTruncatedFrames();
+	if(iTruncatedFrames > 0){
+		p_log("[Access::livemedia] %llu truncated frame(s) since the first attempt", (unsigned long long)iTruncatedFrames);
+	}
+	logHistograms();
+	AdmissionController::getInstance()->release(&m_admissionTicket);
+	m_pRtspClient = NULL;
+	if(m_pAuth){
+		delete m_pAuth;
+		m_pAuth = NULL;
+	}
+	setState(STREAM_STATE_CLOSED);
+	p_log("[Access::livemedia] Stream shutdown done");
+}
+
+void LiveMediaStreamContext::scheduleRestart(int64_t iDelayUs)
+{
+	if(iDelayUs > 0){
+		p_log("[Access::livemedia] Pause for %lld ms before next attempt", (long long)(iDelayUs / 1000));
+	}
+	setState(STREAM_STATE_WAIT_RETRY);
+	m_streamRestartTask = m_env->taskScheduler().scheduleDelayedTask(iDelayUs, (TaskFunc*)CustomRTSPClient::streamRestartHandler, this);
+}
+
+int64_t LiveMediaStreamContext::nextRetryDelay()
+{
+	int64_t iBaseUs = (int64_t)m_pLiveMediaModuleContext->m_iRetryDelay * 1000000;
+	int64_t iMaxUs = (int64_t)m_pLiveMediaModuleContext->m_iRetryMaxDelay * 1000000;
+	if(iMaxUs < iBaseUs){
+		iMaxUs = iBaseUs;
+	}
+
+	// A stream that played for a long time had a transient failure
+	bool bHealthy = false;
+	if(m_iPlayingStartUs != 0){
+		int64_t iPlayingUs = LoopClock::nowUs() - m_iPlayingStartUs;
+		bHealthy = (iPlayingUs >= RETRY_HEALTHY_TIME);
+		m_iPlayingStartUs = 0;
+	}
+
+	if(bHealthy){
+		m_iRetryDelayUs = (int64_t)(rand_r(&m_iRandomSeed) % RETRY_IMMEDIATE_JITTER);
+	}else{
+		// Decorrelated jitter: random between the base and three times the last delay, capped
+		int64_t iUpperUs = m_iRetryDelayUs * 3;
+		if(iUpperUs > iMaxUs){
+			iUpperUs = iMaxUs;
+		}
+		m_iRetryDelayUs = iBaseUs;
+		if(iUpperUs > iBaseUs){
+			uint64_t iRandom = ((uint64_t)rand_r(&m_iRandomSeed) << 31) ^ (uint64_t)rand_r(&m_iRandomSeed);
+			m_iRetryDelayUs += (int64_t)(iRandom % (uint64_t)(iUpperUs - iBaseUs + 1));
+		}
+	}
+	return m_iRetryDelayUs;
+}
+
+void LiveMediaStreamContext::sampleLoad(int64_t iNowUs)
+{
+	uint64_t iTotalBytes = m_pMetrics->getTotalBytes();
+	uint64_t iTotalFrames = m_pMetrics->getTotalFrames();
+
+	if(m_iLastSampleUs != 0){
+		int64_t iDiffMs = (iNowUs - m_iLastSampleUs) / 1000;
+		if(iDiffMs > 0){
+			uint64_t iByteRate = (iTotalBytes - m_iLastSampleBytes) * 1000 / iDiffMs;
+			uint64_t iFrameRate = (iTotalFrames - m_iLastSampleFrames) * 1000 / iDiffMs;
+			if(m_state == STREAM_STATE_PLAYING){
+				// Smooth the measure, a stream being restarted keeps its last known rate
+				m_iByteRate.store((m_iByteRate.load(std::memory_order_relaxed) + iByteRate) / 2, std::memory_order_relaxed);
+				m_iFrameRate.store((m_iFrameRate.load(std::memory_order_relaxed) + iFrameRate) / 2, std::memory_order_relaxed);
+			}
+		}
+	}
+	m_iLastSampleBytes = iTotalBytes;
+	m_iLastSampleFrames = iTotalFrames;
+	m_iLastSampleUs = iNowUs;
+
+	m_pMetrics->m_iByteRate.store(m_iByteRate.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_pMetrics->m_iFrameRate.store(m_iFrameRate.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	sampleReceptionStats(iNowUs);
+
+	if(m_pLiveMediaModuleContext->m_bVerbose && m_state == STREAM_STATE_PLAYING){
+		p_log_set_context(m_iStreamId, m_iAttempt);
+		logHistograms();
+	}
+}
+
+void LiveMediaStreamContext::firstFrameReceived()
+{
+	m_bFirstFrameReceived = true;
+	if(m_iHandshakeStartUs != 0){
+		int64_t iDurationUs = LoopClock::nowUs() - m_iHandshakeStartUs;
+		m_pMetrics->setPhaseDuration(METRICS_PHASE_FIRST_FRAME, iDurationUs);
+		p_log("[Access::livemedia] First frame received %lld ms after the first request%s", (long long)(iDurationUs / 1000),
+				(m_bFastStart ? " (fast start)" : ""));
+	}
+}
+
+void LiveMediaStreamContext::logHistograms()
+{
+	// Kept by the metrics, so they are still available once the sinks are closed
+	for(int i=0; i<METRICS_MAX_SUBSESSIONS; i++){
+		char szName[2*METRICS_LABEL_SIZE];
+		if(!m_pMetrics->getSubsessionName(i, szName, sizeof(szName))){
+			continue;
+		}
+		SubsessionMetrics* pSubsessionMetrics = m_pMetrics->getSubsession(i);
+		Histogram* pFrameInterval = pSubsessionMetrics->pFrameInterval;
+		Histogram* pLatency = pSubsessionMetrics->pLatency;
+		if(pFrameInterval->getCount() > 0){
+			p_log("[Access::livemedia] %s frame interval: p50 %.1f ms, p99 %.1f ms, p99.9 %.1f ms, max %.1f ms (%llu frames)", szName,
+					pFrameInterval->getValueAtPercentile(50) / 1000.0, pFrameInterval->getValueAtPercentile(99) / 1000.0,
+					pFrameInterval->getValueAtPercentile(99.9) / 1000.0, pFrameInterval->getMax() / 1000.0,
+					(unsigned long long)pFrameInterval->getCount());
+		}
+		if(pLatency->getCount() > 0){
+			p_log("[Access::livemedia] %s latency: p50 %.1f ms, p99 %.1f ms, p99.9 %.1f ms, max %.1f ms (%llu frames)", szName,
+					pLatency->getValueAtPercentile(50) / 1000.0, pLatency->getValueAtPercentile(99) / 1000.0,
+					pLatency->getValueAtPercentile(99.9) / 1000.0, pLatency->getMax() / 1000.0,
+					(unsigned long long)pLatency->getCount());
+		}
+	}
+}
+
+void LiveMediaStreamContext::sampleReceptionStats(int64_t iNowUs)
+{
+	// The RTP statistics belong to the event loop of the stream, they are copied for the metrics
+	if(!m_pMediaSession || m_state != STREAM_STATE_PLAYING){
+		return;
+	}
+
+	MediaSubsessionIterator iter(*m_pMediaSession);
+	MediaSubsession* pSubsession;
+	while((pSubsession = iter.next()) != NULL){
+		RTPSource* pRTPSource = pSubsession->rtpSource();
+		DummySink* pSink = (DummySink*)pSubsession->sink;
+		if(!pRTPSource || !pSink){
+			continue;
+		}
+
+		uint64_t iReceived = 0;
+		uint64_t iExpected = 0;
+		uint64_t iJitterUs = 0;
+		unsigned iFrequency = pRTPSource->timestampFrequency();
+		RTPReceptionStatsDB::Iterator statsIter(pRTPSource->receptionStatsDB());
+		RTPReceptionStats* pStats;
+		while((pStats = statsIter.next(True)) != NULL){
+			iReceived += pStats->totNumPacketsReceived();
+			iExpected += pStats->totNumPacketsExpected();
+			if(iFrequency > 0){
+				// In timestamp units, keep the worst source
+				uint64_t iSourceJitterUs = (uint64_t)pStats->jitter() * 1000000 / iFrequency;
+				iJitterUs = std::max(iJitterUs, iSourceJitterUs);
+			}
+		}
+
+		SubsessionMetrics* pMetrics = pSink->getMetrics();
+		pMetrics->iPacketsReceived.store(iReceived, std::memory_order_relaxed);
+		// Duplicated packets may make the received count higher than the expected one
+		pMetrics->iPacketsLost.store((iExpected > iReceived ? iExpected - iReceived : 0), std::memory_order_relaxed);
+		pMetrics->iJitterUs.store(iJitterUs, std::memory_order_relaxed);
+
+		pSink->sampleReceiveBuffer(iNowUs);
+		pSink->sampleReorderWindow();
+	}
+}
+
+uint64_t LiveMediaStreamContext::getLoad() const
+{
+	return LOAD_BYTES_PER_STREAM + m_iByteRate.load(std::memory_order_relaxed) + m_iFrameRate.load(std::memory_order_relaxed) * LOAD_BYTES_PER_FRAME;
+}
+
+bool LiveMediaStreamContext::start()
+{
+	m_iAttempt++;
+	m_pMetrics->m_iAttempts.store(m_iAttempt, std::memory_order_relaxed);
+	p_log_set_context(m_iStreamId, m_iAttempt);
+	p_log(" ");
+	p_log("[Access::livemedia] Attempt %d for stream starting", m_iAttempt);
+	p_log("[Access::livemedia] RTSP %s, %s, %s", m_szMRL, m_szUser, m_szPass);
+
+	reset();
+	m_iSubsessionCount = 0;
+	m_bFirstFrameReceived = false;
+	m_iHandshakeStartUs = 0;
+	m_bFastStart = (m_pLiveMediaModuleContext->m_bFastStart && !m_bFastStartFailed);
+	m_bRestartAtOnce = false;
+	m_bSdpFromCache = false;
+
+	AdmissionController* pAdmissionController = AdmissionController::getInstance();
+	if(pAdmissionController->isEnabled()){
+		if(m_iDownSinceUs == 0){
+			m_iDownSinceUs = LoopClock::nowUs();
+		}
+		m_admissionTicket.pAdmittedCallback = LiveMediaModuleContext::streamAdmittedCallback;
+		m_admissionTicket.pClientData = m_pLiveMediaModuleContext;
+		if(!pAdmissionController->request(&m_admissionTicket, m_iDownSinceUs)){
+			p_log("[Access::livemedia] Waiting for the admission of the handshake");
+			setState(STREAM_STATE_WAIT_ADMISSION);
+			m_pLiveMediaModuleContext->scheduleAdmissionPoll();
+			return true;
+		}
+	}
+	return startHandshake();
+}
+
+bool LiveMediaStreamContext::startHandshake()
+{
+	if(m_admissionTicket.state.load(std::memory_order_acquire) == ADMISSION_TICKET_ADMITTED){
+		m_pMetrics->setPhaseDuration(METRICS_PHASE_ADMISSION, m_admissionTicket.iWaitUs);
+		if(m_admissionTicket.iWaitUs >= 1000){
+			p_log("[Access::livemedia] Handshake admitted after %lld ms", (long long)(m_admissionTicket.iWaitUs / 1000));
+		}
+	}
+
+	// For RTSP 1=verbose, 2=more verbose
+	int iRTSPVerbosityLevel = 0;
+	if(m_pLiveMediaModuleContext->m_iVerbosityLevel >= 2){
+		iRTSPVerbosityLevel = 2;
+	}else if(m_pLiveMediaModuleContext->m_iVerbosityLevel == 1){
+		iRTSPVerbosityLevel = 1;
+	}
+
+	m_pRtspClient = CustomRTSPClient::createNew(this, m_szMRL, iRTSPVerbosityLevel);
+	if(!m_pRtspClient){
+		m_bError = true;
+		p_log("[Access::livemedia] Failed to create a RTSP client for media: %s", m_env->getResultMsg());
+		setState(STREAM_STATE_CLOSED);
+		return false;
+	}
+
+	p_log("[Access::livemedia] RTSP client created");
+	p_log("[Access::livemedia] Creating authenticator");
+
+	m_pAuth = new Authenticator(m_szUser, m_szPass);
+
+	m_bStreamInitialized = false;
+	m_pLiveMediaModuleContext->m_pTimerWheel->arm(&m_streamInitializedTimer, TIMEOUT_CHECKALIVE);
+
+	// With the SDP of a previous DESCRIBE, the handshake starts with the SETUP
+	char* szCachedSdp = NULL;
+	char* szCachedBaseURL = NULL;
+	int iCacheAgeSec = 0;
+	if(SdpCache::getInstance()->isOpen() &&
+			SdpCache::getInstance()->lookup(m_szMRL, m_pLiveMediaModuleContext->m_iSdpCacheMaxAge, &szCachedSdp, &szCachedBaseURL, &iCacheAgeSec))
+	{
+		p_log("[Access::livemedia] Using the SDP description cached %d seconds ago", iCacheAgeSec);
+		((CustomRTSPClient*)m_pRtspClient)->setSessionBaseURL(szCachedBaseURL);
+		bool bCreated = createMediaSession(szCachedSdp);
+		free(szCachedSdp);
+		free(szCachedBaseURL);
+		if(bCreated){
+			m_bSdpFromCache = true;
+			setupSubsessions(m_pRtspClient);
+			return true;
+		}
+		SdpCache::getInstance()->invalidate(m_szMRL);
+		((CustomRTSPClient*)m_pRtspClient)->setSessionBaseURL(m_szMRL);
+	}
+
+	if(m_bFastStart){
+		// The OPTIONS response is not used, the DESCRIBE is sent at once
+		p_log("[Access::livemedia] Sending command DESCRIBE (fast start)");
+		setState(STREAM_STATE_DESCRIBE);
+		m_pRtspClient->sendDescribeCommand(CustomRTSPClient::continueAfterDESCRIBE, m_pAuth);
+	}else{
+		p_log("[Access::livemedia] Sending command OPTIONS");
+		setState(STREAM_STATE_OPTIONS);
+		m_pRtspClient->sendOptionsCommand(CustomRTSPClient::continueAfterOPTIONS, m_pAuth);
+	}
+
+	return true;
+}
+
+void LiveMediaStreamContext::stop()
+{
+	if(m_streamRestartTask) {
+		m_env->taskScheduler().unscheduleDelayedTask(m_streamRestartTask);
+		m_streamRestartTask = NULL;
+	}
+	if(m_streamCloseTask) {
+		m_env->taskScheduler().unscheduleDelayedTask(m_streamCloseTask);
+		m_streamCloseTask = NULL;
+	}
+	if(m_pRtspClient){
+		shutdownStream(m_pRtspClient);
+		if(m_streamCloseTask) {
+			m_env->taskScheduler().unscheduleDelayedTask(m_streamCloseTask);
+			m_streamCloseTask = NULL;
+		}
+		closeStream(m_pRtspClient);
+	}
+	AdmissionController::getInstance()->release(&m_admissionTicket);
+	m_state = STREAM_STATE_CLOSED;
+}
+
+LiveMediaModuleContext::LiveMediaModuleContext(int iVerbosityLevel, LiveMediaSchedulerType schedulerType)
+{
+	m_iVerbosityLevel = iVerbosityLevel;
+	m_scheduler = NULL;
+	m_pEpollScheduler = NULL;
+	if(schedulerType == SCHEDULER_EPOLL){
+		m_pEpollScheduler = EpollTaskScheduler::createNew();
+		m_scheduler = m_pEpollScheduler;
+		if(!m_scheduler){
+			p_log("[Access::livemedia] Failed to create the epoll scheduler, using select: %s", strerror(errno));
+		}
+	}
+	if(!m_scheduler){
+		m_scheduler = CustomBasicTaskScheduler::createNew();
+	}
+	m_pTimerWheel = new TimerWheel(*m_scheduler);
+
+	if(m_iVerbosityLevel > 0) {
+		m_env = CustomBasicUsageEnvironment::createNew(*m_scheduler);
+		m_bVerbose = true;
+	}else{
+		m_env = BasicUsageEnvironment::createNew(*m_scheduler);
+		m_bVerbose = false;
+	}
+	m_pShardPool = NULL;
+	m_iShardId = 0;
+	m_eventLoopWatchVariable = 0;
+	m_bTransportUDP = true;
+	m_bWithPingOptions = true;
+	m_bRTCPKeepalive = true;
+	m_bRetry = false;
+	m_iRetryDelay = 5;
+	m_iRetryMaxDelay = 60;
+	m_iMaxFrameSize = DUMMY_SINK_MAX_BUFFER_SIZE;
+	m_pFrameConsumerPool = NULL;
+	m_iMetricsPort = 0;
+	m_iDurationSec = 0;
+	m_durationTask = NULL;
+	m_bFastStart = false;
+	m_iSdpCacheMaxAge = 86400;
+	m_bParseNalUnits = false;
+	m_bBatchReceive = false;
+	m_bStreamReceive = false;
+	memset(&m_interleavedStats, 0, sizeof(m_interleavedStats));
+	m_reorderMode = REORDER_MODE_LATENCY;
+	m_szRecordPath = NULL;
+	m_iRecordSegmentDuration = 60;
+	m_bRecordUring = true;
+	m_pRecordingWriter = NULL;
+	m_pConsumerRecordingWriter = NULL;
+	m_pRestreamServer = NULL;
+	m_iActiveStreamCount = 0;
+
+	pthread_mutex_init(&m_mutexStreamsInbox, NULL);
+	m_adoptStreamsTrigger = m_scheduler->createEventTrigger(adoptStreamsHandler);
+	m_stopEventLoopTrigger = m_scheduler->createEventTrigger(stopEventLoopHandler);
+	m_admissionTrigger = m_scheduler->createEventTrigger(admissionHandler);
+	m_admissionPollTask = NULL;
+
+	m_loadSamplingTask = NULL;
+	m_iLoad = 0;
+}
+
+LiveMediaModuleContext::~LiveMediaModuleContext()
+{
+	for(size_t i=0; i<m_listStreams.size(); i++){
+		delete m_listStreams[i];
+	}
+	m_listStreams.clear();
+	for(size_t i=0; i<m_listStreamsInbox.size(); i++){
+		delete m_listStreamsInbox[i];
+	}
+	m_listStreamsInbox.clear();
+	if(m_loadSamplingTask) {
+		m_scheduler->unscheduleDelayedTask(m_loadSamplingTask);
+		m_loadSamplingTask = NULL;
+	}
+	if(m_admissionPollTask) {
+		m_scheduler->unscheduleDelayedTask(m_admissionPollTask);
+		m_admissionPollTask = NULL;
+	}
+	if(m_scheduler){
+		m_scheduler->deleteEventTrigger(m_adoptStreamsTrigger);
+		m_scheduler->deleteEventTrigger(m_stopEventLoopTrigger);
+		m_scheduler->deleteEventTrigger(m_admissionTrigger);
+	}
+	pthread_mutex_destroy(&m_mutexStreamsInbox);
+	if(m_szRecordPath){
+		free(m_szRecordPath);
+		m_szRecordPath = NULL;
+	}
+	if(m_env) {
+		m_env->reclaim();
+		m_env = NULL;
+	}
+	if(m_pTimerWheel){
+		delete m_pTimerWheel;
+		m_pTimerWheel = NULL;
+	}
+	if(m_scheduler){
+		delete m_scheduler;
+		m_scheduler = NULL;
+	}
+}
+
+void LiveMediaModuleContext::reset()
+{
+	p_log("[Access::livemedia] Reseting");
+	m_eventLoopWatchVariable = 0;
+	p_log("[Access::livemedia] Reseting done");
+}
+
+void LiveMediaModuleContext::setWithPingOptions(bool bEnable)
+{
+	m_bWithPingOptions = bEnable;
+}
+
+void LiveMediaModuleContext::setRTCPKeepalive(bool bEnable)
+{
+	m_bRTCPKeepalive = bEnable;
+}
+
+void LiveMediaModuleContext::setTransportTCP(bool bTCP)
+{
+	m_bTransportUDP = !bTCP;
+}
+
+void LiveMediaModuleContext::setRetry(bool bRetry, int iRetryDelay, int iRetryMaxDelay)
+{
+	m_bRetry = bRetry;
+	m_iRetryDelay = iRetryDelay;
+	m_iRetryMaxDelay = iRetryMaxDelay;
+}
+
+void LiveMediaModuleContext::setMaxFrameSize(size_t iMaxFrameSize)
+{
+	m_iMaxFrameSize = iMaxFrameSize;
+}
+
+void LiveMediaModuleContext::setFrameConsumerPool(FrameConsumerPool* pFrameConsumerPool, RecordingWriter* pConsumerRecordingWriter)
+{
+	m_pFrameConsumerPool = pFrameConsumerPool;
+	m_pConsumerRecordingWriter = pConsumerRecordingWriter;
+}
+
+void LiveMediaModuleContext::setMetricsPort(int iMetricsPort)
+{
+	m_iMetricsPort = iMetricsPort;
+}
+
+void LiveMediaModuleContext::setDuration(int iDurationSec)
+{
+	m_iDurationSec = iDurationSec;
+}
+
+void LiveMediaModuleContext::setFastStart(bool bFastStart)
+{
+	m_bFastStart = bFastStart;
+}
+
+void LiveMediaModuleContext::setSdpCacheMaxAge(int iSdpCacheMaxAge)
+{
+	m_iSdpCacheMaxAge = iSdpCacheMaxAge;
+}
+
+void LiveMediaModuleContext::setRecording(const char* szRecordPath, int iSegmentDuration, bool bUseUring)
+{
+	if(m_szRecordPath){
+		free(m_szRecordPath);
+	}
+	m_szRecordPath = (szRecordPath ? strdup(szRecordPath) : NULL);
+	m_iRecordSegmentDuration = iSegmentDuration;
+	m_bRecordUring = bUseUring;
+}
+
+void LiveMediaModuleContext::setParseNalUnits(bool bParseNalUnits)
+{
+	m_bParseNalUnits = bParseNalUnits;
+}
+
+void LiveMediaModuleContext::setBatchReceive(bool bBatchReceive)
+{
+	m_bBatchReceive = (bBatchReceive && m_pEpollScheduler);
+}
+
+void LiveMediaModuleContext::setStreamReceive(bool bStreamReceive)
+{
+	m_bStreamReceive = (bStreamReceive && m_pEpollScheduler);
+	if(m_pEpollScheduler){
+		// The handlers of the sources receiving over TCP, for the demultiplexing
+		m_pEpollScheduler->setKeepSocketlessHandlers(m_bStreamReceive);
+	}
+}
+
+void LiveMediaModuleContext::setReorderMode(ReorderMode reorderMode)
+{
+	m_reorderMode = reorderMode;
+}
+
+void LiveMediaModuleContext::setShardPool(LiveMediaShardPool* pShardPool, int iShardId)
+{
+	m_pShardPool = pShardPool;
+	m_iShardId = iShardId;
+}
+
+LiveMediaStreamContext* LiveMediaModuleContext::addStream(const char* szMRL, const char* szUser, const char* szPass)
+{
+	LiveMediaStreamContext* pStream = new LiveMediaStreamContext(this, g_iLastStreamId.fetch_add(1) + 1, szMRL, szUser, szPass);
+	attachStream(pStream);
+	return pStream;
+}
+
+void LiveMediaModuleContext::attachStream(LiveMediaStreamContext* pStream)
+{
+	pStream->m_pLiveMediaModuleContext = this;
+	pStream->m_env = m_env;
+	m_listStreams.push_back(pStream);
+	m_iLoad.fetch_add(pStream->getLoad(), std::memory_order_relaxed);
+}
+
+void LiveMediaModuleContext::detachStream(LiveMediaStreamContext* pStream)
+{
+	for(size_t i=0; i<m_listStreams.size(); i++){
+		if(m_listStreams[i] == pStream){
+			m_listStreams.erase(m_listStreams.begin()+i);
+			break;
+		}
+	}
+	m_iLoad.fetch_sub(std::min(pStream->getLoad(), m_iLoad.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+}
+
+void LiveMediaModuleContext::adoptStream(LiveMediaStreamContext* pStream)
+{
+	// Called from the thread of another shard, the stream is taken over by our own thread
+	m_iLoad.fetch_add(pStream->getLoad(), std::memory_order_relaxed);
+	pthread_mutex_lock(&m_mutexStreamsInbox);
+	m_listStreamsInbox.push_back(pStream);
+	pthread_mutex_unlock(&m_mutexStreamsInbox);
+	m_scheduler->triggerEvent(m_adoptStreamsTrigger, this);
+}
+
+void LiveMediaModuleContext::adoptStreamsHandler(void* clientData)
+{
+	((LiveMediaModuleContext*)clientData)->adoptStreams();
+}
+
+void LiveMediaModuleContext::streamAdmittedCallback(void* clientData)
+{
+	// Called from the thread releasing a handshake slot, which may be another shard
+	LiveMediaModuleContext* pShard = (LiveMediaModuleContext*)clientData;
+	pShard->m_scheduler->triggerEvent(pShard->m_admissionTrigger, pShard);
+}
+
+void LiveMediaModuleContext::admissionHandler(void* clientData)
+{
+	((LiveMediaModuleContext*)clientData)->admitStreams();
+}
+
+void LiveMediaModuleContext::admissionPollHandler(void* clientData)
+{
+	LiveMediaModuleContext* pShard = (LiveMediaModuleContext*)clientData;
+	pShard->m_admissionPollTask = NULL;
+	// Admits the tickets of every shard if the token bucket has refilled
+	AdmissionController::getInstance()->dispatch();
+	pShard->admitStreams();
+}
+
+void LiveMediaModuleContext::admitStreams()
+{
+	// A stream failing at once may be moved to another shard
+	std::vector<LiveMediaStreamContext*> listStreams = m_listStreams;
+	bool bWaiting = false;
+	for(size_t i=0; i<listStreams.size(); i++){
+		LiveMediaStreamContext* pStream = listStreams[i];
+		if(pStream->m_state != STREAM_STATE_WAIT_ADMISSION){
+			continue;
+		}
+		if(pStream->m_admissionTicket.state.load(std::memory_order_acquire) != ADMISSION_TICKET_ADMITTED){
+			bWaiting = true;
+			continue;
+		}
+		p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+		if(!pStream->startHandshake()){
+			streamClosed(pStream);
+		}
+	}
+	if(bWaiting){
+		scheduleAdmissionPoll();
+	}
+}
+
+void LiveMediaModuleContext::scheduleAdmissionPoll()
+{
+	if(m_admissionPollTask || m_eventLoopWatchVariable != 0){
+		return;
+	}
+	int64_t iDelayUs = AdmissionController::getInstance()->dispatch();
+	if(iDelayUs < 0 || iDelayUs > ADMISSION_POLL_PERIOD){
+		iDelayUs = ADMISSION_POLL_PERIOD;
+	}
+	m_admissionPollTask = m_scheduler->scheduleDelayedTask(iDelayUs, (TaskFunc*)LiveMediaModuleContext::admissionPollHandler, this);
+}
+
+void LiveMediaModuleContext::adoptStreams()
+{
+	std::vector<LiveMediaStreamContext*> listStreams;
+	pthread_mutex_lock(&m_mutexStreamsInbox);
+	listStreams.swap(m_listStreamsInbox);
+	pthread_mutex_unlock(&m_mutexStreamsInbox);
+
+	for(size_t i=0; i<listStreams.size(); i++){
+		LiveMediaStreamContext* pStream = listStreams[i];
+		// The load has already been accounted by adoptStream()
+		pStream->m_pLiveMediaModuleContext = this;
+		pStream->m_env = m_env;
+		m_listStreams.push_back(pStream);
+
+		p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+		p_log("[Access::livemedia] Stream moved to shard %d", m_iShardId);
+		if(m_eventLoopWatchVariable == 0){
+			pStream->scheduleRestart(pStream->m_iRetryDelayUs);
+		}
+	}
+}
+
+void LiveMediaModuleContext::loadSamplingHandler(void* clientData)
+{
+	((LiveMediaModuleContext*)clientData)->sampleLoad();
+}
+
+void LiveMediaModuleContext::durationElapsedHandler(void* clientData)
+{
+	LiveMediaModuleContext* pContext = (LiveMediaModuleContext*)clientData;
+	pContext->m_durationTask = NULL;
+	p_log_set_context(0, 0);
+	p_log("[Access::livemedia] Duration of %d seconds elapsed, stopping", pContext->m_iDurationSec);
+	if(pContext->m_pShardPool){
+		pContext->m_pShardPool->stop();
+	}else{
+		pContext->stopEventLoop();
+	}
+}
+
+void LiveMediaModuleContext::sampleLoad()
+{
+	int64_t iNowUs = LoopClock::nowUs();
+
+	uint64_t iLoad = 0;
+	uint64_t iByteRate = 0;
+	uint64_t iFrameRate = 0;
+	for(size_t i=0; i<m_listStreams.size(); i++){
+		LiveMediaStreamContext* pStream = m_listStreams[i];
+		pStream->sampleLoad(iNowUs);
+		iLoad += pStream->getLoad();
+		iByteRate += pStream->m_iByteRate.load(std::memory_order_relaxed);
+		iFrameRate += pStream->m_iFrameRate.load(std::memory_order_relaxed);
+	}
+	m_iLoad.store(iLoad, std::memory_order_relaxed);
+
+	if(m_bVerbose){
+		p_log_set_context(0, 0);
+		p_log("[Access::livemedia] Shard %d load: %d stream(s), %llu bytes/s, %llu frames/s",
+				m_iShardId, (int)m_listStreams.size(), (unsigned long long)iByteRate, (unsigned long long)iFrameRate);
+	}
+
+	if(m_iShardId == 0){
+		// The pool is shared by all the shards, only one of them has to trim it
+		FramePool* pFramePool = FramePool::getInstance();
+		pFramePool->trim();
+		if(m_bVerbose){
+			FramePoolStats stats;
+			pFramePool->getStats(stats);
+			p_log("[Access::livemedia] Frame pool: %llu buffer(s) in use, %llu KB in use, %llu KB mapped",
+					(unsigned long long)stats.iBuffersInUse, (unsigned long long)(stats.iBytesInUse/1024), (unsigned long long)(stats.iBytesMapped/1024));
+			if(m_pFrameConsumerPool){
+				FrameConsumerStats consumerStats;
+				m_pFrameConsumerPool->getStats(consumerStats);
+				p_log("[Access::livemedia] Frame consumers: %llu frame(s) queued, %llu consumed, %llu dropped",
+						(unsigned long long)consumerStats.iQueuedFrames, (unsigned long long)consumerStats.iConsumedFrames,
+						(unsigned long long)consumerStats.iDroppedFrames);
+			}
+		}
+	}
+
+	m_loadSamplingTask = m_scheduler->scheduleDelayedTask(LOAD_SAMPLING_PERIOD, (TaskFunc*)LiveMediaModuleContext::loadSamplingHandler, this);
+}
+
+void LiveMediaModuleContext::streamClosed(LiveMediaStreamContext* pStream)
+{
+	if(m_bRetry && m_eventLoopWatchVariable == 0){
+		// Computed before a move, the shard adopting the stream uses the same delay
+		int64_t iDelayUs = pStream->nextRetryDelay();
+		if(m_pShardPool){
+			// A reconnection is the right time to move the stream to a less loaded shard
+			LiveMediaModuleContext* pShard = m_pShardPool->pickShard(pStream, this);
+			if(pShard != this){
+				p_log("[Access::livemedia] Moving stream from shard %d to shard %d", m_iShardId, pShard->m_iShardId);
+				detachStream(pStream);
+				pShard->adoptStream(pStream);
+				return;
+			}
+		}
+		pStream->scheduleRestart(iDelayUs);
+		return;
+	}
+
+	if(m_pShardPool){
+		m_pShardPool->streamEnded();
+		return;
+	}
+
+	m_iActiveStreamCount--;
+	p_log("[Access::livemedia] Stream ended, %d stream(s) still active", m_iActiveStreamCount);
+	if(m_iActiveStreamCount <= 0){
+		stopEventLoop();
+	}
+}
+
+void LiveMediaModuleContext::stopEventLoopHandler(void* clientData)
+{
+	((LiveMediaModuleContext*)clientData)->m_eventLoopWatchVariable = -1;
+}
+
+void LiveMediaModuleContext::stopEventLoop()
+{
+	// May be called from any thread
+	m_scheduler->triggerEvent(m_stopEventLoopTrigger, this);
+}
+
+int LiveMediaModuleContext::start()
+{
+	int iResult = 0;
+
+	p_log("[Access::livemedia] Start %d stream(s) with transport TCP: %d", (int)m_listStreams.size(), !m_bTransportUDP);
+
+	// Before the streams, whose sinks are created by the SETUP responses. With the consumer
+	// threads, the frames are recorded by them through the writer they share.
+	if(m_szRecordPath && !m_pFrameConsumerPool){
+		m_pRecordingWriter = RecordingWriter::createNew(*m_scheduler, m_bRecordUring);
+		if(m_pRecordingWriter){
+			RecordingStats stats;
+			m_pRecordingWriter->getStats(stats);
+			p_log("[Access::livemedia] Recording in %s with %s, segments of %d s", m_szRecordPath,
+					(stats.bUring ? "io_uring" : "a writer thread"), m_iRecordSegmentDuration);
+		}else{
+			p_log("[Access::livemedia] Cannot start the recording writer");
+		}
+	}
+
+	// Copy the list, since a failing stream may be moved to another shard
+	std::vector<LiveMediaStreamContext*> listStreams = m_listStreams;
+	m_iActiveStreamCount = (int)listStreams.size();
+	for(size_t i=0; i<listStreams.size(); i++){
+		LiveMediaStreamContext* pStream = listStreams[i];
+		if(!pStream->start()){
+			streamClosed(pStream);
+		}
+	}
+	p_log_set_context(0, 0);
+
+	// In a shard pool, the loop must keep running to adopt the streams of the other shards
+	if(m_iActiveStreamCount > 0 || m_pShardPool){
+		m_loadSamplingTask = m_scheduler->scheduleDelayedTask(LOAD_SAMPLING_PERIOD, (TaskFunc*)LiveMediaModuleContext::loadSamplingHandler, this);
+		if(m_iDurationSec > 0){
+			m_durationTask = m_scheduler->scheduleDelayedTask((int64_t)m_iDurationSec*1000000, (TaskFunc*)LiveMediaModuleContext::durationElapsedHandler, this);
+		}
+
+		MetricsHttpServer* pMetricsServer = NULL;
+		if(m_iMetricsPort > 0){
+			pMetricsServer = MetricsHttpServer::createNew(*m_scheduler, m_iMetricsPort);
+			if(pMetricsServer){
+				p_log("[Access::livemedia] Metrics available on http://127.0.0.1:%d/metrics", m_iMetricsPort);
+			}else{
+				p_log("[Access::livemedia] Cannot listen on port %d for the metrics: %s", m_iMetricsPort, strerror(errno));
+			}
+		}
+
+		p_log("[Access::livemedia] Starting event loop: %d", m_eventLoopWatchVariable);
+		m_env->taskScheduler().doEventLoop(&m_eventLoopWatchVariable);
+		p_log_set_context(0, 0);
+		p_log("[Access::livemedia] End of event loop");
+
+		if(m_bBatchReceive){
+			EpollBatchStats stats;
+			m_pEpollScheduler->getBatchStats(stats);
+			p_log("[Access::livemedia] Received %llu datagram(s) in %llu recvmmsg() call(s) (%.1f per call), %llu truncated, %llu unread",
+					(unsigned long long)stats.iDatagrams, (unsigned long long)stats.iBatches,
+					(stats.iBatches > 0 ? (double)stats.iDatagrams / stats.iBatches : 0.0),
+					(unsigned long long)stats.iTruncated, (unsigned long long)stats.iUnread);
+		}
+		if(m_bStreamReceive){
+			const InterleavedStats& stats = m_interleavedStats;
+			p_log("[Access::livemedia] Received %llu byte(s) of interleaved data in %llu read(s) (%.0f per read), %llu packet(s) demultiplexed, %llu given to live555, %llu dropped",
+					(unsigned long long)stats.iBytes, (unsigned long long)stats.iReads,
+					(stats.iReads > 0 ? (double)stats.iBytes / stats.iReads : 0.0),
+					(unsigned long long)stats.iPackets, (unsigned long long)stats.iForwarded, (unsigned long long)stats.iDropped);
+		}
+
+		if(pMetricsServer){
+			delete pMetricsServer;
+			pMetricsServer = NULL;
+		}
+
+		if(m_loadSamplingTask) {
+			m_scheduler->unscheduleDelayedTask(m_loadSamplingTask);
+			m_loadSamplingTask = NULL;
 		}
+		if(m_durationTask) {
+			m_scheduler->unscheduleDelayedTask(m_durationTask);
+			m_durationTask = NULL;
+		}
+	}
+
+	// Streams still waiting to be adopted are stopped with the others
+	adoptStreams();
+
+	for(size_t i=0; i<m_listStreams.size(); i++){
+		LiveMediaStreamContext* pStream = m_listStreams[i];
+		p_log_set_context(pStream->m_iStreamId, pStream->m_iAttempt);
+		pStream->stop();
+		if(pStream->m_bError){
+			iResult = -1;
+		}
+	}
+	p_log_set_context(0, 0);
+
+	// The sinks are closed, wait for their last writes
+	if(m_pRecordingWriter){
+		m_pRecordingWriter->drain();
+		RecordingStats stats;
+		m_pRecordingWriter->getStats(stats);
+		p_log("[Access::livemedia] Recorded %llu bytes in %llu writes and %llu files, %llu failed write(s), %llu frame(s) dropped",
+				(unsigned long long)stats.iBytesWritten, (unsigned long long)stats.iWrites, (unsigned long long)stats.iFilesOpened,
+				(unsigned long long)stats.iFailedWrites, (unsigned long long)stats.iDroppedFrames);
+		delete m_pRecordingWriter;
+		m_pRecordingWriter = NULL;
 	}
-	m_eventLoopWatchVariable = -1;
+
+	return iResult;
 }
 
-void LiveMediaModuleContext::closeStream(RTSPClient* rtspClient)
+////////////////////////////
+// Shard pool
+////////////////////////////
+
+LiveMediaShardPool::LiveMediaShardPool(int iShardCount, int iVerbosityLevel, LiveMediaSchedulerType schedulerType)
 {
-	p_log("[Access::livemedia] Closing the stream.");
-	cleanSesssion();
-	Medium::close(rtspClient);
-	m_pRtspClient = NULL;
-	p_log("[Access::livemedia] Stream shutdown done");
+	if(iShardCount < 1){
+		iShardCount = 1;
+	}
+	for(int i=0; i<iShardCount; i++){
+		LiveMediaModuleContext* pShard = new LiveMediaModuleContext(iVerbosityLevel, schedulerType);
+		pShard->setShardPool(this, i);
+		m_listShards.push_back(pShard);
+	}
+	m_iStreamCount = 0;
+	m_iActiveStreamCount = 0;
+	m_iRestreamPort = 0;
+	m_pRestreamServer = NULL;
 }
 
-int LiveMediaModuleContext::start(const char* szMRL, const char* szUser, const char* szPass, bool bTCP)
+LiveMediaShardPool::~LiveMediaShardPool()
 {
-	int iResult = 0;
+	for(size_t i=0; i<m_listShards.size(); i++){
+		delete m_listShards[i];
+	}
+	m_listShards.clear();
+}
 
-	// Set default transport mode
-	m_bTransportUDP = !bTCP;
-	p_log("[Access::livemedia] Start with transport TCP: %d", !m_bTransportUDP);
+void LiveMediaShardPool::setWithPingOptions(bool bEnable)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setWithPingOptions(bEnable);
+	}
+}
 
-	// For RTSP 1=verbose, 2=more verbose
-	int iRTSPVerbosityLevel = 0;
-	if(m_iVerbosityLevel >= 2){
-		iRTSPVerbosityLevel = 2;
-	}else if(m_iVerbosityLevel == 1){
-		iRTSPVerbosityLevel = 1;
+void LiveMediaShardPool::setRTCPKeepalive(bool bEnable)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setRTCPKeepalive(bEnable);
+	}
+}
+
+void LiveMediaShardPool::setTransportTCP(bool bTCP)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setTransportTCP(bTCP);
 	}
+}
 
+void LiveMediaShardPool::setRetry(bool bRetry, int iRetryDelay, int iRetryMaxDelay)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setRetry(bRetry, iRetryDelay, iRetryMaxDelay);
+	}
+}
 
-	m_pRtspClient = CustomRTSPClient::createNew(this, szMRL, iRTSPVerbosityLevel);
-	if(m_pRtspClient){
-		p_log("[Access::livemedia] RTSP client created");
-		p_log("[Access::livemedia] Creating authenticator");
+void LiveMediaShardPool::setMaxFrameSize(size_t iMaxFrameSize)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setMaxFrameSize(iMaxFrameSize);
+	}
+}
 
-		Authenticator* pAuth = new Authenticator(szUser, szPass);
+void LiveMediaShardPool::setFrameConsumerPool(FrameConsumerPool* pFrameConsumerPool, RecordingWriter* pConsumerRecordingWriter)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setFrameConsumerPool(pFrameConsumerPool, pConsumerRecordingWriter);
+	}
+}
 
-		m_bStreamInitialized = false;
-		m_streamInitializedTask = m_env->taskScheduler().scheduleDelayedTask(TIMEOUT_CHECKALIVE, (TaskFunc*)CustomRTSPClient::streamCheckStreamInitializedHandler, m_pRtspClient);
+void LiveMediaShardPool::setMetricsPort(int iMetricsPort)
+{
+	// One endpoint for the whole process, served by the first shard
+	m_listShards[0]->setMetricsPort(iMetricsPort);
+}
 
-		p_log("[Access::livemedia] Sending command OPTIONS");
-		m_pRtspClient->sendOptionsCommand(CustomRTSPClient::continueAfterOPTIONS, pAuth);
+void LiveMediaShardPool::setDuration(int iDurationSec)
+{
+	// The first shard stops all the others
+	m_listShards[0]->setDuration(iDurationSec);
+}
 
-		p_log("[Access::livemedia] Starting event loop: %d", m_eventLoopWatchVariable);
-		m_env->taskScheduler().doEventLoop(&m_eventLoopWatchVariable);
+void LiveMediaShardPool::setFastStart(bool bFastStart)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setFastStart(bFastStart);
+	}
+}
 
-		p_log("[Access::livemedia] End of event loop");
+void LiveMediaShardPool::setSdpCacheMaxAge(int iSdpCacheMaxAge)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setSdpCacheMaxAge(iSdpCacheMaxAge);
+	}
+}
+
+void LiveMediaShardPool::setRecording(const char* szRecordPath, int iSegmentDuration, bool bUseUring)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setRecording(szRecordPath, iSegmentDuration, bUseUring);
+	}
+}
+
+void LiveMediaShardPool::setParseNalUnits(bool bParseNalUnits)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setParseNalUnits(bParseNalUnits);
+	}
+}
+
+void LiveMediaShardPool::setBatchReceive(bool bBatchReceive)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setBatchReceive(bBatchReceive);
+	}
+}
+
+void LiveMediaShardPool::setStreamReceive(bool bStreamReceive)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setStreamReceive(bStreamReceive);
+	}
+}
+
+void LiveMediaShardPool::setReorderMode(ReorderMode reorderMode)
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->setReorderMode(reorderMode);
+	}
+}
+
+void LiveMediaShardPool::setRestreamPort(int iRestreamPort)
+{
+	m_iRestreamPort = iRestreamPort;
+}
+
+LiveMediaStreamContext* LiveMediaShardPool::addStream(const char* szMRL, const char* szUser, const char* szPass)
+{
+	// Nothing is measured yet, so the streams are spread evenly
+	LiveMediaModuleContext* pShard = m_listShards[m_iStreamCount % m_listShards.size()];
+	m_iStreamCount++;
+
+	LiveMediaStreamContext* pStream = new LiveMediaStreamContext(pShard, g_iLastStreamId.fetch_add(1) + 1, szMRL, szUser, szPass);
+	pShard->attachStream(pStream);
+	m_iActiveStreamCount++;
+	return pStream;
+}
 
-		if(pAuth){
-			delete pAuth;
-			pAuth = NULL;
+LiveMediaModuleContext* LiveMediaShardPool::pickShard(LiveMediaStreamContext* pStream, LiveMediaModuleContext* pCurrentShard)
+{
+	LiveMediaModuleContext* pBestShard = pCurrentShard;
+	uint64_t iBestLoad = pCurrentShard->m_iLoad.load(std::memory_order_relaxed);
+	uint64_t iStreamLoad = pStream->getLoad();
+
+	for(size_t i=0; i<m_listShards.size(); i++){
+		LiveMediaModuleContext* pShard = m_listShards[i];
+		uint64_t iLoad = pShard->m_iLoad.load(std::memory_order_relaxed);
+		if(pShard != pCurrentShard && iLoad < iBestLoad){
+			pBestShard = pShard;
+			iBestLoad = iLoad;
 		}
+	}
 
-		shutdownStream(m_pRtspClient);
-		closeStream(m_pRtspClient);
-	}else{
-		m_bError = true;
-		p_log("[Access::livemedia] Failed to create a RTSP client for media: %s", m_env->getResultMsg());
+	// Only move if the stream lowers the imbalance, to avoid moving it back and forth
+	if(pBestShard != pCurrentShard && iBestLoad + iStreamLoad >= pCurrentShard->m_iLoad.load(std::memory_order_relaxed)){
+		pBestShard = pCurrentShard;
 	}
 
-	if(m_bError){
-		iResult = -1;
+	return pBestShard;
+}
+
+void LiveMediaShardPool::streamEnded()
+{
+	int iActiveStreamCount = --m_iActiveStreamCount;
+	p_log("[Access::livemedia] Stream ended, %d stream(s) still active", iActiveStreamCount);
+	if(iActiveStreamCount <= 0){
+		stop();
+	}
+}
+
+void LiveMediaShardPool::stop()
+{
+	for(size_t i=0; i<m_listShards.size(); i++){
+		m_listShards[i]->stopEventLoop();
+	}
+}
+
+void* LiveMediaShardPool::shardThread(void* arg)
+{
+	LiveMediaModuleContext* pShard = (LiveMediaModuleContext*)arg;
+	LiveMediaShardPool* pShardPool = pShard->m_pShardPool;
+	pShardPool->m_listShardResults[pShard->m_iShardId] = pShard->start();
+	return NULL;
+}
+
+int LiveMediaShardPool::start()
+{
+	int iResult = 0;
+
+	p_log("[Access::livemedia] Start %d stream(s) on %d shard(s)", m_iStreamCount, (int)m_listShards.size());
+
+	std::vector<bool> listThreadStarted(m_listShards.size(), false);
+	m_listShardResults.assign(m_listShards.size(), 0);
+	m_listThreads.resize(m_listShards.size());
+
+	// Before the threads, since the sinks of all the shards add their tracks
+	if(m_iRestreamPort > 0){
+		LiveMediaModuleContext* pFirstShard = m_listShards[0];
+		m_pRestreamServer = RestreamServer::createNew(*pFirstShard->m_env, m_iRestreamPort, pFirstShard->m_iMaxFrameSize);
+		if(m_pRestreamServer){
+			p_log("[Access::livemedia] Restreaming on rtsp://127.0.0.1:%d/stream<N>", m_iRestreamPort);
+		}else{
+			p_log("[Access::livemedia] Cannot listen on port %d for the restreaming", m_iRestreamPort);
+		}
+		for(size_t i=0; i<m_listShards.size(); i++){
+			m_listShards[i]->m_pRestreamServer = m_pRestreamServer;
+		}
+	}
+
+	// The first shard runs in the calling thread
+	for(size_t i=1; i<m_listShards.size(); i++){
+		if(pthread_create(&m_listThreads[i], NULL, shardThread, m_listShards[i]) == 0){
+			listThreadStarted[i] = true;
+		}else{
+			p_log("[Access::livemedia] Failed to create the thread of shard %d", (int)i);
+			m_listShardResults[i] = -1;
+			m_iActiveStreamCount -= (int)m_listShards[i]->m_listStreams.size();
+		}
+	}
+	shardThread(m_listShards[0]);
+
+	for(size_t i=0; i<m_listShards.size(); i++){
+		if(listThreadStarted[i]){
+			pthread_join(m_listThreads[i], NULL);
+		}
+		if(m_listShardResults[i] != 0){
+			iResult = -1;
+		}
+	}
+
+	// All the sinks are closed, the clients are only closed now
+	if(m_pRestreamServer){
+		RestreamStats stats;
+		m_pRestreamServer->getStats(stats);
+		p_log("[Access::livemedia] Restreamed %llu frame(s) and %llu bytes, %llu frame(s) dropped for the slow clients",
+				(unsigned long long)stats.iFramesSent, (unsigned long long)stats.iBytesSent, (unsigned long long)stats.iFramesDropped);
+		for(size_t i=0; i<m_listShards.size(); i++){
+			m_listShards[i]->m_pRestreamServer = NULL;
+		}
+		delete m_pRestreamServer;
+		m_pRestreamServer = NULL;
 	}
 
 	return iResult;
 }
 
+// The microbenchmarks include this file with their own main()
+#ifndef TEST_LIVE_MEDIA_NO_MAIN
+
+static bool addStreamsFromFile(LiveMediaShardPool* pContext, const char* szFilePath, const char* szUsername, const char* szPassword)
+{
+	// One stream per line: URL [username password]
+	FILE* pFile = fopen(szFilePath, "r");
+	if(!pFile){
+		p_log("[Access::livemedia] Cannot open URL file %s", szFilePath);
+		return false;
+	}
+
+	char szLine[2048];
+	while(fgets(szLine, sizeof(szLine), pFile)){
+		char szURL[1024];
+		char szUser[256];
+		char szPass[256];
+		int iCount = sscanf(szLine, "%1023s %255s %255s", szURL, szUser, szPass);
+		if(iCount < 1 || szURL[0] == '#'){
+			continue;
+		}
+		if(iCount == 3){
+			pContext->addStream(szURL, szUser, szPass);
+		}else{
+			pContext->addStream(szURL, szUsername, szPassword);
+		}
+	}
+	fclose(pFile);
+	return true;
+}
+
 int main (int argc, char *argv[])
 {
-	const char* szRTSPUrl = NULL;
+	std::vector<const char*> listRTSPUrl;
+	const char* szURLFile = NULL;
 	const char* szUsername = NULL;
 	const char* szPassword = NULL;
 	bool bTCP = false;
 	int iVerbosityLevel = 0;
 	bool bWithPing = true;
+	bool bRTCPKeepalive = true;
 	bool bRetry = false;
 	int iRetryDelay = 5;
+	int iRetryMaxDelay = 60;
+	int iThreadCount = 1;
+	LiveMediaSchedulerType schedulerType = SCHEDULER_SELECT;
+	bool bHugePages = false;
+	int iMaxFrameSize = DUMMY_SINK_MAX_BUFFER_SIZE;
+	int iConsumerThreadCount = 0;
+	int iConsumerRingSize = 256;
+	bool bAsyncLog = true;
+	int iMetricsPort = 0;
+	int iDurationSec = 0;
+	bool bFastStart = false;
+	const char* szSdpCacheFile = NULL;
+	int iSdpCacheMaxAge = 86400;
+	double dAdmissionRate = 0;
+	int iAdmissionBurst = 1;
+	int iMaxHandshakes = 0;
+	int iMaxHandshakesPerHost = 0;
+	const char* szRecordPath = NULL;
+	int iRecordSegmentDuration = 60;
+	bool bRecordUring = true;
+	bool bParseNalUnits = false;
+	int iGopCacheSize = 0; // In MB
+	int iRestreamPort = 0;
+	bool bBatchReceive = false;
+	bool bStreamReceive = false;
+	const char* szReorderMode = NULL;
 
 	for(int i=0; i<argc; i++)
 	{
@@ -1081,43 +3498,309 @@ int main (int argc, char *argv[])
 			bWithPing = false;
 			continue;
 		}
+		if(strcmp(argv[i], "--ping-with-rtcp") == 0){
+			bRTCPKeepalive = false;
+			continue;
+		}
 		if(strcmp(argv[i], "--retry") == 0){
 			bRetry = true;
 			continue;
 		}
-		if(strcmp(argv[i], "--retry-delay") == 0){
+		if(strcmp(argv[i], "--retry-delay") == 0 && i+1<argc){
 			iRetryDelay = atoi(argv[i+1]);
 			i++;
 			continue;
 		}
-		if(i == argc-1){
-			szRTSPUrl = argv[i];
+		if(strcmp(argv[i], "--retry-max-delay") == 0 && i+1<argc){
+			iRetryMaxDelay = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--threads") == 0 && i+1<argc){
+			iThreadCount = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--scheduler") == 0 && i+1<argc){
+			if(strcmp(argv[i+1], "epoll") == 0){
+				schedulerType = SCHEDULER_EPOLL;
+			}else{
+				schedulerType = SCHEDULER_SELECT;
+			}
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--max-frame-size") == 0 && i+1<argc){
+			iMaxFrameSize = atoi(argv[i+1]);
+			if(iMaxFrameSize < DUMMY_SINK_MIN_BUFFER_SIZE){
+				iMaxFrameSize = DUMMY_SINK_MIN_BUFFER_SIZE;
+			}
+			// The receive buffers come from the frame pool, which has no bigger class
+			if((size_t)iMaxFrameSize > FRAME_POOL_MAX_CAPACITY){
+				p_log("[Access::livemedia] --max-frame-size %s above the maximum, using %d bytes", argv[i+1], (int)FRAME_POOL_MAX_CAPACITY);
+				iMaxFrameSize = FRAME_POOL_MAX_CAPACITY;
+			}
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--consumer-threads") == 0 && i+1<argc){
+			iConsumerThreadCount = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--consumer-ring-size") == 0 && i+1<argc){
+			iConsumerRingSize = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--metrics-port") == 0 && i+1<argc){
+			iMetricsPort = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			iDurationSec = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--fast-start") == 0){
+			bFastStart = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--sdp-cache") == 0 && i+1<argc){
+			szSdpCacheFile = argv[i+1];
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--sdp-cache-max-age") == 0 && i+1<argc){
+			iSdpCacheMaxAge = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--admission-rate") == 0 && i+1<argc){
+			dAdmissionRate = atof(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--admission-burst") == 0 && i+1<argc){
+			iAdmissionBurst = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--max-handshakes") == 0 && i+1<argc){
+			iMaxHandshakes = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--max-handshakes-per-host") == 0 && i+1<argc){
+			iMaxHandshakesPerHost = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--parse-nal") == 0){
+			bParseNalUnits = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--record") == 0 && i+1<argc){
+			szRecordPath = argv[i+1];
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--record-segment") == 0 && i+1<argc){
+			iRecordSegmentDuration = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--record-no-uring") == 0){
+			bRecordUring = false;
+			continue;
+		}
+		if(strcmp(argv[i], "--gop-cache") == 0 && i+1<argc){
+			iGopCacheSize = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--restream-port") == 0 && i+1<argc){
+			iRestreamPort = atoi(argv[i+1]);
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--recvmmsg") == 0){
+			bBatchReceive = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--tcp-batch") == 0){
+			bStreamReceive = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--reorder") == 0 && i+1<argc){
+			szReorderMode = argv[i+1];
+			i++;
+			continue;
+		}
+		if(strcmp(argv[i], "--sync-log") == 0){
+			bAsyncLog = false;
+			continue;
+		}
+		if(strcmp(argv[i], "--huge-pages") == 0){
+			bHugePages = true;
+			continue;
+		}
+		if(strcmp(argv[i], "--url-file") == 0 && i+1<argc){
+			szURLFile = argv[i+1];
+			i++;
+			continue;
+		}
+		// Every other argument is a stream URL
+		listRTSPUrl.push_back(argv[i]);
+	}
+
+	if(schedulerType == SCHEDULER_EPOLL){
+		// Each UDP subsession uses two sockets, so allow as many as possible
+		struct rlimit limit;
+		if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
 		}
 	}
 
-	g_iAttempt = 0;
+	FramePool::getInstance()->setHugePages(bHugePages);
 
-	p_log("[Access::livemedia] RTSP %s, %s, %s", szRTSPUrl, szUsername, szPassword);
+	if(szSdpCacheFile && !SdpCache::getInstance()->open(szSdpCacheFile)){
+		p_log("[Access::livemedia] Failed to open the SDP cache %s: %s", szSdpCacheFile, strerror(errno));
+	}
+
+	AdmissionController::getInstance()->setLimits(dAdmissionRate, iAdmissionBurst, iMaxHandshakes, iMaxHandshakesPerHost);
+
+	// The restreaming needs the GOP cache
+	if(iRestreamPort > 0 && iGopCacheSize <= 0){
+		iGopCacheSize = RESTREAM_DEFAULT_GOP_CACHE_SIZE;
+	}
+	if(iGopCacheSize > 0){
+		GopCache::getInstance()->setBudget((size_t)iGopCacheSize * 1024 * 1024);
+	}
+
+	// From now on the logs are written by a background thread
+	if(bAsyncLog){
+		AsyncLogger::getInstance()->start();
+	}
+
+	// The frames are consumed out of the event loops if some threads are given for it
+	FrameConsumerPool* pFrameConsumerPool = NULL;
+	RecordingWriter* pConsumerRecordingWriter = NULL;
+	if(iConsumerThreadCount > 0){
+		pFrameConsumerPool = new FrameConsumerPool(iConsumerThreadCount, (iConsumerRingSize > 0 ? iConsumerRingSize : 1));
+		pFrameConsumerPool->addConsumer(FrameProcessor::frameConsumer, NULL);
+		if(szRecordPath){
+			pConsumerRecordingWriter = RecordingWriter::createShared();
+			if(pConsumerRecordingWriter){
+				p_log("[Access::livemedia] Recording in %s by the consumer threads, segments of %d s", szRecordPath, iRecordSegmentDuration);
+			}else{
+				p_log("[Access::livemedia] Cannot start the recording writer");
+			}
+		}
+	}
 
 	// Initiate context
-	while(true){
-		g_iAttempt++;
-		p_log(" ");
-		p_log("[Access::livemedia] Attempt %d for stream starting", g_iAttempt);
-		
-		LiveMediaModuleContext* pContext = new LiveMediaModuleContext(iVerbosityLevel);
-		pContext->setWithPingOptions(bWithPing);
-		pContext->start(szRTSPUrl, szUsername, szPassword, bTCP);
-		if(pContext){
-			delete pContext;
-			pContext = NULL;
-		}
-		if(!bRetry){
-			break;
+	LiveMediaShardPool* pContext = new LiveMediaShardPool(iThreadCount, iVerbosityLevel, schedulerType);
+	pContext->setFrameConsumerPool(pFrameConsumerPool, pConsumerRecordingWriter);
+	pContext->setMetricsPort(iMetricsPort);
+	pContext->setDuration(iDurationSec);
+	pContext->setFastStart(bFastStart);
+	pContext->setSdpCacheMaxAge(iSdpCacheMaxAge);
+	pContext->setRecording(szRecordPath, iRecordSegmentDuration, bRecordUring);
+	pContext->setParseNalUnits(bParseNalUnits);
+	pContext->setRestreamPort(iRestreamPort);
+	if(bBatchReceive && schedulerType != SCHEDULER_EPOLL){
+		p_log("[Access::livemedia] --recvmmsg needs --scheduler epoll, the packets are read one by one");
+	}
+	pContext->setBatchReceive(bBatchReceive);
+	if(bStreamReceive && (schedulerType != SCHEDULER_EPOLL || !bTCP)){
+		p_log("[Access::livemedia] --tcp-batch needs --tcp and --scheduler epoll, the RTSP socket is read frame by frame");
+	}
+	pContext->setStreamReceive(bStreamReceive && bTCP);
+	// The recording favours the complete frames, the live view the latency
+	ReorderMode reorderMode = (szRecordPath ? REORDER_MODE_COMPLETENESS : REORDER_MODE_LATENCY);
+	if(szReorderMode && !ReorderWindow::getMode(szReorderMode, &reorderMode)){
+		p_log("[Access::livemedia] Unknown reorder mode %s, using %s", szReorderMode, ReorderWindow::getModeName(reorderMode));
+	}
+	pContext->setReorderMode(reorderMode);
+	pContext->setWithPingOptions(bWithPing);
+	pContext->setRTCPKeepalive(bRTCPKeepalive);
+	pContext->setTransportTCP(bTCP);
+	pContext->setRetry(bRetry, iRetryDelay, iRetryMaxDelay);
+	pContext->setMaxFrameSize(iMaxFrameSize);
+
+	for(size_t i=0; i<listRTSPUrl.size(); i++){
+		pContext->addStream(listRTSPUrl[i], szUsername, szPassword);
+	}
+	if(szURLFile){
+		addStreamsFromFile(pContext, szURLFile, szUsername, szPassword);
+	}
+
+	int iResult = 0;
+	if(pContext->m_iStreamCount == 0){
+		p_log("[Access::livemedia] No RTSP URL given");
+		iResult = -1;
+	}else{
+		if(pFrameConsumerPool && !pFrameConsumerPool->start()){
+			p_log("[Access::livemedia] Failed to create the consumer threads");
+		}
+		iResult = pContext->start();
+		// The streams released while deleting the shards must not wake the others
+		AdmissionController::getInstance()->shutdown();
+		if(pFrameConsumerPool){
+			pFrameConsumerPool->stop();
+
+			FrameConsumerStats consumerStats;
+			pFrameConsumerPool->getStats(consumerStats);
+			p_log("[Access::livemedia] Frame consumers: %llu frame(s) in %llu batch(es), %llu dropped",
+					(unsigned long long)consumerStats.iConsumedFrames, (unsigned long long)consumerStats.iBatchCount,
+					(unsigned long long)consumerStats.iDroppedFrames);
 		}
-		if(iRetryDelay>0){
-			p_log("[Access::livemedia] Pause for %d seconds before next attempt", iRetryDelay);
-			sleep(iRetryDelay);
+		// The last frames are consumed, wait for their writes
+		if(pConsumerRecordingWriter){
+			pConsumerRecordingWriter->drain();
+			RecordingStats recordingStats;
+			pConsumerRecordingWriter->getStats(recordingStats);
+			p_log("[Access::livemedia] Recorded %llu bytes in %llu writes and %llu files, %llu failed write(s), %llu frame(s) dropped",
+					(unsigned long long)recordingStats.iBytesWritten, (unsigned long long)recordingStats.iWrites,
+					(unsigned long long)recordingStats.iFilesOpened, (unsigned long long)recordingStats.iFailedWrites,
+					(unsigned long long)recordingStats.iDroppedFrames);
+		}
+
+		if(GopCache::getInstance()->isEnabled()){
+			GopCacheStats gopCacheStats;
+			GopCache::getInstance()->getStats(gopCacheStats);
+			p_log("[Access::livemedia] GOP cache: %llu consumer(s) attached, %llu cached frame(s) served, %llu eviction(s)",
+					(unsigned long long)gopCacheStats.iAttaches, (unsigned long long)gopCacheStats.iFramesServed,
+					(unsigned long long)gopCacheStats.iEvictions);
 		}
+
+		FramePoolStats stats;
+		FramePool::getInstance()->getStats(stats);
+		p_log("[Access::livemedia] Frame pool high water: %llu buffer(s), %llu KB in use, %llu KB mapped%s",
+				(unsigned long long)stats.iBuffersInUseHighWater, (unsigned long long)(stats.iBytesInUseHighWater/1024),
+				(unsigned long long)(stats.iBytesMappedHighWater/1024), (stats.bHugePages ? " (huge pages)" : ""));
+	}
+
+	if(pContext){
+		delete pContext;
+		pContext = NULL;
+	}
+	if(pFrameConsumerPool){
+		delete pFrameConsumerPool;
+		pFrameConsumerPool = NULL;
 	}
+	if(pConsumerRecordingWriter){
+		delete pConsumerRecordingWriter;
+		pConsumerRecordingWriter = NULL;
+	}
+
+	SdpCache::getInstance()->close();
+	AsyncLogger::getInstance()->stop();
+
+	return (iResult == 0 ? 0 : 1);
 }
+
+#endif // TEST_LIVE_MEDIA_NO_MAIN
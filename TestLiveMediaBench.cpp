@@ -0,0 +1,1718 @@
+/*
+ * TestLiveMediaBench.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <liveMedia.hh>
+#include <BasicUsageEnvironment.hh>
+
+#include "EpollTaskScheduler.h"
+#include "FramePool.h"
+#include "Recording.h"
+
+/////////////////////////////////
+// Utility function definition
+/////////////////////////////////
+
+static int64_t bench_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_raise_fd_limit()
+{
+	struct rlimit limit;
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+static std::vector<int> bench_parse_int_list(const char* szList)
+{
+	std::vector<int> listValues;
+	const char* szCurrent = szList;
+	while(szCurrent && *szCurrent){
+		listValues.push_back(atoi(szCurrent));
+		szCurrent = strchr(szCurrent, ',');
+		if(szCurrent){
+			szCurrent++;
+		}
+	}
+	return listValues;
+}
+
+/////////////////////////////////
+// Scheduler benchmark
+/////////////////////////////////
+
+// Each round, a few sockets out of all the watched ones receive a packet,
+// which is what happens with many cameras: the cost of the loop depends on
+// the number of sockets watched, not only on the number of ready ones.
+
+struct SchedulerBenchSocket
+{
+	int fd;
+	struct sockaddr_in addr;
+	uint64_t* pReadCount;
+};
+
+struct SchedulerBenchResult
+{
+	bool bSupported;
+	uint64_t iSteps;
+	uint64_t iEvents;
+	int64_t iDurationNs;
+};
+
+static void schedulerBenchReadHandler(void* clientData, int /*mask*/)
+{
+	SchedulerBenchSocket* pSocket = (SchedulerBenchSocket*)clientData;
+	char buf[64];
+	while(recv(pSocket->fd, buf, sizeof(buf), 0) > 0){
+		(*pSocket->pReadCount)++;
+	}
+}
+
+static SchedulerBenchResult runSchedulerBench(BasicTaskScheduler0* pScheduler, bool bSelect, int iSocketCount, int iActiveCount, int iRounds)
+{
+	SchedulerBenchResult result;
+	memset(&result, 0, sizeof(result));
+	result.bSupported = true;
+
+	uint64_t iReadCount = 0;
+	std::vector<SchedulerBenchSocket> listSockets(iSocketCount);
+	int iOpened = 0;
+
+	for(int i=0; i<iSocketCount; i++){
+		SchedulerBenchSocket& sock = listSockets[i];
+		sock.pReadCount = &iReadCount;
+		sock.fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if(sock.fd < 0){
+			fprintf(stderr, "Cannot create socket %d: %s\n", i, strerror(errno));
+			result.bSupported = false;
+			break;
+		}
+		iOpened++;
+		if(bSelect && sock.fd >= FD_SETSIZE){
+			// select() cannot watch this socket at all
+			result.bSupported = false;
+			break;
+		}
+		fcntl(sock.fd, F_SETFL, fcntl(sock.fd, F_GETFL) | O_NONBLOCK);
+		memset(&sock.addr, 0, sizeof(sock.addr));
+		sock.addr.sin_family = AF_INET;
+		sock.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(sock.addr);
+		bind(sock.fd, (struct sockaddr*)&sock.addr, sizeof(sock.addr));
+		getsockname(sock.fd, (struct sockaddr*)&sock.addr, &len);
+	}
+
+	int iSender = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if(result.bSupported){
+		for(int i=0; i<iSocketCount; i++){
+			pScheduler->turnOnBackgroundReadHandling(listSockets[i].fd, schedulerBenchReadHandler, &listSockets[i]);
+		}
+
+		unsigned iSeed = 1;
+		for(int iRound=0; iRound<iRounds; iRound++){
+			uint64_t iExpected = iReadCount;
+			for(int i=0; i<iActiveCount; i++){
+				SchedulerBenchSocket& sock = listSockets[rand_r(&iSeed) % iSocketCount];
+				if(sendto(iSender, "x", 1, 0, (struct sockaddr*)&sock.addr, sizeof(sock.addr)) == 1){
+					iExpected++;
+				}
+			}
+
+			int64_t iStart = bench_now_ns();
+			uint64_t iSteps = 0;
+			while(iReadCount < iExpected && iSteps < (uint64_t)iActiveCount*4+100){
+				pScheduler->SingleStep(1000);
+				iSteps++;
+			}
+			result.iDurationNs += bench_now_ns() - iStart;
+			result.iSteps += iSteps;
+		}
+		result.iEvents = iReadCount;
+
+		for(int i=0; i<iSocketCount; i++){
+			pScheduler->turnOffBackgroundReadHandling(listSockets[i].fd);
+		}
+	}
+
+	if(iSender >= 0){
+		close(iSender);
+	}
+	for(int i=0; i<iOpened; i++){
+		close(listSockets[i].fd);
+	}
+
+	return result;
+}
+
+static int benchScheduler(int argc, char* argv[])
+{
+	std::vector<int> listSocketCounts = bench_parse_int_list("100,1000,5000");
+	int iActiveCount = 16;
+	int iRounds = 2000;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--sockets") == 0 && i+1<argc){
+			listSocketCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--active") == 0 && i+1<argc){
+			iActiveCount = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--rounds") == 0 && i+1<argc){
+			iRounds = atoi(argv[i+1]);
+			i++;
+		}
+	}
+
+	bench_raise_fd_limit();
+
+	printf("%-10s %8s %8s %12s %12s %12s\n", "scheduler", "sockets", "active", "steps/event", "ns/step", "ns/event");
+	for(size_t i=0; i<listSocketCounts.size(); i++){
+		int iSocketCount = listSocketCounts[i];
+
+		for(int iType=0; iType<2; iType++){
+			bool bSelect = (iType == 0);
+			BasicTaskScheduler0* pScheduler = NULL;
+			if(bSelect){
+				pScheduler = BasicTaskScheduler::createNew();
+			}else{
+				pScheduler = EpollTaskScheduler::createNew();
+			}
+			if(!pScheduler){
+				fprintf(stderr, "Cannot create the scheduler\n");
+				return 1;
+			}
+
+			SchedulerBenchResult result = runSchedulerBench(pScheduler, bSelect, iSocketCount, iActiveCount, iRounds);
+			delete pScheduler;
+
+			const char* szName = (bSelect ? "select" : "epoll");
+			if(!result.bSupported || result.iEvents == 0){
+				printf("%-10s %8d %8d %12s %12s %12s\n", szName, iSocketCount, iActiveCount, "n/a", "n/a", "n/a");
+				continue;
+			}
+			printf("%-10s %8d %8d %12.2f %12.0f %12.0f\n", szName, iSocketCount, iActiveCount,
+					(double)result.iSteps / result.iEvents,
+					(double)result.iDurationNs / result.iSteps,
+					(double)result.iDurationNs / result.iEvents);
+		}
+	}
+
+	return 0;
+}
+
+/////////////////////////////////
+// Loopback benchmark
+/////////////////////////////////
+
+// A RTSP server running in a thread of the benchmark serves synthetic streams
+// on localhost, and TestLiveMedia is started as a child process to read them.
+// So the clients run the real code path, and their CPU time is measured alone.
+
+#define BENCH_LOOPBACK_MAX_FRAME_SIZE 2000000
+#define BENCH_LOOPBACK_IDR_RATIO 5 // An IDR frame is this many times bigger than the other frames
+#define BENCH_LOOPBACK_AAC_FREQUENCY 48000
+#define BENCH_LOOPBACK_AAC_SAMPLES 1024 // Per frame
+#define BENCH_LOOPBACK_AAC_BITRATE 128 // kbps
+
+enum BenchSourceType
+{
+	BENCH_SOURCE_H264 = 0,
+	BENCH_SOURCE_H265,
+	BENCH_SOURCE_AAC,
+};
+
+struct BenchStreamConfig
+{
+	bool bH265;
+	bool bAudio;
+	int iBitrateKbps; // Of the video
+	int iFps;
+	int iGop;
+};
+
+// Only carried in the SDP and the stream, never decoded
+static const u_int8_t g_h264SPS[] = { 0x67, 0x42, 0xC0, 0x1F, 0xDA, 0x01, 0x40, 0x16, 0xE8, 0x40 };
+static const u_int8_t g_h264PPS[] = { 0x68, 0xCE, 0x3C, 0x80 };
+static const u_int8_t g_h265VPS[] = { 0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00,
+		0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0x95, 0x98, 0x09 };
+static const u_int8_t g_h265SPS[] = { 0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00,
+		0x00, 0x03, 0x00, 0x5D, 0xA0, 0x02, 0x80, 0x80, 0x2D, 0x16, 0x59, 0x59, 0xA4, 0x93, 0x2B, 0xC0, 0x5A, 0x70, 0x80,
+		0x00, 0x01, 0xF4, 0x80, 0x00, 0x3A, 0x98, 0x04 };
+static const u_int8_t g_h265PPS[] = { 0x44, 0x01, 0xC1, 0x72, 0xB4, 0x62, 0x40 };
+static const char* g_szAACConfig = "1190"; // AAC-LC, 48 kHz, stereo
+
+// Delivers one NAL unit (or one AAC frame) per call, in real time
+class BenchSyntheticSource : public FramedSource
+{
+public:
+	static BenchSyntheticSource* createNew(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config);
+
+protected:
+	BenchSyntheticSource(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config);
+	virtual ~BenchSyntheticSource();
+
+	virtual void doGetNextFrame();
+	virtual void doStopGettingFrames();
+
+private:
+	static void deliverFrameHandler(void* clientData);
+	void deliverFrame();
+	void copyFrame(const u_int8_t* pHeader, unsigned iHeaderSize, unsigned iSize);
+
+private:
+	BenchSourceType m_type;
+	unsigned m_iFrameSize;
+	unsigned m_iIDRFrameSize;
+	int64_t m_iFramePeriodUs;
+	int m_iGop;
+
+	uint64_t m_iFrameIndex;
+	int m_iParameterSetIndex; // Parameter sets already sent before the next IDR frame
+	struct timeval m_tvStart;
+	TaskToken m_deliverTask;
+};
+
+BenchSyntheticSource* BenchSyntheticSource::createNew(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config)
+{
+	return new BenchSyntheticSource(env, type, config);
+}
+
+BenchSyntheticSource::BenchSyntheticSource(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config)
+	: FramedSource(env)
+{
+	m_type = type;
+	m_iGop = (config.iGop > 0 ? config.iGop : 1);
+	if(m_type == BENCH_SOURCE_AAC){
+		m_iFramePeriodUs = (int64_t)BENCH_LOOPBACK_AAC_SAMPLES * 1000000 / BENCH_LOOPBACK_AAC_FREQUENCY;
+		m_iFrameSize = (unsigned)((int64_t)BENCH_LOOPBACK_AAC_BITRATE * 1000 / 8 * m_iFramePeriodUs / 1000000);
+		m_iIDRFrameSize = m_iFrameSize;
+	}else{
+		int iFps = (config.iFps > 0 ? config.iFps : 1);
+		m_iFramePeriodUs = 1000000 / iFps;
+		// Keep the bitrate on a GOP, the IDR frame being bigger
+		int64_t iGopBytes = (int64_t)config.iBitrateKbps * 1000 / 8 * m_iGop / iFps;
+		m_iFrameSize = (unsigned)(iGopBytes / (m_iGop - 1 + BENCH_LOOPBACK_IDR_RATIO));
+		m_iIDRFrameSize = m_iFrameSize * BENCH_LOOPBACK_IDR_RATIO;
+	}
+	m_iFrameSize = std::max(m_iFrameSize, 16U);
+	m_iIDRFrameSize = std::min(std::max(m_iIDRFrameSize, 16U), (unsigned)BENCH_LOOPBACK_MAX_FRAME_SIZE);
+
+	m_iFrameIndex = 0;
+	m_iParameterSetIndex = 0;
+	gettimeofday(&m_tvStart, NULL);
+	m_deliverTask = NULL;
+}
+
+BenchSyntheticSource::~BenchSyntheticSource()
+{
+	envir().taskScheduler().unscheduleDelayedTask(m_deliverTask);
+}
+
+void BenchSyntheticSource::doGetNextFrame()
+{
+	// The frames are sent on time, not as fast as possible
+	int64_t iDueUs = (int64_t)m_tvStart.tv_sec*1000000 + m_tvStart.tv_usec + (int64_t)m_iFrameIndex * m_iFramePeriodUs;
+	struct timeval tvNow;
+	gettimeofday(&tvNow, NULL);
+	int64_t iDelayUs = iDueUs - ((int64_t)tvNow.tv_sec*1000000 + tvNow.tv_usec);
+	m_deliverTask = envir().taskScheduler().scheduleDelayedTask(std::max(iDelayUs, (int64_t)0), deliverFrameHandler, this);
+}
+
+void BenchSyntheticSource::doStopGettingFrames()
+{
+	envir().taskScheduler().unscheduleDelayedTask(m_deliverTask);
+}
+
+void BenchSyntheticSource::deliverFrameHandler(void* clientData)
+{
+	((BenchSyntheticSource*)clientData)->deliverFrame();
+}
+
+void BenchSyntheticSource::copyFrame(const u_int8_t* pHeader, unsigned iHeaderSize, unsigned iSize)
+{
+	// The content does not matter, only the size
+	unsigned iCopySize = std::min(iSize, fMaxSize);
+	unsigned iHeaderCopySize = std::min(iHeaderSize, iCopySize);
+	memcpy(fTo, pHeader, iHeaderCopySize);
+	memset(fTo + iHeaderCopySize, 0xA5, iCopySize - iHeaderCopySize);
+	fFrameSize = iCopySize;
+	fNumTruncatedBytes = iSize - iCopySize;
+}
+
+void BenchSyntheticSource::deliverFrame()
+{
+	m_deliverTask = NULL;
+
+	int64_t iOffsetUs = (int64_t)m_iFrameIndex * m_iFramePeriodUs;
+	fPresentationTime.tv_sec = m_tvStart.tv_sec + (m_tvStart.tv_usec + iOffsetUs) / 1000000;
+	fPresentationTime.tv_usec = (m_tvStart.tv_usec + iOffsetUs) % 1000000;
+	fDurationInMicroseconds = 0;
+
+	if(m_type == BENCH_SOURCE_AAC){
+		copyFrame(NULL, 0, m_iFrameSize);
+		m_iFrameIndex++;
+		FramedSource::afterGetting(this);
+		return;
+	}
+
+	bool bH265 = (m_type == BENCH_SOURCE_H265);
+	if((m_iFrameIndex % m_iGop) == 0){
+		// Parameter sets, then the IDR frame, all with the same presentation time
+		const u_int8_t* listParameterSets[3];
+		unsigned listParameterSetSizes[3];
+		int iParameterSetCount = 0;
+		if(bH265){
+			listParameterSets[iParameterSetCount] = g_h265VPS; listParameterSetSizes[iParameterSetCount++] = sizeof(g_h265VPS);
+			listParameterSets[iParameterSetCount] = g_h265SPS; listParameterSetSizes[iParameterSetCount++] = sizeof(g_h265SPS);
+			listParameterSets[iParameterSetCount] = g_h265PPS; listParameterSetSizes[iParameterSetCount++] = sizeof(g_h265PPS);
+		}else{
+			listParameterSets[iParameterSetCount] = g_h264SPS; listParameterSetSizes[iParameterSetCount++] = sizeof(g_h264SPS);
+			listParameterSets[iParameterSetCount] = g_h264PPS; listParameterSetSizes[iParameterSetCount++] = sizeof(g_h264PPS);
+		}
+		if(m_iParameterSetIndex < iParameterSetCount){
+			unsigned iSize = listParameterSetSizes[m_iParameterSetIndex];
+			copyFrame(listParameterSets[m_iParameterSetIndex], iSize, iSize);
+			m_iParameterSetIndex++;
+			FramedSource::afterGetting(this);
+			return;
+		}
+		m_iParameterSetIndex = 0;
+
+		static const u_int8_t h264IDRHeader[] = { 0x65 };
+		static const u_int8_t h265IDRHeader[] = { 0x26, 0x01 }; // IDR_W_RADL
+		if(bH265){
+			copyFrame(h265IDRHeader, sizeof(h265IDRHeader), m_iIDRFrameSize);
+		}else{
+			copyFrame(h264IDRHeader, sizeof(h264IDRHeader), m_iIDRFrameSize);
+		}
+	}else{
+		static const u_int8_t h264Header[] = { 0x41 };
+		static const u_int8_t h265Header[] = { 0x02, 0x01 }; // TRAIL_R
+		if(bH265){
+			copyFrame(h265Header, sizeof(h265Header), m_iFrameSize);
+		}else{
+			copyFrame(h264Header, sizeof(h264Header), m_iFrameSize);
+		}
+	}
+	m_iFrameIndex++;
+	FramedSource::afterGetting(this);
+}
+
+// The first source is shared by all the clients, so the cost of the server
+// depends on the packets sent, not on the number of sources
+class BenchSyntheticSubsession : public OnDemandServerMediaSubsession
+{
+public:
+	static BenchSyntheticSubsession* createNew(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config);
+
+protected:
+	BenchSyntheticSubsession(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config);
+
+	virtual FramedSource* createNewStreamSource(unsigned clientSessionId, unsigned& estBitrate);
+	virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic, FramedSource* inputSource);
+
+private:
+	BenchSourceType m_type;
+	BenchStreamConfig m_config;
+};
+
+BenchSyntheticSubsession* BenchSyntheticSubsession::createNew(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config)
+{
+	return new BenchSyntheticSubsession(env, type, config);
+}
+
+BenchSyntheticSubsession::BenchSyntheticSubsession(UsageEnvironment& env, BenchSourceType type, const BenchStreamConfig& config)
+	: OnDemandServerMediaSubsession(env, True)
+{
+	m_type = type;
+	m_config = config;
+}
+
+FramedSource* BenchSyntheticSubsession::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate)
+{
+	BenchSyntheticSource* pSource = BenchSyntheticSource::createNew(envir(), m_type, m_config);
+	switch(m_type){
+	case BENCH_SOURCE_H264:
+		estBitrate = m_config.iBitrateKbps;
+		return H264VideoStreamDiscreteFramer::createNew(envir(), pSource);
+	case BENCH_SOURCE_H265:
+		estBitrate = m_config.iBitrateKbps;
+		return H265VideoStreamDiscreteFramer::createNew(envir(), pSource);
+	case BENCH_SOURCE_AAC:
+		estBitrate = BENCH_LOOPBACK_AAC_BITRATE;
+		return pSource;
+	}
+	return NULL;
+}
+
+RTPSink* BenchSyntheticSubsession::createNewRTPSink(Groupsock* rtpGroupsock, unsigned char rtpPayloadTypeIfDynamic, FramedSource* /*inputSource*/)
+{
+	switch(m_type){
+	case BENCH_SOURCE_H264:
+		return H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				g_h264SPS, sizeof(g_h264SPS), g_h264PPS, sizeof(g_h264PPS));
+	case BENCH_SOURCE_H265:
+		return H265VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				g_h265VPS, sizeof(g_h265VPS), g_h265SPS, sizeof(g_h265SPS), g_h265PPS, sizeof(g_h265PPS));
+	case BENCH_SOURCE_AAC:
+		return MPEG4GenericRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				BENCH_LOOPBACK_AAC_FREQUENCY, "audio", "AAC-hbr", g_szAACConfig, 2);
+	}
+	return NULL;
+}
+
+struct LoopbackServer
+{
+	TaskScheduler* pScheduler;
+	UsageEnvironment* pEnv;
+	RTSPServer* pRTSPServer;
+	pthread_t thread;
+	char watchVariable;
+};
+
+static void* loopbackServerThread(void* arg)
+{
+	LoopbackServer* pServer = (LoopbackServer*)arg;
+	pServer->pEnv->taskScheduler().doEventLoop(&pServer->watchVariable);
+	return NULL;
+}
+
+static bool startLoopbackServer(LoopbackServer& server, int iPort, const BenchStreamConfig& config)
+{
+	// Big enough for an IDR frame
+	OutPacketBuffer::maxSize = BENCH_LOOPBACK_MAX_FRAME_SIZE;
+
+	server.pScheduler = BasicTaskScheduler::createNew();
+	server.pEnv = BasicUsageEnvironment::createNew(*server.pScheduler);
+	server.watchVariable = 0;
+	server.pRTSPServer = RTSPServer::createNew(*server.pEnv, Port(iPort));
+	if(!server.pRTSPServer){
+		fprintf(stderr, "Cannot create the RTSP server on port %d: %s\n", iPort, server.pEnv->getResultMsg());
+		server.pEnv->reclaim();
+		delete server.pScheduler;
+		return false;
+	}
+
+	ServerMediaSession* pSession = ServerMediaSession::createNew(*server.pEnv, "synthetic", "synthetic", "Synthetic stream");
+	pSession->addSubsession(BenchSyntheticSubsession::createNew(*server.pEnv, (config.bH265 ? BENCH_SOURCE_H265 : BENCH_SOURCE_H264), config));
+	if(config.bAudio){
+		pSession->addSubsession(BenchSyntheticSubsession::createNew(*server.pEnv, BENCH_SOURCE_AAC, config));
+	}
+	server.pRTSPServer->addServerMediaSession(pSession);
+
+	// From now on, the live555 objects are used by the server thread only
+	if(pthread_create(&server.thread, NULL, loopbackServerThread, &server) != 0){
+		fprintf(stderr, "Cannot create the server thread\n");
+		Medium::close(server.pRTSPServer);
+		server.pEnv->reclaim();
+		delete server.pScheduler;
+		return false;
+	}
+	return true;
+}
+
+static void stopLoopbackServer(LoopbackServer& server)
+{
+	server.watchVariable = 1;
+	pthread_join(server.thread, NULL);
+	Medium::close(server.pRTSPServer);
+	server.pRTSPServer = NULL;
+	server.pEnv->reclaim();
+	server.pEnv = NULL;
+	delete server.pScheduler;
+	server.pScheduler = NULL;
+}
+
+static int64_t bench_thread_cpu_ns(pthread_t thread)
+{
+	clockid_t clockId;
+	struct timespec ts;
+	if(pthread_getcpuclockid(thread, &clockId) != 0 || clock_gettime(clockId, &ts) != 0){
+		return 0;
+	}
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t bench_process_cpu_ns(pid_t pid)
+{
+	// User and system times are the 14th and 15th fields, after the command name
+	char szPath[64];
+	char szStat[1024];
+	snprintf(szPath, sizeof(szPath), "/proc/%d/stat", (int)pid);
+	FILE* pFile = fopen(szPath, "r");
+	if(!pFile){
+		return 0;
+	}
+	size_t iLength = fread(szStat, 1, sizeof(szStat)-1, pFile);
+	fclose(pFile);
+	szStat[iLength] = '\0';
+
+	unsigned long long iUserTicks = 0;
+	unsigned long long iSystemTicks = 0;
+	const char* szFields = strrchr(szStat, ')');
+	if(!szFields || sscanf(szFields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &iUserTicks, &iSystemTicks) != 2){
+		return 0;
+	}
+	return (int64_t)(iUserTicks + iSystemTicks) * 1000000000 / sysconf(_SC_CLK_TCK);
+}
+
+static bool bench_http_get(int iPort, const char* szPath, std::string& szBody)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(fd < 0){
+		return false;
+	}
+	struct timeval tvTimeout;
+	tvTimeout.tv_sec = 5;
+	tvTimeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tvTimeout, sizeof(tvTimeout));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(iPort);
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+		close(fd);
+		return false;
+	}
+
+	char szRequest[256];
+	int iRequestLength = snprintf(szRequest, sizeof(szRequest), "GET %s HTTP/1.0\r\n\r\n", szPath);
+	if(send(fd, szRequest, iRequestLength, 0) != iRequestLength){
+		close(fd);
+		return false;
+	}
+
+	// The server closes the connection after the response
+	std::string szResponse;
+	char buf[16384];
+	ssize_t iRead;
+	while((iRead = recv(fd, buf, sizeof(buf), 0)) > 0){
+		szResponse.append(buf, iRead);
+	}
+	close(fd);
+
+	size_t iBodyPos = szResponse.find("\r\n\r\n");
+	if(szResponse.compare(0, 12, "HTTP/1.1 200") != 0 || iBodyPos == std::string::npos){
+		return false;
+	}
+	szBody = szResponse.substr(iBodyPos + 4);
+	return true;
+}
+
+struct LoopbackSample
+{
+	int64_t iTimeNs;
+	int64_t iClientCpuNs;
+	int64_t iServerCpuNs;
+	uint64_t iBytes;
+	uint64_t iFrames;
+	uint64_t iPacketsReceived;
+	uint64_t iPacketsLost;
+	int iPlayingStreams;
+	std::vector<double> listFirstFrameMs;
+};
+
+static bool sampleLoopback(pid_t pid, const LoopbackServer& server, int iMetricsPort, LoopbackSample& sample)
+{
+	sample.iTimeNs = bench_now_ns();
+	sample.iClientCpuNs = bench_process_cpu_ns(pid);
+	sample.iServerCpuNs = bench_thread_cpu_ns(server.thread);
+	sample.iBytes = 0;
+	sample.iFrames = 0;
+	sample.iPacketsReceived = 0;
+	sample.iPacketsLost = 0;
+	sample.iPlayingStreams = 0;
+	sample.listFirstFrameMs.clear();
+
+	std::string szMetrics;
+	if(!bench_http_get(iMetricsPort, "/metrics", szMetrics)){
+		return false;
+	}
+
+	size_t iPos = 0;
+	while(iPos < szMetrics.size()){
+		size_t iEnd = szMetrics.find('\n', iPos);
+		if(iEnd == std::string::npos){
+			iEnd = szMetrics.size();
+		}
+		std::string szLine = szMetrics.substr(iPos, iEnd - iPos);
+		iPos = iEnd + 1;
+
+		size_t iNameEnd = szLine.find_first_of("{ ");
+		size_t iValuePos = szLine.rfind(' ');
+		if(szLine.empty() || szLine[0] == '#' || iNameEnd == std::string::npos || iValuePos == std::string::npos){
+			continue;
+		}
+		std::string szName = szLine.substr(0, iNameEnd);
+		double dValue = atof(szLine.c_str() + iValuePos + 1);
+
+		if(szName == "livemedia_subsession_bytes_total"){
+			sample.iBytes += (uint64_t)dValue;
+		}else if(szName == "livemedia_subsession_frames_total"){
+			sample.iFrames += (uint64_t)dValue;
+		}else if(szName == "livemedia_subsession_packets_received_total"){
+			sample.iPacketsReceived += (uint64_t)dValue;
+		}else if(szName == "livemedia_subsession_packets_lost_total"){
+			sample.iPacketsLost += (uint64_t)dValue;
+		}else if(szName == "livemedia_stream_info" && szLine.find("state=\"playing\"") != std::string::npos){
+			sample.iPlayingStreams++;
+		}else if(szName == "livemedia_stream_handshake_phase_seconds" && szLine.find("phase=\"first_frame\"") != std::string::npos){
+			sample.listFirstFrameMs.push_back(dValue * 1000);
+		}
+	}
+	return true;
+}
+
+struct LoopbackOptions
+{
+	BenchStreamConfig config;
+	int iDurationSec;
+	bool bTCP;
+	int iThreadCount;
+	const char* szScheduler;
+	const char* szClient;
+	const char* szClientLog;
+	int iRTSPPort;
+	int iMetricsPort;
+	double dMaxDropPercent;
+	bool bBatchReceive; // --recvmmsg
+	bool bStreamReceive; // --tcp-batch
+};
+
+struct LoopbackResult
+{
+	bool bValid;
+	int iPlayingStreams;
+	double dMbps;
+	double dPacketsPerSec;
+	double dClientCores;
+	double dServerCores;
+	double dFirstFrameP50Ms;
+	double dFirstFrameMaxMs;
+	double dDropPercent; // Frames not received
+	double dLostPercent; // RTP packets
+};
+
+static void bench_sleep_until(int64_t iTimeNs)
+{
+	int64_t iDelayNs = iTimeNs - bench_now_ns();
+	if(iDelayNs > 0){
+		struct timespec ts;
+		ts.tv_sec = iDelayNs / 1000000000;
+		ts.tv_nsec = iDelayNs % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static pid_t bench_start_client(const std::vector<const char*>& listArgs, const char* szLog)
+{
+	// The list ends with NULL
+	pid_t pid = fork();
+	if(pid == 0){
+		int fdLog = open(szLog ? szLog : "/dev/null", O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if(fdLog >= 0){
+			dup2(fdLog, STDOUT_FILENO);
+			dup2(fdLog, STDERR_FILENO);
+			close(fdLog);
+		}
+		execv(listArgs[0], (char* const*)&listArgs[0]);
+		_exit(127);
+	}
+	if(pid < 0){
+		fprintf(stderr, "Cannot start %s: %s\n", listArgs[0], strerror(errno));
+	}
+	return pid;
+}
+
+static void bench_wait_client(pid_t pid)
+{
+	// The client stops by itself after the duration
+	int iStatus = 0;
+	int64_t iDeadlineNs = bench_now_ns() + 15 * (int64_t)1000000000;
+	while(waitpid(pid, &iStatus, WNOHANG) == 0){
+		if(bench_now_ns() > iDeadlineNs){
+			fprintf(stderr, "The client does not stop, killing it\n");
+			kill(pid, SIGKILL);
+			waitpid(pid, &iStatus, 0);
+			break;
+		}
+		usleep(100000);
+	}
+}
+
+static double bench_expected_frames(const BenchStreamConfig& config, double dWindowSec, int iStreamCount)
+{
+	// Each NAL unit is a frame for the client, the parameter sets included
+	double dVideoFps = (double)config.iFps * (1.0 + (config.bH265 ? 3.0 : 2.0) / std::max(config.iGop, 1));
+	double dAudioFps = (config.bAudio ? (double)BENCH_LOOPBACK_AAC_FREQUENCY / BENCH_LOOPBACK_AAC_SAMPLES : 0);
+	return (dVideoFps + dAudioFps) * dWindowSec * iStreamCount;
+}
+
+static LoopbackResult runLoopbackBench(const LoopbackOptions& options, const LoopbackServer& server, int iStreamCount)
+{
+	LoopbackResult result;
+	memset(&result, 0, sizeof(result));
+
+	char szURLFile[] = "/tmp/TestLiveMediaBench-XXXXXX";
+	int fdURLFile = mkstemp(szURLFile);
+	if(fdURLFile < 0){
+		fprintf(stderr, "Cannot create the URL file: %s\n", strerror(errno));
+		return result;
+	}
+	FILE* pURLFile = fdopen(fdURLFile, "w");
+	for(int i=0; i<iStreamCount; i++){
+		fprintf(pURLFile, "rtsp://127.0.0.1:%d/synthetic\n", options.iRTSPPort);
+	}
+	fclose(pURLFile);
+
+	char szDuration[16];
+	char szMetricsPort[16];
+	char szThreadCount[16];
+	snprintf(szDuration, sizeof(szDuration), "%d", options.iDurationSec);
+	snprintf(szMetricsPort, sizeof(szMetricsPort), "%d", options.iMetricsPort);
+	snprintf(szThreadCount, sizeof(szThreadCount), "%d", options.iThreadCount);
+	std::vector<const char*> listArgs;
+	listArgs.push_back(options.szClient);
+	listArgs.push_back("--url-file");
+	listArgs.push_back(szURLFile);
+	listArgs.push_back("--duration");
+	listArgs.push_back(szDuration);
+	listArgs.push_back("--metrics-port");
+	listArgs.push_back(szMetricsPort);
+	listArgs.push_back("--threads");
+	listArgs.push_back(szThreadCount);
+	listArgs.push_back("--scheduler");
+	listArgs.push_back(options.szScheduler);
+	if(options.bTCP){
+		listArgs.push_back("--tcp");
+	}
+	if(options.bBatchReceive){
+		listArgs.push_back("--recvmmsg");
+	}
+	if(options.bStreamReceive){
+		listArgs.push_back("--tcp-batch");
+	}
+	listArgs.push_back(NULL);
+
+	int64_t iStartNs = bench_now_ns();
+	pid_t pid = bench_start_client(listArgs, options.szClientLog);
+	if(pid < 0){
+		unlink(szURLFile);
+		return result;
+	}
+
+	// The rates are measured once the streams are started, until just before the end
+	int iWarmupSec = std::min(5, options.iDurationSec / 3);
+	LoopbackSample sampleStart;
+	LoopbackSample sampleEnd;
+	bench_sleep_until(iStartNs + (int64_t)iWarmupSec * 1000000000);
+	bool bValid = sampleLoopback(pid, server, options.iMetricsPort, sampleStart);
+	bench_sleep_until(iStartNs + (int64_t)(options.iDurationSec - 1) * 1000000000);
+	bValid = sampleLoopback(pid, server, options.iMetricsPort, sampleEnd) && bValid;
+
+	bench_wait_client(pid);
+	unlink(szURLFile);
+
+	double dWindowSec = (double)(sampleEnd.iTimeNs - sampleStart.iTimeNs) / 1000000000.0;
+	if(!bValid || dWindowSec <= 0){
+		fprintf(stderr, "Cannot read the metrics of the client on port %d\n", options.iMetricsPort);
+		return result;
+	}
+
+	result.bValid = true;
+	result.iPlayingStreams = sampleEnd.iPlayingStreams;
+	result.dMbps = (double)(sampleEnd.iBytes - sampleStart.iBytes) * 8 / dWindowSec / 1000000.0;
+	result.dPacketsPerSec = (double)(sampleEnd.iPacketsReceived - std::min(sampleStart.iPacketsReceived, sampleEnd.iPacketsReceived)) / dWindowSec;
+	result.dClientCores = (double)(sampleEnd.iClientCpuNs - sampleStart.iClientCpuNs) / 1000000000.0 / dWindowSec;
+	result.dServerCores = (double)(sampleEnd.iServerCpuNs - sampleStart.iServerCpuNs) / 1000000000.0 / dWindowSec;
+
+	std::vector<double>& listFirstFrameMs = sampleEnd.listFirstFrameMs;
+	if(!listFirstFrameMs.empty()){
+		std::sort(listFirstFrameMs.begin(), listFirstFrameMs.end());
+		result.dFirstFrameP50Ms = listFirstFrameMs[listFirstFrameMs.size() / 2];
+		result.dFirstFrameMaxMs = listFirstFrameMs.back();
+	}
+
+	double dExpectedFrames = bench_expected_frames(options.config, dWindowSec, iStreamCount);
+	double dReceivedFrames = (double)(sampleEnd.iFrames - sampleStart.iFrames);
+	result.dDropPercent = std::max(0.0, (1.0 - dReceivedFrames / dExpectedFrames) * 100);
+
+	uint64_t iReceived = sampleEnd.iPacketsReceived - std::min(sampleStart.iPacketsReceived, sampleEnd.iPacketsReceived);
+	uint64_t iLost = sampleEnd.iPacketsLost - std::min(sampleStart.iPacketsLost, sampleEnd.iPacketsLost);
+	if(iReceived + iLost > 0){
+		result.dLostPercent = (double)iLost * 100 / (iReceived + iLost);
+	}
+
+	return result;
+}
+
+static int benchLoopback(int argc, char* argv[])
+{
+	std::vector<int> listStreamCounts = bench_parse_int_list("10,50,100");
+	LoopbackOptions options;
+	options.config.bH265 = false;
+	options.config.bAudio = false;
+	options.config.iBitrateKbps = 2000;
+	options.config.iFps = 25;
+	options.config.iGop = 50;
+	options.iDurationSec = 20;
+	options.bTCP = false;
+	options.iThreadCount = 1;
+	options.szScheduler = "epoll";
+	options.szClient = "./TestLiveMedia";
+	options.szClientLog = NULL;
+	options.iRTSPPort = 8554;
+	options.iMetricsPort = 9464;
+	options.dMaxDropPercent = 0.5;
+	options.bBatchReceive = false;
+	options.bStreamReceive = false;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--streams") == 0 && i+1<argc){
+			listStreamCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--codec") == 0 && i+1<argc){
+			// h264, h265, h264+aac or h265+aac
+			options.config.bH265 = (strncmp(argv[i+1], "h265", 4) == 0);
+			options.config.bAudio = (strstr(argv[i+1], "aac") != NULL);
+			i++;
+		}else if(strcmp(argv[i], "--bitrate") == 0 && i+1<argc){
+			options.config.iBitrateKbps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--fps") == 0 && i+1<argc){
+			options.config.iFps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--gop") == 0 && i+1<argc){
+			options.config.iGop = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			options.iDurationSec = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--tcp") == 0){
+			options.bTCP = true;
+		}else if(strcmp(argv[i], "--threads") == 0 && i+1<argc){
+			options.iThreadCount = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--scheduler") == 0 && i+1<argc){
+			options.szScheduler = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--client") == 0 && i+1<argc){
+			options.szClient = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--client-log") == 0 && i+1<argc){
+			options.szClientLog = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--port") == 0 && i+1<argc){
+			options.iRTSPPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--metrics-port") == 0 && i+1<argc){
+			options.iMetricsPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--max-drop") == 0 && i+1<argc){
+			options.dMaxDropPercent = atof(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--recvmmsg") == 0){
+			options.bBatchReceive = true;
+		}else if(strcmp(argv[i], "--tcp-batch") == 0){
+			options.bTCP = true;
+			options.bStreamReceive = true;
+		}
+	}
+	if(options.iDurationSec < 5){
+		options.iDurationSec = 5;
+	}
+	if(options.config.iFps < 1){
+		options.config.iFps = 1;
+	}
+
+	bench_raise_fd_limit();
+	// A client closing its TCP connection must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	LoopbackServer server;
+	if(!startLoopbackServer(server, options.iRTSPPort, options.config)){
+		return 1;
+	}
+
+	printf("%s%s, %d kbps, %d fps, GOP %d, %s%s, %d client thread(s), %s scheduler\n",
+			(options.config.bH265 ? "H265" : "H264"), (options.config.bAudio ? " + AAC" : ""),
+			options.config.iBitrateKbps, options.config.iFps, options.config.iGop, (options.bTCP ? "TCP" : "UDP"),
+			(options.bBatchReceive ? " with recvmmsg" : (options.bStreamReceive ? " read by chunks" : "")), options.iThreadCount, options.szScheduler);
+	printf("%8s %8s %9s %10s %12s %10s %10s %10s %10s %8s %8s\n", "streams", "playing", "Mbps", "cpu cores",
+			"streams/core", "cpu%/Mbps", "server cpu", "ttff p50", "ttff max", "drop%", "lost%");
+
+	int iSustainableStreams = 0;
+	double dSustainableStreamsPerCore = 0;
+	for(size_t i=0; i<listStreamCounts.size(); i++){
+		int iStreamCount = listStreamCounts[i];
+		LoopbackResult result = runLoopbackBench(options, server, iStreamCount);
+		if(!result.bValid){
+			printf("%8d %8s\n", iStreamCount, "n/a");
+			continue;
+		}
+
+		double dStreamsPerCore = (result.dClientCores > 0 ? iStreamCount / result.dClientCores : 0);
+		double dCpuPerMbps = (result.dMbps > 0 ? result.dClientCores * 100 / result.dMbps : 0);
+		printf("%8d %8d %9.1f %10.3f %12.1f %10.3f %10.3f %8.0fms %8.0fms %8.2f %8.2f\n", iStreamCount, result.iPlayingStreams,
+				result.dMbps, result.dClientCores, dStreamsPerCore, dCpuPerMbps, result.dServerCores,
+				result.dFirstFrameP50Ms, result.dFirstFrameMaxMs, result.dDropPercent, result.dLostPercent);
+
+		// Every stream must play without losing frames
+		if(result.iPlayingStreams == iStreamCount && result.dDropPercent <= options.dMaxDropPercent && iStreamCount > iSustainableStreams){
+			iSustainableStreams = iStreamCount;
+			dSustainableStreamsPerCore = dStreamsPerCore;
+		}
+	}
+
+	stopLoopbackServer(server);
+
+	if(iSustainableStreams > 0){
+		printf("Max sustainable: %d streams, %.1f streams per core\n", iSustainableStreams, dSustainableStreamsPerCore);
+	}else{
+		printf("Max sustainable: none\n");
+	}
+	return 0;
+}
+
+/////////////////////////////////
+// Batched receive benchmark
+/////////////////////////////////
+
+// The loopback benchmark run twice for each number of streams, with the RTP
+// packets read one by one by live555 then by recvmmsg(), both with epoll.
+// The bitrate is high by default, so the cost of the packets dominates.
+
+static int benchRecvmmsg(int argc, char* argv[])
+{
+	std::vector<int> listStreamCounts = bench_parse_int_list("10,50,100");
+	LoopbackOptions options;
+	options.config.bH265 = false;
+	options.config.bAudio = false;
+	options.config.iBitrateKbps = 16000;
+	options.config.iFps = 25;
+	options.config.iGop = 50;
+	options.iDurationSec = 20;
+	options.bTCP = false;
+	options.iThreadCount = 1;
+	options.szScheduler = "epoll";
+	options.szClient = "./TestLiveMedia";
+	options.szClientLog = NULL;
+	options.iRTSPPort = 8554;
+	options.iMetricsPort = 9464;
+	options.dMaxDropPercent = 0.5;
+	options.bBatchReceive = false;
+	options.bStreamReceive = false;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--streams") == 0 && i+1<argc){
+			listStreamCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--codec") == 0 && i+1<argc){
+			options.config.bH265 = (strncmp(argv[i+1], "h265", 4) == 0);
+			i++;
+		}else if(strcmp(argv[i], "--bitrate") == 0 && i+1<argc){
+			options.config.iBitrateKbps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			options.iDurationSec = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--client") == 0 && i+1<argc){
+			options.szClient = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--client-log") == 0 && i+1<argc){
+			options.szClientLog = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--port") == 0 && i+1<argc){
+			options.iRTSPPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--metrics-port") == 0 && i+1<argc){
+			options.iMetricsPort = atoi(argv[i+1]);
+			i++;
+		}
+	}
+	if(options.iDurationSec < 5){
+		options.iDurationSec = 5;
+	}
+
+	bench_raise_fd_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	LoopbackServer server;
+	if(!startLoopbackServer(server, options.iRTSPPort, options.config)){
+		return 1;
+	}
+
+	printf("%s, %d kbps, %d fps, GOP %d, UDP, epoll scheduler\n", (options.config.bH265 ? "H265" : "H264"),
+			options.config.iBitrateKbps, options.config.iFps, options.config.iGop);
+	printf("%8s %10s %8s %12s %10s %14s %10s %8s\n", "streams", "read", "playing", "packets/s", "cpu cores",
+			"packets/s/core", "server cpu", "drop%");
+
+	for(size_t i=0; i<listStreamCounts.size(); i++){
+		int iStreamCount = listStreamCounts[i];
+		double dPacketsPerCore[2] = { 0, 0 };
+		for(int iPath=0; iPath<2; iPath++){
+			options.bBatchReceive = (iPath == 1);
+			const char* szPath = (options.bBatchReceive ? "recvmmsg" : "recvfrom");
+			LoopbackResult result = runLoopbackBench(options, server, iStreamCount);
+			if(!result.bValid){
+				printf("%8d %10s %8s\n", iStreamCount, szPath, "n/a");
+				continue;
+			}
+			dPacketsPerCore[iPath] = (result.dClientCores > 0 ? result.dPacketsPerSec / result.dClientCores : 0);
+			printf("%8d %10s %8d %12.0f %10.3f %14.0f %10.3f %8.2f\n", iStreamCount, szPath, result.iPlayingStreams,
+					result.dPacketsPerSec, result.dClientCores, dPacketsPerCore[iPath], result.dServerCores, result.dDropPercent);
+		}
+		if(dPacketsPerCore[0] > 0 && dPacketsPerCore[1] > 0){
+			printf("%8d %10s %+.1f%% packets per core\n", iStreamCount, "gain", (dPacketsPerCore[1] / dPacketsPerCore[0] - 1) * 100);
+		}
+	}
+
+	stopLoopbackServer(server);
+	return 0;
+}
+
+// The loopback benchmark run for each number of streams with the RTP over
+// UDP, interleaved in the RTSP connection and read frame by frame, then
+// interleaved and read by chunks, all with epoll. The throughput per core
+// shows the cost of each transport in the client.
+
+static int benchTransport(int argc, char* argv[])
+{
+	std::vector<int> listStreamCounts = bench_parse_int_list("10,50,100");
+	LoopbackOptions options;
+	options.config.bH265 = false;
+	options.config.bAudio = false;
+	options.config.iBitrateKbps = 8000;
+	options.config.iFps = 25;
+	options.config.iGop = 50;
+	options.iDurationSec = 20;
+	options.bTCP = false;
+	options.iThreadCount = 1;
+	options.szScheduler = "epoll";
+	options.szClient = "./TestLiveMedia";
+	options.szClientLog = NULL;
+	options.iRTSPPort = 8554;
+	options.iMetricsPort = 9464;
+	options.dMaxDropPercent = 0.5;
+	options.bBatchReceive = false;
+	options.bStreamReceive = false;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--streams") == 0 && i+1<argc){
+			listStreamCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--codec") == 0 && i+1<argc){
+			options.config.bH265 = (strncmp(argv[i+1], "h265", 4) == 0);
+			i++;
+		}else if(strcmp(argv[i], "--bitrate") == 0 && i+1<argc){
+			options.config.iBitrateKbps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			options.iDurationSec = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--client") == 0 && i+1<argc){
+			options.szClient = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--client-log") == 0 && i+1<argc){
+			options.szClientLog = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--port") == 0 && i+1<argc){
+			options.iRTSPPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--metrics-port") == 0 && i+1<argc){
+			options.iMetricsPort = atoi(argv[i+1]);
+			i++;
+		}
+	}
+	if(options.iDurationSec < 5){
+		options.iDurationSec = 5;
+	}
+
+	bench_raise_fd_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	LoopbackServer server;
+	if(!startLoopbackServer(server, options.iRTSPPort, options.config)){
+		return 1;
+	}
+
+	printf("%s, %d kbps, %d fps, GOP %d, epoll scheduler\n", (options.config.bH265 ? "H265" : "H264"),
+			options.config.iBitrateKbps, options.config.iFps, options.config.iGop);
+	printf("%8s %10s %8s %9s %10s %10s %10s %8s\n", "streams", "transport", "playing", "Mbps", "cpu cores",
+			"Mbps/core", "server cpu", "drop%");
+
+	const char* listTransports[3] = { "udp", "tcp", "tcp-batch" };
+	for(size_t i=0; i<listStreamCounts.size(); i++){
+		int iStreamCount = listStreamCounts[i];
+		double dMbpsPerCore[3] = { 0, 0, 0 };
+		for(int iTransport=0; iTransport<3; iTransport++){
+			options.bTCP = (iTransport > 0);
+			options.bStreamReceive = (iTransport == 2);
+			LoopbackResult result = runLoopbackBench(options, server, iStreamCount);
+			if(!result.bValid){
+				printf("%8d %10s %8s\n", iStreamCount, listTransports[iTransport], "n/a");
+				continue;
+			}
+			dMbpsPerCore[iTransport] = (result.dClientCores > 0 ? result.dMbps / result.dClientCores : 0);
+			printf("%8d %10s %8d %9.1f %10.3f %10.1f %10.3f %8.2f\n", iStreamCount, listTransports[iTransport], result.iPlayingStreams,
+					result.dMbps, result.dClientCores, dMbpsPerCore[iTransport], result.dServerCores, result.dDropPercent);
+		}
+		if(dMbpsPerCore[0] > 0 && dMbpsPerCore[1] > 0 && dMbpsPerCore[2] > 0){
+			printf("%8d %10s tcp %+.1f%%, tcp-batch %+.1f%% Mbps per core against udp\n", iStreamCount, "gain",
+					(dMbpsPerCore[1] / dMbpsPerCore[0] - 1) * 100, (dMbpsPerCore[2] / dMbpsPerCore[0] - 1) * 100);
+		}
+	}
+
+	stopLoopbackServer(server);
+	return 0;
+}
+
+/////////////////////////////////
+// Restream benchmark
+/////////////////////////////////
+
+// A TestLiveMedia restreamer plays one stream of the local server and
+// restreams it, while another TestLiveMedia plays it from the restreamer with
+// 1, 10, 100 clients. Only one session is opened to the server whatever the
+// number of clients: the CPU of the restreamer is the cost of the fan-out.
+
+struct RestreamOptions
+{
+	BenchStreamConfig config;
+	int iDurationSec;
+	const char* szClient;
+	const char* szClientLog;
+	int iRTSPPort;
+	int iRestreamPort;
+	int iMetricsPort; // Of the clients, the restreamer uses the next one
+	double dMaxDropPercent;
+};
+
+struct RestreamResult
+{
+	bool bValid;
+	int iPlayingStreams;
+	double dMbps; // Received by the clients
+	double dRestreamerCores;
+	double dClientCores;
+	double dFirstFrameP50Ms;
+	double dFirstFrameMaxMs;
+	double dDropPercent;
+};
+
+static RestreamResult runRestreamBench(const RestreamOptions& options, const LoopbackServer& server, int iClientCount)
+{
+	RestreamResult result;
+	memset(&result, 0, sizeof(result));
+
+	// The restreamer runs until the clients are done
+	int iWarmupSec = std::min(5, options.iDurationSec / 3);
+	char szUpstreamURL[64];
+	char szRestreamPort[16];
+	char szRestreamerMetricsPort[16];
+	char szRestreamerDuration[16];
+	snprintf(szUpstreamURL, sizeof(szUpstreamURL), "rtsp://127.0.0.1:%d/synthetic", options.iRTSPPort);
+	snprintf(szRestreamPort, sizeof(szRestreamPort), "%d", options.iRestreamPort);
+	snprintf(szRestreamerMetricsPort, sizeof(szRestreamerMetricsPort), "%d", options.iMetricsPort + 1);
+	snprintf(szRestreamerDuration, sizeof(szRestreamerDuration), "%d", options.iDurationSec + 2 * iWarmupSec);
+	std::vector<const char*> listRestreamerArgs;
+	listRestreamerArgs.push_back(options.szClient);
+	listRestreamerArgs.push_back(szUpstreamURL);
+	listRestreamerArgs.push_back("--restream-port");
+	listRestreamerArgs.push_back(szRestreamPort);
+	listRestreamerArgs.push_back("--metrics-port");
+	listRestreamerArgs.push_back(szRestreamerMetricsPort);
+	listRestreamerArgs.push_back("--duration");
+	listRestreamerArgs.push_back(szRestreamerDuration);
+	listRestreamerArgs.push_back("--scheduler");
+	listRestreamerArgs.push_back("epoll");
+	listRestreamerArgs.push_back(NULL);
+
+	pid_t pidRestreamer = bench_start_client(listRestreamerArgs, options.szClientLog);
+	if(pidRestreamer < 0){
+		return result;
+	}
+	// The stream must be playing, so the track is published and the GOP is cached
+	bench_sleep_until(bench_now_ns() + (int64_t)iWarmupSec * 1000000000);
+
+	char szURLFile[] = "/tmp/TestLiveMediaBench-XXXXXX";
+	int fdURLFile = mkstemp(szURLFile);
+	if(fdURLFile < 0){
+		fprintf(stderr, "Cannot create the URL file: %s\n", strerror(errno));
+		kill(pidRestreamer, SIGKILL);
+		waitpid(pidRestreamer, NULL, 0);
+		return result;
+	}
+	FILE* pURLFile = fdopen(fdURLFile, "w");
+	for(int i=0; i<iClientCount; i++){
+		fprintf(pURLFile, "rtsp://127.0.0.1:%d/stream1\n", options.iRestreamPort);
+	}
+	fclose(pURLFile);
+
+	char szDuration[16];
+	char szMetricsPort[16];
+	snprintf(szDuration, sizeof(szDuration), "%d", options.iDurationSec);
+	snprintf(szMetricsPort, sizeof(szMetricsPort), "%d", options.iMetricsPort);
+	std::vector<const char*> listArgs;
+	listArgs.push_back(options.szClient);
+	listArgs.push_back("--url-file");
+	listArgs.push_back(szURLFile);
+	listArgs.push_back("--duration");
+	listArgs.push_back(szDuration);
+	listArgs.push_back("--metrics-port");
+	listArgs.push_back(szMetricsPort);
+	listArgs.push_back("--scheduler");
+	listArgs.push_back("epoll");
+	listArgs.push_back(NULL);
+
+	int64_t iStartNs = bench_now_ns();
+	pid_t pid = bench_start_client(listArgs, options.szClientLog);
+	if(pid < 0){
+		unlink(szURLFile);
+		kill(pidRestreamer, SIGKILL);
+		waitpid(pidRestreamer, NULL, 0);
+		return result;
+	}
+
+	LoopbackSample sampleStart;
+	LoopbackSample sampleEnd;
+	bench_sleep_until(iStartNs + (int64_t)iWarmupSec * 1000000000);
+	int64_t iRestreamerStartCpuNs = bench_process_cpu_ns(pidRestreamer);
+	bool bValid = sampleLoopback(pid, server, options.iMetricsPort, sampleStart);
+	bench_sleep_until(iStartNs + (int64_t)(options.iDurationSec - 1) * 1000000000);
+	int64_t iRestreamerEndCpuNs = bench_process_cpu_ns(pidRestreamer);
+	bValid = sampleLoopback(pid, server, options.iMetricsPort, sampleEnd) && bValid;
+
+	bench_wait_client(pid);
+	bench_wait_client(pidRestreamer);
+	unlink(szURLFile);
+
+	double dWindowSec = (double)(sampleEnd.iTimeNs - sampleStart.iTimeNs) / 1000000000.0;
+	if(!bValid || dWindowSec <= 0){
+		fprintf(stderr, "Cannot read the metrics of the clients on port %d\n", options.iMetricsPort);
+		return result;
+	}
+
+	result.bValid = true;
+	result.iPlayingStreams = sampleEnd.iPlayingStreams;
+	result.dMbps = (double)(sampleEnd.iBytes - sampleStart.iBytes) * 8 / dWindowSec / 1000000.0;
+	result.dRestreamerCores = (double)(iRestreamerEndCpuNs - iRestreamerStartCpuNs) / 1000000000.0 / dWindowSec;
+	result.dClientCores = (double)(sampleEnd.iClientCpuNs - sampleStart.iClientCpuNs) / 1000000000.0 / dWindowSec;
+
+	std::vector<double>& listFirstFrameMs = sampleEnd.listFirstFrameMs;
+	if(!listFirstFrameMs.empty()){
+		std::sort(listFirstFrameMs.begin(), listFirstFrameMs.end());
+		result.dFirstFrameP50Ms = listFirstFrameMs[listFirstFrameMs.size() / 2];
+		result.dFirstFrameMaxMs = listFirstFrameMs.back();
+	}
+
+	double dExpectedFrames = bench_expected_frames(options.config, dWindowSec, iClientCount);
+	double dReceivedFrames = (double)(sampleEnd.iFrames - sampleStart.iFrames);
+	result.dDropPercent = std::max(0.0, (1.0 - dReceivedFrames / dExpectedFrames) * 100);
+
+	return result;
+}
+
+static int benchRestream(int argc, char* argv[])
+{
+	std::vector<int> listClientCounts = bench_parse_int_list("1,10,100");
+	RestreamOptions options;
+	options.config.bH265 = false;
+	options.config.bAudio = false;
+	options.config.iBitrateKbps = 4000;
+	options.config.iFps = 25;
+	options.config.iGop = 50;
+	options.iDurationSec = 20;
+	options.szClient = "./TestLiveMedia";
+	options.szClientLog = NULL;
+	options.iRTSPPort = 8554;
+	options.iRestreamPort = 8564;
+	options.iMetricsPort = 9464;
+	options.dMaxDropPercent = 0.5;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--clients") == 0 && i+1<argc){
+			listClientCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--codec") == 0 && i+1<argc){
+			// Only the video is restreamed
+			options.config.bH265 = (strncmp(argv[i+1], "h265", 4) == 0);
+			i++;
+		}else if(strcmp(argv[i], "--bitrate") == 0 && i+1<argc){
+			options.config.iBitrateKbps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--fps") == 0 && i+1<argc){
+			options.config.iFps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--gop") == 0 && i+1<argc){
+			options.config.iGop = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			options.iDurationSec = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--client") == 0 && i+1<argc){
+			options.szClient = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--client-log") == 0 && i+1<argc){
+			options.szClientLog = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--port") == 0 && i+1<argc){
+			options.iRTSPPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--restream-port") == 0 && i+1<argc){
+			options.iRestreamPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--metrics-port") == 0 && i+1<argc){
+			options.iMetricsPort = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--max-drop") == 0 && i+1<argc){
+			options.dMaxDropPercent = atof(argv[i+1]);
+			i++;
+		}
+	}
+	if(options.iDurationSec < 5){
+		options.iDurationSec = 5;
+	}
+	if(options.config.iFps < 1){
+		options.config.iFps = 1;
+	}
+
+	bench_raise_fd_limit();
+	signal(SIGPIPE, SIG_IGN);
+
+	LoopbackServer server;
+	if(!startLoopbackServer(server, options.iRTSPPort, options.config)){
+		return 1;
+	}
+
+	printf("%s, %d kbps, %d fps, GOP %d, restreamed from one upstream session\n",
+			(options.config.bH265 ? "H265" : "H264"), options.config.iBitrateKbps, options.config.iFps, options.config.iGop);
+	printf("%8s %8s %9s %15s %10s %10s %10s %10s %8s\n", "clients", "playing", "Mbps", "restreamer cpu",
+			"Mbps/core", "client cpu", "ttff p50", "ttff max", "drop%");
+
+	int iSustainableClients = 0;
+	double dSustainableMbpsPerCore = 0;
+	for(size_t i=0; i<listClientCounts.size(); i++){
+		int iClientCount = listClientCounts[i];
+		RestreamResult result = runRestreamBench(options, server, iClientCount);
+		if(!result.bValid){
+			printf("%8d %8s\n", iClientCount, "n/a");
+			continue;
+		}
+
+		double dMbpsPerCore = (result.dRestreamerCores > 0 ? result.dMbps / result.dRestreamerCores : 0);
+		printf("%8d %8d %9.1f %15.3f %10.1f %10.3f %8.0fms %8.0fms %8.2f\n", iClientCount, result.iPlayingStreams,
+				result.dMbps, result.dRestreamerCores, dMbpsPerCore, result.dClientCores,
+				result.dFirstFrameP50Ms, result.dFirstFrameMaxMs, result.dDropPercent);
+
+		if(result.iPlayingStreams == iClientCount && result.dDropPercent <= options.dMaxDropPercent && iClientCount > iSustainableClients){
+			iSustainableClients = iClientCount;
+			dSustainableMbpsPerCore = dMbpsPerCore;
+		}
+	}
+
+	stopLoopbackServer(server);
+
+	if(iSustainableClients > 0){
+		printf("Max sustainable: %d clients, %.1f Mbps per restreamer core\n", iSustainableClients, dSustainableMbpsPerCore);
+	}else{
+		printf("Max sustainable: none\n");
+	}
+	return 0;
+}
+
+/////////////////////////////////
+// Recording benchmark
+/////////////////////////////////
+
+// The event loop appends the frames of all the streams at the given rate, or
+// as fast as it can with --fps 0, like a shard receiving from many cameras, while the writes are done by
+// io_uring or by the writer thread. The time of the appends is the time
+// taken from the event loop, the throughput counts the bytes on the disk.
+
+struct RecordBenchContext
+{
+	std::vector<RecordingTrack*> listTracks;
+	std::vector<uint8_t> frame;
+	int iGop;
+	int64_t iPeriodNs; // Between the frames of a stream, 0 to write as fast as possible
+	int64_t iNextRoundNs;
+	int64_t iFrameIndex;
+	int64_t iEndNs;
+	int64_t iAppendNs;
+	int64_t iMaxAppendNs;
+	uint64_t iAppends;
+	TaskScheduler* pScheduler;
+	char watchVariable;
+};
+
+struct RecordBenchResult
+{
+	bool bUring;
+	double dDurationSec;
+	RecordingStats stats;
+	uint64_t iAppends;
+	int64_t iAppendNs;
+	int64_t iMaxAppendNs;
+};
+
+static void recordBenchRoundHandler(void* clientData)
+{
+	RecordBenchContext* pContext = (RecordBenchContext*)clientData;
+
+	// One frame per stream, then back to the loop for the completions
+	bool bSyncPoint = (pContext->iFrameIndex % pContext->iGop == 0);
+	int64_t iPresentationTimeUs = pContext->iFrameIndex * 40000;
+	static const uint8_t startCode[4] = { 0, 0, 0, 1 };
+	for(size_t i=0; i<pContext->listTracks.size(); i++){
+		int64_t iStartNs = bench_now_ns();
+		pContext->listTracks[i]->addFrame(startCode, sizeof(startCode), pContext->frame.data(), pContext->frame.size(), iPresentationTimeUs, bSyncPoint);
+		int64_t iAppendNs = bench_now_ns() - iStartNs;
+		pContext->iAppendNs += iAppendNs;
+		pContext->iMaxAppendNs = std::max(pContext->iMaxAppendNs, iAppendNs);
+		pContext->iAppends++;
+	}
+	pContext->iFrameIndex++;
+
+	int64_t iNowNs = bench_now_ns();
+	if(iNowNs >= pContext->iEndNs){
+		pContext->watchVariable = 1;
+		return;
+	}
+	pContext->iNextRoundNs += pContext->iPeriodNs;
+	int64_t iDelayUs = (pContext->iNextRoundNs > iNowNs ? (pContext->iNextRoundNs - iNowNs) / 1000 : 0);
+	pContext->pScheduler->scheduleDelayedTask(iDelayUs, (TaskFunc*)recordBenchRoundHandler, pContext);
+}
+
+static bool runRecordBench(const char* szDirectory, bool bUring, int iStreamCount, int iFrameSize, int iFps, int iGop, int iSegmentDuration,
+		int iDurationSec, RecordBenchResult& result)
+{
+	BasicTaskScheduler* pScheduler = BasicTaskScheduler::createNew();
+	RecordingWriter* pWriter = RecordingWriter::createNew(*pScheduler, bUring);
+	if(!pWriter){
+		delete pScheduler;
+		return false;
+	}
+
+	RecordBenchContext context;
+	context.frame.resize(iFrameSize, 0x5A);
+	context.frame[0] = 0x65; // H264 IDR, the content doesn't matter
+	context.iGop = (iGop > 0 ? iGop : 1);
+	context.iPeriodNs = (iFps > 0 ? 1000000000 / iFps : 0);
+	context.iFrameIndex = 0;
+	context.iAppendNs = 0;
+	context.iMaxAppendNs = 0;
+	context.iAppends = 0;
+	context.pScheduler = pScheduler;
+	context.watchVariable = 0;
+
+	bool bResult = true;
+	for(int i=0; i<iStreamCount && bResult; i++){
+		char szStreamDirectory[1024];
+		snprintf(szStreamDirectory, sizeof(szStreamDirectory), "%s/%s-%d/stream%d", szDirectory, (bUring ? "uring" : "thread"), iStreamCount, i+1);
+		if(!recording_make_directories(szStreamDirectory)){
+			fprintf(stderr, "Cannot create %s: %s\n", szStreamDirectory, strerror(errno));
+			bResult = false;
+			break;
+		}
+		context.listTracks.push_back(new RecordingTrack(pWriter, szStreamDirectory, "0-video-H264", "h264", iSegmentDuration));
+	}
+
+	int64_t iStartNs = bench_now_ns();
+	if(bResult){
+		context.iEndNs = iStartNs + (int64_t)iDurationSec * 1000000000;
+		context.iNextRoundNs = iStartNs;
+		pScheduler->scheduleDelayedTask(0, (TaskFunc*)recordBenchRoundHandler, &context);
+		pScheduler->doEventLoop(&context.watchVariable);
+	}
+
+	for(size_t i=0; i<context.listTracks.size(); i++){
+		delete context.listTracks[i];
+	}
+	// Before drain(), which releases io_uring
+	pWriter->getStats(result.stats);
+	result.bUring = result.stats.bUring;
+	pWriter->drain();
+	pWriter->getStats(result.stats);
+	result.dDurationSec = (double)(bench_now_ns() - iStartNs) / 1000000000.0;
+	result.iAppends = context.iAppends;
+	result.iAppendNs = context.iAppendNs;
+	result.iMaxAppendNs = context.iMaxAppendNs;
+
+	delete pWriter;
+	delete pScheduler;
+	return bResult;
+}
+
+static int benchRecord(int argc, char* argv[])
+{
+	const char* szDirectory = "bench-record";
+	std::vector<int> listStreamCounts = bench_parse_int_list("1,10,50,100");
+	int iFrameSize = 20000; // 4 Mbps at 25 fps
+	int iFps = 25;
+	int iGop = 50;
+	int iSegmentDuration = 10;
+	int iDurationSec = 10;
+	bool bKeepFiles = false;
+
+	for(int i=0; i<argc; i++){
+		if(strcmp(argv[i], "--dir") == 0 && i+1<argc){
+			szDirectory = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--streams") == 0 && i+1<argc){
+			listStreamCounts = bench_parse_int_list(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--frame-size") == 0 && i+1<argc){
+			iFrameSize = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--fps") == 0 && i+1<argc){
+			iFps = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--gop") == 0 && i+1<argc){
+			iGop = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--segment") == 0 && i+1<argc){
+			iSegmentDuration = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--duration") == 0 && i+1<argc){
+			iDurationSec = atoi(argv[i+1]);
+			i++;
+		}else if(strcmp(argv[i], "--keep") == 0){
+			bKeepFiles = true;
+		}
+	}
+	if(iFrameSize < 1){
+		iFrameSize = 1;
+	}
+
+	bench_raise_fd_limit();
+
+	if(iFps > 0){
+		printf("Offered per stream: %.2f MB/s\n", (double)(iFrameSize + 4) * iFps / (1024*1024));
+	}
+	printf("%-8s %8s %10s %10s %12s %12s %10s\n", "writer", "streams", "MB/s", "frames/s", "ns/append", "max us", "dropped");
+	for(size_t i=0; i<listStreamCounts.size(); i++){
+		int iStreamCount = listStreamCounts[i];
+
+		for(int iType=0; iType<2; iType++){
+			bool bUring = (iType == 0);
+			RecordBenchResult result;
+			if(!runRecordBench(szDirectory, bUring, iStreamCount, iFrameSize, iFps, iGop, iSegmentDuration, iDurationSec, result)){
+				return 1;
+			}
+			// Without io_uring in the kernel, the writer falls back to the thread
+			const char* szName = (result.bUring ? "io_uring" : "thread");
+			if(bUring && !result.bUring){
+				szName = "n/a";
+			}
+			printf("%-8s %8d %10.1f %10.0f %12.0f %12.1f %10llu\n", szName, iStreamCount,
+					(double)result.stats.iBytesWritten / result.dDurationSec / (1024*1024),
+					(double)result.iAppends / result.dDurationSec,
+					(result.iAppends > 0 ? (double)result.iAppendNs / result.iAppends : 0.0),
+					(double)result.iMaxAppendNs / 1000.0,
+					(unsigned long long)result.stats.iDroppedFrames);
+			fflush(stdout);
+
+			if(!bKeepFiles){
+				char szCommand[1200];
+				snprintf(szCommand, sizeof(szCommand), "rm -rf '%s/%s-%d'", szDirectory, (bUring ? "uring" : "thread"), iStreamCount);
+				if(system(szCommand) != 0){
+					fprintf(stderr, "Cannot remove the files of the benchmark\n");
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/////////////////////////////////
+// Main
+/////////////////////////////////
+
+static void usage()
+{
+	fprintf(stderr, "Usage: TestLiveMediaBench <benchmark> [options]\n");
+	fprintf(stderr, "  scheduler [--sockets 100,1000,5000] [--active 16] [--rounds 2000]\n");
+	fprintf(stderr, "      Loop overhead of the select and epoll schedulers\n");
+	fprintf(stderr, "  loopback [--streams 10,50,100] [--codec h264|h265|h264+aac|h265+aac] [--bitrate 2000] [--fps 25] [--gop 50]\n");
+	fprintf(stderr, "           [--duration 20] [--tcp] [--threads 1] [--scheduler epoll] [--client ./TestLiveMedia] [--client-log FILE]\n");
+	fprintf(stderr, "           [--port 8554] [--metrics-port 9464] [--max-drop 0.5] [--recvmmsg] [--tcp-batch]\n");
+	fprintf(stderr, "      Streams served by a local RTSP server to TestLiveMedia, CPU, time to first frame and drops\n");
+	fprintf(stderr, "  recvmmsg [--streams 10,50,100] [--codec h264|h265] [--bitrate 16000] [--duration 20] [--client ./TestLiveMedia]\n");
+	fprintf(stderr, "           [--client-log FILE] [--port 8554] [--metrics-port 9464]\n");
+	fprintf(stderr, "      RTP packets per second per core, read one by one then with recvmmsg()\n");
+	fprintf(stderr, "  transport [--streams 10,50,100] [--codec h264|h265] [--bitrate 8000] [--duration 20] [--client ./TestLiveMedia]\n");
+	fprintf(stderr, "            [--client-log FILE] [--port 8554] [--metrics-port 9464]\n");
+	fprintf(stderr, "      Mbps per core with RTP over UDP, over TCP, and over TCP read by chunks\n");
+	fprintf(stderr, "  restream [--clients 1,10,100] [--codec h264|h265] [--bitrate 4000] [--fps 25] [--gop 50] [--duration 20]\n");
+	fprintf(stderr, "           [--client ./TestLiveMedia] [--client-log FILE] [--port 8554] [--restream-port 8564] [--metrics-port 9464]\n");
+	fprintf(stderr, "           [--max-drop 0.5]\n");
+	fprintf(stderr, "      One stream restreamed by TestLiveMedia to many clients, egress and CPU of the restreamer\n");
+	fprintf(stderr, "  record [--dir bench-record] [--streams 1,10,50,100] [--frame-size 20000] [--fps 25] [--gop 50] [--segment 10]\n");
+	fprintf(stderr, "         [--duration 10] [--keep]\n");
+	fprintf(stderr, "      Recording throughput and time of the appends in the event loop, with io_uring and the writer thread\n");
+}
+
+int main (int argc, char *argv[])
+{
+	if(argc < 2){
+		usage();
+		return 1;
+	}
+
+	if(strcmp(argv[1], "scheduler") == 0){
+		return benchScheduler(argc-2, argv+2);
+	}
+	if(strcmp(argv[1], "loopback") == 0){
+		return benchLoopback(argc-2, argv+2);
+	}
+	if(strcmp(argv[1], "recvmmsg") == 0){
+		return benchRecvmmsg(argc-2, argv+2);
+	}
+	if(strcmp(argv[1], "transport") == 0){
+		return benchTransport(argc-2, argv+2);
+	}
+	if(strcmp(argv[1], "restream") == 0){
+		return benchRestream(argc-2, argv+2);
+	}
+	if(strcmp(argv[1], "record") == 0){
+		return benchRecord(argc-2, argv+2);
+	}
+
+	usage();
+	return 1;
+}
@@ -0,0 +1,633 @@
+/*
+ * TestLiveMediaMicroBench.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+// The functions measured are those of the program itself, not copies
+#define TEST_LIVE_MEDIA_NO_MAIN
+#include "TestLiveMedia.cpp"
+
+#include <string>
+#include <vector>
+
+#define MICRO_BENCH_MIN_TIME 0.5 // Seconds per benchmark
+#define MICRO_BENCH_MAX_ITERATIONS 1000000000
+#define MICRO_BENCH_FRAME_SIZE 20000
+#define MICRO_BENCH_FRAME_PERIOD_US 40000
+#define MICRO_BENCH_NAL_FRAME_SIZE (512*1024) // A key frame of a 4K stream
+#define MICRO_BENCH_NAL_SLICES 8
+#define MICRO_BENCH_GOP_LENGTH 50
+#define MICRO_BENCH_RECEIVE_BUFFER_SIZE (512*1024)
+
+/////////////////////////////////
+// Utility function definition
+/////////////////////////////////
+
+static int64_t micro_bench_clock_ns(clockid_t clockId)
+{
+	struct timespec ts;
+	clock_gettime(clockId, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Keeps the compiler from removing the computations measured
+static volatile int64_t g_iMicroBenchSink = 0;
+
+/////////////////////////////////
+// Fake source
+/////////////////////////////////
+
+// Completes the pending request of the sink on demand, so that a frame is
+// received for each call of deliverFrame() instead of recursing into the
+// next request. The content of the buffer is left as is, the sink never
+// reads it.
+class MicroBenchFrameSource : public FramedSource
+{
+public:
+	static MicroBenchFrameSource* createNew(UsageEnvironment& env, unsigned iFrameSize);
+
+	void deliverFrame();
+
+protected:
+	MicroBenchFrameSource(UsageEnvironment& env, unsigned iFrameSize);
+
+	virtual void doGetNextFrame();
+
+private:
+	unsigned m_iFrameSize;
+	struct timeval m_tvPresentationTime;
+};
+
+MicroBenchFrameSource* MicroBenchFrameSource::createNew(UsageEnvironment& env, unsigned iFrameSize)
+{
+	return new MicroBenchFrameSource(env, iFrameSize);
+}
+
+MicroBenchFrameSource::MicroBenchFrameSource(UsageEnvironment& env, unsigned iFrameSize)
+	: FramedSource(env)
+{
+	m_iFrameSize = iFrameSize;
+	gettimeofday(&m_tvPresentationTime, NULL);
+}
+
+void MicroBenchFrameSource::doGetNextFrame()
+{
+	// Kept pending until deliverFrame()
+}
+
+void MicroBenchFrameSource::deliverFrame()
+{
+	if(!isCurrentlyAwaitingData()){
+		return;
+	}
+	fFrameSize = (m_iFrameSize < fMaxSize ? m_iFrameSize : fMaxSize);
+	fNumTruncatedBytes = m_iFrameSize - fFrameSize;
+	m_tvPresentationTime.tv_usec += MICRO_BENCH_FRAME_PERIOD_US;
+	if(m_tvPresentationTime.tv_usec >= 1000000){
+		m_tvPresentationTime.tv_sec++;
+		m_tvPresentationTime.tv_usec -= 1000000;
+	}
+	fPresentationTime = m_tvPresentationTime;
+	fDurationInMicroseconds = MICRO_BENCH_FRAME_PERIOD_US;
+	FramedSource::afterGetting(this);
+}
+
+/////////////////////////////////
+// Benchmarks
+/////////////////////////////////
+
+typedef void (MicroBenchFunc)(void* clientData, uint64_t iIterations);
+
+struct MicroBench
+{
+	const char* szName;
+	MicroBenchFunc* func;
+	void* clientData;
+};
+
+struct MicroBenchResult
+{
+	std::string szName;
+	uint64_t iIterations;
+	double dRealTimeNs; // Per iteration
+	double dCpuTimeNs; // Of the calling thread only, the log writer is not included
+};
+
+// A sink receiving the frames of a fake H264 source, as in a real stream
+struct SinkBench
+{
+	LiveMediaModuleContext* pModuleContext;
+	LiveMediaStreamContext* pStreamContext;
+	MediaSession* pMediaSession;
+	DummySink* pSink;
+	MicroBenchFrameSource* pSource;
+};
+
+static void sinkAfterPlaying(void* /*clientData*/)
+{
+}
+
+static bool createSinkBench(SinkBench& bench, int iVerbosityLevel)
+{
+	memset(&bench, 0, sizeof(bench));
+	bench.pModuleContext = new LiveMediaModuleContext(iVerbosityLevel, SCHEDULER_SELECT);
+	bench.pStreamContext = new LiveMediaStreamContext(bench.pModuleContext, 1, "rtsp://127.0.0.1/bench", NULL, NULL);
+
+	const char* szSDP =
+			"v=0\r\n"
+			"o=- 0 0 IN IP4 127.0.0.1\r\n"
+			"s=Micro benchmark\r\n"
+			"t=0 0\r\n"
+			"m=video 0 RTP/AVP 96\r\n"
+			"b=AS:4000\r\n"
+			"a=rtpmap:96 H264/90000\r\n";
+	bench.pMediaSession = MediaSession::createNew(*bench.pModuleContext->m_env, szSDP);
+	if(!bench.pMediaSession){
+		fprintf(stderr, "Cannot create the media session: %s\n", bench.pModuleContext->m_env->getResultMsg());
+		return false;
+	}
+	MediaSubsessionIterator iter(*bench.pMediaSession);
+	MediaSubsession* pSubsession = iter.next();
+
+	bench.pSink = DummySink::createNew(bench.pStreamContext, *pSubsession, 0);
+	bench.pSource = MicroBenchFrameSource::createNew(*bench.pModuleContext->m_env, MICRO_BENCH_FRAME_SIZE);
+	bench.pSink->startPlaying(*bench.pSource, sinkAfterPlaying, NULL);
+	return true;
+}
+
+static void destroySinkBench(SinkBench& bench)
+{
+	if(bench.pSink){
+		Medium::close(bench.pSink);
+		bench.pSink = NULL;
+	}
+	if(bench.pSource){
+		Medium::close(bench.pSource);
+		bench.pSource = NULL;
+	}
+	if(bench.pMediaSession){
+		Medium::close(bench.pMediaSession);
+		bench.pMediaSession = NULL;
+	}
+	if(bench.pStreamContext){
+		delete bench.pStreamContext;
+		bench.pStreamContext = NULL;
+	}
+	if(bench.pModuleContext){
+		delete bench.pModuleContext;
+		bench.pModuleContext = NULL;
+	}
+}
+
+static void benchAfterGettingFrame(void* clientData, uint64_t iIterations)
+{
+	SinkBench* pBench = (SinkBench*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		pBench->pSource->deliverFrame();
+	}
+}
+
+static void benchEnvString(void* clientData, uint64_t iIterations)
+{
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << "Received ";
+		if((i & 7) == 7){
+			env << "\n";
+		}
+	}
+	env << "\n";
+}
+
+static void benchEnvInt(void* clientData, uint64_t iIterations)
+{
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << (int)i;
+		if((i & 7) == 7){
+			env << "\n";
+		}
+	}
+	env << "\n";
+}
+
+static void benchEnvUnsigned(void* clientData, uint64_t iIterations)
+{
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << (unsigned)i;
+		if((i & 7) == 7){
+			env << "\n";
+		}
+	}
+	env << "\n";
+}
+
+static void benchEnvDouble(void* clientData, uint64_t iIterations)
+{
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << (double)i * 0.04;
+		if((i & 7) == 7){
+			env << "\n";
+		}
+	}
+	env << "\n";
+}
+
+static void benchEnvPointer(void* clientData, uint64_t iIterations)
+{
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << (void*)&env;
+		if((i & 7) == 7){
+			env << "\n";
+		}
+	}
+	env << "\n";
+}
+
+static void benchEnvLine(void* clientData, uint64_t iIterations)
+{
+	// As written by live555 for each RTSP response line, and by the sink with -vvv
+	UsageEnvironment& env = *(UsageEnvironment*)clientData;
+	for(uint64_t i=0; i<iIterations; i++){
+		env << "video" << "/" << "H264" << ":" << "\tReceived " << (unsigned)MICRO_BENCH_FRAME_SIZE << " bytes" << " (+" << 40 << " ms)" << "\n";
+	}
+}
+
+static void benchLog(void* /*clientData*/, uint64_t iIterations)
+{
+	for(uint64_t i=0; i<iIterations; i++){
+		p_log("[Access::livemedia] Stream state %s -> %s (%d)", "setup", "play", (int)i);
+	}
+}
+
+static void benchTimerText(void* /*clientData*/, uint64_t iIterations)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	char szTime[64];
+	for(uint64_t i=0; i<iIterations; i++){
+		tv.tv_usec = (long)(i % 1000000);
+		timer_text("%Y-%m-%d %H:%M:%S", &tv, szTime, sizeof(szTime));
+		g_iMicroBenchSink += szTime[0];
+	}
+}
+
+static void benchStrconcat(void* /*clientData*/, uint64_t iIterations)
+{
+	for(uint64_t i=0; i<iIterations; i++){
+		char* szResult = p_strconcat("rtsp://", "192.168.5.60", "/onvif/profile2/media.smp", NULL);
+		g_iMicroBenchSink += szResult[0];
+		free(szResult);
+	}
+}
+
+static void benchTimevalDiffms(void* /*clientData*/, uint64_t iIterations)
+{
+	struct timeval tv1;
+	struct timeval tv2;
+	gettimeofday(&tv1, NULL);
+	tv2 = tv1;
+	int64_t iTotal = 0;
+	for(uint64_t i=0; i<iIterations; i++){
+		tv1.tv_usec = (long)(i % 1000000);
+		iTotal += p_timeval_diffms(tv1, tv2);
+	}
+	g_iMicroBenchSink += iTotal;
+}
+
+#define MICRO_BENCH_TIMERS 1000 // Armed timers, about the check alive timers of a loaded shard
+
+static void microBenchTimerHandler(void* /*clientData*/)
+{
+}
+
+static void benchTimerWheelRearm(void* clientData, uint64_t iIterations)
+{
+	TimerWheel wheel(*(TaskScheduler*)clientData);
+	std::vector<WheelTimer> listTimers(MICRO_BENCH_TIMERS);
+	for(size_t i=0; i<listTimers.size(); i++){
+		TimerWheel::initTimer(&listTimers[i], microBenchTimerHandler, NULL);
+		wheel.arm(&listTimers[i], TIMEOUT_CHECKALIVE + i * 1000);
+	}
+	for(uint64_t i=0; i<iIterations; i++){
+		wheel.arm(&listTimers[i % listTimers.size()], TIMEOUT_CHECKALIVE);
+	}
+	for(size_t i=0; i<listTimers.size(); i++){
+		wheel.cancel(&listTimers[i]);
+	}
+}
+
+static void benchDelayQueueReschedule(void* clientData, uint64_t iIterations)
+{
+	TaskScheduler* pScheduler = (TaskScheduler*)clientData;
+	std::vector<TaskToken> listTasks(MICRO_BENCH_TIMERS);
+	for(size_t i=0; i<listTasks.size(); i++){
+		listTasks[i] = pScheduler->scheduleDelayedTask(TIMEOUT_CHECKALIVE + i * 1000, microBenchTimerHandler, NULL);
+	}
+	for(uint64_t i=0; i<iIterations; i++){
+		pScheduler->rescheduleDelayedTask(listTasks[i % listTasks.size()], TIMEOUT_CHECKALIVE, microBenchTimerHandler, NULL);
+	}
+	for(size_t i=0; i<listTasks.size(); i++){
+		pScheduler->unscheduleDelayedTask(listTasks[i]);
+	}
+}
+
+static void benchLoopClockNow(void* /*clientData*/, uint64_t iIterations)
+{
+	// As the sinks of one iteration of the event loop
+	int64_t iTotal = 0;
+	LoopClock::beginIteration();
+	for(uint64_t i=0; i<iIterations; i++){
+		iTotal += LoopClock::nowUs();
+	}
+	LoopClock::endIteration();
+	g_iMicroBenchSink += iTotal;
+}
+
+static void benchClockGettime(void* /*clientData*/, uint64_t iIterations)
+{
+	int64_t iTotal = 0;
+	for(uint64_t i=0; i<iIterations; i++){
+		iTotal += LoopClock::readNowUs();
+	}
+	g_iMicroBenchSink += iTotal;
+}
+
+// Annex B frame with random slices, without start code nor emulation
+// prevention sequence inside, so the scan goes through the whole frame
+static void createNalBenchFrame(std::vector<uint8_t>& frame)
+{
+	static const uint8_t header[] = { 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x33, 0xAC, 0, 0, 0, 1, 0x68, 0xEE, 0x3C, 0x80 };
+	frame.assign(header, header + sizeof(header));
+	unsigned int iSeed = 1;
+	size_t iSliceSize = MICRO_BENCH_NAL_FRAME_SIZE / MICRO_BENCH_NAL_SLICES;
+	for(int i=0; i<MICRO_BENCH_NAL_SLICES; i++){
+		static const uint8_t startCode[] = { 0, 0, 0, 1, 0x65 };
+		frame.insert(frame.end(), startCode, startCode + sizeof(startCode));
+		frame.push_back(i == 0 ? 0x88 : 0x40);
+		for(size_t j=0; j<iSliceSize; j++){
+			uint8_t iByte = (uint8_t)rand_r(&iSeed);
+			if(iByte <= 3 && frame.size() >= 2 && frame[frame.size()-1] == 0 && frame[frame.size()-2] == 0){
+				iByte = 4;
+			}
+			frame.push_back(iByte);
+		}
+	}
+}
+
+static void benchNalFindStartCode(void* clientData, uint64_t iIterations)
+{
+	const std::vector<uint8_t>& frame = *(const std::vector<uint8_t>*)clientData;
+	const uint8_t* pEnd = frame.data() + frame.size();
+	for(uint64_t i=0; i<iIterations; i++){
+		int iCount = 0;
+		for(const uint8_t* p = nal_find_start_code(frame.data(), pEnd); p < pEnd; p = nal_find_start_code(p + 3, pEnd)){
+			iCount++;
+		}
+		g_iMicroBenchSink += iCount;
+	}
+}
+
+static void benchNalFindStartCodeScalar(void* clientData, uint64_t iIterations)
+{
+	const std::vector<uint8_t>& frame = *(const std::vector<uint8_t>*)clientData;
+	const uint8_t* pEnd = frame.data() + frame.size();
+	for(uint64_t i=0; i<iIterations; i++){
+		int iCount = 0;
+		for(const uint8_t* p = nal_find_start_code_scalar(frame.data(), pEnd); p < pEnd; p = nal_find_start_code_scalar(p + 3, pEnd)){
+			iCount++;
+		}
+		g_iMicroBenchSink += iCount;
+	}
+}
+
+static void benchNalParseFrame(void* clientData, uint64_t iIterations)
+{
+	const std::vector<uint8_t>& frame = *(const std::vector<uint8_t>*)clientData;
+	NalParser parser(NAL_CODEC_H264);
+	NalFrameInfo info;
+	for(uint64_t i=0; i<iIterations; i++){
+		parser.parseFrame(frame.data(), frame.size(), (int64_t)i * MICRO_BENCH_FRAME_PERIOD_US, info);
+		g_iMicroBenchSink += info.iUnitCount;
+	}
+}
+
+// A frame received in a buffer sized for the key frames, one key frame per GOP
+static void addGopCacheBenchFrame(GopCacheEntry* pEntry, uint64_t iFrame)
+{
+	FrameBuffer* pBuffer = FramePool::getInstance()->acquire(MICRO_BENCH_RECEIVE_BUFFER_SIZE);
+	pBuffer->setSize(MICRO_BENCH_FRAME_SIZE);
+	struct timeval tvPresentationTime;
+	tvPresentationTime.tv_sec = (time_t)(iFrame * MICRO_BENCH_FRAME_PERIOD_US / 1000000);
+	tvPresentationTime.tv_usec = (suseconds_t)(iFrame * MICRO_BENCH_FRAME_PERIOD_US % 1000000);
+	NalFrameInfo info;
+	info.iFlags = NAL_FRAME_SLICE | NAL_FRAME_NEW_PICTURE;
+	info.iUnitCount = 0;
+	if(iFrame % MICRO_BENCH_GOP_LENGTH == 0){
+		info.iFlags |= NAL_FRAME_KEY_FRAME;
+	}
+	pEntry->addFrame(pBuffer, tvPresentationTime, info);
+	pBuffer->unref();
+}
+
+static void benchGopCacheAddFrame(void* /*clientData*/, uint64_t iIterations)
+{
+	GopCacheEntry* pEntry = GopCache::getInstance()->createEntry(0, 0);
+	for(uint64_t i=0; i<iIterations; i++){
+		addGopCacheBenchFrame(pEntry, i);
+	}
+	GopCache::getInstance()->releaseEntry(pEntry);
+}
+
+static void countGopCacheBenchFrame(void* /*clientData*/, const GopCacheFrame& frame)
+{
+	g_iMicroBenchSink += frame.pBuffer->size();
+}
+
+static void benchGopCacheAttach(void* /*clientData*/, uint64_t iIterations)
+{
+	GopCacheEntry* pEntry = GopCache::getInstance()->createEntry(0, 0);
+	for(uint64_t i=0; i<MICRO_BENCH_GOP_LENGTH; i++){
+		addGopCacheBenchFrame(pEntry, i);
+	}
+	for(uint64_t i=0; i<iIterations; i++){
+		pEntry->attach(countGopCacheBenchFrame, NULL);
+		pEntry->detach(countGopCacheBenchFrame, NULL);
+	}
+	GopCache::getInstance()->releaseEntry(pEntry);
+}
+
+static MicroBenchResult runMicroBench(const MicroBench& bench, double dMinTimeSec)
+{
+	// Like Google Benchmark: the iterations grow until the run lasts long enough
+	MicroBenchResult result;
+	result.szName = bench.szName;
+	uint64_t iIterations = 1;
+	while(true){
+		int64_t iRealStart = micro_bench_clock_ns(CLOCK_MONOTONIC);
+		int64_t iCpuStart = micro_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+		bench.func(bench.clientData, iIterations);
+		int64_t iRealNs = micro_bench_clock_ns(CLOCK_MONOTONIC) - iRealStart;
+		int64_t iCpuNs = micro_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID) - iCpuStart;
+
+		double dElapsedSec = (double)iRealNs / 1000000000.0;
+		if(dElapsedSec >= dMinTimeSec || iIterations >= MICRO_BENCH_MAX_ITERATIONS){
+			result.iIterations = iIterations;
+			result.dRealTimeNs = (double)iRealNs / iIterations;
+			result.dCpuTimeNs = (double)iCpuNs / iIterations;
+			return result;
+		}
+
+		double dMultiplier = 10;
+		if(dElapsedSec > 0.01 * dMinTimeSec){
+			dMultiplier = std::min(10.0, dMinTimeSec * 1.4 / dElapsedSec);
+		}
+		iIterations = std::max(iIterations + 1, (uint64_t)(iIterations * dMultiplier));
+		iIterations = std::min(iIterations, (uint64_t)MICRO_BENCH_MAX_ITERATIONS);
+	}
+}
+
+static bool writeJSON(const char* szPath, const char* szExecutable, const std::vector<MicroBenchResult>& listResults)
+{
+	// Same layout as Google Benchmark, so its tools can compare two runs
+	FILE* pFile = fopen(szPath, "w");
+	if(!pFile){
+		fprintf(stderr, "Cannot write %s: %s\n", szPath, strerror(errno));
+		return false;
+	}
+
+	char szDate[64];
+	time_t iNow = time(NULL);
+	struct tm tmNow;
+	localtime_r(&iNow, &tmNow);
+	strftime(szDate, sizeof(szDate), "%Y-%m-%dT%H:%M:%S%z", &tmNow);
+	char szHostName[256];
+	if(gethostname(szHostName, sizeof(szHostName)) != 0){
+		strcpy(szHostName, "unknown");
+	}
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"context\": {\n");
+	fprintf(pFile, "    \"date\": \"%s\",\n", szDate);
+	fprintf(pFile, "    \"host_name\": \"%s\",\n", szHostName);
+	fprintf(pFile, "    \"executable\": \"%s\",\n", szExecutable);
+	fprintf(pFile, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(pFile, "    \"live555_version\": \"%s\"\n", LIVEMEDIA_LIBRARY_VERSION_STRING);
+	fprintf(pFile, "  },\n");
+	fprintf(pFile, "  \"benchmarks\": [\n");
+	for(size_t i=0; i<listResults.size(); i++){
+		const MicroBenchResult& result = listResults[i];
+		fprintf(pFile, "    {\n");
+		fprintf(pFile, "      \"name\": \"%s\",\n", result.szName.c_str());
+		fprintf(pFile, "      \"run_name\": \"%s\",\n", result.szName.c_str());
+		fprintf(pFile, "      \"run_type\": \"iteration\",\n");
+		fprintf(pFile, "      \"iterations\": %llu,\n", (unsigned long long)result.iIterations);
+		fprintf(pFile, "      \"real_time\": %.3f,\n", result.dRealTimeNs);
+		fprintf(pFile, "      \"cpu_time\": %.3f,\n", result.dCpuTimeNs);
+		fprintf(pFile, "      \"time_unit\": \"ns\"\n");
+		fprintf(pFile, "    }%s\n", (i+1 < listResults.size() ? "," : ""));
+	}
+	fprintf(pFile, "  ]\n");
+	fprintf(pFile, "}\n");
+	fclose(pFile);
+	return true;
+}
+
+/////////////////////////////////
+// Main
+/////////////////////////////////
+
+int main (int argc, char *argv[])
+{
+	const char* szJSONPath = NULL;
+	const char* szFilter = NULL;
+	double dMinTimeSec = MICRO_BENCH_MIN_TIME;
+
+	for(int i=1; i<argc; i++){
+		if(strcmp(argv[i], "--json") == 0 && i+1<argc){
+			szJSONPath = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--filter") == 0 && i+1<argc){
+			szFilter = argv[i+1];
+			i++;
+		}else if(strcmp(argv[i], "--min-time") == 0 && i+1<argc){
+			dMinTimeSec = atof(argv[i+1]);
+			i++;
+		}else{
+			fprintf(stderr, "Usage: TestLiveMediaMicroBench [--json FILE] [--filter SUBSTRING] [--min-time %.1f]\n", MICRO_BENCH_MIN_TIME);
+			return 1;
+		}
+	}
+
+	// The logs are formatted as usual, then thrown away by the writer thread
+	FILE* pNull = fopen("/dev/null", "w");
+	AsyncLogger::getInstance()->setOutput(pNull);
+	AsyncLogger::getInstance()->start();
+
+	SinkBench sinkBench0;
+	SinkBench sinkBench3;
+	if(!createSinkBench(sinkBench0, 0) || !createSinkBench(sinkBench3, 3)){
+		return 1;
+	}
+	// Only the verbose environment is the custom one
+	UsageEnvironment* pEnv = sinkBench3.pModuleContext->m_env;
+
+	std::vector<uint8_t> nalFrame;
+	createNalBenchFrame(nalFrame);
+	// After the creation of the sinks, which don't use it
+	GopCache::getInstance()->setBudget((size_t)64 * 1024 * 1024);
+	std::string szNalFindName = std::string("BM_nal_find_start_code/") + nal_get_simd_name();
+
+	MicroBench listBenches[] = {
+		{ "BM_DummySink_afterGettingFrame/verbosity:0", benchAfterGettingFrame, &sinkBench0 },
+		{ "BM_DummySink_afterGettingFrame/verbosity:3", benchAfterGettingFrame, &sinkBench3 },
+		{ "BM_CustomEnv_operator<<(char const*)", benchEnvString, pEnv },
+		{ "BM_CustomEnv_operator<<(int)", benchEnvInt, pEnv },
+		{ "BM_CustomEnv_operator<<(unsigned)", benchEnvUnsigned, pEnv },
+		{ "BM_CustomEnv_operator<<(double)", benchEnvDouble, pEnv },
+		{ "BM_CustomEnv_operator<<(void*)", benchEnvPointer, pEnv },
+		{ "BM_CustomEnv_line", benchEnvLine, pEnv },
+		{ "BM_p_log", benchLog, NULL },
+		{ "BM_timer_text", benchTimerText, NULL },
+		{ "BM_p_strconcat", benchStrconcat, NULL },
+		{ "BM_p_timeval_diffms", benchTimevalDiffms, NULL },
+		{ "BM_TimerWheel_arm/1000", benchTimerWheelRearm, sinkBench0.pModuleContext->m_scheduler },
+		{ "BM_DelayQueue_reschedule/1000", benchDelayQueueReschedule, sinkBench0.pModuleContext->m_scheduler },
+		{ "BM_LoopClock_nowUs/cached", benchLoopClockNow, NULL },
+		{ "BM_clock_gettime/monotonic", benchClockGettime, NULL },
+		{ szNalFindName.c_str(), benchNalFindStartCode, &nalFrame },
+		{ "BM_nal_find_start_code/scalar", benchNalFindStartCodeScalar, &nalFrame },
+		{ "BM_NalParser_parseFrame/512KB", benchNalParseFrame, &nalFrame },
+		{ "BM_GopCacheEntry_addFrame", benchGopCacheAddFrame, NULL },
+		{ "BM_GopCacheEntry_attach/50", benchGopCacheAttach, NULL },
+	};
+
+	std::vector<MicroBenchResult> listResults;
+	printf("%-48s %14s %14s %14s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations");
+	for(size_t i=0; i<sizeof(listBenches)/sizeof(listBenches[0]); i++){
+		if(szFilter && !strstr(listBenches[i].szName, szFilter)){
+			continue;
+		}
+		MicroBenchResult result = runMicroBench(listBenches[i], dMinTimeSec);
+		printf("%-48s %14.1f %14.1f %14llu\n", result.szName.c_str(), result.dRealTimeNs, result.dCpuTimeNs,
+				(unsigned long long)result.iIterations);
+		listResults.push_back(result);
+	}
+
+	destroySinkBench(sinkBench0);
+	destroySinkBench(sinkBench3);
+	AsyncLogger::getInstance()->stop();
+	AsyncLogger::getInstance()->setOutput(stdout);
+	if(pNull){
+		fclose(pNull);
+	}
+
+	if(szJSONPath && !writeJSON(szJSONPath, argv[0], listResults)){
+		return 1;
+	}
+	return 0;
+}
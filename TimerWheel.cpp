@@ -0,0 +1,225 @@
+/*
+ * TimerWheel.cpp
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#include "LoopClock.h"
+#include "TimerWheel.h"
+
+//////////////////////////////////
+// TimerWheel definition
+//////////////////////////////////
+
+TimerWheel::TimerWheel(TaskScheduler& scheduler)
+	: m_scheduler(scheduler)
+{
+	m_tickTask = NULL;
+	m_iScheduledTick = 0;
+	m_iCurrentTick = LoopClock::nowUs() / TIMER_WHEEL_TICK;
+	m_iCount = 0;
+	for(int i=0; i<TIMER_WHEEL_LEVELS; i++){
+		for(int j=0; j<TIMER_WHEEL_SLOTS; j++){
+			listInit(&m_slots[i][j]);
+		}
+	}
+}
+
+TimerWheel::~TimerWheel()
+{
+	if(m_tickTask){
+		m_scheduler.unscheduleDelayedTask(m_tickTask);
+		m_tickTask = NULL;
+	}
+	// The timers still armed belong to their owners, they are only unlinked
+	for(int i=0; i<TIMER_WHEEL_LEVELS; i++){
+		for(int j=0; j<TIMER_WHEEL_SLOTS; j++){
+			WheelTimer* pHead = &m_slots[i][j];
+			while(pHead->pNext != pHead){
+				WheelTimer* pTimer = pHead->pNext;
+				listRemove(pTimer);
+			}
+		}
+	}
+	m_iCount = 0;
+}
+
+void TimerWheel::initTimer(WheelTimer* pTimer, TaskFunc* proc, void* clientData)
+{
+	pTimer->pNext = NULL;
+	pTimer->pPrev = NULL;
+	pTimer->iExpiryTick = 0;
+	pTimer->proc = proc;
+	pTimer->clientData = clientData;
+}
+
+void TimerWheel::listInit(WheelTimer* pHead)
+{
+	pHead->pNext = pHead;
+	pHead->pPrev = pHead;
+}
+
+void TimerWheel::listAppend(WheelTimer* pHead, WheelTimer* pTimer)
+{
+	pTimer->pPrev = pHead->pPrev;
+	pTimer->pNext = pHead;
+	pHead->pPrev->pNext = pTimer;
+	pHead->pPrev = pTimer;
+}
+
+void TimerWheel::listRemove(WheelTimer* pTimer)
+{
+	pTimer->pPrev->pNext = pTimer->pNext;
+	pTimer->pNext->pPrev = pTimer->pPrev;
+	pTimer->pNext = NULL;
+	pTimer->pPrev = NULL;
+}
+
+void TimerWheel::arm(WheelTimer* pTimer, int64_t iDelayUs)
+{
+	if(isArmed(pTimer)){
+		listRemove(pTimer);
+		m_iCount--;
+	}
+
+	int64_t iNowUs = LoopClock::nowUs();
+	if(m_iCount == 0){
+		// Empty, the ticks elapsed since the last timer need no processing
+		m_iCurrentTick = iNowUs / TIMER_WHEEL_TICK;
+	}
+	int64_t iExpiryTick = (iNowUs + (iDelayUs > 0 ? iDelayUs : 0) + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+	if(iExpiryTick <= m_iCurrentTick){
+		iExpiryTick = m_iCurrentTick + 1;
+	}
+	pTimer->iExpiryTick = iExpiryTick;
+	insert(pTimer);
+	m_iCount++;
+
+	// The delayed task is only moved for an expiry before the tick scheduled
+	if(m_tickTask && iExpiryTick < m_iScheduledTick){
+		m_scheduler.unscheduleDelayedTask(m_tickTask);
+		m_tickTask = NULL;
+	}
+	if(!m_tickTask){
+		scheduleTick();
+	}
+}
+
+void TimerWheel::cancel(WheelTimer* pTimer)
+{
+	if(!isArmed(pTimer)){
+		return;
+	}
+	listRemove(pTimer);
+	m_iCount--;
+	if(m_iCount == 0 && m_tickTask){
+		m_scheduler.unscheduleDelayedTask(m_tickTask);
+		m_tickTask = NULL;
+	}
+}
+
+void TimerWheel::insert(WheelTimer* pTimer)
+{
+	int64_t iDelta = pTimer->iExpiryTick - m_iCurrentTick;
+	int64_t iMaxDelta = ((int64_t)1 << (TIMER_WHEEL_LEVEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	if(iDelta > iMaxDelta){
+		pTimer->iExpiryTick = m_iCurrentTick + iMaxDelta;
+		iDelta = iMaxDelta;
+	}
+
+	// The first level whose slots cover the delay
+	int iLevel = 0;
+	while(iLevel < TIMER_WHEEL_LEVELS-1 && iDelta >= ((int64_t)1 << (TIMER_WHEEL_LEVEL_BITS * (iLevel+1)))){
+		iLevel++;
+	}
+	int iSlot = (int)((pTimer->iExpiryTick >> (TIMER_WHEEL_LEVEL_BITS * iLevel)) & (TIMER_WHEEL_SLOTS-1));
+	listAppend(&m_slots[iLevel][iSlot], pTimer);
+}
+
+void TimerWheel::cascade(int iLevel)
+{
+	// The timers of the slot expire within the next slots of the level below
+	int iSlot = (int)((m_iCurrentTick >> (TIMER_WHEEL_LEVEL_BITS * iLevel)) & (TIMER_WHEEL_SLOTS-1));
+	WheelTimer listTimers;
+	listInit(&listTimers);
+	WheelTimer* pHead = &m_slots[iLevel][iSlot];
+	while(pHead->pNext != pHead){
+		WheelTimer* pTimer = pHead->pNext;
+		listRemove(pTimer);
+		listAppend(&listTimers, pTimer);
+	}
+	while(listTimers.pNext != &listTimers){
+		WheelTimer* pTimer = listTimers.pNext;
+		listRemove(pTimer);
+		insert(pTimer);
+	}
+}
+
+void TimerWheel::advance()
+{
+	m_iCurrentTick++;
+	for(int iLevel=1; iLevel<TIMER_WHEEL_LEVELS; iLevel++){
+		if((m_iCurrentTick & (((int64_t)1 << (TIMER_WHEEL_LEVEL_BITS * iLevel)) - 1)) != 0){
+			break;
+		}
+		cascade(iLevel);
+	}
+
+	// Taken out of the slot first, as the handlers may arm or cancel other timers
+	WheelTimer listExpired;
+	listInit(&listExpired);
+	WheelTimer* pHead = &m_slots[0][m_iCurrentTick & (TIMER_WHEEL_SLOTS-1)];
+	while(pHead->pNext != pHead){
+		WheelTimer* pTimer = pHead->pNext;
+		listRemove(pTimer);
+		listAppend(&listExpired, pTimer);
+	}
+	while(listExpired.pNext != &listExpired){
+		WheelTimer* pTimer = listExpired.pNext;
+		listRemove(pTimer);
+		m_iCount--;
+		(*pTimer->proc)(pTimer->clientData);
+	}
+}
+
+void TimerWheel::tickHandler(void* clientData)
+{
+	TimerWheel* pWheel = (TimerWheel*)clientData;
+	pWheel->m_tickTask = NULL;
+	pWheel->tick();
+}
+
+void TimerWheel::tick()
+{
+	// Late ticks are caught up, the empty ones cost little
+	int64_t iTargetTick = LoopClock::nowUs() / TIMER_WHEEL_TICK;
+	while(m_iCurrentTick < iTargetTick && m_iCount > 0){
+		advance();
+	}
+	if(m_iCount == 0){
+		m_iCurrentTick = iTargetTick;
+	}
+	if(!m_tickTask){
+		scheduleTick();
+	}
+}
+
+void TimerWheel::scheduleTick()
+{
+	if(m_iCount == 0){
+		return;
+	}
+
+	// The next timer of the first level, or the next cascade
+	int64_t iNextTick = (m_iCurrentTick | (TIMER_WHEEL_SLOTS-1)) + 1;
+	for(int64_t iTick=m_iCurrentTick+1; iTick<iNextTick; iTick++){
+		const WheelTimer* pHead = &m_slots[0][iTick & (TIMER_WHEEL_SLOTS-1)];
+		if(pHead->pNext != pHead){
+			iNextTick = iTick;
+			break;
+		}
+	}
+	m_iScheduledTick = iNextTick;
+	int64_t iDelayUs = iNextTick * TIMER_WHEEL_TICK - LoopClock::nowUs();
+	m_tickTask = m_scheduler.scheduleDelayedTask(iDelayUs > 0 ? iDelayUs : 0, TimerWheel::tickHandler, this);
+}
@@ -0,0 +1,80 @@
+/*
+ * TimerWheel.h
+ *
+ *  Created on: 17 oct. 2026
+ */
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <UsageEnvironment.hh>
+
+#define TIMER_WHEEL_TICK 100000 // In microseconds, the precision of the timers
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS 4 // 64^4 ticks, about 19 days, longer delays are cut
+
+// Embedded in its owner, so arming allocates nothing
+struct WheelTimer
+{
+	WheelTimer* pNext; // In its slot, NULL if not armed
+	WheelTimer* pPrev;
+	int64_t iExpiryTick;
+	TaskFunc* proc;
+	void* clientData;
+};
+
+//////////////////////////////////
+// TimerWheel declaration
+//////////////////////////////////
+
+// Hierarchical timing wheel for the coarse timers of the streams (handshake,
+// liveness, duration), arming and cancelling in O(1) where the DelayQueue of
+// live555 inserts in a sorted list. A timer is placed in the level whose
+// slots cover its delay, and moved down a level each time the lower one
+// wraps, until it expires from the first level. The wheel is driven by one
+// delayed task of the scheduler, scheduled only while some timers are armed,
+// on the monotonic time of the LoopClock. Used by the event loop of the
+// scheduler only.
+class TimerWheel
+{
+public:
+	TimerWheel(TaskScheduler& scheduler);
+	~TimerWheel();
+
+	static void initTimer(WheelTimer* pTimer, TaskFunc* proc, void* clientData);
+	static bool isArmed(const WheelTimer* pTimer) { return pTimer->pNext != NULL; }
+
+	// Re-arms the timer if it is already armed. The delay is rounded up to the tick.
+	void arm(WheelTimer* pTimer, int64_t iDelayUs);
+	void cancel(WheelTimer* pTimer);
+
+	size_t getCount() const { return m_iCount; }
+
+private:
+	static void tickHandler(void* clientData);
+	void tick();
+	void advance();
+	void insert(WheelTimer* pTimer);
+	void cascade(int iLevel);
+	void scheduleTick();
+
+	static void listInit(WheelTimer* pHead);
+	static void listAppend(WheelTimer* pHead, WheelTimer* pTimer);
+	static void listRemove(WheelTimer* pTimer);
+
+private:
+	TaskScheduler& m_scheduler;
+	TaskToken m_tickTask;
+	int64_t m_iScheduledTick; // Of m_tickTask
+	int64_t m_iCurrentTick; // Last tick processed
+	size_t m_iCount;
+
+	// Heads of the circular lists of the slots
+	WheelTimer m_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+#endif /* TIMERWHEEL_H_ */